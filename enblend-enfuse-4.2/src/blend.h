@@ -25,12 +25,14 @@
 #include <config.h>
 #endif
 
+#include <functional>
 #include <vector>
 
 #include <vigra/combineimages.hxx>
 #include <vigra/numerictraits.hxx>
 
 #include "fixmath.h"
+#include "pyramid.h"
 
 
 namespace enblend {
@@ -120,6 +122,278 @@ blend(std::vector<MaskPyramidType*>* maskGP,
     }
 }
 
+
+/** Functor for adding a level of a layer's Laplacian pyramid,
+ *  weighted by the layer's mask pyramid level, to the accumulated
+ *  pyramid level of a simultaneous blend.
+ */
+template <typename MaskPixelType>
+class AccumulateBlendFunctor {
+public:
+    AccumulateBlendFunctor(MaskPixelType w) : white(vigra::NumericTraits<MaskPixelType>::toRealPromote(w)) {}
+
+    template <typename ImagePixelType>
+    ImagePixelType operator()(const MaskPixelType& maskP, const ImagePixelType& lP, const ImagePixelType& aP) const {
+        typedef typename vigra::NumericTraits<ImagePixelType>::RealPromote RealImagePixelType;
+
+        const double coeff = vigra::NumericTraits<MaskPixelType>::toRealPromote(maskP) / white;
+        // Ignore pixels outside of the layer's mask; see
+        // CartesianBlendFunctor for possible NaN's in masked data.
+        if (coeff <= 0.0) {
+            return aP;
+        }
+
+        RealImagePixelType raP = vigra::NumericTraits<ImagePixelType>::toRealPromote(aP);
+        RealImagePixelType rlP = vigra::NumericTraits<ImagePixelType>::toRealPromote(lP);
+
+        return vigra::NumericTraits<ImagePixelType>::fromRealPromote(raP + coeff * rlP);
+    }
+
+protected:
+    double white;
+};
+
+
+/** Functor for dividing an accumulated pyramid level by the sum of
+ *  the mask pyramid levels, which have been used as weights.
+ */
+template <typename MaskPixelType>
+class NormalizeBlendFunctor {
+public:
+    NormalizeBlendFunctor(MaskPixelType w) : white(vigra::NumericTraits<MaskPixelType>::toRealPromote(w)) {}
+
+    template <typename ImagePixelType>
+    ImagePixelType operator()(const ImagePixelType& aP, const MaskPixelType& weightP) const {
+        typedef typename vigra::NumericTraits<ImagePixelType>::RealPromote RealImagePixelType;
+
+        const double weight = vigra::NumericTraits<MaskPixelType>::toRealPromote(weightP) / white;
+        if (weight <= 0.0) {
+            return vigra::NumericTraits<ImagePixelType>::zero();
+        }
+
+        RealImagePixelType raP = vigra::NumericTraits<ImagePixelType>::toRealPromote(aP);
+
+        return vigra::NumericTraits<ImagePixelType>::fromRealPromote(raP * (1.0 / weight));
+    }
+
+protected:
+    double white;
+};
+
+
+/** Add the Laplacian pyramid of one layer, weighted by the layer's
+ *  mask pyramid, to the pyramid blendLP and add the mask pyramid to
+ *  the pyramid of summed weights weightGP.
+ *
+ *  The layer's pyramids cover a region of interest only, whose upper
+ *  left corner is at offset in level 0 of blendLP and weightGP.  The
+ *  offset must be a multiple of the size of a pixel in the coarsest
+ *  level, so that every level of the layer's pyramids is aligned to
+ *  the corresponding level of blendLP.
+ */
+template <typename MaskPyramidType, typename ImagePyramidType>
+void
+accumulateBlend(std::vector<MaskPyramidType*>* maskGP,
+                std::vector<ImagePyramidType*>* layerLP,
+                std::vector<ImagePyramidType*>* blendLP,
+                std::vector<MaskPyramidType*>* weightGP,
+                const vigra::Diff2D& offset,
+                typename MaskPyramidType::value_type maskPyramidWhiteValue)
+{
+    typedef typename MaskPyramidType::value_type MaskPyramidPixelType;
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << command << ": info: accumulating layers:         ";
+        std::cerr.flush();
+    }
+
+    for (unsigned int layer = 0; layer < maskGP->size(); layer++) {
+        if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+            std::cerr << " l" << layer;
+            std::cerr.flush();
+        }
+
+        const vigra::Diff2D levelOffset(offset.x >> layer, offset.y >> layer);
+
+        vigra::omp::combineThreeImages(srcImageRange(*((*maskGP)[layer])),
+                                       srcImage(*((*layerLP)[layer])),
+                                       vigra::srcIter((*blendLP)[layer]->upperLeft() + levelOffset),
+                                       vigra::destIter((*blendLP)[layer]->upperLeft() + levelOffset),
+                                       AccumulateBlendFunctor<MaskPyramidPixelType>(maskPyramidWhiteValue));
+        vigra::omp::combineTwoImages(srcImageRange(*((*maskGP)[layer])),
+                                     vigra::srcIter((*weightGP)[layer]->upperLeft() + levelOffset),
+                                     vigra::destIter((*weightGP)[layer]->upperLeft() + levelOffset),
+                                     std::plus<MaskPyramidPixelType>());
+    }
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << std::endl;
+    }
+}
+
+
+/** Divide the accumulated pyramid blendLP by the summed weights
+ *  weightGP, which turns it into the Laplacian pyramid of the blended
+ *  image.
+ */
+template <typename MaskPyramidType, typename ImagePyramidType>
+void
+normalizeBlend(std::vector<ImagePyramidType*>* blendLP,
+               std::vector<MaskPyramidType*>* weightGP,
+               typename MaskPyramidType::value_type maskPyramidWhiteValue)
+{
+    for (unsigned int layer = 0; layer < blendLP->size(); layer++) {
+        vigra::omp::combineTwoImages(srcImageRange(*((*blendLP)[layer])),
+                                     srcImage(*((*weightGP)[layer])),
+                                     destImage(*((*blendLP)[layer])),
+                                     NormalizeBlendFunctor<typename MaskPyramidType::value_type>(maskPyramidWhiteValue));
+    }
+}
+
+
+/** Blend black and white strip pyramids using the mask strip
+ *  pyramid.  The strip version of blend().
+ */
+template <typename MaskPyramidType, typename ImagePyramidType>
+void
+blendStrips(std::vector<StripImage<MaskPyramidType>*>* maskGP,
+            std::vector<StripImage<ImagePyramidType>*>* whiteLP,
+            std::vector<StripImage<ImagePyramidType>*>* blackLP,
+            typename MaskPyramidType::value_type maskPyramidWhiteValue)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    MaskPyramidType maskStrip;
+    ImagePyramidType whiteStrip;
+    ImagePyramidType blackStrip;
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << command << ": info: blending layers:             ";
+        std::cerr.flush();
+    }
+
+    for (unsigned int layer = 0; layer < maskGP->size(); layer++) {
+        if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+            std::cerr << " l" << layer;
+            std::cerr.flush();
+        }
+
+        const int h = (*maskGP)[layer]->height();
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+
+            (*maskGP)[layer]->read(y0, y1, maskStrip);
+            (*whiteLP)[layer]->read(y0, y1, whiteStrip);
+            (*blackLP)[layer]->read(y0, y1, blackStrip);
+            vigra::omp::combineThreeImages(srcImageRange(maskStrip),
+                                           srcImage(whiteStrip),
+                                           srcImage(blackStrip),
+                                           destImage(blackStrip),
+                                           CartesianBlendFunctor<typename MaskPyramidType::value_type>(maskPyramidWhiteValue));
+            (*blackLP)[layer]->write(y0, blackStrip, 0, y1 - y0);
+        }
+    }
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << std::endl;
+    }
+}
+
+
+/** Add the Laplacian strip pyramid of one layer, weighted by the
+ *  layer's mask strip pyramid, to blendLP and weightGP.  The strip
+ *  version of accumulateBlend().
+ */
+template <typename MaskPyramidType, typename ImagePyramidType>
+void
+accumulateBlendStrips(std::vector<StripImage<MaskPyramidType>*>* maskGP,
+                      std::vector<StripImage<ImagePyramidType>*>* layerLP,
+                      std::vector<StripImage<ImagePyramidType>*>* blendLP,
+                      std::vector<StripImage<MaskPyramidType>*>* weightGP,
+                      const vigra::Diff2D& offset,
+                      typename MaskPyramidType::value_type maskPyramidWhiteValue)
+{
+    typedef typename MaskPyramidType::value_type MaskPyramidPixelType;
+
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    MaskPyramidType maskStrip;
+    ImagePyramidType layerStrip;
+    ImagePyramidType blendStrip;
+    MaskPyramidType weightStrip;
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << command << ": info: accumulating layers:         ";
+        std::cerr.flush();
+    }
+
+    for (unsigned int layer = 0; layer < maskGP->size(); layer++) {
+        if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+            std::cerr << " l" << layer;
+            std::cerr.flush();
+        }
+
+        const vigra::Diff2D levelOffset(offset.x >> layer, offset.y >> layer);
+        const int h = (*maskGP)[layer]->height();
+
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+
+            (*maskGP)[layer]->read(y0, y1, maskStrip);
+            (*layerLP)[layer]->read(y0, y1, layerStrip);
+            // The strips of the blend pyramids span their full width.
+            (*blendLP)[layer]->read(levelOffset.y + y0, levelOffset.y + y1, blendStrip);
+            (*weightGP)[layer]->read(levelOffset.y + y0, levelOffset.y + y1, weightStrip);
+
+            const vigra::Diff2D stripOffset(levelOffset.x, 0);
+            vigra::omp::combineThreeImages(srcImageRange(maskStrip),
+                                           srcImage(layerStrip),
+                                           vigra::srcIter(blendStrip.upperLeft() + stripOffset),
+                                           vigra::destIter(blendStrip.upperLeft() + stripOffset),
+                                           AccumulateBlendFunctor<MaskPyramidPixelType>(maskPyramidWhiteValue));
+            vigra::omp::combineTwoImages(srcImageRange(maskStrip),
+                                         vigra::srcIter(weightStrip.upperLeft() + stripOffset),
+                                         vigra::destIter(weightStrip.upperLeft() + stripOffset),
+                                         std::plus<MaskPyramidPixelType>());
+
+            (*blendLP)[layer]->write(levelOffset.y + y0, blendStrip, 0, y1 - y0);
+            (*weightGP)[layer]->write(levelOffset.y + y0, weightStrip, 0, y1 - y0);
+        }
+    }
+
+    if (Verbose >= VERBOSE_BLEND_MESSAGES) {
+        std::cerr << std::endl;
+    }
+}
+
+
+/** Divide the accumulated strip pyramid blendLP by the summed weights
+ *  weightGP.  The strip version of normalizeBlend().
+ */
+template <typename MaskPyramidType, typename ImagePyramidType>
+void
+normalizeBlendStrips(std::vector<StripImage<ImagePyramidType>*>* blendLP,
+                     std::vector<StripImage<MaskPyramidType>*>* weightGP,
+                     typename MaskPyramidType::value_type maskPyramidWhiteValue)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    ImagePyramidType blendStrip;
+    MaskPyramidType weightStrip;
+
+    for (unsigned int layer = 0; layer < blendLP->size(); layer++) {
+        const int h = (*blendLP)[layer]->height();
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+
+            (*blendLP)[layer]->read(y0, y1, blendStrip);
+            (*weightGP)[layer]->read(y0, y1, weightStrip);
+            vigra::omp::combineTwoImages(srcImageRange(blendStrip),
+                                         srcImage(weightStrip),
+                                         destImage(blendStrip),
+                                         NormalizeBlendFunctor<typename MaskPyramidType::value_type>(maskPyramidWhiteValue));
+            (*blendLP)[layer]->write(y0, blendStrip, 0, y1 - y0);
+        }
+    }
+}
+
 } // namespace enblend
 
 #endif /* __BLEND_H__ */
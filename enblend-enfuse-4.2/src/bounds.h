@@ -87,38 +87,13 @@ inspectOverlap(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> sr
                           src2.first, src2.second);
 };
 
-/** Determine the region-of-interest and number of blending levels to use,
- *  given the current mask-bounding-box and intersection-bounding-box.
- *  We also need to know if the image is a 360-degree pano so we can check
- *  for the case that the ROI wraps around the left and right edges.
+/** Determine the number of blending levels to use for a region of
+ *  interest, whose shorter side is roiShortDimension pixels long.
+ *  Honors the number of levels requested with option "--levels".
  */
-template <typename ImagePixelComponentType>
-unsigned int
-roiBounds(const vigra::Rect2D& inputUnion,
-          const vigra::Rect2D& iBB, const vigra::Rect2D& mBB, const vigra::Rect2D& uBB,
-          vigra::Rect2D& roiBB,        // roiBB is an _output_ parameter!
-          bool wraparoundForMask)
+inline unsigned int
+numberOfPyramidLevels(unsigned int roiShortDimension)
 {
-    roiBB = mBB;
-    roiBB.addBorder(filterHalfWidth(MAX_PYRAMID_LEVELS));
-
-    if (wraparoundForMask &&
-        (roiBB.left() < 0 || roiBB.right() > uBB.right())) {
-        // If the ROI goes off either edge of the uBB, and the uBB is
-        // the full size of the output image, and the wraparound flag
-        // is specified, then make roiBB the full width of uBB.
-        roiBB.setUpperLeft(vigra::Point2D(0, roiBB.top()));
-        roiBB.setLowerRight(vigra::Point2D(uBB.right(), roiBB.bottom()));
-    }
-
-    // ROI must not be bigger than uBB.
-    roiBB &= uBB;
-    if (Verbose >= VERBOSE_ROIBB_SIZE_MESSAGES) {
-        std::cerr << command << ": info: region-of-interest bounding box: " << roiBB << std::endl;
-    }
-
-    // Verify the number of levels based on the size of the ROI.
-    unsigned int roiShortDimension = std::min(roiBB.width(), roiBB.height());
     const unsigned int minimumPyramidLevels =
         parameter::as_unsigned("minimum-pyramid-levels", 1U); //< minimum-pyramid-levels 1
     unsigned int allowableLevels = minimumPyramidLevels;
@@ -171,6 +146,71 @@ roiBounds(const vigra::Rect2D& inputUnion,
     return allowableLevels;
 }
 
+
+/** Determine the region-of-interest and number of blending levels to use,
+ *  given the current mask-bounding-box and intersection-bounding-box.
+ *  We also need to know if the image is a 360-degree pano so we can check
+ *  for the case that the ROI wraps around the left and right edges.
+ */
+template <typename ImagePixelComponentType>
+unsigned int
+roiBounds(const vigra::Rect2D& inputUnion,
+          const vigra::Rect2D& iBB, const vigra::Rect2D& mBB, const vigra::Rect2D& uBB,
+          vigra::Rect2D& roiBB,        // roiBB is an _output_ parameter!
+          bool wraparoundForMask)
+{
+    roiBB = mBB;
+    roiBB.addBorder(filterHalfWidth(MAX_PYRAMID_LEVELS));
+
+    if (wraparoundForMask &&
+        (roiBB.left() < 0 || roiBB.right() > uBB.right())) {
+        // If the ROI goes off either edge of the uBB, and the uBB is
+        // the full size of the output image, and the wraparound flag
+        // is specified, then make roiBB the full width of uBB.
+        roiBB.setUpperLeft(vigra::Point2D(0, roiBB.top()));
+        roiBB.setLowerRight(vigra::Point2D(uBB.right(), roiBB.bottom()));
+    }
+
+    // ROI must not be bigger than uBB.
+    roiBB &= uBB;
+    if (Verbose >= VERBOSE_ROIBB_SIZE_MESSAGES) {
+        std::cerr << command << ": info: region-of-interest bounding box: " << roiBB << std::endl;
+    }
+
+    return numberOfPyramidLevels(std::min(roiBB.width(), roiBB.height()));
+}
+
+
+/** Determine the region-of-interest of a layer in a simultaneous
+ *  blend, given the bounding box labelBB of the pixels assigned to
+ *  the layer.  The region is widened by the width of the filter and
+ *  aligned to the pixels of the coarsest of numLevels levels, so that
+ *  level l of the layer's pyramids starts at (offset >> l) in level l
+ *  of the pyramids of unionBB.  Only the lower right corner may be
+ *  unaligned, where it is clipped at the border of unionBB.
+ */
+inline vigra::Rect2D
+simultaneousRoiBounds(const vigra::Rect2D& unionBB, const vigra::Rect2D& labelBB,
+                      unsigned int numLevels, bool wraparound)
+{
+    const int alignment = 1 << (numLevels - 1);
+    vigra::Rect2D roiBB(labelBB);
+
+    roiBB.addBorder(filterHalfWidth(numLevels));
+    if (wraparound && (roiBB.left() < 0 || roiBB.right() > unionBB.right())) {
+        roiBB.setUpperLeft(vigra::Point2D(0, roiBB.top()));
+        roiBB.setLowerRight(vigra::Point2D(unionBB.right(), roiBB.bottom()));
+    }
+    roiBB &= unionBB;
+    roiBB.setUpperLeft(vigra::Point2D(roiBB.left() / alignment * alignment,
+                                      roiBB.top() / alignment * alignment));
+    roiBB.setLowerRight(vigra::Point2D((roiBB.right() + alignment - 1) / alignment * alignment,
+                                       (roiBB.bottom() + alignment - 1) / alignment * alignment));
+    roiBB &= unionBB;
+
+    return roiBB;
+}
+
 } // namespace enblend
 
 #endif /* __BOUNDS_H__ */
@@ -113,6 +113,7 @@ std::string OutputFileName(DEFAULT_OUTPUT_FILENAME);
 int Verbose = 1;                //< default-verbosity-level 1
 int ExactLevels = 0;            // 0 means: automatically calculate maximum
 bool OneAtATime = true;
+bool SimultaneousBlend = false;
 boundary_t WrapAround = OpenBoundaries;
 bool GimpAssociatedAlphaHack = false;
 blend_colorspace_t BlendColorspace = UndeterminedColorspace;
@@ -237,6 +238,8 @@ void dump_global_variables(const char* file, unsigned line,
         "+ ExactLevels = " << ExactLevels << "\n" <<
         "+ UseGPU = " << UseGPU << "\n" <<
         "+ OneAtATime = " << enblend::stringOfBool(OneAtATime) << ", option \"-a\"\n" <<
+        "+ SimultaneousBlend = " << enblend::stringOfBool(SimultaneousBlend) <<
+        ", options \"--simultaneous-blend\" and \"--no-simultaneous-blend\"\n" <<
         "+ WrapAround = " << enblend::stringOfWraparound(WrapAround) << ", option \"--wrap\"\n" <<
         "+ GimpAssociatedAlphaHack = " << enblend::stringOfBool(GimpAssociatedAlphaHack) <<
         ", option \"-g\"\n" <<
@@ -360,6 +363,9 @@ printUsage(const bool error = true)
         "\n" <<
         "Expert options:\n" <<
         "  -a, --pre-assemble     pre-assemble non-overlapping images; negate with \"--no-pre-assemble\"\n" <<
+        "  --simultaneous-blend   label all images at once and blend them in a single\n" <<
+        "                         pass; seams are not optimized; negate with\n" <<
+        "                         \"--no-simultaneous-blend\"\n" <<
         "  -x                     checkpoint partial results\n" <<
         "  --fallback-profile=PROFILE-FILE\n" <<
         "                         use the ICC profile from PROFILE-FILE instead of sRGB\n" <<
@@ -493,7 +499,8 @@ void sigint_handler(int sig)
 
 
 enum AllPossibleOptions {
-    VersionOption, PreAssembleOption /* -a */, NoPreAssembleOption, HelpOption, LevelsOption,
+    VersionOption, PreAssembleOption /* -a */, NoPreAssembleOption,
+    SimultaneousBlendOption, NoSimultaneousBlendOption, HelpOption, LevelsOption,
     OutputOption, VerboseOption, WrapAroundOption /* -w */,
     CheckpointOption /* -x */, CompressionOption, LZWCompressionOption,
     BlendColorspaceOption, CIECAM02Option, NoCIECAM02Option, FallbackProfileOption,
@@ -563,6 +570,45 @@ void warn_of_ineffective_options(const OptionSetType& optionSet)
         }
     }
 
+    if (SimultaneousBlend) {
+        if (contains(optionSet, LoadMasksOption)) {
+            std::cerr << command <<
+                ": warning: option \"--simultaneous-blend\" has no effect with \"--load-masks\"" << std::endl;
+        } else {
+            if (contains(optionSet, PreAssembleOption)) {
+                std::cerr << command <<
+                    ": warning: option \"--pre-assemble\" has no effect with \"--simultaneous-blend\"" <<
+                    std::endl;
+            }
+            if (contains(optionSet, CheckpointOption)) {
+                std::cerr << command <<
+                    ": warning: option \"-x\" has no effect with \"--simultaneous-blend\"" << std::endl;
+            }
+            if (contains(optionSet, CoarseMaskOption)) {
+                std::cerr << command <<
+                    ": warning: option \"--coarse-mask\" has no effect with \"--simultaneous-blend\"" <<
+                    std::endl;
+            }
+            if (contains(optionSet, OptimizeOption)) {
+                std::cerr << command <<
+                    ": warning: option \"--optimize\" has no effect with \"--simultaneous-blend\"" <<
+                    std::endl;
+            }
+            if (contains(optionSet, VisualizeOption)) {
+                std::cerr << command <<
+                    ": warning: option \"--visualize\" has no effect with \"--simultaneous-blend\"" <<
+                    std::endl;
+            }
+            if (contains(optionSet, GraphCutOption)) {
+                std::cerr << command <<
+                    ": warning: option \"--primary-seam-generator\" has no effect with\n" <<
+                    command <<
+                    ": warning: \"--simultaneous-blend\"" <<
+                    std::endl;
+            }
+        }
+    }
+
     if (contains(optionSet, SaveMasksOption) && !contains(optionSet, OutputOption)) {
         if (contains(optionSet, LevelsOption)) {
             std::cerr << command <<
@@ -770,6 +816,8 @@ process_options(int argc, char** argv)
         PreferGpuId,
         PreAssembleId,
         NoPreAssembleId,
+        SimultaneousBlendId,
+        NoSimultaneousBlendId,
         CoarseMaskId,
         FineMaskId,
         OptimizeMaskId,
@@ -814,6 +862,8 @@ process_options(int argc, char** argv)
         {"preassemble", no_argument, 0, PreAssembleId}, // dash-less form: not documented, not deprecated
         {"no-pre-assemble", no_argument, 0, NoPreAssembleId},
         {"no-preassemble", no_argument, 0, NoPreAssembleId}, // dash-less form: not documented, not deprecated
+        {"simultaneous-blend", no_argument, 0, SimultaneousBlendId},
+        {"no-simultaneous-blend", no_argument, 0, NoSimultaneousBlendId},
         {"coarse-mask", optional_argument, 0, CoarseMaskId},
         {"fine-mask", no_argument, 0, FineMaskId},
         {"optimize", no_argument, 0, OptimizeMaskId},
@@ -1399,6 +1449,16 @@ process_options(int argc, char** argv)
             optionSet.insert(NoPreAssembleOption);
             break;
 
+        case SimultaneousBlendId:
+            SimultaneousBlend = true;
+            optionSet.insert(SimultaneousBlendOption);
+            break;
+
+        case NoSimultaneousBlendId:
+            SimultaneousBlend = false;
+            optionSet.insert(NoSimultaneousBlendOption);
+            break;
+
         case BlendColorspaceId:
             if (optarg != nullptr && *optarg != 0) {
                 std::string name(optarg);
@@ -1734,6 +1794,11 @@ process_options(int argc, char** argv)
 
     warn_of_ineffective_options(optionSet);
 
+    if (LoadMasks) {
+        // Loaded masks describe the seams of sequential blending.
+        SimultaneousBlend = false;
+    }
+
 #ifdef OPENCL
     if (UseGPU) {
         initialize_gpu_subsystem(preferredGPUPlatform, preferredGPUDevice);
@@ -25,8 +25,10 @@
 #include <config.h>
 #endif
 
+#include <cfloat>
 #include <iostream>
 #include <list>
+#include <vector>
 
 #include <vigra/impex.hxx>
 #include <vigra/initimage.hxx>
@@ -49,6 +51,463 @@
 
 namespace enblend {
 
+/** Blend all layers at once instead of one after the other.
+ *
+ *  First every pixel of the input union is labelled with the layer
+ *  whose exclusive part, i.e. the pixels covered by no other layer,
+ *  is nearest.  This is the N-way form of the nearest-feature
+ *  transform, which createMask() applies to a pair of images.  Then
+ *  the Laplacian pyramid of each layer is built over its labelled
+ *  region plus the width of the pyramid filter only, weighted with
+ *  the Gaussian pyramid of its label mask and added to a single
+ *  pyramid of the union, which is collapsed once.  Each layer's
+ *  pyramid is built exactly once, so the work grows linearly with
+ *  the number of layers.
+ *
+ *  The seam line is never optimized and the masks cannot be loaded;
+ *  the layers are read twice, once for their alpha channels and once
+ *  for blending.
+ */
+template <typename ImagePixelType>
+void enblendSimultaneous(const FileNameList& anInputFileNameList,
+                         const std::list<vigra::ImageImportInfo*>& anImageInfoList,
+                         vigra::ImageExportInfo& anOutputImageInfo,
+                         vigra::Rect2D& anInputUnion)
+{
+    typedef typename EnblendNumericTraits<ImagePixelType>::ImageType ImageType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::AlphaPixelType AlphaPixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::AlphaType AlphaType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::MaskPixelType MaskPixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::MaskType MaskType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::ImagePyramidPixelType ImagePyramidPixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::ImagePyramidType ImagePyramidType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::MaskPyramidPixelType MaskPyramidPixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::MaskPyramidType MaskPyramidType;
+
+    enum {ImagePyramidIntegerBits = EnblendNumericTraits<ImagePixelType>::ImagePyramidIntegerBits};
+    enum {ImagePyramidFractionBits = EnblendNumericTraits<ImagePixelType>::ImagePyramidFractionBits};
+    enum {MaskPyramidIntegerBits = EnblendNumericTraits<ImagePixelType>::MaskPyramidIntegerBits};
+    enum {MaskPyramidFractionBits = EnblendNumericTraits<ImagePixelType>::MaskPyramidFractionBits};
+    typedef typename EnblendNumericTraits<ImagePixelType>::SKIPSMImagePixelType SKIPSMImagePixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::SKIPSMAlphaPixelType SKIPSMAlphaPixelType;
+    typedef typename EnblendNumericTraits<ImagePixelType>::SKIPSMMaskPixelType SKIPSMMaskPixelType;
+
+    // Label 0 marks pixels outside of all layers, label n marks
+    // pixels, which are assigned to layer n - 1.
+    typedef IMAGETYPE<vigra::UInt16> LabelType;
+    typedef IMAGETYPE<vigra::UInt8> CoverageType;
+    typedef IMAGETYPE<float> DistanceType;
+
+    const std::vector<vigra::ImageImportInfo*> layers(anImageInfoList.begin(), anImageInfoList.end());
+    const unsigned numberOfImages = layers.size();
+
+    if (numberOfImages >= vigra::NumericTraits<vigra::UInt16>::max()) {
+        std::cerr << command << ": cannot blend more than "
+                  << vigra::NumericTraits<vigra::UInt16>::max() - 1
+                  << " images simultaneously" << std::endl;
+        exit(1);
+    }
+
+    // All rectangles are relative to the upper left corner of the input union.
+    const vigra::Rect2D unionBB(anInputUnion.size());
+    const bool wraparound = WrapAround != OpenBoundaries;
+    const MaskPixelType maskWhite = vigra::NumericTraits<MaskPixelType>::max();
+
+    if (Verbose >= VERBOSE_MEMORY_ESTIMATION_MESSAGES) {
+        // Labelling: labels, coverage and distances of the union
+        // Blending: labels, blended pyramid and sum of weights of the union
+        const long long labelBytes =
+            unionBB.area() * (sizeof(vigra::UInt16) + sizeof(vigra::UInt8) + sizeof(float));
+        const long long blendBytes =
+            unionBB.area() * sizeof(vigra::UInt16)
+            + 4LL * unionBB.area() / 3 * (sizeof(ImagePyramidPixelType) + sizeof(MaskPyramidPixelType));
+
+        std::cerr << command << ": info: estimated space required for simultaneous blending: "
+                  << static_cast<int>(ceil(std::max(labelBytes, blendBytes) / 1000000.0))
+                  << "MB" << std::endl;
+    }
+
+    // Read the alpha channels and count how many layers cover each
+    // pixel.  Counts greater than 2 do not matter.
+    std::vector<vigra::Rect2D> layerBB(numberOfImages);
+    std::vector<AlphaType*> layerAlpha(numberOfImages);
+    CoverageType* coverage = new CoverageType(unionBB.size());
+
+    for (unsigned i = 0; i < numberOfImages; ++i) {
+        if (Verbose >= VERBOSE_ASSEMBLE_MESSAGES) {
+            std::cerr << command
+                      << ": info: loading alpha channel of image: " << layers[i]->getFileName()
+                      << " " << layers[i]->getImageIndex() + 1 << '/' << layers[i]->numImages()
+                      << std::endl;
+        }
+
+        layerBB[i] = vigra::Rect2D(vigra::Point2D(layers[i]->getPosition() - anInputUnion.upperLeft()),
+                                   layers[i]->size());
+        layerAlpha[i] = new AlphaType(layers[i]->size());
+        {
+            ImageType image(layers[i]->size());
+            import(*layers[i], destImage(image), destImage(*layerAlpha[i]));
+        }
+
+        typename AlphaType::traverser ay = layerAlpha[i]->upperLeft();
+        const typename AlphaType::traverser aend = layerAlpha[i]->lowerRight();
+        typename CoverageType::traverser cy = coverage->upperLeft() + layerBB[i].upperLeft();
+        for (; ay.y < aend.y; ++ay.y, ++cy.y) {
+            typename AlphaType::traverser ax = ay;
+            typename CoverageType::traverser cx = cy;
+            for (; ax.x < aend.x; ++ax.x, ++cx.x) {
+                if (*ax && *cx < 2) {
+                    ++(*cx);
+                }
+            }
+        }
+    }
+
+    // Assign each pixel to the layer with the nearest exclusive
+    // pixel.  A layer without any exclusive pixels only takes
+    // pixels, which no other layer covers closer to its exclusive
+    // part.
+    const unsigned default_norm_value =
+        std::min(static_cast<unsigned>(EuclideanDistance),
+                 parameter::as_unsigned("distance-transform-norm", static_cast<unsigned>(EuclideanDistance)));
+    const nearest_neighbor_metric_t norm = static_cast<nearest_neighbor_metric_t>(default_norm_value);
+
+    LabelType* label = new LabelType(unionBB.size());
+    DistanceType* nearest = new DistanceType(unionBB.size(), FLT_MAX);
+
+    for (unsigned i = 0; i < numberOfImages; ++i) {
+        if (Verbose >= VERBOSE_NFT_MESSAGES) {
+            std::cerr << command << ": info: labelling image " << i + 1 << '/' << numberOfImages
+                      << std::endl;
+        }
+
+        const vigra::Rect2D& bb = layerBB[i];
+        MaskType exclusive(bb.size());
+        bool hasExclusive = false;
+
+        typename AlphaType::traverser ay = layerAlpha[i]->upperLeft();
+        const typename AlphaType::traverser aend = layerAlpha[i]->lowerRight();
+        typename CoverageType::traverser cy = coverage->upperLeft() + bb.upperLeft();
+        typename MaskType::traverser ey = exclusive.upperLeft();
+        for (; ay.y < aend.y; ++ay.y, ++cy.y, ++ey.y) {
+            typename AlphaType::traverser ax = ay;
+            typename CoverageType::traverser cx = cy;
+            typename MaskType::traverser ex = ey;
+            for (; ax.x < aend.x; ++ax.x, ++cx.x, ++ex.x) {
+                if (*ax && *cx == 1) {
+                    *ex = maskWhite;
+                    hasExclusive = true;
+                }
+            }
+        }
+
+        DistanceType distance(bb.size(), FLT_MAX);
+        if (hasExclusive) {
+            if (wraparound && bb.width() == unionBB.width()) {
+                periodicDistanceTransform(srcImageRange(exclusive), destImage(distance),
+                                          vigra::NumericTraits<MaskPixelType>::zero(), norm, HorizontalStrip);
+            } else {
+                vigra::ocl::distanceTransform(srcImageRange(exclusive), destImage(distance),
+                                              vigra::NumericTraits<MaskPixelType>::zero(), norm);
+            }
+        }
+
+        ay = layerAlpha[i]->upperLeft();
+        typename DistanceType::traverser dy = distance.upperLeft();
+        typename DistanceType::traverser ny = nearest->upperLeft() + bb.upperLeft();
+        typename LabelType::traverser ly = label->upperLeft() + bb.upperLeft();
+        for (; ay.y < aend.y; ++ay.y, ++dy.y, ++ny.y, ++ly.y) {
+            typename AlphaType::traverser ax = ay;
+            typename DistanceType::traverser dx = dy;
+            typename DistanceType::traverser nx = ny;
+            typename LabelType::traverser lx = ly;
+            for (; ax.x < aend.x; ++ax.x, ++dx.x, ++nx.x, ++lx.x) {
+                if (*ax && (*lx == 0 || *dx < *nx)) {
+                    *nx = *dx;
+                    *lx = static_cast<vigra::UInt16>(i + 1);
+                }
+            }
+        }
+    }
+
+    delete nearest;
+    delete coverage;
+    for (unsigned i = 0; i < numberOfImages; ++i) {
+        delete layerAlpha[i];
+    }
+
+    // Find the bounding box of the pixels assigned to each layer.
+    std::vector<vigra::Point2D> labelUpperLeft(numberOfImages, unionBB.lowerRight());
+    std::vector<vigra::Point2D> labelLowerRight(numberOfImages, unionBB.upperLeft());
+    {
+        typename LabelType::traverser ly = label->upperLeft();
+        const typename LabelType::traverser lend = label->lowerRight();
+        for (int y = 0; ly.y < lend.y; ++ly.y, ++y) {
+            typename LabelType::traverser lx = ly;
+            for (int x = 0; lx.x < lend.x; ++lx.x, ++x) {
+                if (*lx != 0) {
+                    const unsigned i = *lx - 1;
+                    labelUpperLeft[i].x = std::min(labelUpperLeft[i].x, x);
+                    labelUpperLeft[i].y = std::min(labelUpperLeft[i].y, y);
+                    labelLowerRight[i].x = std::max(labelLowerRight[i].x, x + 1);
+                    labelLowerRight[i].y = std::max(labelLowerRight[i].y, y + 1);
+                }
+            }
+        }
+    }
+
+    // All layers share one pyramid, hence the number of levels
+    // depends on the input union.  The region of interest of a layer
+    // is its labelled region plus the width of the filter, aligned to
+    // the pixels of the coarsest level (see simultaneousRoiBounds).
+    const unsigned int numLevels =
+        numberOfPyramidLevels(std::min(unionBB.width(), unionBB.height()));
+
+    // With strip pyramids the accumulated pyramids live in temporary
+    // files, which read as zero until they are written.
+    const bool stripPyramids = pyramidStripHeight() > 0;
+    std::vector<StripImage<ImagePyramidType>*>* stripBlendLP = nullptr;
+    std::vector<StripImage<MaskPyramidType>*>* stripWeightGP = nullptr;
+    if (stripPyramids && !StopAfterMaskGeneration) {
+        stripBlendLP = emptyStripPyramid<ImagePyramidType>(numLevels, unionBB.size());
+        stripWeightGP = emptyStripPyramid<MaskPyramidType>(numLevels, unionBB.size());
+    }
+
+    std::vector<ImagePyramidType*>* blendLP = new std::vector<ImagePyramidType*>();
+    std::vector<MaskPyramidType*>* weightGP = new std::vector<MaskPyramidType*>();
+    if (!stripPyramids && !StopAfterMaskGeneration) {
+        int w = unionBB.width();
+        int h = unionBB.height();
+        for (unsigned int l = 0; l < numLevels; l++) {
+            blendLP->push_back(new ImagePyramidType(w, h));
+            weightGP->push_back(new MaskPyramidType(w, h));
+            w = (w + 1) >> 1;
+            h = (h + 1) >> 1;
+        }
+    }
+
+    ImageType* outputImage = new ImageType(unionBB.size());
+    ConvertScalarToPyramidFunctor<MaskPixelType, MaskPyramidPixelType,
+                                  MaskPyramidIntegerBits, MaskPyramidFractionBits> whiteMask;
+    bool redundantImages = false;
+
+    FileNameList::const_iterator inputFileNameIterator(anInputFileNameList.begin());
+    for (unsigned i = 0; i < numberOfImages; ++i, ++inputFileNameIterator) {
+        if (labelUpperLeft[i].x >= labelLowerRight[i].x) {
+            redundantImages = true;
+            continue;
+        }
+
+        const vigra::Rect2D& bb = layerBB[i];
+        const vigra::Rect2D roiBB =
+            simultaneousRoiBounds(unionBB, vigra::Rect2D(labelUpperLeft[i], labelLowerRight[i]),
+                                  numLevels, wraparound);
+        const bool wraparoundForBlend = wraparound && roiBB.width() == unionBB.width();
+
+        if (Verbose >= VERBOSE_ROIBB_SIZE_MESSAGES) {
+            std::cerr << command << ": info: region-of-interest bounding box of image "
+                      << i + 1 << '/' << numberOfImages << ": " << roiBB << std::endl;
+        }
+
+        // Label mask of this layer over its region of interest.
+        MaskType mask(roiBB.size());
+        {
+            typename LabelType::traverser ly = label->upperLeft() + roiBB.upperLeft();
+            const typename LabelType::traverser lend = label->upperLeft() + roiBB.lowerRight();
+            typename MaskType::traverser my = mask.upperLeft();
+            for (; ly.y < lend.y; ++ly.y, ++my.y) {
+                typename LabelType::traverser lx = ly;
+                typename MaskType::traverser mx = my;
+                for (; lx.x < lend.x; ++lx.x, ++mx.x) {
+                    if (*lx == i + 1) {
+                        *mx = maskWhite;
+                    }
+                }
+            }
+        }
+
+        if (SaveMasks) {
+            const std::string maskFilename =
+                enblend::expandFilenameTemplate(SaveMaskTemplate,
+                                                numberOfImages,
+                                                *inputFileNameIterator,
+                                                OutputFileName,
+                                                i);
+            if (maskFilename == *inputFileNameIterator) {
+                std::cerr << command
+                          << ": will not overwrite input image \""
+                          << *inputFileNameIterator
+                          << "\" with mask file"
+                          << std::endl;
+                exit(1);
+            } else if (maskFilename == OutputFileName) {
+                std::cerr << command
+                          << ": will not overwrite output image \""
+                          << OutputFileName
+                          << "\" with mask file"
+                          << std::endl;
+                exit(1);
+            } else {
+                if (Verbose >= VERBOSE_MASK_MESSAGES) {
+                    std::cerr << command
+                              << ": info: saving mask \"" << maskFilename << "\"" << std::endl;
+                }
+                vigra::ImageExportInfo maskInfo(maskFilename.c_str());
+                maskInfo.setXResolution(ImageResolution.x);
+                maskInfo.setYResolution(ImageResolution.y);
+                maskInfo.setPosition(roiBB.upperLeft());
+                maskInfo.setCompression(MASK_COMPRESSION);
+                exportImage(srcImageRange(mask), maskInfo);
+            }
+        }
+
+        // Read the layer again, this time into a buffer, which covers
+        // the layer and its region of interest.
+        const vigra::Rect2D bufferBB = roiBB | bb;
+        vigra::Rect2D roiInBuffer = roiBB;
+        roiInBuffer.moveBy(-bufferBB.upperLeft());
+        ImageType* image = new ImageType(bufferBB.size());
+        AlphaType* alpha = new AlphaType(bufferBB.size());
+
+        if (Verbose >= VERBOSE_ASSEMBLE_MESSAGES) {
+            std::cerr << command
+                      << ": info: loading next image: " << layers[i]->getFileName()
+                      << " " << layers[i]->getImageIndex() + 1 << '/' << layers[i]->numImages()
+                      << std::endl;
+        }
+        import(*layers[i],
+               vigra::destIter(image->upperLeft() + bb.upperLeft() - bufferBB.upperLeft()),
+               vigra::destIter(alpha->upperLeft() + bb.upperLeft() - bufferBB.upperLeft()));
+
+        if (StopAfterMaskGeneration) {
+            vigra::copyImageIf(vigra_ext::apply(roiInBuffer, srcImageRange(*image)),
+                               maskImage(mask),
+                               vigra_ext::apply(roiBB, destImage(*outputImage)));
+            delete image;
+            delete alpha;
+            continue;
+        }
+
+        if (stripPyramids) {
+            std::vector<StripImage<MaskPyramidType>*>* maskGP =
+                gaussianStripPyramid<MaskType, MaskPyramidType,
+                                     MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                     SKIPSMMaskPixelType>(numLevels, wraparoundForBlend, srcImageRange(mask));
+
+            std::vector<StripImage<ImagePyramidType>*>* layerLP =
+                laplacianStripPyramid<ImageType, AlphaType, ImagePyramidType,
+                                      ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                (numLevels, wraparoundForBlend,
+                 vigra_ext::apply(roiInBuffer, srcImageRange(*image)),
+                 vigra_ext::apply(roiInBuffer, maskImage(*alpha)));
+
+            delete image;
+            delete alpha;
+
+            accumulateBlendStrips(maskGP, layerLP, stripBlendLP, stripWeightGP,
+                                  roiBB.upperLeft(),
+                                  whiteMask(maskWhite));
+
+            deleteStripPyramid(maskGP);
+            deleteStripPyramid(layerLP);
+            continue;
+        }
+
+        std::vector<MaskPyramidType*>* maskGP =
+            gaussianPyramid<MaskType, MaskPyramidType,
+                            MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                            SKIPSMMaskPixelType>(numLevels, wraparoundForBlend, srcImageRange(mask));
+
+        std::vector<ImagePyramidType*>* layerLP =
+            laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                             ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                             SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            ("layerGP",
+             numLevels, wraparoundForBlend,
+             vigra_ext::apply(roiInBuffer, srcImageRange(*image)),
+             vigra_ext::apply(roiInBuffer, maskImage(*alpha)));
+
+        delete image;
+        delete alpha;
+
+        accumulateBlend(maskGP, layerLP, blendLP, weightGP,
+                        roiBB.upperLeft(),
+                        whiteMask(maskWhite));
+
+        for (unsigned int l = 0; l < maskGP->size(); l++) {
+            delete (*maskGP)[l];
+        }
+        delete maskGP;
+        for (unsigned int l = 0; l < layerLP->size(); l++) {
+            delete (*layerLP)[l];
+        }
+        delete layerLP;
+    }
+
+    if (redundantImages) {
+        std::cerr << command << ": warning: some images are redundant and will not be blended\n"
+                  << command << ": note: usually this means that at least one of the images\n"
+                  << command << ": note: does not belong to the set" << std::endl;
+    }
+
+    // The alpha channel of the result is the union of all layers.
+    AlphaType* outputAlpha = new AlphaType(unionBB.size());
+    vigra::transformImage(srcImageRange(*label), destImage(*outputAlpha),
+                          vigra::functor::ifThenElse(vigra::functor::Arg1() != vigra::functor::Param(0),
+                                                     vigra::functor::Param(vigra::NumericTraits<AlphaPixelType>::max()),
+                                                     vigra::functor::Param(vigra::NumericTraits<AlphaPixelType>::zero())));
+    delete label;
+
+    if (stripPyramids && !StopAfterMaskGeneration) {
+        normalizeBlendStrips(stripBlendLP, stripWeightGP, whiteMask(maskWhite));
+        deleteStripPyramid(stripWeightGP);
+
+        collapseStripPyramid<SKIPSMImagePixelType>(wraparound, stripBlendLP);
+
+        copyFromStripPyramidImageIf<ImagePyramidType, AlphaType, ImageType,
+                                    ImagePyramidIntegerBits, ImagePyramidFractionBits>
+            ((*stripBlendLP)[0],
+             maskImage(*outputAlpha),
+             destImage(*outputImage));
+
+        deleteStripPyramid(stripBlendLP);
+    } else if (!StopAfterMaskGeneration) {
+        normalizeBlend(blendLP, weightGP, whiteMask(maskWhite));
+
+        for (unsigned int l = 0; l < weightGP->size(); l++) {
+            delete (*weightGP)[l];
+        }
+
+#ifdef DEBUG_EXPORT_PYRAMID
+        exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(blendLP, "enblend_blend_lp");
+#endif
+
+        collapsePyramid<SKIPSMImagePixelType>(wraparound, blendLP);
+
+        copyFromPyramidImageIf<ImagePyramidType, AlphaType, ImageType,
+                               ImagePyramidIntegerBits, ImagePyramidFractionBits>
+            (srcImageRange(*((*blendLP)[0])),
+             maskImage(*outputAlpha),
+             destImage(*outputImage));
+
+        for (unsigned int l = 0; l < blendLP->size(); l++) {
+            delete (*blendLP)[l];
+        }
+    }
+    delete weightGP;
+    delete blendLP;
+
+    if (Verbose >= VERBOSE_CHECKPOINTING_MESSAGES) {
+        std::cerr << command << ": info: writing final output" << std::endl;
+    }
+    checkpoint(std::make_pair(outputImage, outputAlpha), anOutputImageInfo);
+
+    delete outputImage;
+    delete outputAlpha;
+}
+
+
 /** Enblend's main blending loop. Templatized to handle different image types.
  */
 template <typename ImagePixelType>
@@ -76,6 +535,12 @@ void enblendMain(const FileNameList& anInputFileNameList,
     typedef typename EnblendNumericTraits<ImagePixelType>::SKIPSMAlphaPixelType SKIPSMAlphaPixelType;
     typedef typename EnblendNumericTraits<ImagePixelType>::SKIPSMMaskPixelType SKIPSMMaskPixelType;
 
+    if (SimultaneousBlend) {
+        enblendSimultaneous<ImagePixelType>(anInputFileNameList, anImageInfoList,
+                                            anOutputImageInfo, anInputUnion);
+        return;
+    }
+
     std::list<vigra::ImageImportInfo*> imageInfoList(anImageInfoList);
 
     // Create the initial black image.
@@ -354,15 +819,29 @@ void enblendMain(const FileNameList& anInputFileNameList,
         vigra::Rect2D roiBB_uBB = roiBB;
         roiBB_uBB.moveBy(-uBB.upperLeft());
 
+        // With strip pyramids all pyramids live in temporary files
+        // and only the strip* pointers are used.
+        const bool stripPyramids = pyramidStripHeight() > 0;
+        std::vector<MaskPyramidType*>* maskGP = nullptr;
+        std::vector<StripImage<MaskPyramidType>*>* stripMaskGP = nullptr;
+
         // Build Gaussian pyramid from mask.
-        std::vector<MaskPyramidType*> *maskGP =
-            gaussianPyramid<MaskType, MaskPyramidType,
-                            MaskPyramidIntegerBits, MaskPyramidFractionBits,
-                            SKIPSMMaskPixelType>(numLevels, wraparoundForBlend,
-                                                 vigra_ext::apply(roiBB_uBB, srcImageRange(*mask)));
+        if (stripPyramids) {
+            stripMaskGP =
+                gaussianStripPyramid<MaskType, MaskPyramidType,
+                                     MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                     SKIPSMMaskPixelType>(numLevels, wraparoundForBlend,
+                                                          vigra_ext::apply(roiBB_uBB, srcImageRange(*mask)));
+        } else {
+            maskGP =
+                gaussianPyramid<MaskType, MaskPyramidType,
+                                MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                SKIPSMMaskPixelType>(numLevels, wraparoundForBlend,
+                                                     vigra_ext::apply(roiBB_uBB, srcImageRange(*mask)));
 #ifdef DEBUG_EXPORT_PYRAMID
-        exportPyramid<SKIPSMMaskPixelType, MaskPyramidType>(maskGP, "mask");
+            exportPyramid<SKIPSMMaskPixelType, MaskPyramidType>(maskGP, "mask");
 #endif
+        }
 
         // mem usage before = MaskType*ubb + 2*anInputUnion*ImageValueType + 2*anInputUnion*AlphaValueType
         // mem usage xsection = 3 * roiBB.width * MaskPyramidType
@@ -390,14 +869,26 @@ void enblendMain(const FileNameList& anInputFileNameList,
         //                   (4/3)*roiBB*MaskPyramidType
 
         // Build Laplacian pyramid from white image.
-        std::vector<ImagePyramidType*>* whiteLP =
-            laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
-                             ImagePyramidIntegerBits, ImagePyramidFractionBits,
-                             SKIPSMImagePixelType, SKIPSMAlphaPixelType>
-            ("whiteGP",
-             numLevels, wraparoundForBlend,
-             vigra_ext::apply(roiBB, srcImageRange(*(whitePair.first))),
-             vigra_ext::apply(roiBB, maskImage(*(whitePair.second))));
+        std::vector<ImagePyramidType*>* whiteLP = nullptr;
+        std::vector<StripImage<ImagePyramidType>*>* stripWhiteLP = nullptr;
+        if (stripPyramids) {
+            stripWhiteLP =
+                laplacianStripPyramid<ImageType, AlphaType, ImagePyramidType,
+                                      ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                (numLevels, wraparoundForBlend,
+                 vigra_ext::apply(roiBB, srcImageRange(*(whitePair.first))),
+                 vigra_ext::apply(roiBB, maskImage(*(whitePair.second))));
+        } else {
+            whiteLP =
+                laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                 ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                 SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                ("whiteGP",
+                 numLevels, wraparoundForBlend,
+                 vigra_ext::apply(roiBB, srcImageRange(*(whitePair.first))),
+                 vigra_ext::apply(roiBB, maskImage(*(whitePair.second))));
+        }
 
         // mem usage after = 2*anInputUnion*ImageValueType + 2*anInputUnion*AlphaValueType
         //                   + (4/3)*roiBB*MaskPyramidType + (4/3)*roiBB*ImagePyramidType
@@ -410,18 +901,30 @@ void enblendMain(const FileNameList& anInputFileNameList,
         //                   + (4/3)*roiBB*MaskPyramidType + (4/3)*roiBB*ImagePyramidType
 
         // Build Laplacian pyramid from black image.
-        std::vector<ImagePyramidType*>* blackLP =
-            laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
-                             ImagePyramidIntegerBits, ImagePyramidFractionBits,
-                             SKIPSMImagePixelType, SKIPSMAlphaPixelType>
-            ("blackGP",
-             numLevels, wraparoundForBlend,
-             vigra_ext::apply(roiBB, srcImageRange(*(blackPair.first))),
-             vigra_ext::apply(roiBB, maskImage(*(blackPair.second))));
+        std::vector<ImagePyramidType*>* blackLP = nullptr;
+        std::vector<StripImage<ImagePyramidType>*>* stripBlackLP = nullptr;
+        if (stripPyramids) {
+            stripBlackLP =
+                laplacianStripPyramid<ImageType, AlphaType, ImagePyramidType,
+                                      ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                (numLevels, wraparoundForBlend,
+                 vigra_ext::apply(roiBB, srcImageRange(*(blackPair.first))),
+                 vigra_ext::apply(roiBB, maskImage(*(blackPair.second))));
+        } else {
+            blackLP =
+                laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                 ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                 SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                ("blackGP",
+                 numLevels, wraparoundForBlend,
+                 vigra_ext::apply(roiBB, srcImageRange(*(blackPair.first))),
+                 vigra_ext::apply(roiBB, maskImage(*(blackPair.second))));
 
 #ifdef DEBUG_EXPORT_PYRAMID
-        exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(blackLP, "enblend_black_lp");
+            exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(blackLP, "enblend_black_lp");
 #endif
+        }
 
         // Peak memory xsection is here!
         // mem xsection = 4 * roiBB.width() * SKIPSMImagePixelType
@@ -445,49 +948,67 @@ void enblendMain(const FileNameList& anInputFileNameList,
         // Blend pyramids
         ConvertScalarToPyramidFunctor<MaskPixelType, MaskPyramidPixelType,
                                       MaskPyramidIntegerBits, MaskPyramidFractionBits> whiteMask;
-        blend(maskGP, whiteLP, blackLP, whiteMask(vigra::NumericTraits<MaskPixelType>::max()));
+        if (stripPyramids) {
+            blendStrips(stripMaskGP, stripWhiteLP, stripBlackLP,
+                        whiteMask(vigra::NumericTraits<MaskPixelType>::max()));
 
-        // delete mask pyramid
+            deleteStripPyramid(stripMaskGP);
+            deleteStripPyramid(stripWhiteLP);
+
+            collapseStripPyramid<SKIPSMImagePixelType>(wraparoundForBlend, stripBlackLP);
+
+            copyFromStripPyramidImageIf<ImagePyramidType, MaskType, ImageType,
+                                        ImagePyramidIntegerBits, ImagePyramidFractionBits>
+                ((*stripBlackLP)[0],
+                 vigra_ext::apply(roiBB, maskImage(*(blackPair.second))),
+                 vigra_ext::apply(roiBB, destImage(*(blackPair.first))));
+
+            deleteStripPyramid(stripBlackLP);
+        } else {
+            blend(maskGP, whiteLP, blackLP, whiteMask(vigra::NumericTraits<MaskPixelType>::max()));
+
+            // delete mask pyramid
 #ifdef DEBUG_EXPORT_PYRAMID
-        exportPyramid<SKIPSMMaskPixelType, MaskPyramidType>(maskGP, "enblend_mask_gp");
+            exportPyramid<SKIPSMMaskPixelType, MaskPyramidType>(maskGP, "enblend_mask_gp");
 #endif
-        for (unsigned int i = 0; i < maskGP->size(); i++) {
-            delete (*maskGP)[i];
-        }
-        delete maskGP;
+            for (unsigned int i = 0; i < maskGP->size(); i++) {
+                delete (*maskGP)[i];
+            }
+            delete maskGP;
 
-        // mem usage after = anInputUnion*ImageValueType + anInputUnion*AlphaValueType + 2*(4/3)*roiBB*ImagePyramidType
+            // mem usage after = anInputUnion*ImageValueType + anInputUnion*AlphaValueType + 2*(4/3)*roiBB*ImagePyramidType
 
-        // delete white pyramid
+            // delete white pyramid
 #ifdef DEBUG_EXPORT_PYRAMID
-        exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(whiteLP, "enblend_white_lp");
+            exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(whiteLP, "enblend_white_lp");
 #endif
-        for (unsigned int i = 0; i < whiteLP->size(); i++) {
-            delete (*whiteLP)[i];
-        }
-        delete whiteLP;
+            for (unsigned int i = 0; i < whiteLP->size(); i++) {
+                delete (*whiteLP)[i];
+            }
+            delete whiteLP;
 
-        // mem usage after = anInputUnion*ImageValueType + anInputUnion*AlphaValueType + (4/3)*roiBB*ImagePyramidType
+            // mem usage after = anInputUnion*ImageValueType + anInputUnion*AlphaValueType + (4/3)*roiBB*ImagePyramidType
 
 #ifdef DEBUG_EXPORT_PYRAMID
-        exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(blackLP, "enblend_blend_lp");
+            exportPyramid<SKIPSMImagePixelType, ImagePyramidType>(blackLP, "enblend_blend_lp");
 #endif
 
-        // collapse black pyramid
-        collapsePyramid<SKIPSMImagePixelType>(wraparoundForBlend, blackLP);
+            // collapse black pyramid
+            collapsePyramid<SKIPSMImagePixelType>(wraparoundForBlend, blackLP);
 
-        // copy collapsed black pyramid into black image ROI, using black alpha mask.
-        copyFromPyramidImageIf<ImagePyramidType, MaskType, ImageType,
-                               ImagePyramidIntegerBits, ImagePyramidFractionBits>
-            (srcImageRange(*((*blackLP)[0])),
-             vigra_ext::apply(roiBB, maskImage(*(blackPair.second))),
-             vigra_ext::apply(roiBB, destImage(*(blackPair.first))));
+            // copy collapsed black pyramid into black image ROI, using black alpha mask.
+            copyFromPyramidImageIf<ImagePyramidType, MaskType, ImageType,
+                                   ImagePyramidIntegerBits, ImagePyramidFractionBits>
+                (srcImageRange(*((*blackLP)[0])),
+                 vigra_ext::apply(roiBB, maskImage(*(blackPair.second))),
+                 vigra_ext::apply(roiBB, destImage(*(blackPair.first))));
 
-        // delete black pyramid
-        for (unsigned int i = 0; i < blackLP->size(); i++) {
-            delete (*blackLP)[i];
+            // delete black pyramid
+            for (unsigned int i = 0; i < blackLP->size(); i++) {
+                delete (*blackLP)[i];
+            }
+            delete blackLP;
         }
-        delete blackLP;
 
         // mem usage after = anInputUnion*ImageValueType + anInputUnion*AlphaValueType
 
@@ -25,10 +25,13 @@
 #include <config.h>
 #endif
 
+#include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <list>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <vigra/flatmorphology.hxx>
 #include <vigra/functorexpression.hxx>
@@ -453,13 +456,193 @@ private:
 };
 
 
+// Tells whether the channel type KeyType has so few values that a
+// histogram can be a flat array with one bin per value.
+template <typename KeyType>
+struct FlatHistogramTraits
+{
+    typedef vigra::VigraFalseType isFlat;
+};
+
+template <>
+struct FlatHistogramTraits<vigra::UInt8>
+{
+    typedef vigra::VigraTrueType isFlat;
+};
+
+template <>
+struct FlatHistogramTraits<vigra::Int16>
+{
+    typedef vigra::VigraTrueType isFlat;
+};
+
+template <>
+struct FlatHistogramTraits<vigra::UInt16>
+{
+    typedef vigra::VigraTrueType isFlat;
+};
+
+
+/** Values of log(n) and n * log(n) for all pixel counts n a
+ *  FlatHistogram can hold.  Shared read-only by the histograms of all
+ *  threads. */
+class EntropyTable
+{
+public:
+    explicit EntropyTable(size_t maximumCount) :
+        log_(maximumCount + 1), nLogN_(maximumCount + 1)
+    {
+        log_[0] = 0.0;          // just to have a reliable value
+        nLogN_[0] = 0.0;
+        for (size_t i = 1; i <= maximumCount; ++i)
+        {
+            log_[i] = std::log(static_cast<double>(i));
+            nLogN_[i] = static_cast<double>(i) * log_[i];
+        }
+    }
+
+    double log(size_t n) const {return log_[n];}
+    double nLogN(size_t n) const {return nLogN_[n];}
+
+private:
+    std::vector<double> log_;
+    std::vector<double> nLogN_;
+};
+
+
+/** Histogram of the pixels in a moving window for 8-bit and 16-bit
+ *  channels.  Every possible value has a bin of its own, and the sum
+ *  of n * log(n) over all bins and the number of occupied bins are
+ *  updated along with the bins, so inserting, erasing, and the
+ *  entropy all take constant time.
+ *
+ *  The entropy is the same as the one of Histogram:
+ *      -sum(p * log(p)) / log(bins)
+ *    = (log(total) - sum(n * log(n)) / total) / log(bins). */
+template <typename InputPixelType, typename ResultPixelType>
+class FlatHistogram
+{
+    enum {GRAY = 0, CHANNELS = 3};
+
+public:
+    typedef vigra::NumericTraits<InputPixelType> InputPixelTraits;
+    typedef typename InputPixelTraits::ValueType KeyType;
+    typedef typename InputPixelTraits::isScalar pixelIsScalar;
+    typedef unsigned DataType;  // pixel counts are our data
+    typedef vigra::NumericTraits<ResultPixelType> ResultPixelTraits;
+    typedef typename ResultPixelTraits::ValueType ResultType;
+
+    explicit FlatHistogram(const EntropyTable& aTable) : table(aTable) {
+        // Scalar pixels only use the GRAY channel.
+        const size_t numberOfBins = bin(vigra::NumericTraits<KeyType>::max()) + 1U;
+        const int usedChannels = pixelIsScalar::asBool ? 1 : CHANNELS;
+        for (int channel = 0; channel < CHANNELS; ++channel)
+        {
+            if (channel < usedChannels)
+            {
+                histogram[channel].assign(numberOfBins, DataType());
+            }
+            totalCount[channel] = DataType();
+            occupiedBins[channel] = DataType();
+            sumNLogN[channel] = 0.0;
+        }
+    }
+
+    void insert(const InputPixelType& x) {insertFun(x, pixelIsScalar());}
+    void erase(const InputPixelType& x) {eraseFun(x, pixelIsScalar());}
+
+    ResultPixelType entropy() const {return entropyFun(pixelIsScalar());}
+
+protected:
+    static size_t bin(KeyType key) {
+        return static_cast<size_t>(static_cast<long>(key) - static_cast<long>(vigra::NumericTraits<KeyType>::min()));
+    }
+
+    void insertInChannel(int channel, KeyType key) {
+        const DataType c = ++histogram[channel][bin(key)];
+        if (c == 1U)
+        {
+            ++occupiedBins[channel];
+        }
+        sumNLogN[channel] += table.nLogN(c) - table.nLogN(c - 1U);
+        ++totalCount[channel];
+    }
+
+    void eraseInChannel(int channel, KeyType key) {
+        DataType& c = histogram[channel][bin(key)];
+        assert(c != 0U);
+        sumNLogN[channel] += table.nLogN(c - 1U) - table.nLogN(c);
+        if (--c == 0U)
+        {
+            --occupiedBins[channel];
+        }
+        if (--totalCount[channel] == 0U)
+        {
+            sumNLogN[channel] = 0.0; // drop accumulated rounding errors
+        }
+    }
+
+    double entropyOfChannel(int channel) const {
+        const DataType total = totalCount[channel];
+        if (total == 0U || occupiedBins[channel] <= 1U)
+        {
+            return 0.0;
+        }
+        else
+        {
+            const double e = table.log(total) - sumNLogN[channel] / static_cast<double>(total);
+            return std::max(0.0, e) / table.log(occupiedBins[channel]);
+        }
+    }
+
+    // Grayscale
+    void insertFun(const InputPixelType& x, vigra::VigraTrueType) {insertInChannel(GRAY, x);}
+    void eraseFun(const InputPixelType& x, vigra::VigraTrueType) {eraseInChannel(GRAY, x);}
+
+    ResultPixelType entropyFun(vigra::VigraTrueType) const {
+        const double max = static_cast<double>(vigra::NumericTraits<KeyType>::max());
+        return ResultPixelType(ResultPixelTraits::fromRealPromote(entropyOfChannel(GRAY) * max));
+    }
+
+    // RGB
+    void insertFun(const InputPixelType& x, vigra::VigraFalseType) {
+        for (int channel = 0; channel < CHANNELS; ++channel) {
+            insertInChannel(channel, x[channel]);
+        }
+    }
+
+    void eraseFun(const InputPixelType& x, vigra::VigraFalseType) {
+        for (int channel = 0; channel < CHANNELS; ++channel) {
+            eraseInChannel(channel, x[channel]);
+        }
+    }
+
+    ResultPixelType entropyFun(vigra::VigraFalseType) const {
+        const double max = static_cast<double>(vigra::NumericTraits<KeyType>::max());
+        return ResultPixelType(vigra::NumericTraits<ResultType>::fromRealPromote(entropyOfChannel(0) * max),
+                               vigra::NumericTraits<ResultType>::fromRealPromote(entropyOfChannel(1) * max),
+                               vigra::NumericTraits<ResultType>::fromRealPromote(entropyOfChannel(2) * max));
+    }
+
+private:
+    const EntropyTable& table;
+    std::vector<DataType> histogram[CHANNELS];
+    DataType totalCount[CHANNELS];
+    DataType occupiedBins[CHANNELS];
+    double sumNLogN[CHANNELS];
+};
+
+
+// Local entropy with map-based histograms for channel types with too
+// many values for a flat histogram.
 template <class SrcIterator, class SrcAccessor,
           class MaskIterator, class MaskAccessor,
           class DestIterator, class DestAccessor>
 void localEntropyIf(SrcIterator src_ul, SrcIterator src_lr, SrcAccessor src_acc,
                     MaskIterator mask_ul, MaskAccessor mask_acc,
                     DestIterator dest_ul, DestAccessor dest_acc,
-                    vigra::Size2D size)
+                    vigra::Size2D size,
+                    vigra::VigraFalseType)
 {
     typedef typename SrcIterator::PixelType SrcPixelType;
     typedef typename DestIterator::PixelType DestPixelType;
@@ -564,6 +747,134 @@ void localEntropyIf(SrcIterator src_ul, SrcIterator src_lr, SrcAccessor src_acc,
 }
 
 
+// Insert (insert == true) or erase the unmasked pixels of one column
+// of the moving window into/from the histogram.
+template <class HistogramType,
+          class SrcIterator, class SrcAccessor,
+          class MaskIterator, class MaskAccessor>
+inline void
+updateEntropyWindowColumn(HistogramType& histogram, bool insert, int height,
+                          SrcIterator src, SrcAccessor src_acc,
+                          MaskIterator mask, MaskAccessor mask_acc)
+{
+    for (int y = 0; y < height; ++y, ++src.y, ++mask.y)
+    {
+        if (mask_acc(mask))
+        {
+            if (insert)
+            {
+                histogram.insert(src_acc(src));
+            }
+            else
+            {
+                histogram.erase(src_acc(src));
+            }
+        }
+    }
+}
+
+
+// Local entropy with flat histograms for 8-bit and 16-bit channels.
+// Every row of results slides its own window from left to right, so
+// the rows are computed in parallel, each thread with a histogram of
+// its own.
+template <class SrcIterator, class SrcAccessor,
+          class MaskIterator, class MaskAccessor,
+          class DestIterator, class DestAccessor>
+void localEntropyIf(SrcIterator src_ul, SrcIterator src_lr, SrcAccessor src_acc,
+                    MaskIterator mask_ul, MaskAccessor mask_acc,
+                    DestIterator dest_ul, DestAccessor dest_acc,
+                    vigra::Size2D size,
+                    vigra::VigraTrueType)
+{
+    typedef typename SrcIterator::PixelType SrcPixelType;
+    typedef typename DestIterator::PixelType DestPixelType;
+    typedef FlatHistogram<SrcPixelType, DestPixelType> HistogramType;
+
+    vigra_precondition(src_lr.x - src_ul.x >= size.x &&
+                       src_lr.y - src_ul.y >= size.y,
+                       "localEntropyIf(): window larger than image");
+
+    const typename SrcIterator::difference_type imageSize = src_lr - src_ul;
+    const vigra::Diff2D border(size.x / 2, size.y / 2);
+    const int windowWidth = 2 * border.x + 1;
+    const int windowHeight = 2 * border.y + 1;
+    const EntropyTable table(static_cast<size_t>(windowWidth) * static_cast<size_t>(windowHeight));
+
+#ifdef OPENMP
+#pragma omp parallel
+#endif
+    {
+        HistogramType histogram(table);
+
+#ifdef OPENMP
+#pragma omp for schedule(guided)
+#endif
+        for (int y = border.y; y < imageSize.y - border.y; ++y)
+        {
+            const vigra::Diff2D windowTop(0, y - border.y);
+            SrcIterator const srcTop(src_ul + windowTop);
+            MaskIterator const maskTop(mask_ul + windowTop);
+            DestIterator destCol(dest_ul + vigra::Diff2D(border.x, y));
+            MaskIterator maskCol(mask_ul + vigra::Diff2D(border.x, y));
+
+            // Fill the window of the first result of the row.
+            for (int x = 0; x < windowWidth - 1; ++x)
+            {
+                updateEntropyWindowColumn(histogram, true, windowHeight,
+                                          srcTop + vigra::Diff2D(x, 0), src_acc,
+                                          maskTop + vigra::Diff2D(x, 0), mask_acc);
+            }
+
+            for (int x = border.x; x < imageSize.x - border.x; ++x, ++destCol.x, ++maskCol.x)
+            {
+                // Add the rightmost column of the window.
+                updateEntropyWindowColumn(histogram, true, windowHeight,
+                                          srcTop + vigra::Diff2D(x + border.x, 0), src_acc,
+                                          maskTop + vigra::Diff2D(x + border.x, 0), mask_acc);
+
+                if (mask_acc(maskCol))
+                {
+                    dest_acc.set(histogram.entropy(), destCol);
+                }
+
+                // Remove the leftmost column of the window.
+                updateEntropyWindowColumn(histogram, false, windowHeight,
+                                          srcTop + vigra::Diff2D(x - border.x, 0), src_acc,
+                                          maskTop + vigra::Diff2D(x - border.x, 0), mask_acc);
+            }
+
+            // Empty the histogram for the next row.
+            for (int x = imageSize.x - windowWidth + 1; x < imageSize.x; ++x)
+            {
+                updateEntropyWindowColumn(histogram, false, windowHeight,
+                                          srcTop + vigra::Diff2D(x, 0), src_acc,
+                                          maskTop + vigra::Diff2D(x, 0), mask_acc);
+            }
+        }
+    }
+}
+
+
+template <class SrcIterator, class SrcAccessor,
+          class MaskIterator, class MaskAccessor,
+          class DestIterator, class DestAccessor>
+inline void
+localEntropyIf(SrcIterator src_ul, SrcIterator src_lr, SrcAccessor src_acc,
+               MaskIterator mask_ul, MaskAccessor mask_acc,
+               DestIterator dest_ul, DestAccessor dest_acc,
+               vigra::Size2D size)
+{
+    typedef typename vigra::NumericTraits<typename SrcIterator::PixelType>::ValueType KeyType;
+
+    localEntropyIf(src_ul, src_lr, src_acc,
+                   mask_ul, mask_acc,
+                   dest_ul, dest_acc,
+                   size,
+                   typename FlatHistogramTraits<KeyType>::isFlat());
+}
+
+
 template <typename SrcIterator, typename SrcAccessor,
           typename MaskIterator, typename MaskAccessor,
           typename DestIterator, typename DestAccessor>
@@ -957,6 +1268,94 @@ private:
 };
 
 
+/** Add up the weights of all criteria in a single pass over the
+ *  image, so that the image, the neighborhood-based criteria, and the
+ *  result are each read only once.  Exposure and saturation are
+ *  computed right from the pixel; contrast and entropy come from the
+ *  images grad and entropy.  A criterion is skipped if its functor or
+ *  image is nullptr or, for saturation, if its weight is zero.
+ *  Without exposure the sum starts from the current result.  The
+ *  rows are processed in parallel.
+ */
+template <typename SrcIterator, typename SrcAccessor,
+          typename MaskIterator, typename MaskAccessor,
+          typename DestIterator, typename DestAccessor,
+          typename ExposureFunctorType, typename GradImageType, typename EntropyImageType>
+void
+accumulateWeightsIf(vigra::triple<SrcIterator, SrcIterator, SrcAccessor> src,
+                    vigra::pair<MaskIterator, MaskAccessor> mask,
+                    vigra::pair<DestIterator, DestAccessor> result,
+                    const ExposureFunctorType* exposure,
+                    const GradImageType* grad,
+                    const EntropyImageType* entropy)
+{
+    typedef typename SrcAccessor::value_type ImageValueType;
+    typedef typename EntropyImageType::value_type PixelType;
+    typedef typename vigra::NumericTraits<PixelType>::ValueType ScalarType;
+    typedef typename GradImageType::value_type LongScalarType;
+    typedef typename DestAccessor::value_type MaskValueType;
+
+    const ContrastFunctor<LongScalarType, ScalarType, MaskValueType> cf(WContrast);
+    const SaturationFunctor<ImageValueType, MaskValueType> sf(WSaturation);
+    const EntropyFunctor<PixelType, MaskValueType> ef(WEntropy);
+    const bool saturation = WSaturation > 0.0;
+    const vigra::Diff2D size(src.second - src.first);
+
+#ifdef OPENMP
+#pragma omp parallel for schedule(guided)
+#endif
+    for (int y = 0; y < size.y; ++y)
+    {
+        SrcIterator srcX(src.first + vigra::Diff2D(0, y));
+        MaskIterator maskX(mask.first + vigra::Diff2D(0, y));
+        DestIterator destX(result.first + vigra::Diff2D(0, y));
+
+        for (int x = 0; x < size.x; ++x, ++srcX.x, ++maskX.x, ++destX.x)
+        {
+            if (!mask.second(maskX))
+            {
+                continue;
+            }
+
+            const ImageValueType pixel(src.third(srcX));
+            MaskValueType weight = exposure != nullptr ? (*exposure)(pixel) : result.second(destX);
+            if (grad != nullptr)
+            {
+                weight = cf(static_cast<ScalarType>((*grad)(x, y))) + weight;
+            }
+            if (saturation)
+            {
+                weight = sf(pixel) + weight;
+            }
+            if (entropy != nullptr)
+            {
+                weight = ef((*entropy)(x, y)) + weight;
+            }
+            result.second.set(weight, destX);
+        }
+    }
+}
+
+
+/** Normalize the soft mask @p mask by the sum of all masks @p
+ *  normImage and scale it to the range expected by the mask pyramid.
+ *  Pixels, which no image covers, get the same share of all @p
+ *  totalImages images.
+ */
+template <typename MaskType>
+void
+normalizeMask(MaskType& mask, const MaskType& normImage,
+              typename MaskType::value_type maxMaskPixel, int totalImages)
+{
+    vigra::omp::combineTwoImages(srcImageRange(mask),
+                                 srcImage(normImage),
+                                 destImage(mask),
+                                 ifThenElse(Arg2() > Param(0.0),
+                                            Param(maxMaskPixel) * Arg1() / Arg2(),
+                                            Param(maxMaskPixel / totalImages)));
+}
+
+
 template <typename ImageType, typename AlphaType, typename MaskType>
 void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename ImageType::const_traverser, typename ImageType::ConstAccessor> src,
                 vigra::pair<typename AlphaType::const_traverser, typename AlphaType::ConstAccessor> mask,
@@ -965,54 +1364,21 @@ void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename Imag
     typedef typename ImageType::PixelType PixelType;
     typedef typename vigra::NumericTraits<PixelType>::ValueType ScalarType;
     typedef typename MaskType::value_type MaskValueType;
+    typedef typename vigra::NumericTraits<ScalarType>::Promote LongScalarType;
+    typedef IMAGETYPE<LongScalarType> GradImage;
+    typedef IMAGETYPE<PixelType> EntropyImage;
 
-    const typename ImageType::difference_type imageSize = src.second - src.first;
-
-    // Exposure
-    if (WExposure > 0.0) {
-        typedef MultiGrayscaleAccessor<ImageValueType, ScalarType> MultiGrayAcc;
-        MultiGrayAcc ga(GrayscaleProjector);
+    // The criteria, which need the neighborhood of a pixel, go into
+    // images of their own.  The pointwise criteria are computed and
+    // all weights are added up in a single pass afterwards.
+    std::unique_ptr<GradImage> grad;
+    std::unique_ptr<EntropyImage> entropy;
 
-        if (ExposureLowerCutoff.is_effective<ScalarType>() ||
-            ExposureUpperCutoff.is_effective<ScalarType>()) {
-            MultiGrayAcc lca(ExposureLowerCutoffGrayscaleProjector.empty() ?
-                             GrayscaleProjector :
-                             ExposureLowerCutoffGrayscaleProjector);
-            MultiGrayAcc uca(ExposureUpperCutoffGrayscaleProjector.empty() ?
-                             ExposureLowerCutoffGrayscaleProjector :
-                             ExposureUpperCutoffGrayscaleProjector);
-            CutoffExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>
-                cef(WExposure, ExposureWeightFunction, ga,
-                    ExposureLowerCutoff, ExposureUpperCutoff, lca, uca);
-#ifdef DEBUG_EXPOSURE
-            std::cout << "+ enfuseMask: cutoff - GrayscaleProjector = <" <<
-                GrayscaleProjector << ">\n" <<
-                "+ enfuseMask: ExposureLowerCutoffGrayscaleProjector = <" <<
-                ExposureLowerCutoffGrayscaleProjector << ">, cutoff spec = " << ExposureLowerCutoff.str() <<
-                ", actual cutoff = " << static_cast<double>(ExposureLowerCutoff.instantiate<ScalarType>()) <<
-                "\n+ enfuseMask: ExposureUpperCutoffGrayscaleProjector = <" <<
-                ExposureUpperCutoffGrayscaleProjector << ">, cutoff spec = " << ExposureUpperCutoff.str() <<
-                ", actual cutoff = " << static_cast<double>(ExposureUpperCutoff.instantiate<ScalarType>()) <<
-                "\n";
-#endif
-            vigra::omp::transformImageIf(src, mask, result, cef);
-        } else {
-            ExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>
-                ef(WExposure, ExposureWeightFunction, ga);
-#ifdef DEBUG_EXPOSURE
-            std::cout << "+ enfuseMask: plain - GrayscaleProjector = <" <<
-                GrayscaleProjector << ">\n";
-#endif
-            vigra::omp::transformImageIf(src, mask, result, ef);
-        }
-    }
+    const typename ImageType::difference_type imageSize = src.second - src.first;
 
     // Contrast
     if (WContrast > 0.0) {
-        typedef typename vigra::NumericTraits<ScalarType>::Promote LongScalarType;
-        typedef IMAGETYPE<LongScalarType> GradImage;
-
-        GradImage grad(imageSize);
+        grad.reset(new GradImage(imageSize));
         MultiGrayscaleAccessor<PixelType, LongScalarType> ga(GrayscaleProjector);
 
         if (FilterConfig.edgeScale > 0.0)
@@ -1062,7 +1428,7 @@ void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename Imag
 #endif
                 vigra::omp::transformImageIf(laplacian.upperLeft(), laplacian.lowerRight(), laplacian.accessor(),
                                              mask.first, mask.second,
-                                             grad.upperLeft(), grad.accessor(),
+                                             grad->upperLeft(), grad->accessor(),
                                              ClampingFunctor<LongScalarType, LongScalarType>
                                              (static_cast<LongScalarType>(-minCurve), LongScalarType(),
                                               vigra::NumericTraits<LongScalarType>::max(), vigra::NumericTraits<LongScalarType>::max()));
@@ -1082,7 +1448,7 @@ void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename Imag
                 vigra::omp::combineTwoImagesIf(laplacian.upperLeft(), laplacian.lowerRight(), laplacian.accessor(),
                                                localContrast.upperLeft(), localContrast.accessor(),
                                                mask.first, mask.second,
-                                               grad.upperLeft(), grad.accessor(),
+                                               grad->upperLeft(), grad->accessor(),
                                                FillInFunctor<LongScalarType, LongScalarType>
                                                (static_cast<LongScalarType>(minCurve), // threshold
                                                 1.0, // scale factor for "laplacian"
@@ -1096,49 +1462,23 @@ void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename Imag
 #endif
             localStdDevIf(src.first, src.second, ga,
                           mask.first, mask.second,
-                          grad.upperLeft(), grad.accessor(),
+                          grad->upperLeft(), grad->accessor(),
                           vigra::Size2D(ContrastWindowSize, ContrastWindowSize));
         }
 
 #ifdef DEBUG_LOG
         {
             vigra::FindMinMax<LongScalarType> minmax;
-            vigra::inspectImage(srcImageRange(grad), minmax);
+            vigra::inspectImage(srcImageRange(*grad), minmax);
             std::cout << "+ final grad: min = " << minmax.min << ", max = " << minmax.max << std::endl;
         }
-#endif
-        ContrastFunctor<LongScalarType, ScalarType, MaskValueType> cf(WContrast);
-#if defined(__clang__)
-        vigra::omp::combineTwoImagesIf(srcImageRange(grad), result, mask, result,
-                                       std::bind(std::plus<MaskValueType>(),
-                                                 std::bind(cf, std::placeholders::_1),
-                                                 std::placeholders::_2));
-#else
-        vigra::omp::combineTwoImagesIf(srcImageRange(grad), result, mask, result,
-                                       [&cf](ScalarType x, const MaskValueType& y) {return cf(x) + y;});
-#endif
-    }
-
-    // Saturation
-    if (WSaturation > 0.0) {
-        SaturationFunctor<ImageValueType, MaskValueType> sf(WSaturation);
-#if defined(__clang__)
-        vigra::omp::combineTwoImagesIf(src, result, mask, result,
-                                       std::bind(std::plus<MaskValueType>(),
-                                                 std::bind(sf, std::placeholders::_1),
-                                                 std::placeholders::_2));
-#else
-        vigra::omp::combineTwoImagesIf(src, result, mask, result,
-                                       [&sf](ImageValueType x, const MaskValueType& y) {return sf(x) + y;});
 #endif
     }
 
     // Entropy
     if (WEntropy > 0.0) {
-        typedef typename ImageType::PixelType PixelType;
-        typedef typename vigra::NumericTraits<PixelType>::ValueType ScalarType;
         typedef IMAGETYPE<PixelType> Image;
-        Image entropy(imageSize);
+        entropy.reset(new EntropyImage(imageSize));
 
         if (EntropyLowerCutoff.is_effective<ScalarType>() || EntropyUpperCutoff.is_effective<ScalarType>())
         {
@@ -1185,27 +1525,59 @@ void enfuseMask(vigra::triple<typename ImageType::const_traverser, typename Imag
                                        cf);
             localEntropyIf(trunc.upperLeft(), trunc.lowerRight(), trunc.accessor(),
                            mask.first, mask.second,
-                           entropy.upperLeft(), entropy.accessor(),
+                           entropy->upperLeft(), entropy->accessor(),
                            vigra::Size2D(EntropyWindowSize, EntropyWindowSize));
         }
         else
         {
             localEntropyIf(src.first, src.second, src.third,
                            mask.first, mask.second,
-                           entropy.upperLeft(), entropy.accessor(),
+                           entropy->upperLeft(), entropy->accessor(),
                            vigra::Size2D(EntropyWindowSize, EntropyWindowSize));
         }
+    }
 
-        EntropyFunctor<PixelType, MaskValueType> ef(WEntropy);
-#if defined(__clang__)
-        vigra::omp::combineTwoImagesIf(srcImageRange(entropy), result, mask, result,
-                                       std::bind(std::plus<MaskValueType>(),
-                                                 std::bind(ef, std::placeholders::_1),
-                                                 std::placeholders::_2));
-#else
-        vigra::omp::combineTwoImagesIf(srcImageRange(entropy), result, mask, result,
-                                       [&ef](PixelType x, const MaskValueType& y) {return ef(x) + y;});
+    // Exposure, saturation, and sum of all weights
+    typedef MultiGrayscaleAccessor<ImageValueType, ScalarType> MultiGrayAcc;
+    if (WExposure > 0.0) {
+        MultiGrayAcc ga(GrayscaleProjector);
+
+        if (ExposureLowerCutoff.is_effective<ScalarType>() ||
+            ExposureUpperCutoff.is_effective<ScalarType>()) {
+            MultiGrayAcc lca(ExposureLowerCutoffGrayscaleProjector.empty() ?
+                             GrayscaleProjector :
+                             ExposureLowerCutoffGrayscaleProjector);
+            MultiGrayAcc uca(ExposureUpperCutoffGrayscaleProjector.empty() ?
+                             ExposureLowerCutoffGrayscaleProjector :
+                             ExposureUpperCutoffGrayscaleProjector);
+            CutoffExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>
+                cef(WExposure, ExposureWeightFunction, ga,
+                    ExposureLowerCutoff, ExposureUpperCutoff, lca, uca);
+#ifdef DEBUG_EXPOSURE
+            std::cout << "+ enfuseMask: cutoff - GrayscaleProjector = <" <<
+                GrayscaleProjector << ">\n" <<
+                "+ enfuseMask: ExposureLowerCutoffGrayscaleProjector = <" <<
+                ExposureLowerCutoffGrayscaleProjector << ">, cutoff spec = " << ExposureLowerCutoff.str() <<
+                ", actual cutoff = " << static_cast<double>(ExposureLowerCutoff.instantiate<ScalarType>()) <<
+                "\n+ enfuseMask: ExposureUpperCutoffGrayscaleProjector = <" <<
+                ExposureUpperCutoffGrayscaleProjector << ">, cutoff spec = " << ExposureUpperCutoff.str() <<
+                ", actual cutoff = " << static_cast<double>(ExposureUpperCutoff.instantiate<ScalarType>()) <<
+                "\n";
 #endif
+            accumulateWeightsIf(src, mask, result, &cef, grad.get(), entropy.get());
+        } else {
+            ExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>
+                ef(WExposure, ExposureWeightFunction, ga);
+#ifdef DEBUG_EXPOSURE
+            std::cout << "+ enfuseMask: plain - GrayscaleProjector = <" <<
+                GrayscaleProjector << ">\n";
+#endif
+            accumulateWeightsIf(src, mask, result, &ef, grad.get(), entropy.get());
+        }
+    } else {
+        accumulateWeightsIf(src, mask, result,
+                            static_cast<ExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>*>(nullptr),
+                            grad.get(), entropy.get());
     }
 };
 
@@ -1470,11 +1842,89 @@ void enfuseMain(const FileNameList& anInputFileNameList,
 
     std::vector<ImagePyramidType*> *resultLP = nullptr;
 
+    // With strip pyramids all pyramids live in temporary files and
+    // are processed in strips of pyramidStripHeight() rows.
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    std::vector<StripImage<ImagePyramidType>*> *stripResultLP = nullptr;
+
     m = 0;
     while (!imageList.empty()) {
         vigra::triple<ImageType*, AlphaType*, MaskType*> imageTriple = imageList.front();
         imageList.erase(imageList.begin());
 
+        if (stripHeight > 0) {
+            std::vector<StripImage<ImagePyramidType>*> *imageLP =
+                laplacianStripPyramid<ImageType, AlphaType, ImagePyramidType,
+                                      ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>(numLevels, WrapAround != OpenBoundaries,
+                                                                                  srcImageRange(*(imageTriple.first)),
+                                                                                  maskImage(*(imageTriple.second)));
+
+            delete imageTriple.first;
+            delete imageTriple.second;
+
+            if (!UseHardMask) {
+                normalizeMask(*(imageTriple.third), *normImage, maxMaskPixelType, totalImages);
+            }
+
+            std::vector<StripImage<MaskPyramidType>*> *maskGP =
+                gaussianStripPyramid<MaskType, AlphaType, MaskPyramidType,
+                                     MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                     SKIPSMMaskPixelType, SKIPSMAlphaPixelType>
+                (numLevels,
+                 WrapAround != OpenBoundaries,
+                 srcImageRange(*(imageTriple.third)),
+                 maskImage(*(outputPair.second)));
+
+            delete imageTriple.third;
+
+            ConvertScalarToPyramidFunctor<typename EnblendNumericTraits<ImagePixelType>::MaskPixelType,
+                MaskPyramidPixelType,
+                MaskPyramidIntegerBits,
+                MaskPyramidFractionBits> maskConvertFunctor;
+            MaskPyramidPixelType maxMaskPyramidPixelValue = maskConvertFunctor(maxMaskPixelType);
+
+            // Multiply image lp with the mask gp and add it to the
+            // result lp, or make it the result lp if there is none yet.
+            ImagePyramidType imageStrip;
+            MaskPyramidType maskStrip;
+            ImagePyramidType resultStrip;
+            for (unsigned int i = 0; i < maskGP->size(); ++i) {
+                const int h = (*maskGP)[i]->height();
+                for (int y0 = 0; y0 < h; y0 += stripHeight) {
+                    const int y1 = std::min(h, y0 + stripHeight);
+
+                    (*imageLP)[i]->read(y0, y1, imageStrip);
+                    (*maskGP)[i]->read(y0, y1, maskStrip);
+                    vigra::omp::combineTwoImages(srcImageRange(imageStrip),
+                                                 srcImage(maskStrip),
+                                                 destImage(imageStrip),
+                                                 ImageMaskMultiplyFunctor<MaskPyramidPixelType>(maxMaskPyramidPixelValue));
+
+                    if (stripResultLP != nullptr) {
+                        (*stripResultLP)[i]->read(y0, y1, resultStrip);
+                        vigra::omp::combineTwoImages(srcImageRange(imageStrip),
+                                                     srcImage(resultStrip),
+                                                     destImage(resultStrip),
+                                                     Arg1() + Arg2());
+                        (*stripResultLP)[i]->write(y0, resultStrip, 0, y1 - y0);
+                    } else {
+                        (*imageLP)[i]->write(y0, imageStrip, 0, y1 - y0);
+                    }
+                }
+            }
+            deleteStripPyramid(maskGP);
+
+            if (stripResultLP != nullptr) {
+                deleteStripPyramid(imageLP);
+            } else {
+                stripResultLP = imageLP;
+            }
+
+            ++m;
+            continue;
+        }
+
         std::ostringstream oss0;
         oss0 << "imageGP" << m << "_";
 
@@ -1499,12 +1949,7 @@ void enfuseMain(const FileNameList& anInputFileNameList,
         if (!UseHardMask) {
             // Normalize the mask coefficients.
             // Scale to the range expected by the MaskPyramidPixelType.
-            vigra::omp::combineTwoImages(srcImageRange(*(imageTriple.third)),
-                                         srcImage(*normImage),
-                                         destImage(*(imageTriple.third)),
-                                         ifThenElse(Arg2() > Param(0.0),
-                                                    Param(maxMaskPixelType) * Arg1() / Arg2(),
-                                                    Param(maxMaskPixelType / totalImages)));
+            normalizeMask(*(imageTriple.third), *normImage, maxMaskPixelType, totalImages);
         }
 
         // maskGP is constructed using the union of the input alpha channels
@@ -1569,6 +2014,26 @@ void enfuseMain(const FileNameList& anInputFileNameList,
 
     delete normImage;
 
+    if (stripResultLP != nullptr) {
+        collapseStripPyramid<SKIPSMImagePixelType>(WrapAround != OpenBoundaries, stripResultLP);
+
+        outputPair.first = new ImageType(anInputUnion.size());
+
+        copyFromStripPyramidImageIf<ImagePyramidType, AlphaType, ImageType,
+                                    ImagePyramidIntegerBits, ImagePyramidFractionBits>
+            ((*stripResultLP)[0],
+             maskImage(*(outputPair.second)),
+             destImage(*(outputPair.first)));
+
+        deleteStripPyramid(stripResultLP);
+
+        checkpoint(outputPair, anOutputImageInfo);
+
+        delete outputPair.first;
+        delete outputPair.second;
+        return;
+    }
+
     //exportPyramid<ImagePyramidType>(resultLP, "resultLP");
 
     collapsePyramid<SKIPSMImagePixelType>(WrapAround != OpenBoundaries, resultLP);
@@ -49,6 +49,12 @@
 
 #define OPENMP_PRAGMA(m_token_sequence) _Pragma(#m_token_sequence)
 
+#if _OPENMP >= 201307 // OpenMP version 4.0
+#define OPENMP_SIMD OPENMP_PRAGMA(omp simd)
+#else
+#define OPENMP_SIMD
+#endif
+
 
 namespace omp
 {
@@ -91,6 +97,7 @@ namespace omp
 #define OPENMP_MONTH 0
 
 #define OPENMP_PRAGMA(m_token_sequence)
+#define OPENMP_SIMD
 
 inline void omp_set_num_threads(int) {}
 inline int omp_get_num_threads() {return 1;}
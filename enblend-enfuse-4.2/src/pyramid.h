@@ -25,10 +25,22 @@
 #include <config.h>
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <string>
 #include <vector>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <vigra/basicimage.hxx>
 #include <vigra/convolution.hxx>
+#include <vigra/copyimage.hxx>
 #include <vigra/error.hxx>
 #include <vigra/inspectimage.hxx>
 #include <vigra/numerictraits.hxx>
@@ -37,6 +49,8 @@
 #include <vigra/transformimage.hxx>
 
 #include "fixmath.h"
+#include "openmp_def.h"
+#include "parameter.h"
 
 
 namespace enblend
@@ -71,6 +85,37 @@ filterHalfWidth(const unsigned int levels)
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+/** Number of additional rows processed above and below a band of
+ *  rows.  They cover the support of the reduce and expand filters,
+ *  so the rows of a band come out exactly as if the whole image had
+ *  been processed at once. */
+const int PyramidHalo = 4;
+
+
+/** Return the number of bands of rows, which reduce() and expand()
+ *  process in parallel for a destination image of the given height.
+ *  A band must be considerably higher than the halo around it to pay
+ *  for the rows processed twice. */
+inline int
+numberOfPyramidBands(int height)
+{
+#ifdef OPENMP
+    if (omp_in_parallel()) {
+        return 1;
+    }
+
+    const int minimumBandHeight =
+        std::max(2 * PyramidHalo,
+                 static_cast<int>(parameter::as_unsigned("pyramid-minimum-band-height", 64U))); //< pyramid-minimum-band-height 64
+
+    return std::max(1, std::min(omp_get_max_threads(), height / minimumBandHeight));
+#else
+    (void) height;
+    return 1;
+#endif
+}
+
+
 /** This version is for images with alpha channels.
  *  Gaussian blur, downsampling, and extrapolation in one pass over
  *  the input image using SKIPSM-based algorithm.
@@ -205,6 +250,10 @@ reduce(bool wraparound,
     SKIPSMAlphaPixelType* asc1 = new SKIPSMAlphaPixelType[dst_w + 1];
     SKIPSMAlphaPixelType* ascp = new SKIPSMAlphaPixelType[dst_w + 1];
 
+    // Row filtered values of the current row
+    SKIPSMImagePixelType* ihr = new SKIPSMImagePixelType[dst_w + 1];
+    SKIPSMAlphaPixelType* ahr = new SKIPSMAlphaPixelType[dst_w + 1];
+
     // Convenient constants
     const SKIPSMImagePixelType SKIPSMImageZero(vigra::NumericTraits<SKIPSMImagePixelType>::zero());
     const SKIPSMAlphaPixelType SKIPSMAlphaZero(vigra::NumericTraits<SKIPSMAlphaPixelType>::zero());
@@ -352,38 +401,20 @@ reduce(bool wraparound,
                 // isc*[0] are never used
                 ++sx.x;
                 ++ax.x;
-                dx = dy;
-                dax = day;
 
-                // Main entries in row
+                // Main entries in row.  The row filter carries its
+                // state from pixel to pixel, so this loop only stores
+                // the filtered values of the row in ihr and ahr.
                 for (evenX = false, srcx = 1, dstx = 0; srcx < src_w; ++srcx, ++sx.x, ++ax.x) {
                     SKIPSMAlphaPixelType mcurrent(aa(ax) ? SKIPSMAlphaOne : SKIPSMAlphaZero);
                     SKIPSMImagePixelType icurrent(aa(ax) ? SKIPSMImagePixelType(sa(sx)) : SKIPSMImageZero);
                     if (evenX) {
-                        SKIPSMAlphaPixelType ap = asc1[dstx] + amul6(asc0[dstx]) + ascp[dstx];
-                        asc1[dstx] = asc0[dstx] + ascp[dstx];
-                        asc0[dstx] = asr1 + amul6(asr0) + asrp + mcurrent;
+                        ahr[dstx] = asr1 + amul6(asr0) + asrp + mcurrent;
                         asr1 = asr0 + asrp;
                         asr0 = mcurrent;
-                        ap += asc0[dstx];
-
-                        SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                        isc1[dstx] = isc0[dstx] + iscp[dstx];
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp + icurrent;
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp + icurrent;
                         isr1 = isr0 + isrp;
                         isr0 = icurrent;
-                        if (ap) {
-                            ip += isc0[dstx]; // OVERFLOW!!!
-                            ip /= SKIPSMImagePixelType(ap);
-                            da.set(DestPixelType(ip), dx);
-                            daa.set(DestAlphaMax, dax);
-                        } else {
-                            da.set(DestImageZero, dx);
-                            daa.set(DestAlphaZero, dax);
-                        }
-
-                        ++dx.x;
-                        ++dax.x;
                     } else {
                         asrp = mcurrent * 4;
                         isrp = icurrent * 4;
@@ -396,59 +427,54 @@ reduce(bool wraparound,
                 if (!evenX) {
                     // previous srcx was even
                     ++dstx;
-
-                    SKIPSMAlphaPixelType ap = asc1[dstx] + amul6(asc0[dstx]) + ascp[dstx];
-                    asc1[dstx] = asc0[dstx] + ascp[dstx];
                     if (wraparound) {
-                        asc0[dstx] = asr1 + amul6(asr0) + (aa(ay) ? (SKIPSMAlphaOne * 4) : SKIPSMAlphaZero) + (aa(ay, vigra::Diff2D(1,0)) ? SKIPSMAlphaOne : SKIPSMAlphaZero);
-                    } else {
-                        asc0[dstx] = asr1 + amul6(asr0);
-                    }
-                    ap += asc0[dstx];
-
-                    SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                    isc1[dstx] = isc0[dstx] + iscp[dstx];
-                    if (wraparound) {
-                        isc0[dstx] =
+                        ahr[dstx] = asr1 + amul6(asr0) + (aa(ay) ? (SKIPSMAlphaOne * 4) : SKIPSMAlphaZero) + (aa(ay, vigra::Diff2D(1,0)) ? SKIPSMAlphaOne : SKIPSMAlphaZero);
+                        ihr[dstx] =
                             isr1 + imul6(isr0) +
                             (aa(ay) ?
                              vigra::NumericTraits<SKIPSMImagePixelType>::fromRealPromote(SKIPSMImagePixelType(sa(sy)) * 4) :
                              SKIPSMImageZero) +
                             (aa(ay, vigra::Diff2D(1, 0)) ? SKIPSMImagePixelType(sa(sy, vigra::Diff2D(1, 0))) : SKIPSMImageZero);
                     } else {
-                        isc0[dstx] = isr1 + imul6(isr0);
-                    }
-                    if (ap) {
-                        ip += isc0[dstx];
-                        ip /= SKIPSMImagePixelType(ap);
-                        da.set(DestPixelType(ip), dx);
-                        daa.set(DestAlphaMax, dax);
-                    } else {
-                        da.set(DestImageZero, dx);
-                        daa.set(DestAlphaZero, dax);
+                        ahr[dstx] = asr1 + amul6(asr0);
+                        ihr[dstx] = isr1 + imul6(isr0);
                     }
                 } else {
                     // Previous srcx was odd
-                    SKIPSMAlphaPixelType ap = asc1[dstx] + amul6(asc0[dstx]) + ascp[dstx];
-                    asc1[dstx] = asc0[dstx] + ascp[dstx];
                     if (wraparound) {
-                        asc0[dstx] = asr1 + amul6(asr0) + asrp + (aa(ay) ? SKIPSMAlphaOne : SKIPSMAlphaZero);
+                        ahr[dstx] = asr1 + amul6(asr0) + asrp + (aa(ay) ? SKIPSMAlphaOne : SKIPSMAlphaZero);
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp + (aa(ay) ? SKIPSMImagePixelType(sa(sy)) : SKIPSMImageZero);
                     } else {
-                        asc0[dstx] = asr1 + amul6(asr0) + asrp;
+                        ahr[dstx] = asr1 + amul6(asr0) + asrp;
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp;
                     }
-                    ap += asc0[dstx];
+                }
 
-                    SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                    isc1[dstx] = isc0[dstx] + iscp[dstx];
-                    if (wraparound) {
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp + (aa(ay) ? SKIPSMImagePixelType(sa(sy)) : SKIPSMImageZero);
-                    } else {
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp;
-                    }
-                    if (ap) {
-                        ip += isc0[dstx];
-                        ip /= SKIPSMImagePixelType(ap);
-                        da.set(DestPixelType(ip), dx);
+                // The column filter is independent for each column,
+                // so it runs as a vectorized loop over the row.  The
+                // results replace the row values in ihr and ahr.
+                OPENMP_SIMD
+                for (int x = 1; x < dst_w + 1; ++x) {
+                    SKIPSMAlphaPixelType ap = asc1[x] + amul6(asc0[x]) + ascp[x];
+                    asc1[x] = asc0[x] + ascp[x];
+                    asc0[x] = ahr[x];
+                    ap += asc0[x];
+
+                    SKIPSMImagePixelType ip = isc1[x] + imul6(isc0[x]) + iscp[x];
+                    isc1[x] = isc0[x] + iscp[x];
+                    isc0[x] = ihr[x];
+                    ip += isc0[x]; // OVERFLOW!!!
+                    // ap is either zero, where ip is not used, or at
+                    // least one.  Unlike a branch, std::max() keeps
+                    // the loop vectorizable.
+                    ip /= SKIPSMImagePixelType(std::max(ap, SKIPSMAlphaOne));
+                    ihr[x] = ip;
+                    ahr[x] = ap;
+                }
+
+                for (dstx = 1, dx = dy, dax = day; dstx < dst_w + 1; ++dstx, ++dx.x, ++dax.x) {
+                    if (ahr[dstx]) {
+                        da.set(DestPixelType(ihr[dstx]), dx);
                         daa.set(DestAlphaMax, dax);
                     } else {
                         da.set(DestImageZero, dx);
@@ -570,6 +596,91 @@ reduce(bool wraparound,
     delete [] asc0;
     delete [] asc1;
     delete [] ascp;
+
+    delete [] ihr;
+    delete [] ahr;
+}
+
+
+/** Run the Reduce operation for images with alpha channels in
+ *  parallel on horizontal bands of the destination image.
+ *
+ *  Each band is reduced, together with PyramidHalo rows above and
+ *  below it, into a buffer of its own, so the SKIPSM state never
+ *  crosses a band boundary.  Only the rows of the band proper are
+ *  copied into the destination.  Wraparound only concerns the left
+ *  and right edges, which every band contains completely.
+ */
+template <typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType,
+          typename SrcImageIterator, typename SrcAccessor,
+          typename AlphaIterator, typename AlphaAccessor,
+          typename DestImageIterator, typename DestAccessor,
+          typename DestAlphaIterator, typename DestAlphaAccessor>
+void
+reduceInBands(bool wraparound,
+              SrcImageIterator src_upperleft,
+              SrcImageIterator src_lowerright,
+              SrcAccessor sa,
+              AlphaIterator alpha_upperleft,
+              AlphaAccessor aa,
+              DestImageIterator dest_upperleft,
+              DestImageIterator dest_lowerright,
+              DestAccessor da,
+              DestAlphaIterator dest_alpha_upperleft,
+              DestAlphaIterator dest_alpha_lowerright,
+              DestAlphaAccessor daa)
+{
+    typedef vigra::BasicImage<typename DestAccessor::value_type> BandImageType;
+    typedef vigra::BasicImage<typename DestAlphaAccessor::value_type> BandAlphaType;
+
+    const int src_w = src_lowerright.x - src_upperleft.x;
+    const int src_h = src_lowerright.y - src_upperleft.y;
+    const int dst_w = dest_lowerright.x - dest_upperleft.x;
+    const int dst_h = dest_lowerright.y - dest_upperleft.y;
+    const int bands = numberOfPyramidBands(dst_h);
+
+    if (bands <= 1) {
+        reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>(wraparound,
+                                                           src_upperleft, src_lowerright, sa,
+                                                           alpha_upperleft, aa,
+                                                           dest_upperleft, dest_lowerright, da,
+                                                           dest_alpha_upperleft, dest_alpha_lowerright, daa);
+        return;
+    }
+
+#ifdef OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int band = 0; band < bands; ++band) {
+        const int y0 = dst_h * band / bands;
+        const int y1 = dst_h * (band + 1) / bands;
+        const int c0 = std::max(0, y0 - PyramidHalo);
+        const int c1 = std::min(dst_h, y1 + PyramidHalo);
+        const int p0 = 2 * c0;
+        const int p1 = std::min(src_h, 2 * c1);
+
+        BandImageType bandImage(dst_w, c1 - c0);
+        BandAlphaType bandAlpha(dst_w, c1 - c0);
+
+        reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>(wraparound,
+                                                           src_upperleft + vigra::Diff2D(0, p0),
+                                                           src_upperleft + vigra::Diff2D(src_w, p1),
+                                                           sa,
+                                                           alpha_upperleft + vigra::Diff2D(0, p0), aa,
+                                                           bandImage.upperLeft(), bandImage.lowerRight(),
+                                                           bandImage.accessor(),
+                                                           bandAlpha.upperLeft(), bandAlpha.lowerRight(),
+                                                           bandAlpha.accessor());
+
+        vigra::copyImage(bandImage.upperLeft() + vigra::Diff2D(0, y0 - c0),
+                         bandImage.upperLeft() + vigra::Diff2D(dst_w, y1 - c0),
+                         bandImage.accessor(),
+                         dest_upperleft + vigra::Diff2D(0, y0), da);
+        vigra::copyImage(bandAlpha.upperLeft() + vigra::Diff2D(0, y0 - c0),
+                         bandAlpha.upperLeft() + vigra::Diff2D(dst_w, y1 - c0),
+                         bandAlpha.accessor(),
+                         dest_alpha_upperleft + vigra::Diff2D(0, y0), daa);
+    }
 }
 
 
@@ -586,11 +697,11 @@ reduce(bool wraparound,
        vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest,
        vigra::triple<DestAlphaIterator, DestAlphaIterator, DestAlphaAccessor> destMask)
 {
-    reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>(wraparound,
-                                                       src.first, src.second, src.third,
-                                                       mask.first, mask.second,
-                                                       dest.first, dest.second, dest.third,
-                                                       destMask.first, destMask.second, destMask.third);
+    reduceInBands<SKIPSMImagePixelType, SKIPSMAlphaPixelType>(wraparound,
+                                                              src.first, src.second, src.third,
+                                                              mask.first, mask.second,
+                                                              dest.first, dest.second, dest.third,
+                                                              destMask.first, destMask.second, destMask.third);
 };
 
 
@@ -626,6 +737,9 @@ reduce(bool wraparound,
     SKIPSMImagePixelType* isc1 = new SKIPSMImagePixelType[dst_w + 1];
     SKIPSMImagePixelType* iscp = new SKIPSMImagePixelType[dst_w + 1];
 
+    // Row filtered values of the current row
+    SKIPSMImagePixelType* ihr = new SKIPSMImagePixelType[dst_w + 1];
+
     // Convenient constants
     const SKIPSMImagePixelType SKIPSMImageZero(vigra::NumericTraits<SKIPSMImagePixelType>::zero());
 
@@ -717,21 +831,16 @@ reduce(bool wraparound,
                 isr0 = SKIPSMImagePixelType(sa(sx));
                 // isc*[0] are never used
                 ++sx.x;
-                dx = dy;
 
-                // Main entries in row
+                // Main entries in row.  The row filter carries its
+                // state from pixel to pixel, so this loop only stores
+                // the filtered values of the row in ihr.
                 for (evenX = false, srcx = 1, dstx = 0; srcx < src_w; ++srcx, ++sx.x) {
                     SKIPSMImagePixelType icurrent(SKIPSMImagePixelType(sa(sx)));
                     if (evenX) {
-                        SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                        isc1[dstx] = isc0[dstx] + iscp[dstx];
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp + icurrent;
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp + icurrent;
                         isr1 = isr0 + isrp;
                         isr0 = icurrent;
-                        ip += isc0[dstx];
-                        ip /= 256;
-                        da.set(DestPixelType(ip), dx);
-                        ++dx.x;
                     } else {
                         isrp = icurrent * 4;
                         ++dstx;
@@ -743,30 +852,36 @@ reduce(bool wraparound,
                 if (!evenX) {
                     // previous srcx was even
                     ++dstx;
-
-                    SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                    isc1[dstx] = isc0[dstx] + iscp[dstx];
                     if (wraparound) {
-                        isc0[dstx] = isr1 + imul6(isr0) + (SKIPSMImagePixelType(sa(sy)) * 4)
+                        ihr[dstx] = isr1 + imul6(isr0) + (SKIPSMImagePixelType(sa(sy)) * 4)
                             + SKIPSMImagePixelType(sa(sy, vigra::Diff2D(1, 0)));
                     } else {
-                        isc0[dstx] = isr1 + imul11(isr0);
+                        ihr[dstx] = isr1 + imul11(isr0);
                     }
-                    ip += isc0[dstx];
-                    ip /= 256;
-                    da.set(DestPixelType(ip), dx);
                 } else {
                     // Previous srcx was odd
-                    SKIPSMImagePixelType ip = isc1[dstx] + imul6(isc0[dstx]) + iscp[dstx];
-                    isc1[dstx] = isc0[dstx] + iscp[dstx];
                     if (wraparound) {
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp + SKIPSMImagePixelType(sa(sy));
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp + SKIPSMImagePixelType(sa(sy));
                     } else {
-                        isc0[dstx] = isr1 + imul6(isr0) + isrp + (isrp / 4);
+                        ihr[dstx] = isr1 + imul6(isr0) + isrp + (isrp / 4);
                     }
-                    ip += isc0[dstx];
+                }
+
+                // The column filter is independent for each column,
+                // so it runs as a vectorized loop over the row.  The
+                // results replace the row values in ihr.
+                OPENMP_SIMD
+                for (int x = 1; x < dst_w + 1; ++x) {
+                    SKIPSMImagePixelType ip = isc1[x] + imul6(isc0[x]) + iscp[x];
+                    isc1[x] = isc0[x] + iscp[x];
+                    isc0[x] = ihr[x];
+                    ip += isc0[x];
                     ip /= 256;
-                    da.set(DestPixelType(ip), dx);
+                    ihr[x] = ip;
+                }
+
+                for (dstx = 1, dx = dy; dstx < dst_w + 1; ++dstx, ++dx.x) {
+                    da.set(DestPixelType(ihr[dstx]), dx);
                 }
 
                 ++dy.y;
@@ -845,6 +960,65 @@ reduce(bool wraparound,
     delete [] isc0;
     delete [] isc1;
     delete [] iscp;
+    delete [] ihr;
+}
+
+
+/** Run the Reduce operation for images without alpha channels in
+ *  parallel on horizontal bands of the destination image.  See the
+ *  version for images with alpha channels.
+ */
+template <typename SKIPSMImagePixelType,
+          typename SrcImageIterator, typename SrcAccessor,
+          typename DestImageIterator, typename DestAccessor>
+void
+reduceInBands(bool wraparound,
+              SrcImageIterator src_upperleft,
+              SrcImageIterator src_lowerright,
+              SrcAccessor sa,
+              DestImageIterator dest_upperleft,
+              DestImageIterator dest_lowerright,
+              DestAccessor da)
+{
+    typedef vigra::BasicImage<typename DestAccessor::value_type> BandImageType;
+
+    const int src_w = src_lowerright.x - src_upperleft.x;
+    const int src_h = src_lowerright.y - src_upperleft.y;
+    const int dst_w = dest_lowerright.x - dest_upperleft.x;
+    const int dst_h = dest_lowerright.y - dest_upperleft.y;
+    const int bands = numberOfPyramidBands(dst_h);
+
+    if (bands <= 1) {
+        reduce<SKIPSMImagePixelType>(wraparound,
+                                     src_upperleft, src_lowerright, sa,
+                                     dest_upperleft, dest_lowerright, da);
+        return;
+    }
+
+#ifdef OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int band = 0; band < bands; ++band) {
+        const int y0 = dst_h * band / bands;
+        const int y1 = dst_h * (band + 1) / bands;
+        const int c0 = std::max(0, y0 - PyramidHalo);
+        const int c1 = std::min(dst_h, y1 + PyramidHalo);
+        const int p0 = 2 * c0;
+        const int p1 = std::min(src_h, 2 * c1);
+
+        BandImageType bandImage(dst_w, c1 - c0);
+
+        reduce<SKIPSMImagePixelType>(wraparound,
+                                     src_upperleft + vigra::Diff2D(0, p0),
+                                     src_upperleft + vigra::Diff2D(src_w, p1),
+                                     sa,
+                                     bandImage.upperLeft(), bandImage.lowerRight(), bandImage.accessor());
+
+        vigra::copyImage(bandImage.upperLeft() + vigra::Diff2D(0, y0 - c0),
+                         bandImage.upperLeft() + vigra::Diff2D(dst_w, y1 - c0),
+                         bandImage.accessor(),
+                         dest_upperleft + vigra::Diff2D(0, y0), da);
+    }
 }
 
 
@@ -857,9 +1031,9 @@ reduce(bool wraparound,
        vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
        vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest)
 {
-    reduce<SKIPSMImagePixelType>(wraparound,
-                                 src.first, src.second, src.third,
-                                 dest.first, dest.second, dest.third);
+    reduceInBands<SKIPSMImagePixelType>(wraparound,
+                                        src.first, src.second, src.third,
+                                        dest.first, dest.second, dest.third);
 }
 
 
@@ -1038,6 +1212,58 @@ reduce(bool wraparound,
     } while (false)
 
 
+// SKIPSM update routine used for the main columns of a row, that is
+// from the third column to the last column of the source image.  The
+// row filter carries its state from pixel to pixel and only stores
+// its values in ra and rb.  The column filter is independent for each
+// column and runs as a vectorized loop, which leaves the four outputs
+// of each source pixel in ra, rb, r01, and r11.  The last loop
+// combines them with the destination image.
+#define SKIPSM_EXPAND_MAIN_COLUMNS(SCALE_OUT00, SCALE_OUT10, SCALE_OUT01, SCALE_OUT11) \
+    do {                                                            \
+        for (srcx = 2, ++sx.x; srcx < src_w; ++srcx, ++sx.x) {      \
+            current = SKIPSMImagePixelType(sa(sx));                 \
+            ra[srcx] = sr1 + imul6(sr0) + current;                  \
+            rb[srcx] = (sr0 + current) * 4;                         \
+            sr1 = sr0;                                              \
+            sr0 = current;                                          \
+        }                                                           \
+        OPENMP_SIMD                                                 \
+        for (int x = 2; x < src_w; ++x) {                           \
+            SKIPSMImagePixelType o00 = sc1a[x] + imul6(sc0a[x]);    \
+            SKIPSMImagePixelType o10 = sc1b[x] + imul6(sc0b[x]);    \
+            SKIPSMImagePixelType o01 = sc0a[x];                     \
+            SKIPSMImagePixelType o11 = sc0b[x];                     \
+            sc1a[x] = sc0a[x];                                      \
+            sc1b[x] = sc0b[x];                                      \
+            sc0a[x] = ra[x];                                        \
+            sc0b[x] = rb[x];                                        \
+            o00 += sc0a[x];                                         \
+            o10 += sc0b[x];                                         \
+            o01 += sc0a[x];                                         \
+            o11 += sc0b[x];                                         \
+            o00 /= SKIPSMImagePixelType(SCALE_OUT00);               \
+            o10 /= SKIPSMImagePixelType(SCALE_OUT10);               \
+            o01 /= SKIPSMImagePixelType(SCALE_OUT01);               \
+            o11 /= SKIPSMImagePixelType(SCALE_OUT11);               \
+            ra[x] = o00;                                            \
+            rb[x] = o10;                                            \
+            r01[x] = o01;                                           \
+            r11[x] = o11;                                           \
+        }                                                           \
+        for (srcx = 2; srcx < src_w; ++srcx) {                      \
+            da.set(cf(SKIPSMImagePixelType(da(dx)), ra[srcx]), dx); \
+            ++dx.x;                                                 \
+            da.set(cf(SKIPSMImagePixelType(da(dx)), rb[srcx]), dx); \
+            ++dx.x;                                                 \
+            da.set(cf(SKIPSMImagePixelType(da(dxx)), r01[srcx]), dxx); \
+            ++dxx.x;                                                \
+            da.set(cf(SKIPSMImagePixelType(da(dxx)), r11[srcx]), dxx); \
+            ++dxx.x;                                                \
+        }                                                           \
+    } while (false)
+
+
 /** The Burt & Adelson Expand operation.
  *
  *  Upsampling with Gaussian interpolation in one pass over the input image using SKIPSM-based algorithm.
@@ -1130,6 +1356,12 @@ expand(bool add, bool wraparound,
     SKIPSMImagePixelType* sc1a = new SKIPSMImagePixelType[src_w + 1];
     SKIPSMImagePixelType* sc1b = new SKIPSMImagePixelType[src_w + 1];
 
+    // Row filtered values and outputs of the main columns
+    SKIPSMImagePixelType* ra = new SKIPSMImagePixelType[src_w + 1];
+    SKIPSMImagePixelType* rb = new SKIPSMImagePixelType[src_w + 1];
+    SKIPSMImagePixelType* r01 = new SKIPSMImagePixelType[src_w + 1];
+    SKIPSMImagePixelType* r11 = new SKIPSMImagePixelType[src_w + 1];
+
     // Convenient constants
     const SKIPSMImagePixelType SKIPSMImageZero(vigra::NumericTraits<SKIPSMImagePixelType>::zero());
 
@@ -1233,9 +1465,7 @@ expand(bool add, bool wraparound,
             }
 
             // Main columns
-            for (srcx = 2, ++sx.x; srcx < src_w; ++srcx, ++sx.x) {
-                SKIPSM_EXPAND(56, 56, 16, 16);
-            }
+            SKIPSM_EXPAND_MAIN_COLUMNS(56, 56, 16, 16);
 
             // extra column at end of second row
             if (wraparound) {
@@ -1300,6 +1530,11 @@ expand(bool add, bool wraparound,
         delete [] sc1a;
         delete [] sc1b;
 
+        delete [] ra;
+        delete [] rb;
+        delete [] r01;
+        delete [] r11;
+
         return;
     }
 
@@ -1345,9 +1580,7 @@ expand(bool add, bool wraparound,
             }
 
             // Main columns
-            for (srcx = 2, ++sx.x; srcx < src_w; ++srcx, ++sx.x) {
-                SKIPSM_EXPAND(64, 64, 16, 16);
-            }
+            SKIPSM_EXPAND_MAIN_COLUMNS(64, 64, 16, 16);
 
             // extra column at end of row
             if (wraparound) {
@@ -1416,6 +1649,11 @@ expand(bool add, bool wraparound,
     delete [] sc0b;
     delete [] sc1a;
     delete [] sc1b;
+
+    delete [] ra;
+    delete [] rb;
+    delete [] r01;
+    delete [] r11;
 }
 
 
@@ -1432,6 +1670,79 @@ struct FromPromotePlusFunctorWrapper :
 };
 
 
+/** Run the Expand operation in parallel on horizontal bands of the
+ *  destination image.
+ *
+ *  Expand combines every destination pixel with the expansion at the
+ *  same place only, so each band copies its own rows into a buffer,
+ *  which has PyramidHalo rows of the source image above and below,
+ *  expands into the buffer, and copies its rows back.  The halo rows
+ *  of the buffer are discarded and thus need no initialization from
+ *  the destination.
+ */
+template <typename SKIPSMImagePixelType,
+          typename SrcImageIterator, typename SrcAccessor,
+          typename DestImageIterator, typename DestAccessor,
+          typename CombineFunctor>
+void
+expandInBands(bool add, bool wraparound,
+              SrcImageIterator src_upperleft,
+              SrcImageIterator src_lowerright,
+              SrcAccessor sa,
+              DestImageIterator dest_upperleft,
+              DestImageIterator dest_lowerright,
+              DestAccessor da,
+              CombineFunctor cf)
+{
+    typedef vigra::BasicImage<typename DestAccessor::value_type> BandImageType;
+
+    const int src_w = src_lowerright.x - src_upperleft.x;
+    const int src_h = src_lowerright.y - src_upperleft.y;
+    const int dst_w = dest_lowerright.x - dest_upperleft.x;
+    const int dst_h = dest_lowerright.y - dest_upperleft.y;
+    const int bands = numberOfPyramidBands(dst_h);
+
+    if (bands <= 1) {
+        expand<SKIPSMImagePixelType>(add, wraparound,
+                                     src_upperleft, src_lowerright, sa,
+                                     dest_upperleft, dest_lowerright, da,
+                                     cf);
+        return;
+    }
+
+#ifdef OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int band = 0; band < bands; ++band) {
+        const int y0 = dst_h * band / bands;
+        const int y1 = dst_h * (band + 1) / bands;
+        const int c0 = std::max(0, y0 / 2 - PyramidHalo);
+        const int c1 = std::min(src_h, (y1 + 1) / 2 + PyramidHalo);
+        const int f0 = 2 * c0;
+        const int f1 = std::min(dst_h, 2 * c1);
+
+        BandImageType bandImage(dst_w, f1 - f0);
+
+        vigra::copyImage(dest_upperleft + vigra::Diff2D(0, y0),
+                         dest_upperleft + vigra::Diff2D(dst_w, y1),
+                         da,
+                         bandImage.upperLeft() + vigra::Diff2D(0, y0 - f0), bandImage.accessor());
+
+        expand<SKIPSMImagePixelType>(add, wraparound,
+                                     src_upperleft + vigra::Diff2D(0, c0),
+                                     src_upperleft + vigra::Diff2D(src_w, c1),
+                                     sa,
+                                     bandImage.upperLeft(), bandImage.lowerRight(), bandImage.accessor(),
+                                     cf);
+
+        vigra::copyImage(bandImage.upperLeft() + vigra::Diff2D(0, y0 - f0),
+                         bandImage.upperLeft() + vigra::Diff2D(dst_w, y1 - f0),
+                         bandImage.accessor(),
+                         dest_upperleft + vigra::Diff2D(0, y0), da);
+    }
+}
+
+
 // Version using argument object factories.
 template <typename SKIPSMImagePixelType,
           typename SrcImageIterator, typename SrcAccessor,
@@ -1444,15 +1755,15 @@ expand(bool add, bool wraparound,
     typedef typename DestAccessor::value_type DestPixelType;
 
     if (add) {
-        expand<SKIPSMImagePixelType>(add, wraparound,
-                                     src.first, src.second, src.third,
-                                     dest.first, dest.second, dest.third,
-                                     FromPromotePlusFunctorWrapper<DestPixelType, SKIPSMImagePixelType, DestPixelType>());
+        expandInBands<SKIPSMImagePixelType>(add, wraparound,
+                                            src.first, src.second, src.third,
+                                            dest.first, dest.second, dest.third,
+                                            FromPromotePlusFunctorWrapper<DestPixelType, SKIPSMImagePixelType, DestPixelType>());
     } else {
-        expand<SKIPSMImagePixelType>(add, wraparound,
-                                     src.first, src.second, src.third,
-                                     dest.first, dest.second, dest.third,
-                                     std::minus<SKIPSMImagePixelType>());
+        expandInBands<SKIPSMImagePixelType>(add, wraparound,
+                                            src.first, src.second, src.third,
+                                            dest.first, dest.second, dest.third,
+                                            std::minus<SKIPSMImagePixelType>());
     }
 }
 
@@ -1856,6 +2167,515 @@ exportPyramid(std::vector<PyramidImageType*>* v, const char* prefix)
     exportPyramid<SKIPSMImagePyramidType, PyramidImageType>(v, prefix, pyramid_is_scalar());
 }
 
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Strip Pyramids
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/** Return the height of the strips in which pyramids are built,
+ *  blended and collapsed out of core, or zero if pyramids are kept
+ *  in memory.
+ *
+ *  Strip pyramids hold each level in a temporary file and only ever
+ *  keep a few strips of consecutive rows in memory, so the memory
+ *  required for the pyramids does not depend on the image size. */
+inline unsigned int
+pyramidStripHeight()
+{
+    return parameter::as_unsigned("pyramid-strip-height", 0U); //< pyramid-strip-height 0
+}
+
+
+/** Open an anonymous temporary file in the directory named by the
+ *  environment variable TMPDIR or, if TMPDIR is unset, in "/tmp".
+ *  The file vanishes as soon as it is closed. */
+inline FILE*
+openTemporaryFile()
+{
+#ifdef _WIN32
+    FILE* file = tmpfile();
+#else
+    const char* tmpdir = getenv("TMPDIR");
+    std::string name(tmpdir != nullptr && *tmpdir != 0 ? tmpdir : "/tmp");
+    name.append("/" + command + "-XXXXXX");
+
+    std::vector<char> filename(name.begin(), name.end());
+    filename.push_back(0);
+
+    FILE* file = nullptr;
+    const int fd = mkstemp(&filename[0]);
+    if (fd != -1) {
+        unlink(&filename[0]);
+        file = fdopen(fd, "w+b");
+    }
+#endif
+
+    if (file == nullptr) {
+        std::cerr << command << ": cannot create temporary file for strip pyramid: "
+                  << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    return file;
+}
+
+
+/** An image, which lives in a temporary file and is read and written
+ *  in strips of full rows.  Rows, which have never been written, read
+ *  as zero. */
+template <typename ImageType>
+class StripImage
+{
+public:
+    typedef ImageType image_type;
+    typedef typename ImageType::value_type value_type;
+
+    StripImage(int aWidth, int aHeight) :
+        width_(aWidth), height_(aHeight), file_(openTemporaryFile())
+    {}
+
+    ~StripImage() {fclose(file_);}
+
+    int width() const {return width_;}
+    int height() const {return height_;}
+    vigra::Size2D size() const {return vigra::Size2D(width_, height_);}
+
+    /** Read rows [y0, y1) into anImage, which is resized to fit. */
+    void read(int y0, int y1, ImageType& anImage)
+    {
+        anImage.resize(width_, y1 - y0);
+        seek(y0);
+        // A short read means we hit rows past the last written
+        // one; resize() has already zeroed them.
+        const size_t count =
+            fread(anImage.data(), sizeof(value_type), static_cast<size_t>(width_) * (y1 - y0), file_);
+        (void) count;
+        clearerr(file_);
+    }
+
+    /** Write numberOfRows rows of anImage, starting at row
+     *  aFirstRow, to rows [y0, y0 + numberOfRows). */
+    void write(int y0, const ImageType& anImage, int aFirstRow, int numberOfRows)
+    {
+        seek(y0);
+        const size_t count = static_cast<size_t>(width_) * numberOfRows;
+        if (fwrite(anImage.data() + static_cast<size_t>(width_) * aFirstRow,
+                   sizeof(value_type), count, file_) != count) {
+            std::cerr << command << ": cannot write strip pyramid to temporary file: "
+                      << strerror(errno) << std::endl;
+            exit(1);
+        }
+    }
+
+private:
+    StripImage(const StripImage&) = delete;
+    StripImage& operator=(const StripImage&) = delete;
+
+    void seek(int y)
+    {
+        const long long offset = static_cast<long long>(y) * width_ * sizeof(value_type);
+#ifdef _WIN32
+        _fseeki64(file_, offset, SEEK_SET);
+#else
+        fseeko(file_, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    }
+
+    int width_;
+    int height_;
+    FILE* file_;
+};
+
+
+/** Calculate the Gaussian pyramid for the given SrcImage/AlphaImage
+ *  pair strip by strip into temporary files.  The strip version of
+ *  gaussianPyramid(); the reduced alpha channels of the levels are
+ *  kept in temporary files, too. */
+template <typename SrcImageType, typename AlphaImageType, typename PyramidImageType,
+          int PyramidIntegerBits, int PyramidFractionBits,
+          typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType>
+std::vector<StripImage<PyramidImageType>*>*
+gaussianStripPyramid(unsigned int numLevels,
+                     bool wraparound,
+                     typename SrcImageType::const_traverser src_upperleft,
+                     typename SrcImageType::const_traverser src_lowerright,
+                     typename SrcImageType::ConstAccessor sa,
+                     typename AlphaImageType::const_traverser alpha_upperleft,
+                     typename AlphaImageType::ConstAccessor aa)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    std::vector<StripImage<PyramidImageType>*>* gp = new std::vector<StripImage<PyramidImageType>*>();
+
+    // Size of pyramid level 0
+    int w = src_lowerright.x - src_upperleft.x;
+    int h = src_lowerright.y - src_upperleft.y;
+
+    // Pyramid level 0
+    StripImage<PyramidImageType>* gp0 = new StripImage<PyramidImageType>(w, h);
+    PyramidImageType strip;
+
+    // Copy src image into gp0, using fixed-point conversions.
+    for (int y0 = 0; y0 < h; y0 += stripHeight) {
+        const int y1 = std::min(h, y0 + stripHeight);
+        strip.resize(w, y1 - y0);
+        copyToPyramidImage<SrcImageType, PyramidImageType, PyramidIntegerBits, PyramidFractionBits>
+            (src_upperleft + vigra::Diff2D(0, y0), src_upperleft + vigra::Diff2D(w, y1), sa,
+             strip.upperLeft(), strip.accessor());
+        gp0->write(y0, strip, 0, y1 - y0);
+    }
+
+    gp->push_back(gp0);
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << command << ": info: generating Gaussian strip pyramid:  g0";
+    }
+
+    // Make remaining levels.
+    StripImage<PyramidImageType>* lastGP = gp0;
+    StripImage<AlphaImageType>* lastA = nullptr;
+    PyramidImageType parent;
+    AlphaImageType parentA;
+    AlphaImageType stripA;
+    for (unsigned int l = 1; l < numLevels; l++) {
+        if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+            std::cerr << " g" << l;
+            std::cerr.flush();
+        }
+
+        const int parentHeight = h;
+
+        // Size of next level
+        w = (w + 1) >> 1;
+        h = (h + 1) >> 1;
+
+        // Next pyramid level
+        StripImage<PyramidImageType>* gpn = new StripImage<PyramidImageType>(w, h);
+        StripImage<AlphaImageType>* nextA = new StripImage<AlphaImageType>(w, h);
+
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+            // Rows of this level and of the parent level including the halo.
+            const int c0 = std::max(0, y0 - PyramidHalo);
+            const int c1 = std::min(h, y1 + PyramidHalo);
+            const int p0 = 2 * c0;
+            const int p1 = std::min(parentHeight, 2 * c1);
+
+            lastGP->read(p0, p1, parent);
+            strip.resize(w, c1 - c0);
+            stripA.resize(w, c1 - c0);
+
+            if (lastA == nullptr) {
+                reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                    (wraparound,
+                     srcImageRange(parent), maskIter(alpha_upperleft + vigra::Diff2D(0, p0), aa),
+                     destImageRange(strip), destImageRange(stripA));
+            } else {
+                lastA->read(p0, p1, parentA);
+                reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+                    (wraparound,
+                     srcImageRange(parent), maskImage(parentA),
+                     destImageRange(strip), destImageRange(stripA));
+            }
+
+            gpn->write(y0, strip, y0 - c0, y1 - y0);
+            nextA->write(y0, stripA, y0 - c0, y1 - y0);
+        }
+
+        gp->push_back(gpn);
+        lastGP = gpn;
+        delete lastA;
+        lastA = nextA;
+    }
+
+    delete lastA;
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << std::endl;
+    }
+
+    return gp;
+}
+
+
+// Version using argument object factories.
+template <typename SrcImageType, typename AlphaImageType, typename PyramidImageType,
+          int PyramidIntegerBits, int PyramidFractionBits,
+          typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType>
+inline std::vector<StripImage<PyramidImageType>*>*
+gaussianStripPyramid(unsigned int numLevels,
+                     bool wraparound,
+                     vigra::triple<typename SrcImageType::const_traverser, typename SrcImageType::const_traverser, typename SrcImageType::ConstAccessor> src,
+                     vigra::pair<typename AlphaImageType::const_traverser, typename AlphaImageType::ConstAccessor> alpha)
+{
+    return gaussianStripPyramid<SrcImageType, AlphaImageType, PyramidImageType,
+                                PyramidIntegerBits, PyramidFractionBits,
+                                SKIPSMImagePixelType, SKIPSMAlphaPixelType>(numLevels, wraparound,
+                                                                            src.first, src.second, src.third,
+                                                                            alpha.first, alpha.second);
+}
+
+
+/** Calculate the Gaussian pyramid for the given image (without an
+ *  alpha channel) strip by strip into temporary files. */
+template <typename SrcImageType, typename PyramidImageType,
+          int PyramidIntegerBits, int PyramidFractionBits,
+          typename SKIPSMImagePixelType>
+std::vector<StripImage<PyramidImageType>*>*
+gaussianStripPyramid(unsigned int numLevels,
+                     bool wraparound,
+                     typename SrcImageType::const_traverser src_upperleft,
+                     typename SrcImageType::const_traverser src_lowerright,
+                     typename SrcImageType::ConstAccessor sa)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    std::vector<StripImage<PyramidImageType>*>* gp = new std::vector<StripImage<PyramidImageType>*>();
+
+    // Size of pyramid level 0
+    int w = src_lowerright.x - src_upperleft.x;
+    int h = src_lowerright.y - src_upperleft.y;
+
+    // Pyramid level 0
+    StripImage<PyramidImageType>* gp0 = new StripImage<PyramidImageType>(w, h);
+    PyramidImageType strip;
+
+    // Copy src image into gp0, using fixed-point conversions.
+    for (int y0 = 0; y0 < h; y0 += stripHeight) {
+        const int y1 = std::min(h, y0 + stripHeight);
+        strip.resize(w, y1 - y0);
+        copyToPyramidImage<SrcImageType, PyramidImageType, PyramidIntegerBits, PyramidFractionBits>
+            (src_upperleft + vigra::Diff2D(0, y0), src_upperleft + vigra::Diff2D(w, y1), sa,
+             strip.upperLeft(), strip.accessor());
+        gp0->write(y0, strip, 0, y1 - y0);
+    }
+
+    gp->push_back(gp0);
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << command << ": info: generating Gaussian strip pyramid:  g0";
+    }
+
+    // Make remaining levels.
+    StripImage<PyramidImageType>* lastGP = gp0;
+    PyramidImageType parent;
+    for (unsigned int l = 1; l < numLevels; l++) {
+        if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+            std::cerr << " g" << l;
+            std::cerr.flush();
+        }
+
+        const int parentHeight = h;
+
+        // Size of next level
+        w = (w + 1) >> 1;
+        h = (h + 1) >> 1;
+
+        // Next pyramid level
+        StripImage<PyramidImageType>* gpn = new StripImage<PyramidImageType>(w, h);
+
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+            const int c0 = std::max(0, y0 - PyramidHalo);
+            const int c1 = std::min(h, y1 + PyramidHalo);
+            const int p0 = 2 * c0;
+            const int p1 = std::min(parentHeight, 2 * c1);
+
+            lastGP->read(p0, p1, parent);
+            strip.resize(w, c1 - c0);
+            reduce<SKIPSMImagePixelType>(wraparound, srcImageRange(parent), destImageRange(strip));
+            gpn->write(y0, strip, y0 - c0, y1 - y0);
+        }
+
+        gp->push_back(gpn);
+        lastGP = gpn;
+    }
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << std::endl;
+    }
+
+    return gp;
+}
+
+
+// Version using argument object factories.
+template <typename SrcImageType, typename PyramidImageType,
+          int PyramidIntegerBits, int PyramidFractionBits,
+          typename SKIPSMImagePixelType>
+inline static std::vector<StripImage<PyramidImageType>*>*
+gaussianStripPyramid(unsigned int numLevels,
+                     bool wraparound,
+                     vigra::triple<typename SrcImageType::const_traverser, typename SrcImageType::const_traverser, typename SrcImageType::ConstAccessor> src)
+{
+    return gaussianStripPyramid<SrcImageType, PyramidImageType,
+                                PyramidIntegerBits, PyramidFractionBits,
+                                SKIPSMImagePixelType>(numLevels,
+                                                      wraparound,
+                                                      src.first, src.second, src.third);
+}
+
+
+/** Add (add == true) the expansion of every level of the strip
+ *  pyramid to the next finer level or subtract it (add == false).
+ *  Subtracting proceeds from the finest level, so each level is
+ *  expanded before it is changed itself, and turns a Gaussian into a
+ *  Laplacian pyramid.  Adding proceeds from the coarsest level and
+ *  collapses a Laplacian pyramid. */
+template <typename SKIPSMImagePixelType, typename PyramidImageType>
+void
+expandStripPyramid(bool add, bool wraparound, std::vector<StripImage<PyramidImageType>*>* p)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    const int numLevels = static_cast<int>(p->size());
+    PyramidImageType fine;
+    PyramidImageType coarse;
+
+    for (int i = 0; i < numLevels - 1; i++) {
+        const int l = add ? numLevels - 2 - i : i;
+
+        if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+            std::cerr << " l" << l;
+            std::cerr.flush();
+        }
+
+        StripImage<PyramidImageType>* fineLevel = (*p)[l];
+        StripImage<PyramidImageType>* coarseLevel = (*p)[l + 1];
+        const int h = fineLevel->height();
+        const int coarseHeight = coarseLevel->height();
+
+        for (int y0 = 0; y0 < h; y0 += stripHeight) {
+            const int y1 = std::min(h, y0 + stripHeight);
+            // Rows of the coarse level including the halo and the
+            // rows of this level they expand to.  Rows of the fine
+            // strip above y0 may have been changed already, but they
+            // only receive the expansion and are not written back.
+            const int c0 = std::max(0, y0 / 2 - PyramidHalo);
+            const int c1 = std::min(coarseHeight, (y1 + 1) / 2 + PyramidHalo);
+            const int f0 = 2 * c0;
+            const int f1 = std::min(h, 2 * c1);
+
+            fineLevel->read(f0, f1, fine);
+            coarseLevel->read(c0, c1, coarse);
+            expand<SKIPSMImagePixelType>(add, wraparound, srcImageRange(coarse), destImageRange(fine));
+            fineLevel->write(y0, fine, y0 - f0, y1 - y0);
+        }
+    }
+}
+
+
+/** Calculate the Laplacian pyramid of the given SrcImage/AlphaImage
+ *  pair strip by strip into temporary files. */
+template <typename SrcImageType, typename AlphaImageType, typename PyramidImageType,
+          int PyramidIntegerBits, int PyramidFractionBits,
+          typename SKIPSMImagePixelType, typename SKIPSMAlphaPixelType>
+std::vector<StripImage<PyramidImageType>*>*
+laplacianStripPyramid(unsigned int numLevels,
+                      bool wraparound,
+                      vigra::triple<typename SrcImageType::const_traverser, typename SrcImageType::const_traverser, typename SrcImageType::ConstAccessor> src,
+                      vigra::pair<typename AlphaImageType::const_traverser, typename AlphaImageType::ConstAccessor> alpha)
+{
+    // First create a Gaussian pyramid.
+    std::vector<StripImage<PyramidImageType>*>* gp =
+        gaussianStripPyramid<SrcImageType, AlphaImageType, PyramidImageType,
+                             PyramidIntegerBits, PyramidFractionBits,
+                             SKIPSMImagePixelType, SKIPSMAlphaPixelType>(numLevels, wraparound,
+                                                                         src.first, src.second, src.third,
+                                                                         alpha.first, alpha.second);
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << command << ": info: generating Laplacian strip pyramid:";
+        std::cerr.flush();
+    }
+
+    // For each level, subtract the expansion of the next level.
+    expandStripPyramid<SKIPSMImagePixelType>(false, wraparound, gp);
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << " l" << (numLevels - 1) << std::endl;
+    }
+
+    return gp;
+}
+
+
+/** Collapse the given Laplacian strip pyramid. */
+template <typename SKIPSMImagePixelType, typename PyramidImageType>
+void
+collapseStripPyramid(bool wraparound, std::vector<StripImage<PyramidImageType>*>* p)
+{
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << command << ": info: collapsing Laplacian strip pyramid: "
+                  << "l" << p->size() - 1;
+        std::cerr.flush();
+    }
+
+    expandStripPyramid<SKIPSMImagePixelType>(true, wraparound, p);
+
+    if (Verbose >= VERBOSE_PYRAMID_MESSAGES) {
+        std::cerr << std::endl;
+    }
+}
+
+
+/** Create an empty strip pyramid with numLevels levels for an image
+ *  of the given size, e.g. to accumulate other pyramids into. */
+template <typename PyramidImageType>
+std::vector<StripImage<PyramidImageType>*>*
+emptyStripPyramid(unsigned int numLevels, const vigra::Size2D& size)
+{
+    std::vector<StripImage<PyramidImageType>*>* p = new std::vector<StripImage<PyramidImageType>*>();
+
+    int w = size.x;
+    int h = size.y;
+    for (unsigned int l = 0; l < numLevels; l++) {
+        p->push_back(new StripImage<PyramidImageType>(w, h));
+        w = (w + 1) >> 1;
+        h = (h + 1) >> 1;
+    }
+
+    return p;
+}
+
+
+/** Copy level 0 of a collapsed strip pyramid into dest where mask is
+ *  set.  The strip version of copyFromPyramidImageIf(). */
+template <typename PyramidImageType, typename MaskImageType, typename DestImageType,
+          int PyramidIntegerBits, int PyramidFractionBits>
+void
+copyFromStripPyramidImageIf(StripImage<PyramidImageType>* src,
+                            vigra::pair<typename MaskImageType::const_traverser, typename MaskImageType::ConstAccessor> mask,
+                            vigra::pair<typename DestImageType::traverser, typename DestImageType::Accessor> dest)
+{
+    const int stripHeight = static_cast<int>(pyramidStripHeight());
+    const int h = src->height();
+    PyramidImageType strip;
+
+    for (int y0 = 0; y0 < h; y0 += stripHeight) {
+        const int y1 = std::min(h, y0 + stripHeight);
+        src->read(y0, y1, strip);
+        const PyramidImageType& constStrip = strip;
+        copyFromPyramidImageIf<PyramidImageType, MaskImageType, DestImageType,
+                               PyramidIntegerBits, PyramidFractionBits>
+            (constStrip.upperLeft(), constStrip.lowerRight(), constStrip.accessor(),
+             mask.first + vigra::Diff2D(0, y0), mask.second,
+             dest.first + vigra::Diff2D(0, y0), dest.second);
+    }
+}
+
+
+/** Delete a strip pyramid and its temporary files. */
+template <typename PyramidImageType>
+void
+deleteStripPyramid(std::vector<StripImage<PyramidImageType>*>* p)
+{
+    for (unsigned int i = 0; i < p->size(); i++) {
+        delete (*p)[i];
+    }
+    delete p;
+}
+
 } // namespace enblend
 
 
@@ -0,0 +1,109 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TEST_GLOBALS_H_INCLUDED_
+#define TEST_GLOBALS_H_INCLUDED_
+
+// The headers of Enblend and Enfuse refer to global variables, which
+// enblend.cc and enfuse.cc define before they include them.  Each
+// test includes this file first, so it can use the headers the same
+// way.  The values are the defaults of the command-line options;
+// tests change them as they need.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <iostream>
+#include <string>
+
+#include <lcms2.h>
+
+#include "alternativepercentage.h"
+#include "exposure_weight.h"
+#include "global.h"
+
+
+extern const std::string command;
+const std::string command("enblend-test");
+
+int Verbose = 0;
+blend_colorspace_t BlendColorspace = IdentitySpace;
+
+cmsHPROFILE InputProfile = nullptr;
+cmsHTRANSFORM InputToXYZTransform = nullptr;
+cmsHTRANSFORM XYZToInputTransform = nullptr;
+cmsHTRANSFORM InputToLabTransform = nullptr;
+cmsHTRANSFORM LabToInputTransform = nullptr;
+cmsHANDLE CIECAMTransform = nullptr;
+
+// Enblend and Enfuse
+std::string OutputFileName(DEFAULT_OUTPUT_FILENAME);
+int ExactLevels = 0;
+bool OneAtATime = true;
+boundary_t WrapAround = OpenBoundaries;
+bool SaveMasks = false;
+bool StopAfterMaskGeneration = false;
+bool LoadMasks = false;
+TiffResolution ImageResolution;
+bool OutputIsValid = true;
+
+// Enfuse
+double WExposure = 1.0;
+double ExposureOptimum = 0.5;
+double ExposureWidth = 0.2;
+ExposureWeight* ExposureWeightFunction = new exposure_weight::Gaussian(ExposureOptimum, ExposureWidth);
+AlternativePercentage ExposureLowerCutoff(0.0, true);
+CompactifiedAlternativePercentage ExposureUpperCutoff(100.0, true);
+std::string ExposureLowerCutoffGrayscaleProjector("anti-value");
+std::string ExposureUpperCutoffGrayscaleProjector("value");
+double WContrast = 0.0;
+double WSaturation = 0.2;
+double WEntropy = 0.0;
+int ContrastWindowSize = 5;
+std::string GrayscaleProjector;
+struct EdgeFilterConfiguration {double edgeScale, lceScale, lceFactor;} FilterConfig = {0.0, 0.0, 0.0};
+AlternativePercentage MinCurvature(0.0, false);
+int EntropyWindowSize = 3;
+AlternativePercentage EntropyLowerCutoff(0.0, true);
+CompactifiedAlternativePercentage EntropyUpperCutoff(100.0, true);
+bool UseHardMask = false;
+std::string SoftMaskTemplate("softmask-%n.tif");
+std::string HardMaskTemplate("hardmask-%n.tif");
+
+
+namespace test
+{
+    int failures = 0;
+
+    inline void
+    check(bool condition, const std::string& description)
+    {
+        if (!condition) {
+            std::cerr << command << ": FAILED: " << description << std::endl;
+            ++failures;
+        }
+    }
+} // namespace test
+
+
+#endif // TEST_GLOBALS_H_INCLUDED_
+
+
+// Local Variables:
+// mode: c++
+// End:
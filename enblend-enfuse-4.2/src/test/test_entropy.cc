@@ -0,0 +1,214 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Checks that the local entropy computed with flat histograms agrees
+// with the one computed with map-based histograms.  The two sum up
+// the bins in a different order, so a result may differ by one in
+// the last place.
+
+#include "globals.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include <vigra/basicimage.hxx>
+#include <vigra/rgbvalue.hxx>
+
+#include "enfuse.h"
+
+
+template <typename InputPixelType, typename ResultPixelType>
+size_t enblend::Histogram<InputPixelType, ResultPixelType>::precomputedSize = 0;
+
+template <typename InputPixelType, typename ResultPixelType>
+double* enblend::Histogram<InputPixelType, ResultPixelType>::precomputedLog = nullptr;
+
+template <typename InputPixelType, typename ResultPixelType>
+double* enblend::Histogram<InputPixelType, ResultPixelType>::precomputedEntropy = nullptr;
+
+
+static unsigned int
+nextRandom(unsigned int& state)
+{
+    state = state * 1103515245U + 12345U;
+    return (state >> 16) & 0x7fffU;
+}
+
+
+// Only a few distinct values, so that the windows hold repeated
+// values and some hold a single one.
+template <typename T>
+static void
+setRandom(T& value, unsigned int& state, int offset, int step)
+{
+    value = static_cast<T>(offset + static_cast<int>(nextRandom(state) % 7U) * step);
+}
+
+
+template <typename T>
+static void
+setRandom(vigra::RGBValue<T>& value, unsigned int& state, int offset, int step)
+{
+    for (int channel = 0; channel < 3; ++channel) {
+        setRandom(value[channel], state, offset, step);
+    }
+}
+
+
+// Random except for a constant block in the upper left corner.
+template <typename ImageType>
+static void
+fillImage(ImageType& image, int offset, int step)
+{
+    unsigned int seed = 1U;
+    typename ImageType::value_type constant;
+    setRandom(constant, seed, offset, step);
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            if (x < image.width() / 3 && y < image.height() / 3) {
+                image(x, y) = constant;
+            } else {
+                setRandom(image(x, y), seed, offset, step);
+            }
+        }
+    }
+}
+
+
+// Opaque except for a rectangle and every 7th pixel.
+template <typename MaskType>
+static void
+fillMask(MaskType& mask)
+{
+    for (int y = 0; y < mask.height(); ++y) {
+        for (int x = 0; x < mask.width(); ++x) {
+            const bool hole = (x > mask.width() / 2 && y > mask.height() / 2 && x < mask.width() - 4) ||
+                (x + y * mask.width()) % 7 == 0;
+            mask(x, y) = hole ? 0 : 255;
+        }
+    }
+}
+
+
+template <typename T>
+static bool
+closeValues(T a, T b)
+{
+    return std::abs(static_cast<long>(a) - static_cast<long>(b)) <= 1L;
+}
+
+
+template <typename T>
+static bool
+closeValues(const vigra::RGBValue<T>& a, const vigra::RGBValue<T>& b)
+{
+    return closeValues(a.red(), b.red()) && closeValues(a.green(), b.green()) && closeValues(a.blue(), b.blue());
+}
+
+
+template <typename ImageType>
+static bool
+closeImages(const ImageType& a, const ImageType& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (typename ImageType::const_iterator i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j) {
+        if (!closeValues(*i, *j)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <typename ImageType>
+static bool
+nonzeroImage(const ImageType& image)
+{
+    const typename ImageType::value_type zero = vigra::NumericTraits<typename ImageType::value_type>::zero();
+
+    for (typename ImageType::const_iterator i = image.begin(); i != image.end(); ++i) {
+        if (*i != zero) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+template <typename PixelType>
+static void
+testEntropy(const std::string& name, int offset, int step)
+{
+    typedef vigra::BasicImage<PixelType> ImageType;
+    typedef vigra::BasicImage<vigra::UInt8> MaskType;
+
+    const int width = 41;
+    const int height = 37;
+
+    ImageType image(width, height);
+    MaskType mask(width, height);
+    fillImage(image, offset, step);
+    fillMask(mask);
+
+    for (int windowSize = 3; windowSize <= 7; windowSize += 2) {
+        std::ostringstream oss;
+        oss << name << ", window " << windowSize << "x" << windowSize;
+        const std::string description(oss.str());
+        const vigra::Size2D size(windowSize, windowSize);
+
+        ImageType map(width, height);
+        ImageType flat(width, height);
+
+        enblend::localEntropyIf(image.upperLeft(), image.lowerRight(), image.accessor(),
+                                mask.upperLeft(), mask.accessor(),
+                                map.upperLeft(), map.accessor(),
+                                size, vigra::VigraFalseType());
+        enblend::localEntropyIf(image.upperLeft(), image.lowerRight(), image.accessor(),
+                                mask.upperLeft(), mask.accessor(),
+                                flat.upperLeft(), flat.accessor(),
+                                size, vigra::VigraTrueType());
+
+        test::check(nonzeroImage(map), description + ": nonzero entropy");
+        test::check(closeImages(map, flat), description + ": flat and map histograms");
+    }
+}
+
+
+int
+main()
+{
+    testEntropy<vigra::UInt8>("UInt8", 10, 40);
+    testEntropy<vigra::RGBValue<vigra::UInt8> >("RGB UInt8", 10, 40);
+    testEntropy<vigra::UInt16>("UInt16", 500, 9000);
+    testEntropy<vigra::RGBValue<vigra::UInt16> >("RGB UInt16", 500, 9000);
+    testEntropy<vigra::Int16>("Int16", -27000, 9000);
+
+    return test::failures == 0 ? 0 : 1;
+}
+
+
+// Local Variables:
+// mode: c++
+// End:
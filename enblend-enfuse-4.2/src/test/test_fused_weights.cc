@@ -0,0 +1,238 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Checks that enfuseMask(), which adds up all weights in one pass,
+// gives exactly the weights of one pass per criterion in the order
+// exposure, contrast, saturation, entropy.
+
+#include "globals.h"
+
+#include <algorithm>
+#include <string>
+
+#include <vigra/basicimage.hxx>
+#include <vigra/rgbvalue.hxx>
+
+#include "enfuse.h"
+
+
+template <typename InputPixelType, typename ResultPixelType>
+size_t enblend::Histogram<InputPixelType, ResultPixelType>::precomputedSize = 0;
+
+template <typename InputPixelType, typename ResultPixelType>
+double* enblend::Histogram<InputPixelType, ResultPixelType>::precomputedLog = nullptr;
+
+template <typename InputPixelType, typename ResultPixelType>
+double* enblend::Histogram<InputPixelType, ResultPixelType>::precomputedEntropy = nullptr;
+
+
+static unsigned int
+nextRandom(unsigned int& state)
+{
+    state = state * 1103515245U + 12345U;
+    return (state >> 16) & 0x7fffU;
+}
+
+
+template <typename T>
+static void
+setRandom(T& value, unsigned int& state)
+{
+    value = static_cast<T>(nextRandom(state) % (static_cast<unsigned int>(vigra::NumericTraits<T>::max()) + 1U));
+}
+
+
+template <typename T>
+static void
+setRandom(vigra::RGBValue<T>& value, unsigned int& state)
+{
+    for (int channel = 0; channel < 3; ++channel) {
+        setRandom(value[channel], state);
+    }
+}
+
+
+// Random except for a constant block in the upper left corner.
+template <typename ImageType>
+static void
+fillImage(ImageType& image)
+{
+    unsigned int seed = 1U;
+    typename ImageType::value_type constant;
+    setRandom(constant, seed);
+
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            if (x < image.width() / 3 && y < image.height() / 3) {
+                image(x, y) = constant;
+            } else {
+                setRandom(image(x, y), seed);
+            }
+        }
+    }
+}
+
+
+// Opaque except for a rectangle and every 9th pixel.
+template <typename AlphaType>
+static void
+fillAlpha(AlphaType& alpha)
+{
+    const typename AlphaType::value_type opaque = vigra::NumericTraits<typename AlphaType::value_type>::max();
+
+    for (int y = 0; y < alpha.height(); ++y) {
+        for (int x = 0; x < alpha.width(); ++x) {
+            const bool hole = (x > alpha.width() / 2 && y > alpha.height() / 2) || (x + y * alpha.width()) % 9 == 0;
+            alpha(x, y) = hole ? 0 : opaque;
+        }
+    }
+}
+
+
+// Adds the weight of one criterion to the weight accumulated so far.
+template <typename FunctorType, typename InputType, typename MaskValueType>
+class AddWeightFunctor
+{
+public:
+    AddWeightFunctor(const FunctorType& f) : functor(f) {}
+
+    MaskValueType operator()(const InputType& x, const MaskValueType& y) const {return functor(x) + y;}
+
+private:
+    const FunctorType functor;
+};
+
+
+// Weights the way enfuseMask() computed them before the passes were
+// fused: one pass over the image for each criterion.
+template <typename ImageType, typename AlphaType, typename MaskType>
+static void
+separateWeights(const ImageType& image, const AlphaType& alpha, MaskType& result)
+{
+    typedef typename ImageType::value_type ImageValueType;
+    typedef typename ImageType::PixelType PixelType;
+    typedef typename vigra::NumericTraits<PixelType>::ValueType ScalarType;
+    typedef typename MaskType::value_type MaskValueType;
+    typedef typename vigra::NumericTraits<ScalarType>::Promote LongScalarType;
+    typedef vigra::BasicImage<LongScalarType> GradImage;
+    typedef vigra::BasicImage<PixelType> EntropyImage;
+    typedef enblend::MultiGrayscaleAccessor<ImageValueType, ScalarType> MultiGrayAcc;
+
+    // Exposure
+    if (WExposure > 0.0) {
+        MultiGrayAcc ga(GrayscaleProjector);
+        enblend::ExposureFunctor<ImageValueType, MultiGrayAcc, MaskValueType>
+            ef(WExposure, ExposureWeightFunction, ga);
+        vigra::omp::transformImageIf(srcImageRange(image), maskImage(alpha), destImage(result), ef);
+    }
+
+    // Contrast
+    if (WContrast > 0.0) {
+        GradImage grad(image.size());
+        enblend::MultiGrayscaleAccessor<PixelType, LongScalarType> ga(GrayscaleProjector);
+        enblend::localStdDevIf(image.upperLeft(), image.lowerRight(), ga,
+                               alpha.upperLeft(), alpha.accessor(),
+                               grad.upperLeft(), grad.accessor(),
+                               vigra::Size2D(ContrastWindowSize, ContrastWindowSize));
+
+        typedef enblend::ContrastFunctor<LongScalarType, ScalarType, MaskValueType> ContrastFunctor;
+        vigra::omp::combineTwoImagesIf(srcImageRange(grad), srcImage(result), maskImage(alpha), destImage(result),
+                                       AddWeightFunctor<ContrastFunctor, ScalarType, MaskValueType>
+                                       (ContrastFunctor(WContrast)));
+    }
+
+    // Saturation
+    if (WSaturation > 0.0) {
+        typedef enblend::SaturationFunctor<ImageValueType, MaskValueType> SaturationFunctor;
+        vigra::omp::combineTwoImagesIf(srcImageRange(image), srcImage(result), maskImage(alpha), destImage(result),
+                                       AddWeightFunctor<SaturationFunctor, ImageValueType, MaskValueType>
+                                       (SaturationFunctor(WSaturation)));
+    }
+
+    // Entropy
+    if (WEntropy > 0.0) {
+        EntropyImage entropy(image.size());
+        enblend::localEntropyIf(srcImageRange(image), maskImage(alpha), destImage(entropy),
+                                vigra::Size2D(EntropyWindowSize, EntropyWindowSize));
+
+        typedef enblend::EntropyFunctor<PixelType, MaskValueType> EntropyFunctor;
+        vigra::omp::combineTwoImagesIf(srcImageRange(entropy), srcImage(result), maskImage(alpha), destImage(result),
+                                       AddWeightFunctor<EntropyFunctor, PixelType, MaskValueType>
+                                       (EntropyFunctor(WEntropy)));
+    }
+}
+
+
+template <typename ImagePixelType>
+static void
+testFusedWeights(const std::string& name, int width, int height)
+{
+    typedef typename enblend::EnblendNumericTraits<ImagePixelType>::ImageType ImageType;
+    typedef typename enblend::EnblendNumericTraits<ImagePixelType>::AlphaType AlphaType;
+    typedef vigra::BasicImage<float> MaskType;
+
+    struct Weights {const char* description; double exposure, contrast, saturation, entropy;};
+    const Weights weights[] = {
+        {"all criteria", 1.0, 0.3, 0.2, 0.4},
+        {"without exposure", 0.0, 0.3, 0.2, 0.4},
+        {"exposure and entropy", 0.7, 0.0, 0.0, 0.5},
+        {"contrast only", 0.0, 1.0, 0.0, 0.0}
+    };
+
+    ImageType image(width, height);
+    AlphaType alpha(width, height);
+    fillImage(image);
+    fillAlpha(alpha);
+    const ImageType& constImage = image;
+    const AlphaType& constAlpha = alpha;
+
+    for (const Weights& w : weights) {
+        WExposure = w.exposure;
+        WContrast = w.contrast;
+        WSaturation = w.saturation;
+        WEntropy = w.entropy;
+
+        // Without exposure the weights add to what is in the mask.
+        MaskType fused(width, height, 0.25f);
+        MaskType separate(width, height, 0.25f);
+
+        enblend::enfuseMask<ImageType, AlphaType, MaskType>(srcImageRange(constImage),
+                                                             srcImage(constAlpha),
+                                                             destImage(fused));
+        separateWeights(constImage, constAlpha, separate);
+
+        test::check(std::equal(fused.begin(), fused.end(), separate.begin()),
+                    name + ", " + w.description);
+    }
+}
+
+
+int
+main()
+{
+    testFusedWeights<vigra::RGBValue<vigra::UInt8> >("RGB UInt8", 45, 38);
+    testFusedWeights<vigra::UInt8>("UInt8", 39, 44);
+    testFusedWeights<vigra::RGBValue<vigra::UInt16> >("RGB UInt16", 33, 30);
+
+    return test::failures == 0 ? 0 : 1;
+}
+
+
+// Local Variables:
+// mode: c++
+// End:
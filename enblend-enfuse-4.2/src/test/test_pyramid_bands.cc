@@ -0,0 +1,222 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Checks that reduce() and expand(), which process pyramid levels in
+// parallel bands of rows, give exactly the result of the serial
+// SKIPSM kernels.  Without OpenMP both are the same code and the
+// test passes trivially.
+
+#include "globals.h"
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+
+#include <vigra/basicimage.hxx>
+#include <vigra/rgbvalue.hxx>
+
+#include "common.h"
+#include "openmp_def.h"
+#include "openmp_vigra.h"
+#include "numerictraits.h"
+#include "fixmath.h"
+#include "parameter.h"
+#include "pyramid.h"
+
+
+static unsigned int
+nextRandom(unsigned int& state)
+{
+    state = state * 1103515245U + 12345U;
+    return (state >> 16) & 0x7fffU;
+}
+
+
+template <typename T>
+static void
+setRandom(T& value, unsigned int& state)
+{
+    value = static_cast<T>(static_cast<int>(nextRandom(state) % 4096U) - 2048);
+}
+
+
+static void
+setRandom(double& value, unsigned int& state)
+{
+    value = static_cast<double>(nextRandom(state)) / 32767.0 - 0.5;
+}
+
+
+template <typename T>
+static void
+setRandom(vigra::RGBValue<T>& value, unsigned int& state)
+{
+    for (int channel = 0; channel < 3; ++channel) {
+        setRandom(value[channel], state);
+    }
+}
+
+
+template <typename ImageType>
+static void
+fillImage(ImageType& image, unsigned int seed)
+{
+    for (typename ImageType::iterator i = image.begin(); i != image.end(); ++i) {
+        setRandom(*i, seed);
+    }
+}
+
+
+// Opaque except for a rectangle and every 11th pixel.
+template <typename AlphaType>
+static void
+fillAlpha(AlphaType& alpha)
+{
+    const typename AlphaType::value_type opaque = vigra::NumericTraits<typename AlphaType::value_type>::max();
+
+    for (int y = 0; y < alpha.height(); ++y) {
+        for (int x = 0; x < alpha.width(); ++x) {
+            const bool hole = (x > alpha.width() / 2 && y > alpha.height() / 3 && y < alpha.height() / 2) ||
+                (x + y * alpha.width()) % 11 == 0;
+            alpha(x, y) = hole ? 0 : opaque;
+        }
+    }
+}
+
+
+template <typename ImageType>
+static bool
+equalImages(const ImageType& a, const ImageType& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+
+template <typename ImagePixelType>
+static void
+testBands(const std::string& name, int width, int height, bool wraparound)
+{
+    typedef enblend::EnblendNumericTraits<ImagePixelType> Traits;
+    typedef typename Traits::AlphaType AlphaType;
+    typedef typename Traits::ImagePyramidType PyramidType;
+    typedef typename PyramidType::value_type PyramidPixelType;
+    typedef typename Traits::SKIPSMImagePixelType SKIPSMImagePixelType;
+    typedef typename Traits::SKIPSMAlphaPixelType SKIPSMAlphaPixelType;
+
+    const std::string description(name + (wraparound ? ", wraparound" : ""));
+    const int reducedWidth = (width + 1) >> 1;
+    const int reducedHeight = (height + 1) >> 1;
+
+    PyramidType fine(width, height);
+    AlphaType fineAlpha(width, height);
+    PyramidType coarse(reducedWidth, reducedHeight);
+    fillImage(fine, 1U);
+    fillAlpha(fineAlpha);
+    fillImage(coarse, 2U);
+    const PyramidType& constFine = fine;
+    const AlphaType& constFineAlpha = fineAlpha;
+    const PyramidType& constCoarse = coarse;
+
+    // Reduce with alpha channel
+    {
+        PyramidType serial(reducedWidth, reducedHeight);
+        AlphaType serialAlpha(reducedWidth, reducedHeight);
+        PyramidType bands(reducedWidth, reducedHeight);
+        AlphaType bandsAlpha(reducedWidth, reducedHeight);
+
+        enblend::reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            (wraparound,
+             constFine.upperLeft(), constFine.lowerRight(), constFine.accessor(),
+             constFineAlpha.upperLeft(), constFineAlpha.accessor(),
+             serial.upperLeft(), serial.lowerRight(), serial.accessor(),
+             serialAlpha.upperLeft(), serialAlpha.lowerRight(), serialAlpha.accessor());
+        enblend::reduce<SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            (wraparound,
+             srcImageRange(fine), maskImage(fineAlpha),
+             destImageRange(bands), destImageRange(bandsAlpha));
+
+        test::check(equalImages(serial, bands), description + ": reduce with alpha, image");
+        test::check(equalImages(serialAlpha, bandsAlpha), description + ": reduce with alpha, alpha");
+    }
+
+    // Reduce without alpha channel
+    {
+        PyramidType serial(reducedWidth, reducedHeight);
+        PyramidType bands(reducedWidth, reducedHeight);
+
+        enblend::reduce<SKIPSMImagePixelType>
+            (wraparound,
+             constFine.upperLeft(), constFine.lowerRight(), constFine.accessor(),
+             serial.upperLeft(), serial.lowerRight(), serial.accessor());
+        enblend::reduce<SKIPSMImagePixelType>(wraparound, srcImageRange(fine), destImageRange(bands));
+
+        test::check(equalImages(serial, bands), description + ": reduce without alpha");
+    }
+
+    // Expand, adding to and subtracting from the finer level
+    for (bool add : {true, false}) {
+        PyramidType serial(fine);
+        PyramidType bands(fine);
+
+        if (add) {
+            enblend::expand<SKIPSMImagePixelType>
+                (add, wraparound,
+                 constCoarse.upperLeft(), constCoarse.lowerRight(), constCoarse.accessor(),
+                 serial.upperLeft(), serial.lowerRight(), serial.accessor(),
+                 enblend::FromPromotePlusFunctorWrapper<PyramidPixelType, SKIPSMImagePixelType, PyramidPixelType>());
+        } else {
+            enblend::expand<SKIPSMImagePixelType>
+                (add, wraparound,
+                 constCoarse.upperLeft(), constCoarse.lowerRight(), constCoarse.accessor(),
+                 serial.upperLeft(), serial.lowerRight(), serial.accessor(),
+                 std::minus<SKIPSMImagePixelType>());
+        }
+        enblend::expand<SKIPSMImagePixelType>(add, wraparound, srcImageRange(coarse), destImageRange(bands));
+
+        test::check(equalImages(serial, bands),
+                    description + (add ? ": expand and add" : ": expand and subtract"));
+    }
+}
+
+
+int
+main()
+{
+    // Split even small levels into several bands.
+    parameter::insert("pyramid-minimum-band-height", "8");
+#ifdef OPENMP
+    omp_set_num_threads(4);
+#endif
+
+    for (bool wraparound : {false, true}) {
+        testBands<vigra::UInt8>("UInt8 97x123", 97, 123, wraparound);
+        testBands<vigra::RGBValue<vigra::UInt16> >("RGB UInt16 64x90", 64, 90, wraparound);
+        testBands<float>("float 75x101", 75, 101, wraparound);
+        testBands<vigra::RGBValue<float> >("RGB float 50x70", 50, 70, wraparound);
+    }
+
+    parameter::erase("pyramid-minimum-band-height");
+
+    return test::failures == 0 ? 0 : 1;
+}
+
+
+// Local Variables:
+// mode: c++
+// End:
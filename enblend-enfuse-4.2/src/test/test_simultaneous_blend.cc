@@ -0,0 +1,412 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Checks the building blocks of enblendSimultaneous().  The region
+// of interest of a layer is aligned to the coarsest level, so that
+// the layer's pyramids land at (offset >> level) in every level of
+// the pyramids of the union, even if the labelled region is not
+// aligned.  Two layers blended simultaneously along a seam give the
+// result of the sequential blend() along the same seam.
+
+#include "globals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vigra/basicimage.hxx>
+
+#include "rect2d.hxx"
+
+#include "common.h"
+#include "openmp_def.h"
+#include "openmp_vigra.h"
+#include "numerictraits.h"
+#include "fixmath.h"
+#include "parameter.h"
+#include "pyramid.h"
+#include "blend.h"
+#include "bounds.h"
+
+
+typedef enblend::EnblendNumericTraits<vigra::UInt8> Traits;
+typedef Traits::ImageType ImageType;
+typedef Traits::AlphaType AlphaType;
+typedef Traits::MaskPixelType MaskPixelType;
+typedef Traits::MaskType MaskType;
+typedef Traits::ImagePyramidType ImagePyramidType;
+typedef Traits::MaskPyramidPixelType MaskPyramidPixelType;
+typedef Traits::MaskPyramidType MaskPyramidType;
+typedef Traits::SKIPSMImagePixelType SKIPSMImagePixelType;
+typedef Traits::SKIPSMAlphaPixelType SKIPSMAlphaPixelType;
+typedef Traits::SKIPSMMaskPixelType SKIPSMMaskPixelType;
+enum {ImagePyramidIntegerBits = Traits::ImagePyramidIntegerBits};
+enum {ImagePyramidFractionBits = Traits::ImagePyramidFractionBits};
+enum {MaskPyramidIntegerBits = Traits::MaskPyramidIntegerBits};
+enum {MaskPyramidFractionBits = Traits::MaskPyramidFractionBits};
+
+typedef vigra::BasicImage<vigra::UInt8> LabelType;
+
+
+static const MaskPixelType maskWhite = vigra::NumericTraits<MaskPixelType>::max();
+
+
+static MaskPyramidPixelType
+pyramidWhite()
+{
+    enblend::ConvertScalarToPyramidFunctor<MaskPixelType, MaskPyramidPixelType,
+                                           MaskPyramidIntegerBits, MaskPyramidFractionBits> whiteMask;
+    return whiteMask(maskWhite);
+}
+
+
+// Smooth contents, which differ between the layers.
+static void
+fillLayer(ImageType& image, int layer)
+{
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            image(x, y) = static_cast<vigra::UInt8>(128.0 + 60.0 * sin(x / (7.0 + 4.0 * layer)) +
+                                                    40.0 * cos(y / (5.0 + 3.0 * layer)));
+        }
+    }
+}
+
+
+// Label 1 left of a curved seam, label 2 right of it.
+static LabelType
+seamLabels(const vigra::Size2D& size)
+{
+    LabelType label(size);
+    for (int y = 0; y < size.y; ++y) {
+        const int seam = size.x / 3 + static_cast<int>(size.x / 8 * sin(y / 9.0));
+        for (int x = 0; x < size.x; ++x) {
+            label(x, y) = x < seam ? 1 : 2;
+        }
+    }
+    return label;
+}
+
+
+// White where the label equals value, within region roiBB of label.
+static MaskType
+labelMask(const LabelType& label, vigra::UInt8 value, const vigra::Rect2D& roiBB)
+{
+    MaskType mask(roiBB.size());
+    for (int y = 0; y < roiBB.height(); ++y) {
+        for (int x = 0; x < roiBB.width(); ++x) {
+            mask(x, y) = label(roiBB.left() + x, roiBB.top() + y) == value ? maskWhite : 0;
+        }
+    }
+    return mask;
+}
+
+
+static vigra::Rect2D
+labelBounds(const LabelType& label, vigra::UInt8 value)
+{
+    vigra::Point2D upperLeft(label.width(), label.height());
+    vigra::Point2D lowerRight(0, 0);
+    for (int y = 0; y < label.height(); ++y) {
+        for (int x = 0; x < label.width(); ++x) {
+            if (label(x, y) == value) {
+                upperLeft.x = std::min(upperLeft.x, x);
+                upperLeft.y = std::min(upperLeft.y, y);
+                lowerRight.x = std::max(lowerRight.x, x + 1);
+                lowerRight.y = std::max(lowerRight.y, y + 1);
+            }
+        }
+    }
+    return vigra::Rect2D(upperLeft, lowerRight);
+}
+
+
+template <typename PyramidImageType>
+static void
+deletePyramid(std::vector<PyramidImageType*>* p)
+{
+    for (unsigned int i = 0; i < p->size(); i++) {
+        delete (*p)[i];
+    }
+    delete p;
+}
+
+
+// Zero pyramid of the size of the union, which is accumulated into.
+template <typename PyramidImageType>
+static std::vector<PyramidImageType*>*
+emptyPyramid(unsigned int numLevels, const vigra::Size2D& size)
+{
+    std::vector<PyramidImageType*>* p = new std::vector<PyramidImageType*>();
+    int w = size.x;
+    int h = size.y;
+    for (unsigned int l = 0; l < numLevels; l++) {
+        p->push_back(new PyramidImageType(w, h));
+        w = (w + 1) >> 1;
+        h = (h + 1) >> 1;
+    }
+    return p;
+}
+
+
+template <typename ImageType>
+static bool
+equalImages(const ImageType& a, const ImageType& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+
+// Blend white over black with the mask like the sequential Enblend
+// does, with the union as region of interest.
+static ImageType
+sequentialBlend(const ImageType& white, const ImageType& black, const AlphaType& alpha,
+                const MaskType& whiteMask, unsigned int numLevels)
+{
+    std::vector<MaskPyramidType*>* maskGP =
+        enblend::gaussianPyramid<MaskType, MaskPyramidType,
+                                 MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                 SKIPSMMaskPixelType>(numLevels, false, srcImageRange(whiteMask));
+    std::vector<ImagePyramidType*>* whiteLP =
+        enblend::laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                  ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                  SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+        ("whiteGP", numLevels, false, srcImageRange(white), maskImage(alpha));
+    std::vector<ImagePyramidType*>* blackLP =
+        enblend::laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                  ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                  SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+        ("blackGP", numLevels, false, srcImageRange(black), maskImage(alpha));
+
+    enblend::blend(maskGP, whiteLP, blackLP, pyramidWhite());
+    enblend::collapsePyramid<SKIPSMImagePixelType>(false, blackLP);
+
+    ImageType result(white.size());
+    enblend::copyFromPyramidImageIf<ImagePyramidType, AlphaType, ImageType,
+                                    ImagePyramidIntegerBits, ImagePyramidFractionBits>
+        (srcImageRange(*((*blackLP)[0])), maskImage(alpha), destImage(result));
+
+    deletePyramid(maskGP);
+    deletePyramid(whiteLP);
+    deletePyramid(blackLP);
+
+    return result;
+}
+
+
+// Blend all layers at once like enblendSimultaneous() does: each
+// layer's pyramids cover its region of interest only and are
+// accumulated into the pyramids of the union.
+static ImageType
+simultaneousBlend(const std::vector<const ImageType*>& layers, const AlphaType& alpha,
+                  const LabelType& label, unsigned int numLevels)
+{
+    const vigra::Rect2D unionBB(label.size());
+    std::vector<ImagePyramidType*>* blendLP = emptyPyramid<ImagePyramidType>(numLevels, unionBB.size());
+    std::vector<MaskPyramidType*>* weightGP = emptyPyramid<MaskPyramidType>(numLevels, unionBB.size());
+
+    for (unsigned int i = 0; i < layers.size(); ++i) {
+        const vigra::UInt8 value = static_cast<vigra::UInt8>(i + 1);
+        const vigra::Rect2D roiBB =
+            enblend::simultaneousRoiBounds(unionBB, labelBounds(label, value), numLevels, false);
+        const MaskType mask(labelMask(label, value, roiBB));
+
+        std::vector<MaskPyramidType*>* maskGP =
+            enblend::gaussianPyramid<MaskType, MaskPyramidType,
+                                     MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                     SKIPSMMaskPixelType>(numLevels, false, srcImageRange(mask));
+        std::vector<ImagePyramidType*>* layerLP =
+            enblend::laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                      ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            ("layerGP", numLevels, false,
+             vigra_ext::apply(roiBB, srcImageRange(*layers[i])),
+             vigra_ext::apply(roiBB, maskImage(alpha)));
+
+        enblend::accumulateBlend(maskGP, layerLP, blendLP, weightGP, roiBB.upperLeft(), pyramidWhite());
+
+        deletePyramid(maskGP);
+        deletePyramid(layerLP);
+    }
+
+    enblend::normalizeBlend(blendLP, weightGP, pyramidWhite());
+    enblend::collapsePyramid<SKIPSMImagePixelType>(false, blendLP);
+
+    ImageType result(unionBB.size());
+    enblend::copyFromPyramidImageIf<ImagePyramidType, AlphaType, ImageType,
+                                    ImagePyramidIntegerBits, ImagePyramidFractionBits>
+        (srcImageRange(*((*blendLP)[0])), maskImage(alpha), destImage(result));
+
+    deletePyramid(blendLP);
+    deletePyramid(weightGP);
+
+    return result;
+}
+
+
+// The region of interest of an unaligned labelled region is aligned
+// to the coarsest level and still covers the filter around the
+// region.  Accumulating the mask pyramid of the region of interest at
+// (offset >> level) gives exactly the mask pyramid of the union.
+static void
+testLevelOffset(const std::string& name, const vigra::Size2D& size, const vigra::Rect2D& labelBB)
+{
+    const vigra::Rect2D unionBB(size);
+    const unsigned int numLevels = enblend::numberOfPyramidLevels(std::min(size.x, size.y));
+    const int alignment = 1 << (numLevels - 1);
+    const vigra::Rect2D roiBB = enblend::simultaneousRoiBounds(unionBB, labelBB, numLevels, false);
+
+    vigra::Rect2D filterBB(labelBB);
+    filterBB.addBorder(enblend::filterHalfWidth(numLevels));
+    filterBB &= unionBB;
+    test::check((roiBB & filterBB) == filterBB, name + ": region of interest covers the filter");
+    test::check((roiBB & unionBB) == roiBB, name + ": region of interest lies inside the union");
+    test::check(roiBB.left() % alignment == 0 && roiBB.top() % alignment == 0,
+                name + ": region of interest is aligned to the coarsest level");
+    bool exactOffsets = true;
+    for (unsigned int l = 0; l < numLevels; ++l) {
+        exactOffsets = exactOffsets &&
+            (roiBB.left() >> l) << l == roiBB.left() && (roiBB.top() >> l) << l == roiBB.top();
+    }
+    test::check(exactOffsets, name + ": offset is exact in every level");
+
+    // An elliptic labelled region, which touches all sides of labelBB.
+    LabelType label(size);
+    const double cx = (labelBB.left() + labelBB.right() - 1) / 2.0;
+    const double cy = (labelBB.top() + labelBB.bottom() - 1) / 2.0;
+    const double rx = (labelBB.width() - 1) / 2.0 + 0.5;
+    const double ry = (labelBB.height() - 1) / 2.0 + 0.5;
+    for (int y = labelBB.top(); y < labelBB.bottom(); ++y) {
+        for (int x = labelBB.left(); x < labelBB.right(); ++x) {
+            const double dx = (x - cx) / rx;
+            const double dy = (y - cy) / ry;
+            label(x, y) = dx * dx + dy * dy <= 1.0 ? 1 : 0;
+        }
+    }
+
+    const MaskType fullMask(labelMask(label, 1, unionBB));
+    std::vector<MaskPyramidType*>* fullGP =
+        enblend::gaussianPyramid<MaskType, MaskPyramidType,
+                                 MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                 SKIPSMMaskPixelType>(numLevels, false, srcImageRange(fullMask));
+
+    const MaskType roiMask(labelMask(label, 1, roiBB));
+    std::vector<MaskPyramidType*>* maskGP =
+        enblend::gaussianPyramid<MaskType, MaskPyramidType,
+                                 MaskPyramidIntegerBits, MaskPyramidFractionBits,
+                                 SKIPSMMaskPixelType>(numLevels, false, srcImageRange(roiMask));
+    ImageType image(size);
+    AlphaType alpha(size, vigra::NumericTraits<AlphaType::value_type>::max());
+    fillLayer(image, 0);
+    std::vector<ImagePyramidType*>* layerLP =
+        enblend::laplacianPyramid<ImageType, AlphaType, ImagePyramidType,
+                                  ImagePyramidIntegerBits, ImagePyramidFractionBits,
+                                  SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+        ("layerGP", numLevels, false,
+         vigra_ext::apply(roiBB, srcImageRange(image)),
+         vigra_ext::apply(roiBB, maskImage(alpha)));
+
+    std::vector<ImagePyramidType*>* blendLP = emptyPyramid<ImagePyramidType>(numLevels, size);
+    std::vector<MaskPyramidType*>* weightGP = emptyPyramid<MaskPyramidType>(numLevels, size);
+    enblend::accumulateBlend(maskGP, layerLP, blendLP, weightGP, roiBB.upperLeft(), pyramidWhite());
+
+    for (unsigned int l = 0; l < numLevels; ++l) {
+        std::ostringstream oss;
+        oss << name << ": accumulated weights match mask pyramid of the union in level " << l;
+        test::check(equalImages(*(*weightGP)[l], *(*fullGP)[l]), oss.str());
+    }
+
+    deletePyramid(fullGP);
+    deletePyramid(maskGP);
+    deletePyramid(layerLP);
+    deletePyramid(blendLP);
+    deletePyramid(weightGP);
+}
+
+
+// Two layers blended simultaneously along a seam give the sequential
+// blend of the two along the same seam, except for rounding.
+static void
+testTwoLayers(const std::string& name, const vigra::Size2D& size)
+{
+    const unsigned int numLevels = enblend::numberOfPyramidLevels(std::min(size.x, size.y));
+    ImageType layer1(size);
+    ImageType layer2(size);
+    fillLayer(layer1, 0);
+    fillLayer(layer2, 1);
+    const AlphaType alpha(size, vigra::NumericTraits<AlphaType::value_type>::max());
+    const LabelType label(seamLabels(size));
+
+    const vigra::Rect2D unionBB(size);
+    test::check(enblend::simultaneousRoiBounds(unionBB, labelBounds(label, 2), numLevels, false) != unionBB,
+                name + ": region of interest of the second layer is smaller than the union");
+
+    const ImageType sequential =
+        sequentialBlend(layer1, layer2, alpha, labelMask(label, 1, unionBB), numLevels);
+    std::vector<const ImageType*> layers;
+    layers.push_back(&layer1);
+    layers.push_back(&layer2);
+    const ImageType simultaneous = simultaneousBlend(layers, alpha, label, numLevels);
+
+    int maxDifference = 0;
+    double meanDifference = 0.0;
+    for (int y = 0; y < size.y; ++y) {
+        for (int x = 0; x < size.x; ++x) {
+            const int difference = std::abs(static_cast<int>(sequential(x, y)) - static_cast<int>(simultaneous(x, y)));
+            maxDifference = std::max(maxDifference, difference);
+            meanDifference += difference;
+        }
+    }
+    meanDifference /= size.x * size.y;
+
+    std::ostringstream oss;
+    oss << name << ": simultaneous blend matches sequential blend (max difference " << maxDifference <<
+        ", mean difference " << meanDifference << ")";
+    test::check(maxDifference <= 3 && meanDifference <= 0.5, oss.str());
+}
+
+
+int
+main()
+{
+    // Few levels keep the filter small compared to the images, so
+    // the regions of interest are smaller than the union.
+    ExactLevels = 4;
+
+    const vigra::Size2D size(203, 151);
+    testLevelOffset("inner region", size, vigra::Rect2D(vigra::Point2D(101, 63), vigra::Point2D(141, 97)));
+    testLevelOffset("region at the lower right corner", size,
+                    vigra::Rect2D(vigra::Point2D(170, 121), vigra::Point2D(203, 151)));
+    testLevelOffset("region at the upper left corner", size,
+                    vigra::Rect2D(vigra::Point2D(3, 5), vigra::Point2D(29, 41)));
+
+    testTwoLayers("two layers 203x151", size);
+    testTwoLayers("two layers 240x97", vigra::Size2D(240, 97));
+
+    ExactLevels = 0;
+
+    return test::failures == 0 ? 0 : 1;
+}
+
+
+// Local Variables:
+// mode: c++
+// End:
@@ -0,0 +1,229 @@
+/*
+ * This file is part of Enblend.
+ *
+ * Enblend is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Enblend is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Enblend; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// Checks that the strip pyramids, which live in temporary files, are
+// identical to the pyramids in memory, level by level and after
+// collapsing, for strips lower than, equal to, and higher than the
+// halo.
+
+#include "globals.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vigra/basicimage.hxx>
+#include <vigra/rgbvalue.hxx>
+
+#include "common.h"
+#include "openmp_def.h"
+#include "openmp_vigra.h"
+#include "numerictraits.h"
+#include "fixmath.h"
+#include "parameter.h"
+#include "pyramid.h"
+
+
+static unsigned int
+nextRandom(unsigned int& state)
+{
+    state = state * 1103515245U + 12345U;
+    return (state >> 16) & 0x7fffU;
+}
+
+
+template <typename T>
+static void
+setRandom(T& value, unsigned int& state)
+{
+    value = static_cast<T>(nextRandom(state));
+}
+
+
+static void
+setRandom(float& value, unsigned int& state)
+{
+    value = static_cast<float>(nextRandom(state)) / 32767.0f;
+}
+
+
+template <typename T>
+static void
+setRandom(vigra::RGBValue<T>& value, unsigned int& state)
+{
+    for (int channel = 0; channel < 3; ++channel) {
+        setRandom(value[channel], state);
+    }
+}
+
+
+template <typename ImageType>
+static void
+fillImage(ImageType& image, unsigned int seed)
+{
+    for (typename ImageType::iterator i = image.begin(); i != image.end(); ++i) {
+        setRandom(*i, seed);
+    }
+}
+
+
+// Opaque except for a rectangle and every 13th pixel.
+template <typename AlphaType>
+static void
+fillAlpha(AlphaType& alpha)
+{
+    const typename AlphaType::value_type opaque = vigra::NumericTraits<typename AlphaType::value_type>::max();
+
+    for (int y = 0; y < alpha.height(); ++y) {
+        for (int x = 0; x < alpha.width(); ++x) {
+            const bool hole = (x > alpha.width() / 3 && x < alpha.width() / 2 && y > alpha.height() / 4) ||
+                (x + y * alpha.width()) % 13 == 0;
+            alpha(x, y) = hole ? 0 : opaque;
+        }
+    }
+}
+
+
+template <typename ImageType>
+static bool
+equalImages(const ImageType& a, const ImageType& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+
+template <typename PyramidImageType>
+static void
+comparePyramids(const std::string& description,
+                std::vector<PyramidImageType*>* inCore,
+                std::vector<enblend::StripImage<PyramidImageType>*>* strips)
+{
+    test::check(inCore->size() == strips->size(), description + ": number of levels");
+
+    PyramidImageType level;
+    for (unsigned int l = 0; l < std::min(inCore->size(), strips->size()); ++l) {
+        (*strips)[l]->read(0, (*strips)[l]->height(), level);
+        std::ostringstream oss;
+        oss << description << ": level " << l;
+        test::check(equalImages(*(*inCore)[l], level), oss.str());
+    }
+}
+
+
+template <typename PyramidImageType>
+static void
+deletePyramid(std::vector<PyramidImageType*>* p)
+{
+    for (unsigned int i = 0; i < p->size(); i++) {
+        delete (*p)[i];
+    }
+    delete p;
+}
+
+
+template <typename ImagePixelType>
+static void
+testStripPyramid(const std::string& name, int width, int height, unsigned int numLevels, bool wraparound)
+{
+    typedef enblend::EnblendNumericTraits<ImagePixelType> Traits;
+    typedef typename Traits::ImageType ImageType;
+    typedef typename Traits::AlphaType AlphaType;
+    typedef typename Traits::ImagePyramidType PyramidType;
+    enum {IntegerBits = Traits::ImagePyramidIntegerBits};
+    enum {FractionBits = Traits::ImagePyramidFractionBits};
+    typedef typename Traits::SKIPSMImagePixelType SKIPSMImagePixelType;
+    typedef typename Traits::SKIPSMAlphaPixelType SKIPSMAlphaPixelType;
+
+    std::ostringstream oss;
+    oss << name << " " << width << "x" << height << ", strip height " << enblend::pyramidStripHeight() <<
+        (wraparound ? ", wraparound" : "");
+    const std::string description(oss.str());
+
+    ImageType image(width, height);
+    AlphaType alpha(width, height);
+    fillImage(image, 1U);
+    fillAlpha(alpha);
+
+    // Gaussian pyramid without alpha channel
+    {
+        std::vector<PyramidType*>* inCore =
+            enblend::gaussianPyramid<ImageType, PyramidType, IntegerBits, FractionBits,
+                                     SKIPSMImagePixelType>(numLevels, wraparound, srcImageRange(image));
+        std::vector<enblend::StripImage<PyramidType>*>* strips =
+            enblend::gaussianStripPyramid<ImageType, PyramidType, IntegerBits, FractionBits,
+                                          SKIPSMImagePixelType>(numLevels, wraparound, srcImageRange(image));
+
+        comparePyramids(description + ", Gaussian pyramid", inCore, strips);
+
+        deletePyramid(inCore);
+        enblend::deleteStripPyramid(strips);
+    }
+
+    // Laplacian pyramid with alpha channel and its collapse
+    {
+        std::vector<PyramidType*>* inCore =
+            enblend::laplacianPyramid<ImageType, AlphaType, PyramidType, IntegerBits, FractionBits,
+                                      SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            ("test", numLevels, wraparound, srcImageRange(image), maskImage(alpha));
+        std::vector<enblend::StripImage<PyramidType>*>* strips =
+            enblend::laplacianStripPyramid<ImageType, AlphaType, PyramidType, IntegerBits, FractionBits,
+                                           SKIPSMImagePixelType, SKIPSMAlphaPixelType>
+            (numLevels, wraparound, srcImageRange(image), maskImage(alpha));
+
+        comparePyramids(description + ", Laplacian pyramid", inCore, strips);
+
+        enblend::collapsePyramid<SKIPSMImagePixelType>(wraparound, inCore);
+        enblend::collapseStripPyramid<SKIPSMImagePixelType>(wraparound, strips);
+
+        PyramidType collapsed;
+        (*strips)[0]->read(0, height, collapsed);
+        test::check(equalImages(*(*inCore)[0], collapsed), description + ", collapsed Laplacian pyramid");
+
+        deletePyramid(inCore);
+        enblend::deleteStripPyramid(strips);
+    }
+}
+
+
+int
+main()
+{
+    const unsigned int stripHeights[] = {3U, 8U, 16U};
+
+    for (unsigned int stripHeight : stripHeights) {
+        std::ostringstream oss;
+        oss << stripHeight;
+        parameter::insert("pyramid-strip-height", oss.str());
+
+        for (bool wraparound : {false, true}) {
+            testStripPyramid<vigra::UInt8>("UInt8", 67, 45, 4U, wraparound);
+            testStripPyramid<vigra::RGBValue<vigra::UInt16> >("RGB UInt16", 40, 33, 3U, wraparound);
+            testStripPyramid<float>("float", 52, 61, 4U, wraparound);
+        }
+    }
+
+    parameter::erase("pyramid-strip-height");
+
+    return test::failures == 0 ? 0 : 1;
+}
+
+
+// Local Variables:
+// mode: c++
+// End:
@@ -0,0 +1,199 @@
+/**
+ * @file CommandGraph.cpp
+ * @brief dependency graph of a CommandQueue for running independent commands in parallel
+ *
+ */
+
+/*  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "CommandGraph.h"
+
+#include <map>
+#include <set>
+
+namespace HuginQueue
+{
+    CommandGraph::CommandGraph(const CommandQueue& queue, unsigned int cores, unsigned long long memory)
+        : m_cores(cores > 0 ? cores : 1), m_memoryBudget(memory), m_usedMemory(0),
+          m_finishedCount(0), m_runningCount(0), m_failed(false)
+    {
+        const size_t count = queue.size();
+        m_freeCores = m_cores;
+        m_dependencies.resize(count);
+        m_dependents.resize(count);
+        m_unfinishedDependencies.resize(count, 0);
+        m_states.resize(count, WAITING);
+        m_memory.resize(count, 0);
+        m_threads.resize(count, 0);
+        // last command which has written the file
+        std::map<wxString, size_t> lastWriter;
+        // commands which have read the file since it was written last
+        std::map<wxString, std::vector<size_t> > readers;
+        bool hasBarrier = false;
+        size_t lastBarrier = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const NormalCommand* cmd = queue[i];
+            m_memory[i] = cmd->GetEstimatedMemory();
+            std::set<size_t> deps;
+            if (cmd->HasFiles())
+            {
+                if (hasBarrier)
+                {
+                    deps.insert(lastBarrier);
+                };
+                const wxArrayString& inputFiles = cmd->GetInputFiles();
+                const wxArrayString& outputFiles = cmd->GetOutputFiles();
+                // read after write
+                for (size_t j = 0; j < inputFiles.size(); ++j)
+                {
+                    std::map<wxString, size_t>::const_iterator writer = lastWriter.find(inputFiles[j]);
+                    if (writer != lastWriter.end())
+                    {
+                        deps.insert(writer->second);
+                    };
+                };
+                // write after write and write after read
+                for (size_t j = 0; j < outputFiles.size(); ++j)
+                {
+                    std::map<wxString, size_t>::const_iterator writer = lastWriter.find(outputFiles[j]);
+                    if (writer != lastWriter.end())
+                    {
+                        deps.insert(writer->second);
+                    };
+                    std::map<wxString, std::vector<size_t> >::const_iterator reader = readers.find(outputFiles[j]);
+                    if (reader != readers.end())
+                    {
+                        deps.insert(reader->second.begin(), reader->second.end());
+                    };
+                };
+                for (size_t j = 0; j < inputFiles.size(); ++j)
+                {
+                    readers[inputFiles[j]].push_back(i);
+                };
+                for (size_t j = 0; j < outputFiles.size(); ++j)
+                {
+                    lastWriter[outputFiles[j]] = i;
+                    readers.erase(outputFiles[j]);
+                };
+            }
+            else
+            {
+                // unknown files, wait for all previous commands
+                for (size_t j = 0; j < i; ++j)
+                {
+                    deps.insert(j);
+                };
+                hasBarrier = true;
+                lastBarrier = i;
+            };
+            // a command reading and writing the same file does not depend on itself
+            deps.erase(i);
+            m_dependencies[i].assign(deps.begin(), deps.end());
+            m_unfinishedDependencies[i] = deps.size();
+            for (std::set<size_t>::const_iterator it = deps.begin(); it != deps.end(); ++it)
+            {
+                m_dependents[*it].push_back(i);
+            };
+        };
+    };
+
+    std::vector<CommandGraph::StartInfo> CommandGraph::StartCommands()
+    {
+        std::vector<StartInfo> starts;
+        if (m_failed)
+        {
+            return starts;
+        };
+        unsigned long long usedMemory = m_usedMemory;
+        for (size_t i = 0; i < m_states.size() && starts.size() < m_freeCores; ++i)
+        {
+            if (m_states[i] != WAITING || m_unfinishedDependencies[i] > 0)
+            {
+                continue;
+            };
+            // a command which does not fit into the memory budget is only started,
+            // when nothing else is running
+            if (m_memoryBudget > 0 && usedMemory + m_memory[i] > m_memoryBudget &&
+                (m_runningCount > 0 || !starts.empty()))
+            {
+                continue;
+            };
+            StartInfo start;
+            start.index = i;
+            start.threads = 0;
+            starts.push_back(start);
+            usedMemory += m_memory[i];
+        };
+        if (starts.empty())
+        {
+            return starts;
+        };
+        // split the free cores evenly between the started commands
+        const unsigned int share = m_freeCores / starts.size();
+        const unsigned int remainder = m_freeCores % starts.size();
+        for (size_t i = 0; i < starts.size(); ++i)
+        {
+            starts[i].threads = share + (i < remainder ? 1 : 0);
+            m_threads[starts[i].index] = starts[i].threads;
+            m_states[starts[i].index] = RUNNING;
+        };
+        m_freeCores = 0;
+        m_usedMemory = usedMemory;
+        m_runningCount += starts.size();
+        return starts;
+    };
+
+    void CommandGraph::SetFinished(const size_t index, const bool success)
+    {
+        if (m_states[index] != RUNNING)
+        {
+            return;
+        };
+        m_states[index] = FINISHED;
+        m_freeCores += m_threads[index];
+        m_usedMemory -= m_memory[index];
+        --m_runningCount;
+        ++m_finishedCount;
+        if (!success)
+        {
+            m_failed = true;
+        };
+        for (size_t i = 0; i < m_dependents[index].size(); ++i)
+        {
+            --m_unfinishedDependencies[m_dependents[index][i]];
+        };
+    };
+
+    bool CommandGraph::IsFinished() const
+    {
+        return m_runningCount == 0 && (m_failed || m_finishedCount == m_states.size());
+    };
+
+    bool QueueHasFiles(const CommandQueue& queue)
+    {
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            if (queue[i]->HasFiles())
+            {
+                return true;
+            };
+        };
+        return false;
+    };
+
+}; // namespace
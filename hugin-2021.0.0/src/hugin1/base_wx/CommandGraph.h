@@ -0,0 +1,102 @@
+/**
+ * @file CommandGraph.h
+ * @brief dependency graph of a CommandQueue for running independent commands in parallel
+ *
+ */
+
+/*  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef COMMANDGRAPH_H
+#define COMMANDGRAPH_H
+
+#include <hugin_shared.h>
+#include <vector>
+#include "Executor.h"
+
+namespace HuginQueue
+{
+    /** dependency graph of the commands in a CommandQueue
+     *
+     *  A command depends on all earlier commands which write a file it reads,
+     *  or which read or write a file it writes. Commands without known files
+     *  (see NormalCommand::SetFiles) act as barrier: they depend on all earlier
+     *  commands and all later commands depend on them. So running the commands
+     *  in any order allowed by the graph gives the same result as running
+     *  the queue sequentially.
+     *
+     *  The graph also distributes a budget of cores and memory: only so many
+     *  commands are started that their estimated memory fits into the budget,
+     *  and the free cores are split between the started commands.
+     */
+    class WXIMPEX CommandGraph
+    {
+    public:
+        /** a command which can be started now */
+        struct StartInfo
+        {
+            /** index of the command in the queue */
+            size_t index;
+            /** number of threads the command should use */
+            unsigned int threads;
+        };
+        /** builds the graph for the given queue
+         *  @param queue commands, the graph does not take the ownership
+         *  @param cores number of cores, which can be used in total
+         *  @param memory memory budget in bytes, 0 for no limit
+         */
+        CommandGraph(const CommandQueue& queue, unsigned int cores, unsigned long long memory);
+        /** returns the number of commands */
+        size_t GetCommandCount() const { return m_dependencies.size(); };
+        /** returns the indices of all commands the given command depends on */
+        const std::vector<size_t>& GetDependencies(const size_t index) const { return m_dependencies[index]; };
+        /** returns the commands which can be started now and marks them as running,
+         *  returns nothing after a command failed */
+        std::vector<StartInfo> StartCommands();
+        /** marks the command as finished and gives its resources back */
+        void SetFinished(const size_t index, const bool success);
+        /** returns true, if all commands are finished or a command failed
+         *  and no command is running anymore */
+        bool IsFinished() const;
+        /** returns true, if a command failed */
+        bool HasFailed() const { return m_failed; };
+        /** returns the number of finished commands */
+        size_t GetFinishedCount() const { return m_finishedCount; };
+        /** returns the number of running commands */
+        size_t GetRunningCount() const { return m_runningCount; };
+    private:
+        enum CommandState { WAITING, RUNNING, FINISHED };
+        std::vector<std::vector<size_t> > m_dependencies;
+        std::vector<std::vector<size_t> > m_dependents;
+        std::vector<size_t> m_unfinishedDependencies;
+        std::vector<CommandState> m_states;
+        std::vector<unsigned long long> m_memory;
+        std::vector<unsigned int> m_threads;
+        unsigned int m_cores;
+        unsigned int m_freeCores;
+        unsigned long long m_memoryBudget;
+        unsigned long long m_usedMemory;
+        size_t m_finishedCount;
+        size_t m_runningCount;
+        bool m_failed;
+    };
+
+    /** returns true, if at least one command of the queue knows its input and output files */
+    WXIMPEX bool QueueHasFiles(const CommandQueue& queue);
+
+}; // namespace
+
+#endif
@@ -22,9 +22,18 @@
 */
 
 #include "Executor.h"
+#include "CommandGraph.h"
 #include "hugin_config.h"
 
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <wx/app.h>
+#include <wx/apptrait.h>
+#include <wx/evtloop.h>
+#include <wx/process.h>
+#include <wx/thread.h>
 #include <wx/utils.h>
 #include <wx/config.h>
 #include <wx/filename.h>
@@ -34,6 +43,12 @@
 #include "base_wx/platform.h"
 #endif
 #include "base_wx/wxPlatform.h"
+#include "hugin_utils/platform.h"
+#ifdef __WXMSW__
+#include <wx/msw/wrapwin.h>
+#elif defined UNIX_LIKE
+#include <unistd.h>
+#endif
 
 namespace HuginQueue
 {
@@ -67,6 +82,13 @@ namespace HuginQueue
         return m_comment;
     };
 
+    void NormalCommand::SetFiles(const wxArrayString& inputFiles, const wxArrayString& outputFiles)
+    {
+        m_inputFiles = inputFiles;
+        m_outputFiles = outputFiles;
+        m_hasFiles = true;
+    };
+
     // optional command, returns always true, even if process failed
     bool OptionalCommand::Execute(bool dryRun)
     {
@@ -79,6 +101,88 @@ namespace HuginQueue
         return false;
     };
 
+    namespace
+    {
+        /** set temp dir from preferences for all started programs */
+        void SetTempDirEnv()
+        {
+            wxString tempDir = wxConfig::Get()->Read(wxT("tempDir"), wxT(""));
+            if (!tempDir.IsEmpty())
+            {
+#ifdef UNIX_LIKE
+                wxSetEnv(wxT("TMPDIR"), tempDir);
+#else
+                wxSetEnv(wxT("TMP"), tempDir);
+#endif
+            };
+        };
+
+        /** process started by RunCommandsGraph, remembers the termination */
+        class GraphProcess : public wxProcess
+        {
+        public:
+            GraphProcess() : wxProcess(), m_terminated(false), m_status(0) {};
+            virtual void OnTerminate(int pid, int status)
+            {
+                m_terminated = true;
+                m_status = status;
+            };
+            bool IsTerminated() const { return m_terminated; };
+            int GetStatus() const { return m_status; };
+        private:
+            bool m_terminated;
+            int m_status;
+        };
+    };
+
+    // memory budget for the commands running in parallel
+    unsigned long long GetMemoryBudget()
+    {
+        wxConfigBase* config = wxConfigBase::Get();
+        // user defined limit in MB
+        const long budget = config->Read(wxT("/output/MemoryBudget"), 0l);
+        if (budget > 0)
+        {
+            return static_cast<unsigned long long>(budget) << 20;
+        };
+#ifdef __WXMSW__
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        if (GlobalMemoryStatusEx(&status))
+        {
+            return status.ullAvailPhys;
+        };
+#else
+#ifdef __linux__
+        // MemAvailable includes the reclaimable page cache, in contrast to the free memory
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        unsigned long long value;
+        while (meminfo >> key >> value)
+        {
+            if (key == "MemAvailable:")
+            {
+                // value is given in kB
+                return value << 10;
+            };
+            meminfo.ignore(256, '\n');
+        };
+#endif
+#ifdef UNIX_LIKE
+        // use a fraction of the physical memory, when the available memory is not known
+        const long pages = sysconf(_SC_PHYS_PAGES);
+        const long pageSize = sysconf(_SC_PAGE_SIZE);
+        if (pages > 0 && pageSize > 0)
+        {
+            const long percent = std::min(std::max(config->Read(wxT("/output/MemoryBudgetPercent"), 50l), 1l), 100l);
+            return static_cast<unsigned long long>(pages) * pageSize / 100 * percent;
+        };
+#endif
+#endif
+        // no information about the memory, don't limit the parallel commands
+        return 0;
+    };
+
     // execute the command queue
     bool RunCommandsQueue(CommandQueue* queue, size_t threads, bool dryRun)
     {
@@ -90,15 +194,7 @@ namespace HuginQueue
             wxSetEnv(wxT("OMP_NUM_THREADS"), s);
         };
         // set temp dir
-        wxString tempDir = wxConfig::Get()->Read(wxT("tempDir"), wxT(""));
-        if (!tempDir.IsEmpty())
-        {
-#ifdef UNIX_LIKE
-            wxSetEnv(wxT("TMPDIR"), tempDir);
-#else
-            wxSetEnv(wxT("TMP"), tempDir);
-#endif
-        };
+        SetTempDirEnv();
         bool isSuccessful = true;
         size_t i = 0;
         // prevent displaying message box if wxExecute failed
@@ -115,6 +211,88 @@ namespace HuginQueue
         return isSuccessful;
     };
 
+    // execute the command queue, independent commands run in parallel
+    bool RunCommandsGraph(CommandQueue* queue, size_t threads, unsigned long long memory, bool dryRun)
+    {
+        if (dryRun || !QueueHasFiles(*queue) || wxTheApp == NULL)
+        {
+            // nothing to run in parallel
+            return RunCommandsQueue(queue, threads, dryRun);
+        };
+        if (threads == 0)
+        {
+            const int cpuCount = wxThread::GetCPUCount();
+            threads = cpuCount > 0 ? cpuCount : 1;
+        };
+        if (memory == 0)
+        {
+            memory = GetMemoryBudget();
+        };
+        SetTempDirEnv();
+        // OMP_NUM_THREADS is set for each started program separately
+        wxExecuteEnv env;
+        wxGetEnvMap(&env.env);
+        // prevent displaying message box if wxExecute failed
+        wxLogStream log(&std::cerr);
+        CommandGraph graph(*queue, threads, memory);
+        std::map<size_t, GraphProcess*> running;
+        // the termination of asynchronous processes is reported by the event loop
+        wxEventLoopBase* loop = wxTheApp->GetTraits()->CreateEventLoop();
+        {
+            wxEventLoopActivator activator(loop);
+            while (!graph.IsFinished())
+            {
+                const std::vector<CommandGraph::StartInfo> starts = graph.StartCommands();
+                for (size_t i = 0; i < starts.size(); ++i)
+                {
+                    NormalCommand* cmd = (*queue)[starts[i].index];
+                    if (!cmd->GetComment().IsEmpty())
+                    {
+                        std::cout << std::endl << cmd->GetComment().mb_str(wxConvLocal) << std::endl;
+                    };
+                    wxString s;
+                    s << starts[i].threads;
+                    env.env[wxT("OMP_NUM_THREADS")] = s;
+                    GraphProcess* process = new GraphProcess();
+                    if (wxExecute(cmd->GetCommand(), wxEXEC_ASYNC | wxEXEC_MAKE_GROUP_LEADER, process, &env) == 0)
+                    {
+                        delete process;
+                        graph.SetFinished(starts[i].index, !cmd->CheckReturnCode());
+                    }
+                    else
+                    {
+                        running[starts[i].index] = process;
+                    };
+                };
+                if (running.empty())
+                {
+                    continue;
+                };
+                loop->DispatchTimeout(100);
+                for (std::map<size_t, GraphProcess*>::iterator it = running.begin(); it != running.end();)
+                {
+                    if (it->second->IsTerminated())
+                    {
+                        const bool success = it->second->GetStatus() == 0 || !(*queue)[it->first]->CheckReturnCode();
+                        graph.SetFinished(it->first, success);
+                        delete it->second;
+                        running.erase(it++);
+                    }
+                    else
+                    {
+                        ++it;
+                    };
+                };
+            };
+        }
+        delete loop;
+        const bool isSuccessful = !graph.HasFailed();
+        // clean up queue
+        CleanQueue(queue);
+        delete queue;
+        return isSuccessful;
+    };
+
     void CleanQueue(CommandQueue* queue)
     {
         while (!queue->empty())
@@ -27,6 +27,7 @@
 #include <hugin_shared.h>
 #include <vector>
 #include <wx/string.h>
+#include <wx/arrstr.h>
 #include <wx/config.h>
 #include "base_wx/wxPlatform.h"
 
@@ -37,16 +38,30 @@ namespace HuginQueue
     class WXIMPEX NormalCommand 
     {
     public:
-        NormalCommand(wxString prog, wxString args, wxString comment=wxEmptyString) : m_prog(prog), m_args(args), m_comment(comment) {};
+        NormalCommand(wxString prog, wxString args, wxString comment=wxEmptyString) : m_prog(prog), m_args(args), m_comment(comment), m_hasFiles(false), m_memory(0) {};
         virtual ~NormalCommand() {};
         virtual bool Execute(bool dryRun);
         virtual bool CheckReturnCode() const;
         virtual wxString GetCommand() const;
         wxString GetComment() const;
+        /** set the files read and written by the command, they are used to
+            find the commands which can run in parallel (see CommandGraph) */
+        void SetFiles(const wxArrayString& inputFiles, const wxArrayString& outputFiles);
+        /** returns true, if the files read and written are known */
+        bool HasFiles() const { return m_hasFiles; };
+        const wxArrayString& GetInputFiles() const { return m_inputFiles; };
+        const wxArrayString& GetOutputFiles() const { return m_outputFiles; };
+        /** set the estimated peak memory usage of the command in bytes, 0 if unknown */
+        void SetEstimatedMemory(unsigned long long memory) { m_memory = memory; };
+        unsigned long long GetEstimatedMemory() const { return m_memory; };
     protected:
         wxString m_prog;
         wxString m_args;
         wxString m_comment;
+        bool m_hasFiles;
+        wxArrayString m_inputFiles;
+        wxArrayString m_outputFiles;
+        unsigned long long m_memory;
     };
 
     /** optional command for queue, processing of queue is always continued, also if an error occurred */
@@ -63,6 +78,20 @@ namespace HuginQueue
     /** execute the given, set environment variable OMP_NUM_THREADS to threads (ignored for 0) 
         after running the function the queue is cleared */
     WXIMPEX bool RunCommandsQueue(CommandQueue* queue, size_t threads, bool dryRun);
+    /** execute the given queue, independent commands run in parallel
+        the dependencies are derived from the files of the commands (see CommandGraph),
+        commands without files are run sequential as in RunCommandsQueue
+        @param queue commands to execute, the queue is cleared and deleted afterwards
+        @param threads number of cores which can be used by all commands (0 for all available cores)
+        @param memory memory budget in bytes (0 for the default of GetMemoryBudget)
+        @param dryRun only print the commands */
+    WXIMPEX bool RunCommandsGraph(CommandQueue* queue, size_t threads, unsigned long long memory, bool dryRun);
+    /** return the default memory budget in bytes for commands running in parallel:
+        the setting /output/MemoryBudget (in MB) if set, otherwise the available
+        memory as reported by the system (MemAvailable on Linux) or as fallback
+        the percentage /output/MemoryBudgetPercent (default 50) of the physical memory,
+        0 if nothing is known */
+    WXIMPEX unsigned long long GetMemoryBudget();
     /** clean the queue, delete all entries, but not the queue itself */
     WXIMPEX void CleanQueue(CommandQueue* queue);
 
@@ -34,6 +34,7 @@
 
 #include "wx/ffile.h"
 #include "wx/process.h"
+#include "wx/thread.h"
 #include "wx/mimetype.h"
 #include <wx/sstream.h>
 
@@ -76,7 +77,8 @@ END_EVENT_TABLE()
 // frame constructor
 MyExecPanel::MyExecPanel(wxWindow * parent)
        : wxPanel(parent),
-       m_timerIdleWakeUp(this), m_queue(NULL), m_queueLength(0), m_checkReturnCode(true)
+       m_timerIdleWakeUp(this), m_queue(NULL), m_queueLength(0), m_checkReturnCode(true),
+       m_graph(NULL), m_graphStatus(0)
 {
     m_pidLast = 0;
 
@@ -101,13 +103,29 @@ MyExecPanel::MyExecPanel(wxWindow * parent)
 
 void MyExecPanel::KillProcess()
 {
-    if (m_pidLast) {
+    if (m_graph)
+    {
+        // kill all running commands
+        for (std::map<long, size_t>::const_iterator it = m_graphPids.begin(); it != m_graphPids.end(); ++it)
+        {
+            KillProcessGroup(it->first);
+        };
+    }
+    else
+    {
+        KillProcessGroup(m_pidLast);
+    };
+}
+
+void MyExecPanel::KillProcessGroup(long pid)
+{
+    if (pid) {
 #ifdef __WXMSW__
-        DEBUG_DEBUG("Killing process " << m_pidLast << " with sigkill");
-        wxKillError rc = wxProcess::Kill(m_pidLast, wxSIGKILL, wxKILL_CHILDREN);
+        DEBUG_DEBUG("Killing process " << pid << " with sigkill");
+        wxKillError rc = wxProcess::Kill(pid, wxSIGKILL, wxKILL_CHILDREN);
 #else
-        DEBUG_DEBUG("Killing process " << m_pidLast << " with sigterm");
-        wxKillError rc = wxProcess::Kill(m_pidLast, wxSIGTERM, wxKILL_CHILDREN);
+        DEBUG_DEBUG("Killing process " << pid << " with sigterm");
+        wxKillError rc = wxProcess::Kill(pid, wxSIGTERM, wxKILL_CHILDREN);
 #endif
         if ( rc != wxKILL_OK ) {
             static const wxChar *errorText[] =
@@ -120,13 +138,28 @@ void MyExecPanel::KillProcess()
             };
 
             wxLogError(_("Failed to kill process %ld, error %d: %s"),
-                        m_pidLast, rc, errorText[rc]);
+                        pid, rc, errorText[rc]);
         }
     }
 }
 
-/**function to pause running process, argument pause defaults to true - to resume, set it to false*/
+/**function to pause running processes, argument pause defaults to true - to resume, set it to false*/
 void MyExecPanel::PauseProcess(bool pause)
+{
+    if (m_graph)
+    {
+        for (std::map<long, size_t>::const_iterator it = m_graphPids.begin(); it != m_graphPids.end(); ++it)
+        {
+            PauseProcessGroup(it->first, pause);
+        };
+    }
+    else
+    {
+        PauseProcessGroup(m_pidLast, pause);
+    };
+}
+
+void MyExecPanel::PauseProcessGroup(long pid, bool pause)
 {
 #ifdef __WXMSW__
 	HANDLE hProcessSnapshot = NULL;
@@ -137,7 +170,7 @@ void MyExecPanel::PauseProcess(bool pause)
 	hProcessSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
 
 	if (hProcessSnapshot == INVALID_HANDLE_VALUE)
-		wxLogError(_("Error pausing process %ld, code 1"),m_pidLast);
+		wxLogError(_("Error pausing process %ld, code 1"),pid);
 	else
 	{
 		pEntry.dwSize = sizeof(PROCESSENTRY32);
@@ -149,12 +182,12 @@ void MyExecPanel::PauseProcess(bool pause)
 			do
 			{
 				//we pause threads of the main (make) process and its children (nona,enblend...)
-				if((pEntry.th32ProcessID == m_pidLast) || (pEntry.th32ParentProcessID == m_pidLast))
+				if((pEntry.th32ProcessID == pid) || (pEntry.th32ParentProcessID == pid))
 				{
 					//we take a snapshot of all system threads
 					HANDLE hThreadSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0); 
 					if (hThreadSnapshot == INVALID_HANDLE_VALUE)
-						wxLogError(_("Error pausing process %ld, code 2"),m_pidLast);
+						wxLogError(_("Error pausing process %ld, code 2"),pid);
 
 					//we traverse all threads
 					if(Thread32First(hThreadSnapshot, &tEntry))
@@ -182,9 +215,9 @@ void MyExecPanel::PauseProcess(bool pause)
 #else
 	//send the process group a pause/cont signal
 	if(pause)
-		killpg(m_pidLast,SIGSTOP);
+		killpg(pid,SIGSTOP);
 	else
-		killpg(m_pidLast,SIGCONT);
+		killpg(pid,SIGCONT);
 #endif //__WXMSW__
 }
 
@@ -275,9 +308,74 @@ int MyExecPanel::ExecQueue(HuginQueue::CommandQueue* queue)
     {
         return 0;
     };
+    if (HuginQueue::QueueHasFiles(*m_queue))
+    {
+        // the dependencies between the commands are known,
+        // so run independent commands in parallel
+        unsigned int cores = threads;
+        if (cores == 0)
+        {
+            const int cpuCount = wxThread::GetCPUCount();
+            cores = cpuCount > 0 ? cpuCount : 1;
+        };
+        m_graph = new HuginQueue::CommandGraph(*m_queue, cores, HuginQueue::GetMemoryBudget());
+        m_graphStatus = 0;
+        const int result = ExecGraphCommands();
+        if (result != 0)
+        {
+            delete m_graph;
+            m_graph = NULL;
+        };
+        return result;
+    };
     return ExecNextQueue();
 };
 
+/** start all commands of the graph, which can run now */
+int MyExecPanel::ExecGraphCommands()
+{
+    do
+    {
+        const std::vector<HuginQueue::CommandGraph::StartInfo> starts = m_graph->StartCommands();
+        for (size_t i = 0; i < starts.size(); ++i)
+        {
+            HuginQueue::NormalCommand* cmd = (*m_queue)[starts[i].index];
+            AddString(cmd->GetComment());
+            wxString s;
+            s << starts[i].threads;
+            m_executeEnv.env["OMP_NUM_THREADS"] = s;
+            const wxString cmdString = cmd->GetCommand();
+            MyPipedProcess *process = new MyPipedProcess(this, cmdString);
+            const long pid = wxExecute(cmdString, wxEXEC_ASYNC | wxEXEC_MAKE_GROUP_LEADER, process, &m_executeEnv);
+            if (pid == 0)
+            {
+                wxLogError(_T("Execution of '%s' failed."), cmdString.c_str());
+                delete process;
+                if (cmd->CheckReturnCode())
+                {
+                    m_graphStatus = -1;
+                };
+                m_graph->SetFinished(starts[i].index, !cmd->CheckReturnCode());
+            }
+            else
+            {
+                m_pidLast = pid;
+                m_graphPids[pid] = starts[i].index;
+                AddAsyncProcess(process);
+#ifndef _WIN32
+                setpgid(pid, pid);
+#endif
+            };
+        };
+        if (starts.empty())
+        {
+            break;
+        };
+        // repeat, if all started commands failed immediately
+    } while (m_graphPids.empty() && !m_graph->IsFinished());
+    return m_graphPids.empty() ? -1 : 0;
+};
+
 /** execute next command in queue */
 int MyExecPanel::ExecNextQueue()
 {
@@ -460,6 +558,41 @@ void MyExecPanel::OnProcessTerminated(MyPipedProcess *process, int pid, int stat
 
     RemoveAsyncProcess(process);
 
+    if (m_graph)
+    {
+        std::map<long, size_t>::iterator it = m_graphPids.find(pid);
+        if (it != m_graphPids.end())
+        {
+            const bool success = status == 0 || !(*m_queue)[it->second]->CheckReturnCode();
+            if (!success)
+            {
+                m_graphStatus = status;
+            };
+            m_graph->SetFinished(it->second, success);
+            m_graphPids.erase(it);
+        };
+        // start the commands waiting for this one
+        if (!m_graph->IsFinished())
+        {
+            if (this->GetParent())
+            {
+                wxCommandEvent event(EVT_QUEUE_PROGRESS, wxID_ANY);
+                event.SetInt(hugin_utils::roundi((m_graph->GetFinishedCount() + 1) * 100.0f / m_queueLength));
+                this->GetParent()->GetEventHandler()->AddPendingEvent(event);
+            };
+            if (ExecGraphCommands() == 0)
+            {
+                return;
+            };
+        };
+        // all commands finished or a command failed
+        status = m_graphStatus;
+        m_checkReturnCode = true;
+        HuginQueue::CleanQueue(m_queue);
+        delete m_graph;
+        m_graph = NULL;
+        m_graphPids.clear();
+    };
     if (m_queue && !m_queue->empty())
     {
         // queue has further commands
@@ -488,6 +621,7 @@ void MyExecPanel::OnProcessTerminated(MyPipedProcess *process, int pid, int stat
 
 MyExecPanel::~MyExecPanel()
 {
+    delete m_graph;
     delete m_textctrl;
 }
 
@@ -29,7 +29,9 @@
 
 #include <hugin_shared.h>
 #include <wx/utils.h>
+#include <map>
 #include "Executor.h"
+#include "CommandGraph.h"
 
 const int HUGIN_EXIT_CODE_CANCELLED = -255;
 
@@ -94,6 +96,10 @@ private:
     void RemoveAsyncProcess(MyPipedProcess *process);
 
     int ExecNextQueue();
+    /** start all commands of the graph, which can run now */
+    int ExecGraphCommands();
+    void KillProcessGroup(long pid);
+    void PauseProcessGroup(long pid, bool pause);
 
     // the PID of the last process we launched asynchronously
     long m_pidLast;
@@ -111,6 +117,12 @@ private:
     // if the return code of the process should be checked
     bool m_checkReturnCode;
     wxExecuteEnv m_executeEnv;
+    // dependency graph, when the commands run in parallel
+    HuginQueue::CommandGraph* m_graph;
+    // running commands of the graph (pid -> index in queue)
+    std::map<long, size_t> m_graphPids;
+    // exit code of the failed command of the graph
+    int m_graphStatus;
     // any class wishing to process wxWidgets events must use this macro
     DECLARE_EVENT_TABLE()
 };
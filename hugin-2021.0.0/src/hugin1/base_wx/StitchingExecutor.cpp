@@ -54,6 +54,33 @@ namespace HuginQueue
             return filenames;
         };
 
+        /** returns an array with the given file as only item */
+        wxArrayString SingleFile(const wxString& file)
+        {
+            wxArrayString files;
+            files.Add(file);
+            return files;
+        };
+
+        /** rough estimate of the memory used by a program which processes nrImages
+            images of the size of the output ROI at the same time */
+        unsigned long long EstimateMemory(const HuginBase::PanoramaOptions& opts, const size_t nrImages, const unsigned int bytesPerPixel)
+        {
+            const vigra::Rect2D roi(opts.getROI());
+            return static_cast<unsigned long long>(roi.width()) * roi.height() * bytesPerPixel * nrImages;
+        };
+
+        /** returns the nona switches to remap only the given images */
+        wxString GetImageNumberArgs(const HuginBase::UIntSet& img)
+        {
+            wxString args;
+            for (HuginBase::UIntSet::const_iterator it = img.begin(); it != img.end(); ++it)
+            {
+                args << wxT(" -i ") << *it;
+            };
+            return args;
+        };
+
         /** append all strings from input array to output array */
         void AddToArray(const wxArrayString& input, wxArrayString& output)
         {
@@ -570,6 +597,12 @@ namespace HuginQueue
                 finalNonaArgs.Append(wxT("-o ") + wxEscapeFilename(prefix) + wxT(" ") + quotedProject);
                 commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
                     finalNonaArgs, _("Remapping and blending LDR images...")));
+                wxArrayString nonaOutput(detail::SingleFile(finalFilename));
+                if (opts.outputLDRLayers)
+                {
+                    detail::AddToArray(remappedImages, nonaOutput);
+                };
+                commands->back()->SetFiles(detail::SingleFile(project), nonaOutput);
                 outputFiles.Add(finalFilename);
                 if (copyMetadata)
                 {
@@ -581,6 +614,7 @@ namespace HuginQueue
                 commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
                     nonaArgs + wxT("-r ldr -m TIFF_m -o ") + wxEscapeFilename(prefix) + wxT(" ") + quotedProject,
                     _("Remapping LDR images...")));
+                commands->back()->SetFiles(detail::SingleFile(project), remappedImages);
                 detail::AddToArray(remappedImages, outputFiles);
                 if (opts.outputLDRBlended)
                 {
@@ -593,6 +627,7 @@ namespace HuginQueue
                             finalEnblendArgs + wxT(" ") + GetQuotedFilenamesString(remappedImages), 
                             _("Blending images..."))
                         );
+                        commands->back()->SetFiles(remappedImages, detail::SingleFile(finalFilename));
                         outputFiles.Add(finalFilename);
                         if (copyMetadata)
                         {
@@ -644,6 +679,12 @@ namespace HuginQueue
                 HuginBase::UIntSet exposureLayersNumber;
                 fill_set(exposureLayersNumber, 0, exposureLayers.size() - 1);
                 exposureLayersFiles = detail::GetNumberedFilename(prefix + wxT("_exposure_"), wxT(".tif"), exposureLayersNumber);
+                wxArrayString nonaOutput(exposureLayersFiles);
+                if (opts.outputLDRExposureRemapped || opts.outputLDRStacks || opts.outputLDRExposureBlended)
+                {
+                    detail::AddToArray(remappedImages, nonaOutput);
+                };
+                commands->back()->SetFiles(detail::SingleFile(project), nonaOutput);
                 detail::AddToArray(exposureLayersFiles, outputFiles);
                 if (!opts.outputLDRExposureLayers)
                 {
@@ -656,9 +697,31 @@ namespace HuginQueue
             }
             else
             {
-                commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
-                    nonaArgs + wxT("-r ldr -m TIFF_m --ignore-exposure -o ") + wxEscapeFilename(prefix + wxT("_exposure_layers_")) + wxT(" ") + quotedProject,
-                    _("Remapping LDR images without exposure correction...")));
+                if (stacks.empty())
+                {
+                    stacks = getHDRStacks(pano, allActiveImages, opts);
+                };
+                if (stacks.size() > 1)
+                {
+                    // remap each stack separately, so the stacks can be processed in parallel
+                    for (unsigned stackNr = 0; stackNr < stacks.size(); ++stackNr)
+                    {
+                        commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
+                            nonaArgs + wxT("-r ldr -m TIFF_m --ignore-exposure") + detail::GetImageNumberArgs(stacks[stackNr]) +
+                            wxT(" -o ") + wxEscapeFilename(prefix + wxT("_exposure_layers_")) + wxT(" ") + quotedProject,
+                            wxString::Format(_("Remapping LDR images of stack number %u without exposure correction..."), stackNr)));
+                        commands->back()->SetFiles(detail::SingleFile(project),
+                            detail::GetNumberedFilename(prefix + wxT("_exposure_layers_"), wxT(".tif"), stacks[stackNr]));
+                        commands->back()->SetEstimatedMemory(detail::EstimateMemory(opts, 1, 16));
+                    };
+                }
+                else
+                {
+                    commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
+                        nonaArgs + wxT("-r ldr -m TIFF_m --ignore-exposure -o ") + wxEscapeFilename(prefix + wxT("_exposure_layers_")) + wxT(" ") + quotedProject,
+                        _("Remapping LDR images without exposure correction...")));
+                    commands->back()->SetFiles(detail::SingleFile(project), remappedImages);
+                };
                 detail::AddToArray(remappedImages, outputFiles);
                 if (!opts.outputLDRExposureRemapped)
                 {
@@ -680,6 +743,8 @@ namespace HuginQueue
                             enblendArgs + enLayersCompressionArgs + wxT(" -o ") + wxEscapeFilename(exposureLayerImgName) + wxT(" -- ") + GetQuotedFilenamesString(exposureLayersImgs),
                             wxString::Format(_("Blending exposure layer %u..."), exposureLayer))
                         );
+                        commands->back()->SetFiles(exposureLayersImgs, detail::SingleFile(exposureLayerImgName));
+                        commands->back()->SetEstimatedMemory(detail::EstimateMemory(opts, 2, 24));
                         if (copyMetadata && opts.outputLDRExposureLayers)
                         {
                             filesForCopyTagsExiftool.Add(exposureLayerImgName);
@@ -701,6 +766,7 @@ namespace HuginQueue
                     finalEnfuseArgs + wxT(" ")+GetQuotedFilenamesString(exposureLayersFiles), 
                     _("Fusing all exposure layers..."))
                 );
+                commands->back()->SetFiles(exposureLayersFiles, detail::SingleFile(fusedExposureLayersFilename));
                 outputFiles.Add(fusedExposureLayersFilename);
                 if (copyMetadata)
                 {
@@ -710,7 +776,10 @@ namespace HuginQueue
             if (opts.outputLDRStacks || opts.outputLDRExposureBlended)
             {
                 // fusing stacks, then blending
-                stacks = getHDRStacks(pano, allActiveImages, opts);
+                if (stacks.empty())
+                {
+                    stacks = getHDRStacks(pano, allActiveImages, opts);
+                };
                 wxArrayString stackedImages;
                 // fuse all stacks
                 for (unsigned stackNr = 0; stackNr < stacks.size(); ++stackNr)
@@ -724,6 +793,8 @@ namespace HuginQueue
                         enfuseArgs + enLayersCompressionArgs + wxT(" -o ") + wxEscapeFilename(stackImgName) + wxT(" -- ") + GetQuotedFilenamesString(stackImgs),
                         wxString::Format(_("Fusing stack number %u..."), stackNr))
                     );
+                    commands->back()->SetFiles(stackImgs, detail::SingleFile(stackImgName));
+                    commands->back()->SetEstimatedMemory(detail::EstimateMemory(opts, stacks[stackNr].size(), 24));
                     if (copyMetadata && opts.outputLDRStacks)
                     {
                         filesForCopyTagsExiftool.Add(stackImgName);
@@ -747,6 +818,7 @@ namespace HuginQueue
                                 finalEnblendArgs+wxT(" ")+GetQuotedFilenamesString(stackedImages), 
                                 _("Blending all stacks..."))
                             );
+                            commands->back()->SetFiles(stackedImages, detail::SingleFile(fusedStacksFilename));
                         };
                         break;
                     case HuginBase::PanoramaOptions::INTERNAL_BLEND:
@@ -757,6 +829,7 @@ namespace HuginQueue
                             finalVerdandiArgs.Append(wxT(" -- ") + detail::GetQuotedFilenamesStringForVerdandi(stackedImages, pano, stacks, opts.colorReferenceImage, opts.verdandiOptions.find("--seam=blend") == std::string::npos));
                             commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("verdandi")),
                                 finalVerdandiArgs, _("Blending all stacks...")));
+                            commands->back()->SetFiles(stackedImages, detail::SingleFile(fusedStacksFilename));
                         };
                         break;
                     };
@@ -771,20 +844,41 @@ namespace HuginQueue
         // hdr output
         if (opts.outputHDRLayers || opts.outputHDRStacks || opts.outputHDRBlended)
         {
-            commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
-                nonaArgs + wxT("-r hdr -m EXR_m  -o ") + wxEscapeFilename(prefix + wxT("_hdr_")) + wxT(" ") + quotedProject,
-                _("Remapping HDR images...")));
+            if (stacks.empty())
+            {
+                stacks = getHDRStacks(pano, allActiveImages, opts);
+            };
             const wxArrayString remappedHDR = detail::GetNumberedFilename(prefix + wxT("_hdr_"), wxT(".exr"), allActiveImages);
             const wxArrayString remappedHDRComp = detail::GetNumberedFilename(prefix + wxT("_hdr_"), wxT("_gray.pgm"), allActiveImages);
+            if (stacks.size() > 1)
+            {
+                // remap each stack separately, so the stacks can be merged in parallel
+                for (unsigned stackNr = 0; stackNr < stacks.size(); ++stackNr)
+                {
+                    commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
+                        nonaArgs + wxT("-r hdr -m EXR_m") + detail::GetImageNumberArgs(stacks[stackNr]) +
+                        wxT(" -o ") + wxEscapeFilename(prefix + wxT("_hdr_")) + wxT(" ") + quotedProject,
+                        wxString::Format(_("Remapping HDR images of stack number %u..."), stackNr)));
+                    wxArrayString nonaOutput(detail::GetNumberedFilename(prefix + wxT("_hdr_"), wxT(".exr"), stacks[stackNr]));
+                    detail::AddToArray(detail::GetNumberedFilename(prefix + wxT("_hdr_"), wxT("_gray.pgm"), stacks[stackNr]), nonaOutput);
+                    commands->back()->SetFiles(detail::SingleFile(project), nonaOutput);
+                    commands->back()->SetEstimatedMemory(detail::EstimateMemory(opts, 1, 32));
+                };
+            }
+            else
+            {
+                commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("nona")),
+                    nonaArgs + wxT("-r hdr -m EXR_m  -o ") + wxEscapeFilename(prefix + wxT("_hdr_")) + wxT(" ") + quotedProject,
+                    _("Remapping HDR images...")));
+                wxArrayString nonaOutput(remappedHDR);
+                detail::AddToArray(remappedHDRComp, nonaOutput);
+                commands->back()->SetFiles(detail::SingleFile(project), nonaOutput);
+            };
             detail::AddToArray(remappedHDR, outputFiles);
             detail::AddToArray(remappedHDRComp, outputFiles);
             if (opts.outputHDRStacks || opts.outputHDRBlended)
             {
                 // merging stacks, then blending
-                if (stacks.empty())
-                {
-                    stacks = getHDRStacks(pano, allActiveImages, opts);
-                };
                 wxArrayString stackedImages;
                 // merge all stacks
                 for (unsigned stackNr = 0; stackNr < stacks.size(); ++stackNr)
@@ -796,6 +890,8 @@ namespace HuginQueue
                     commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("hugin_hdrmerge")),
                         opts.hdrmergeOptions + wxT(" -o ") + wxEscapeFilename(stackImgName) + wxT(" -- ") + GetQuotedFilenamesString(stackImgs),
                         wxString::Format(_("Merging HDR stack number %u..."), stackNr)));
+                    commands->back()->SetFiles(stackImgs, detail::SingleFile(stackImgName));
+                    commands->back()->SetEstimatedMemory(detail::EstimateMemory(opts, stacks[stackNr].size(), 16));
                     if (!opts.outputHDRStacks)
                     {
                         tempFilesDelete.Add(stackImgName);
@@ -813,12 +909,14 @@ namespace HuginQueue
                                 enblendArgs + finalBlendArgs + wxT(" ") + GetQuotedFilenamesString(stackedImages),
                                     _("Blending HDR stacks..."))
                             );
+                            commands->back()->SetFiles(stackedImages, detail::SingleFile(mergedStacksFilename));
                             break;
                         case HuginBase::PanoramaOptions::INTERNAL_BLEND:
                         default:  // switch to internal blender for all other cases, not exposed in GUI
                             commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("verdandi")),
                                 verdandiArgs + finalBlendArgs + detail::GetQuotedFilenamesStringForVerdandi(stackedImages, pano, stacks, opts.colorReferenceImage, opts.verdandiOptions.find("--seam=blend") == std::string::npos),
                                 _("Blending HDR stacks...")));
+                            commands->back()->SetFiles(stackedImages, detail::SingleFile(mergedStacksFilename));
                             break;
                     };
                     outputFiles.Add(mergedStacksFilename);
@@ -840,12 +938,15 @@ namespace HuginQueue
             commands->push_back(new OptionalCommand(GetExternalProgram(config, ExePath, wxT("exiftool")),
                 exiftoolArgs + GetQuotedFilenamesString(filesForCopyTagsExiftool),
                 _("Updating metadata...")));
+            // exiftool modifies the files in place
+            commands->back()->SetFiles(filesForCopyTagsExiftool, filesForCopyTagsExiftool);
         };
         if (!filesForFullExiftool.IsEmpty())
         {
             commands->push_back(new OptionalCommand(GetExternalProgram(config, ExePath, wxT("exiftool")),
                 exiftoolArgs + exiftoolArgsFinal + GetQuotedFilenamesString(filesForFullExiftool),
                 _("Updating metadata...")));
+            commands->back()->SetFiles(filesForFullExiftool, filesForFullExiftool);
         };
         return commands;
     };
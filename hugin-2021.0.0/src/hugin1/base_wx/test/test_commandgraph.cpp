@@ -0,0 +1,256 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_commandgraph.cpp
+ *
+ *  @brief checks the dependencies and the scheduling of CommandGraph
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base_wx/Executor.h"
+#include "base_wx/CommandGraph.h"
+
+using namespace HuginQueue;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** list of up to two files, empty names are skipped */
+    wxArrayString Files(const wxString& file1 = wxEmptyString, const wxString& file2 = wxEmptyString)
+    {
+        wxArrayString files;
+        if (!file1.IsEmpty())
+        {
+            files.Add(file1);
+        };
+        if (!file2.IsEmpty())
+        {
+            files.Add(file2);
+        };
+        return files;
+    };
+
+    /** command which reads @p inputs and writes @p outputs */
+    NormalCommand* FileCommand(const wxArrayString& inputs, const wxArrayString& outputs, unsigned long long memory = 0)
+    {
+        NormalCommand* cmd = new NormalCommand(wxT("prog"), wxT("args"));
+        cmd->SetFiles(inputs, outputs);
+        cmd->SetEstimatedMemory(memory);
+        return cmd;
+    };
+
+    bool SameDependencies(const CommandGraph& graph, size_t index, const std::vector<size_t>& expected)
+    {
+        return graph.GetDependencies(index) == expected;
+    };
+
+    std::vector<size_t> Indices(size_t count, size_t i1 = 0, size_t i2 = 0)
+    {
+        std::vector<size_t> indices;
+        if (count > 0)
+        {
+            indices.push_back(i1);
+        };
+        if (count > 1)
+        {
+            indices.push_back(i2);
+        };
+        return indices;
+    };
+
+    /** runs all commands of the graph, the oldest running command finishes
+     *  first, each command must only be started after its dependencies
+     *  @return true, if all commands were started in a valid order */
+    bool RunGraph(CommandGraph& graph, std::vector<size_t>& order)
+    {
+        std::vector<bool> finished(graph.GetCommandCount(), false);
+        std::deque<size_t> running;
+        bool valid = true;
+        while (!graph.IsFinished())
+        {
+            const std::vector<CommandGraph::StartInfo> starts = graph.StartCommands();
+            for (size_t i = 0; i < starts.size(); ++i)
+            {
+                const std::vector<size_t>& deps = graph.GetDependencies(starts[i].index);
+                for (size_t j = 0; j < deps.size(); ++j)
+                {
+                    valid = valid && finished[deps[j]];
+                };
+                order.push_back(starts[i].index);
+                running.push_back(starts[i].index);
+            };
+            if (running.empty())
+            {
+                // nothing can be started and nothing is running
+                return false;
+            };
+            finished[running.front()] = true;
+            graph.SetFinished(running.front(), true);
+            running.pop_front();
+        };
+        return valid && std::find(finished.begin(), finished.end(), false) == finished.end();
+    };
+
+    /** total memory of the started commands */
+    unsigned long long StartedMemory(const CommandQueue& queue, const std::vector<CommandGraph::StartInfo>& starts)
+    {
+        unsigned long long memory = 0;
+        for (size_t i = 0; i < starts.size(); ++i)
+        {
+            memory += queue[starts[i].index]->GetEstimatedMemory();
+        };
+        return memory;
+    };
+}
+
+int main()
+{
+    // dependencies follow the files and commands run only after their dependencies
+    {
+        CommandQueue queue;
+        // 0: remap a, 1: process a into b, 2: remap c independently,
+        // 3: blend b and c, 4: overwrite a after it has been read
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("a.tif"))));
+        queue.push_back(FileCommand(Files(wxT("a.tif")), Files(wxT("b.tif"))));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("c.tif"))));
+        queue.push_back(FileCommand(Files(wxT("b.tif"), wxT("c.tif")), Files(wxT("out.tif"))));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("a.tif"))));
+        // 5: unknown files, waits for all, 6: runs after the barrier
+        queue.push_back(new NormalCommand(wxT("prog"), wxT("args")));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("d.tif"))));
+        CommandGraph graph(queue, 4, 0);
+        check(graph.GetCommandCount() == 7, "graph contains all commands");
+        check(SameDependencies(graph, 0, Indices(0)), "first command has no dependencies");
+        check(SameDependencies(graph, 1, Indices(1, 0)), "read after write");
+        check(SameDependencies(graph, 2, Indices(0)), "reading the same input is independent");
+        check(SameDependencies(graph, 3, Indices(2, 1, 2)), "command depends on the writers of all inputs");
+        check(SameDependencies(graph, 4, Indices(2, 0, 1)), "write after write and write after read");
+        const std::vector<size_t>& barrierDeps = graph.GetDependencies(5);
+        check(barrierDeps.size() == 5, "command without files depends on all earlier commands");
+        check(SameDependencies(graph, 6, Indices(1, 5)), "later commands depend on the barrier");
+        std::vector<size_t> order;
+        check(RunGraph(graph, order), "commands run after their dependencies");
+        check(order.size() == 7 && graph.GetFinishedCount() == 7, "all commands are run once");
+        check(order.size() > 2 && order[0] == 0 && order[1] == 2, "independent commands start together");
+        CleanQueue(&queue);
+    }
+
+    // independent commands run concurrently as long as their memory fits into the budget
+    {
+        CommandQueue queue;
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("a.tif")), 40));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("b.tif")), 40));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("c.tif")), 40));
+        CommandGraph graph(queue, 4, 100);
+        std::vector<CommandGraph::StartInfo> starts = graph.StartCommands();
+        check(starts.size() == 2, "two commands fit into the memory budget");
+        check(StartedMemory(queue, starts) <= 100, "started commands stay within the budget");
+        check(starts.size() == 2 && starts[0].threads == 2 && starts[1].threads == 2, "cores are split between the commands");
+        check(graph.StartCommands().empty(), "nothing more is started while the budget is used");
+        graph.SetFinished(starts[0].index, true);
+        starts = graph.StartCommands();
+        check(starts.size() == 1 && starts[0].index == 2, "waiting command starts when memory is free");
+        check(starts.size() == 1 && starts[0].threads == 2, "waiting command gets the free cores");
+        check(graph.GetRunningCount() == 2, "two commands are running");
+        CleanQueue(&queue);
+    }
+
+    // a command larger than the budget runs alone, without budget all commands start
+    {
+        CommandQueue queue;
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("a.tif")), 150));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("b.tif")), 40));
+        CommandGraph graph(queue, 4, 100);
+        std::vector<CommandGraph::StartInfo> starts = graph.StartCommands();
+        check(starts.size() == 1 && starts[0].index == 0 && starts[0].threads == 4, "oversized command runs alone with all cores");
+        graph.SetFinished(0, true);
+        starts = graph.StartCommands();
+        check(starts.size() == 1 && starts[0].index == 1, "next command starts after the oversized command");
+
+        CommandGraph unlimited(queue, 3, 0);
+        starts = unlimited.StartCommands();
+        check(starts.size() == 2, "without budget all independent commands start");
+        check(starts.size() == 2 && starts[0].threads + starts[1].threads == 3, "all cores are used");
+        CleanQueue(&queue);
+    }
+
+    // after a failure no further command is started, running commands still finish
+    {
+        CommandQueue queue;
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("a.tif"))));
+        queue.push_back(FileCommand(Files(wxT("a.tif")), Files(wxT("b.tif"))));
+        queue.push_back(FileCommand(Files(wxT("pano.pto")), Files(wxT("c.tif"))));
+        CommandGraph graph(queue, 2, 0);
+        const std::vector<CommandGraph::StartInfo> starts = graph.StartCommands();
+        check(starts.size() == 2, "independent commands start");
+        graph.SetFinished(0, false);
+        check(graph.HasFailed(), "failure is recorded");
+        check(graph.StartCommands().empty(), "dependent command is not started after a failure");
+        check(!graph.IsFinished(), "graph waits for the running command");
+        graph.SetFinished(2, true);
+        check(graph.IsFinished(), "graph is finished when nothing runs anymore");
+        check(graph.GetFinishedCount() == 2, "dependent command never ran");
+        check(graph.StartCommands().empty(), "nothing is started after the graph finished");
+        CleanQueue(&queue);
+    }
+
+    // files used in a cycle don't give a cyclic graph: dependencies always
+    // point to earlier commands, so the queue order decides
+    {
+        CommandQueue queue;
+        queue.push_back(FileCommand(Files(wxT("x.tif")), Files(wxT("y.tif"))));
+        queue.push_back(FileCommand(Files(wxT("y.tif")), Files(wxT("x.tif"))));
+        // reading and writing the same file
+        queue.push_back(FileCommand(Files(wxT("x.tif")), Files(wxT("x.tif"))));
+        CommandGraph graph(queue, 2, 0);
+        bool backwards = false;
+        for (size_t i = 0; i < graph.GetCommandCount(); ++i)
+        {
+            const std::vector<size_t>& deps = graph.GetDependencies(i);
+            for (size_t j = 0; j < deps.size(); ++j)
+            {
+                backwards = backwards || deps[j] >= i;
+            };
+        };
+        check(!backwards, "no command depends on itself or a later command");
+        check(SameDependencies(graph, 0, Indices(0)), "first command of the cycle has no dependencies");
+        check(SameDependencies(graph, 1, Indices(1, 0)), "second command of the cycle waits for the first");
+        std::vector<size_t> order;
+        check(RunGraph(graph, order), "cyclic file usage runs in queue order");
+        CleanQueue(&queue);
+    }
+
+    if (failures == 0)
+    {
+        std::cout << "all command graph tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
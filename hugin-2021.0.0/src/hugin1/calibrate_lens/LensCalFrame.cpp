@@ -560,6 +560,11 @@ void LensCalFrame::OnFindLines(wxCommandEvent &e)
     for(unsigned int i=0;i<m_images.size();i++)
     {
         std::string filename(m_images[i]->GetFilename().mb_str(HUGIN_CONV_FILENAME));
+        // load the next image in the background, while the lines of the current image are searched
+        if(i+1<m_images.size())
+        {
+            ImageCache::getInstance().prefetchImage(std::string(m_images[i+1]->GetFilename().mb_str(HUGIN_CONV_FILENAME)));
+        };
         ImageCache::EntryPtr img=ImageCache::getInstance().getImage(filename);
         double scale;
         SetStatusText(_("Detecting edges..."));
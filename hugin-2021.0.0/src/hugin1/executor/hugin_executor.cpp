@@ -180,7 +180,8 @@ class HuginExecutor : public APP
             m_threads = wxConfigBase::Get()->Read(wxT("/output/NumberOfThreads"), 0l);
         };
 
-        const bool success = HuginQueue::RunCommandsQueue(commands, m_threads, m_dryRun);
+        // independent commands, e.g. the stacks of a bracketed panorama, are run in parallel
+        const bool success = HuginQueue::RunCommandsGraph(commands, m_threads, m_memory << 20, m_dryRun);
         if (!tempfiles.IsEmpty())
         {
             if (m_dryRun)
@@ -218,6 +219,7 @@ class HuginExecutor : public APP
         parser.AddSwitch(wxT("a"), wxT("assistant"), _("execute assistant"));
         parser.AddSwitch(wxT("s"), wxT("stitching"), _("execute stitching with given project"));
         parser.AddOption(wxT("t"), wxT("threads"), _("number of used threads"), wxCMD_LINE_VAL_NUMBER);
+        parser.AddLongOption(wxT("memory"), _("memory in MB used by parallel running commands (default: available memory)"), wxCMD_LINE_VAL_NUMBER);
         parser.AddOption(wxT("p"), wxT("prefix"), _("prefix used for stitching"), wxCMD_LINE_VAL_STRING);
         parser.AddOption(wxT("u"), wxT("user-defined-output"), _("use user defined commands in given file"), wxCMD_LINE_VAL_STRING);
         parser.AddLongOption(wxT("user-defined-assistant"), _("use user defined assistant commands in given file"), wxCMD_LINE_VAL_STRING);
@@ -227,6 +229,7 @@ class HuginExecutor : public APP
         m_runStitching = false;
         m_dryRun = false;
         m_threads = -1;
+        m_memory = 0;
     }
 
     /** processes the command line parameters */
@@ -241,6 +244,11 @@ class HuginExecutor : public APP
         {
             m_threads = threads;
         };
+        long memory;
+        if (parser.Found(wxT("memory"), &memory) && memory > 0)
+        {
+            m_memory = memory;
+        };
         parser.Found(wxT("p"), &m_prefix);
         parser.Found(wxT("u"), &m_userOutput);
         if (!m_userOutput.IsEmpty() && m_runStitching)
@@ -333,6 +341,8 @@ private:
     wxString m_prefix;
     /** number of threads used for assistant or stitching */
     long m_threads;
+    /** memory budget in MB for parallel running commands, 0 for the default budget */
+    unsigned long long m_memory;
     /** path to utils */
     wxString m_utilsBinDir;
     /** locale for internationalisation */
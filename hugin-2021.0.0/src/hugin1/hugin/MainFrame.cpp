@@ -695,6 +695,7 @@ MainFrame::MainFrame(wxWindow* parent, HuginBase::Panorama & pano)
 #else
     ImageCache::getInstance().SetUpperLimit(wxConfigBase::Get()->Read(wxT("/ImageCache/UpperBound"), HUGIN_IMGCACHE_UPPERBOUND));
 #endif
+    ImageCache::getInstance().SetSpillLimit(static_cast<unsigned long long>(wxConfigBase::Get()->Read(wxT("/ImageCache/SpillBound"), HUGIN_IMGCACHE_SPILLBOUND)) << 20);
 
     if(splash) {
         splash->Close();
@@ -1524,6 +1525,7 @@ void MainFrame::OnShowPrefs(wxCommandEvent & e)
 #else
     ImageCache::getInstance().SetUpperLimit(cfg->Read(wxT("/ImageCache/UpperBound"), HUGIN_IMGCACHE_UPPERBOUND));
 #endif
+    ImageCache::getInstance().SetSpillLimit(static_cast<unsigned long long>(cfg->Read(wxT("/ImageCache/SpillBound"), HUGIN_IMGCACHE_SPILLBOUND)) << 20);
     images_panel->ReloadCPDetectorSettings();
     if(gl_preview_frame)
     {
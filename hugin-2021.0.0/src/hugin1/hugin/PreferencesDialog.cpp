@@ -599,6 +599,7 @@ void PreferencesDialog::UpdateDisplayData(int panel)
         }
 #endif
         MY_SPIN_VAL("prefs_cache_UpperBound", mem >> 20);
+        MY_SPIN_VAL("prefs_cache_SpillBound", cfg->Read(wxT("/ImageCache/SpillBound"), HUGIN_IMGCACHE_SPILLBOUND));
 
         // language
         // check if current language is in list and activate it then.
@@ -867,6 +868,7 @@ void PreferencesDialog::OnRestoreDefaults(wxCommandEvent& e)
             #endif
             */
             cfg->Write(wxT("/ImageCache/UpperBound"), HUGIN_IMGCACHE_UPPERBOUND);
+            cfg->Write(wxT("/ImageCache/SpillBound"), HUGIN_IMGCACHE_SPILLBOUND);
             // locale
             cfg->Write(wxT("language"), int(HUGIN_LANGUAGE));
             // smart undo
@@ -1025,6 +1027,7 @@ void PreferencesDialog::UpdateConfigData()
     cfg->Write(wxT("/ImageCache/UpperBoundHigh"), (long) MY_G_SPIN_VAL("prefs_cache_UpperBound") >> 12);
 #endif
     cfg->Write(wxT("/ImageCache/UpperBound"), (long) MY_G_SPIN_VAL("prefs_cache_UpperBound") << 20);
+    cfg->Write(wxT("/ImageCache/SpillBound"), (long) MY_G_SPIN_VAL("prefs_cache_SpillBound"));
     // locale
     // language
     wxChoice* lang = XRCCTRL(*this, "prefs_gui_language", wxChoice);
@@ -57,6 +57,8 @@
 
 // Image cache defaults
 #define HUGIN_IMGCACHE_UPPERBOUND             268435456
+// limit for the scratch files of evicted images in MB, 0 disables them
+#define HUGIN_IMGCACHE_SPILLBOUND             0l
 #define HUGIN_IMGCACHE_MAPPING_INTEGER        0l
 #define HUGIN_IMGCACHE_MAPPING_FLOAT          1l
 
@@ -0,0 +1,42 @@
+// -*- c-basic-offset: 4 -*-
+/** @file NonaMemoryStitcher.cpp
+ *
+ *  Stitching of images in memory without file input and output
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "NonaMemoryStitcher.h"
+
+#include <nona/Stitcher.h>
+
+namespace HuginBase {
+
+    bool NonaMemoryStitcher::runStitcher()
+    {
+        Nona::stitchPanoramaToMemory(o_panorama,
+                       o_panoramaOptions,
+                       getProgressDisplay(),
+                       m_images,
+                       o_usedImages,
+                       m_output,
+                       m_advOptions);
+
+        return true;
+    }
+
+
+} //namespace
@@ -0,0 +1,69 @@
+// -*- c-basic-offset: 4 -*-
+/** @file NonaMemoryStitcher.h
+ *
+ *  Stitching of images in memory without file input and output
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONAMEMORYSTITCHER_H
+#define _NONAMEMORYSTITCHER_H
+
+#include <hugin_shared.h>
+#include <algorithms/StitcherAlgorithm.h>
+#include <nona/ImageBuffer.h>
+#include <nona/StitcherOptions.h>
+
+namespace HuginBase {
+
+    /** This class uses Nona::stitchPanoramaToMemory. The pixel data of the
+     *  images are read from caller owned buffers instead of the files given in
+     *  the project, the output region of the panorama is written into the
+     *  output buffer. The buffers must stay valid until run() has finished.
+     */
+    class IMPEX NonaMemoryStitcher : public StitcherAlgorithm
+    {
+
+    public:
+        ///
+        NonaMemoryStitcher(PanoramaData& panoramaData,
+                           AppBase::ProgressDisplay* progressDisplay,
+                           const PanoramaOptions& options,
+                           const UIntSet& usedImages,
+                           const Nona::ImageBufferMap& images,
+                           const Nona::ImageBuffer& output,
+                           const Nona::AdvancedOptions& advOptions)
+                           : StitcherAlgorithm(panoramaData, progressDisplay, options, usedImages),
+                             m_images(images), m_output(output), m_advOptions(advOptions)
+        {};
+
+        ///
+        ~NonaMemoryStitcher() {};
+
+
+    protected:
+        ///
+        virtual bool runStitcher();  // uses Nona::stitchPanoramaToMemory()
+
+    private:
+        Nona::ImageBufferMap m_images;
+        Nona::ImageBuffer m_output;
+        Nona::AdvancedOptions m_advOptions;
+    };
+
+}
+
+#endif //_H
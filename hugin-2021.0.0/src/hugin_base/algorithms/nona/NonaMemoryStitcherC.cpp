@@ -0,0 +1,188 @@
+// -*- c-basic-offset: 4 -*-
+/** @file NonaMemoryStitcherC.cpp
+ *
+ *  C interface for stitching images in memory
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "NonaMemoryStitcherC.h"
+
+#include <fstream>
+#include <exception>
+#include <string>
+
+#include <hugin_utils/utils.h>
+#include <panodata/Panorama.h>
+#include <appbase/ProgressDisplay.h>
+#include "NonaMemoryStitcher.h"
+
+struct HuginNonaStitcher
+{
+    HuginBase::Panorama pano;
+    HuginBase::Nona::AdvancedOptions advOptions;
+    std::string lastError;
+};
+
+namespace
+{
+    /** convert the C description into the C++ one */
+    bool ConvertImage(const HuginNonaImage& image, HuginBase::Nona::ImageBuffer& buffer)
+    {
+        switch (image.pixelType)
+        {
+            case HUGIN_NONA_UINT8:
+                buffer.pixelType = "UINT8";
+                break;
+            case HUGIN_NONA_UINT16:
+                buffer.pixelType = "UINT16";
+                break;
+            case HUGIN_NONA_FLOAT:
+                buffer.pixelType = "FLOAT";
+                break;
+            default:
+                return false;
+        };
+        buffer.data = image.data;
+        buffer.width = image.width;
+        buffer.height = image.height;
+        buffer.stride = image.stride;
+        buffer.bands = image.bands;
+        return image.data != NULL && image.bands >= 1 && image.bands <= 4;
+    }
+}
+
+HuginNonaStitcher* hugin_nona_create(const char* projectFile)
+{
+    if (projectFile == NULL)
+    {
+        return NULL;
+    };
+    std::ifstream prjfile(projectFile);
+    if (!prjfile.good())
+    {
+        return NULL;
+    };
+    HuginNonaStitcher* stitcher = new HuginNonaStitcher;
+    stitcher->pano.setFilePrefix(hugin_utils::getPathPrefix(projectFile));
+    if (stitcher->pano.readData(prjfile) != AppBase::DocumentData::SUCCESSFUL || stitcher->pano.getNrOfImages() == 0)
+    {
+        delete stitcher;
+        return NULL;
+    };
+    return stitcher;
+}
+
+void hugin_nona_destroy(HuginNonaStitcher* stitcher)
+{
+    delete stitcher;
+}
+
+int hugin_nona_get_image_count(const HuginNonaStitcher* stitcher)
+{
+    if (stitcher == NULL)
+    {
+        return 0;
+    };
+    return stitcher->pano.getNrOfImages();
+}
+
+int hugin_nona_get_image_size(const HuginNonaStitcher* stitcher, int imgNr, int* width, int* height)
+{
+    if (stitcher == NULL || imgNr < 0 || imgNr >= static_cast<int>(stitcher->pano.getNrOfImages()) || width == NULL || height == NULL)
+    {
+        return -1;
+    };
+    const vigra::Size2D size = stitcher->pano.getImage(imgNr).getSize();
+    *width = size.width();
+    *height = size.height();
+    return 0;
+}
+
+int hugin_nona_get_output_size(const HuginNonaStitcher* stitcher, int* width, int* height)
+{
+    if (stitcher == NULL || width == NULL || height == NULL)
+    {
+        return -1;
+    };
+    const vigra::Rect2D roi = stitcher->pano.getOptions().getROI();
+    *width = roi.width();
+    *height = roi.height();
+    return 0;
+}
+
+int hugin_nona_set_option(HuginNonaStitcher* stitcher, const char* name, const char* value)
+{
+    if (stitcher == NULL || name == NULL || value == NULL)
+    {
+        return -1;
+    };
+    HuginBase::Nona::SetAdvancedOption(stitcher->advOptions, name, std::string(value));
+    return 0;
+}
+
+int hugin_nona_stitch(HuginNonaStitcher* stitcher, const HuginNonaImage* images, int count, HuginNonaImage* output)
+{
+    if (stitcher == NULL)
+    {
+        return -1;
+    };
+    stitcher->lastError.clear();
+    if (images == NULL || output == NULL || count != static_cast<int>(stitcher->pano.getNrOfImages()))
+    {
+        stitcher->lastError = "Invalid arguments, one image buffer for each image in the project is required";
+        return -1;
+    };
+    HuginBase::Nona::ImageBufferMap buffers;
+    for (int i = 0; i < count; ++i)
+    {
+        HuginBase::Nona::ImageBuffer buffer;
+        if (!ConvertImage(images[i], buffer))
+        {
+            stitcher->lastError = "Invalid image buffer for image " + std::to_string(i);
+            return -1;
+        };
+        buffers[i] = buffer;
+    };
+    HuginBase::Nona::ImageBuffer outputBuffer;
+    if (!ConvertImage(*output, outputBuffer))
+    {
+        stitcher->lastError = "Invalid output buffer";
+        return -1;
+    };
+    try
+    {
+        AppBase::DummyProgressDisplay progress;
+        HuginBase::NonaMemoryStitcher nonaStitcher(stitcher->pano, &progress, stitcher->pano.getOptions(),
+            stitcher->pano.getActiveImages(), buffers, outputBuffer, stitcher->advOptions);
+        nonaStitcher.run();
+    }
+    catch (std::exception& e)
+    {
+        stitcher->lastError = e.what();
+        return -1;
+    };
+    return 0;
+}
+
+const char* hugin_nona_get_last_error(const HuginNonaStitcher* stitcher)
+{
+    if (stitcher == NULL)
+    {
+        return "";
+    };
+    return stitcher->lastError.c_str();
+}
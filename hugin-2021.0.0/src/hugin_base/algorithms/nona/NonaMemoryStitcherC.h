@@ -0,0 +1,85 @@
+/* -*- c-basic-offset: 4 -*- */
+/** @file NonaMemoryStitcherC.h
+ *
+ *  C interface for stitching images in memory, e.g. for use with
+ *  Python ctypes or other languages which can call C functions.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONAMEMORYSTITCHERC_H
+#define _NONAMEMORYSTITCHERC_H
+
+#include <stddef.h>
+#include <hugin_shared.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** opaque handle, holds the project and the stitching options */
+typedef struct HuginNonaStitcher HuginNonaStitcher;
+
+/** pixel types of the image buffers */
+enum HuginNonaPixelType
+{
+    HUGIN_NONA_UINT8 = 0,
+    HUGIN_NONA_UINT16 = 1,
+    HUGIN_NONA_FLOAT = 2
+};
+
+/** interleaved image buffer, owned by the caller.
+ *  bands is 1 (gray) or 3 (RGB), an additional band is used as alpha channel.
+ *  stride is the distance between two rows in bytes. */
+typedef struct HuginNonaImage
+{
+    void* data;
+    int width;
+    int height;
+    ptrdiff_t stride;
+    int pixelType;
+    int bands;
+} HuginNonaImage;
+
+/** load the project file, returns NULL if the project could not be read */
+IMPEX HuginNonaStitcher* hugin_nona_create(const char* projectFile);
+/** release all resources of the stitcher */
+IMPEX void hugin_nona_destroy(HuginNonaStitcher* stitcher);
+
+/** return the number of images in the project */
+IMPEX int hugin_nona_get_image_count(const HuginNonaStitcher* stitcher);
+/** return the expected size of image imgNr, returns 0 on success */
+IMPEX int hugin_nona_get_image_size(const HuginNonaStitcher* stitcher, int imgNr, int* width, int* height);
+/** return the size of the output buffer (the output region of the panorama), returns 0 on success */
+IMPEX int hugin_nona_get_output_size(const HuginNonaStitcher* stitcher, int* width, int* height);
+/** set an advanced nona option (e.g. "hardSeam", "remapPlanDir"), returns 0 on success */
+IMPEX int hugin_nona_set_option(HuginNonaStitcher* stitcher, const char* name, const char* value);
+
+/** stitch the given images into the output buffer.
+ *  images must contain count buffers, the i-th buffer is used for image i of
+ *  the project. Only the active images of the project are stitched.
+ *  Returns 0 on success, otherwise the error can be queried with
+ *  hugin_nona_get_last_error() */
+IMPEX int hugin_nona_stitch(HuginNonaStitcher* stitcher, const HuginNonaImage* images, int count, HuginNonaImage* output);
+
+/** return the message of the last error, the string is valid until the next call */
+IMPEX const char* hugin_nona_get_last_error(const HuginNonaStitcher* stitcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NONAMEMORYSTITCHERC_H */
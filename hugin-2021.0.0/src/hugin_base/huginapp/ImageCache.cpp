@@ -27,8 +27,24 @@
 #include "ImageCache.h"
 
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "hugin_config.h"
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <vigra/inspectimage.hxx>
 #include <vigra/accessor.hxx>
 #include <vigra/functorexpression.hxx>
@@ -37,6 +53,7 @@
 #include <vigra_ext/impexalpha.hxx>
 #include <vigra_ext/Pyramid.h>
 #include <vigra_ext/FunctorAccessor.h>
+#include <vigra_ext/ReducedImport.h>
 
 
 
@@ -119,20 +136,759 @@ ImageCache::ImageCacheRGB8Ptr ImageCache::Entry::get8BitImage()
     return image8;
 }
 
+unsigned long long ImageCache::Entry::getMemoryUsage() const
+{
+    unsigned long long bytes = 0;
+    if (image8) {
+        bytes += static_cast<unsigned long long>(image8->width()) * image8->height() * sizeof(vigra::BRGBImage::value_type);
+    }
+    if (image16) {
+        bytes += static_cast<unsigned long long>(image16->width()) * image16->height() * sizeof(vigra::UInt16RGBImage::value_type);
+    }
+    if (imageFloat) {
+        bytes += static_cast<unsigned long long>(imageFloat->width()) * imageFloat->height() * sizeof(vigra::FRGBImage::value_type);
+    }
+    if (mask) {
+        bytes += static_cast<unsigned long long>(mask->width()) * mask->height() * sizeof(vigra::BImage::value_type);
+    }
+    return bytes;
+}
+
+namespace
+{
+    /** return the directory for the scratch files */
+    std::string GetScratchDirectory()
+    {
+#ifdef _WIN32
+        char buffer[MAX_PATH + 1];
+        const DWORD length = GetTempPathA(MAX_PATH + 1, buffer);
+        if (length > 0 && length <= MAX_PATH)
+        {
+            return std::string(buffer, length);
+        };
+        return std::string(".");
+#else
+        const char* tmpDir = getenv("TMPDIR");
+        if (tmpDir != NULL && *tmpDir != 0)
+        {
+            return std::string(tmpDir);
+        };
+        return std::string("/tmp");
+#endif
+    }
+
+    /** a scratch file, which is written once and then mapped read only into memory.
+     *  The file is removed in the destructor. */
+    class MappedScratchFile
+    {
+    public:
+        typedef std::vector<std::pair<const void*, size_t> > BlockList;
+
+        MappedScratchFile() : m_data(NULL), m_size(0)
+#ifdef _WIN32
+            , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+        {};
+
+        ~MappedScratchFile()
+        {
+#ifdef _WIN32
+            if (m_data)
+            {
+                UnmapViewOfFile(m_data);
+            };
+            if (m_mapping)
+            {
+                CloseHandle(m_mapping);
+            };
+            if (m_file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_file);
+            };
+#else
+            if (m_data)
+            {
+                munmap(const_cast<char*>(m_data), m_size);
+            };
+#endif
+            if (!m_filename.empty())
+            {
+                std::remove(m_filename.c_str());
+            };
+        };
+
+        /** write the given memory blocks into the file and map it
+         *  @return false, if the file could not be written or mapped */
+        bool create(const std::string& filename, const BlockList& blocks)
+        {
+            FILE* file = fopen(filename.c_str(), "wb");
+            if (file == NULL)
+            {
+                return false;
+            };
+            m_filename = filename;
+            bool success = true;
+            for (BlockList::const_iterator it = blocks.begin(); it != blocks.end() && success; ++it)
+            {
+                if (it->second > 0)
+                {
+                    success = fwrite(it->first, 1, it->second, file) == it->second;
+                    m_size += it->second;
+                };
+            };
+            if (fclose(file) != 0)
+            {
+                success = false;
+            };
+            if (!success || m_size == 0)
+            {
+                return false;
+            };
+#ifdef _WIN32
+            m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_TEMPORARY, NULL);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            };
+            m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (m_mapping == NULL)
+            {
+                return false;
+            };
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            return m_data != NULL;
+#else
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            };
+            void* data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            // the mapping stays valid after closing the file descriptor
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                return false;
+            };
+            m_data = static_cast<const char*>(data);
+            return true;
+#endif
+        };
+
+        const char* data() const { return m_data; };
+        size_t size() const { return m_size; };
+
+    private:
+        // not copyable
+        MappedScratchFile(const MappedScratchFile&);
+        MappedScratchFile& operator=(const MappedScratchFile&);
+
+        std::string m_filename;
+        const char* m_data;
+        size_t m_size;
+#ifdef _WIN32
+        HANDLE m_file;
+        HANDLE m_mapping;
+#endif
+    };
+
+    /** add the pixel data of @p img to the block list */
+    template <class ImageType>
+    void AddImageBlock(const ImageType& img, MappedScratchFile::BlockList& blocks)
+    {
+        if (img.width() > 0 && img.height() > 0)
+        {
+            blocks.push_back(std::make_pair(static_cast<const void*>(img.data()),
+                static_cast<size_t>(img.width()) * img.height() * sizeof(typename ImageType::value_type)));
+        };
+    }
+
+    /** copy the pixel data for image @p img with size @p size from the scratch file,
+     *  @p offset is advanced to the next image */
+    template <class ImageType>
+    void ReadImageBlock(const char* data, size_t& offset, const vigra::Size2D& size, ImageType& img)
+    {
+        if (size.x > 0 && size.y > 0)
+        {
+            img.resize(size);
+            const size_t bytes = static_cast<size_t>(size.x) * size.y * sizeof(typename ImageType::value_type);
+            memcpy(img.data(), data + offset, bytes);
+            offset += bytes;
+        };
+    }
+}
+
+/** scratch files of evicted images, the oldest files are removed first,
+ *  when the spill limit is exceeded */
+class ImageCache::SpillStore
+{
+public:
+    explicit SpillStore(const std::string& directory)
+        : m_requestedDirectory(directory), m_directory(directory), m_used(0), m_counter(0)
+    {
+        if (m_directory.empty())
+        {
+            m_directory = GetScratchDirectory();
+        };
+        const char last = m_directory[m_directory.size() - 1];
+        if (last != '/' && last != '\\')
+        {
+            m_directory.append("/");
+        };
+    };
+
+    /** return the directory given to the constructor */
+    const std::string& getRequestedDirectory() const { return m_requestedDirectory; };
+    unsigned long long getUsed() const { return m_used; };
+
+    /** write the pixel data of @p entry into a scratch file
+     *  @return false, if the scratch file could not be created */
+    bool add(const std::string& name, const EntryPtr& entry)
+    {
+        remove(name);
+        MappedScratchFile::BlockList blocks;
+        AddImageBlock(*entry->image8, blocks);
+        AddImageBlock(*entry->image16, blocks);
+        AddImageBlock(*entry->imageFloat, blocks);
+        AddImageBlock(*entry->mask, blocks);
+        std::ostringstream filename;
+#ifdef _WIN32
+        filename << m_directory << "hugin_cache_" << GetCurrentProcessId() << "_" << m_counter++ << ".raw";
+#else
+        filename << m_directory << "hugin_cache_" << getpid() << "_" << m_counter++ << ".raw";
+#endif
+        std::shared_ptr<MappedScratchFile> file(new MappedScratchFile);
+        if (!file->create(filename.str(), blocks))
+        {
+            DEBUG_ERROR("Could not create scratch file " << filename.str());
+            return false;
+        };
+        SpilledEntry& spilled = m_entries[name];
+        spilled.file = file;
+        spilled.origType = entry->origType;
+        spilled.iccProfile = entry->iccProfile;
+        spilled.size8 = entry->image8->size();
+        spilled.size16 = entry->image16->size();
+        spilled.sizeFloat = entry->imageFloat->size();
+        spilled.sizeMask = entry->mask->size();
+        m_order.push_front(name);
+        spilled.orderPos = m_order.begin();
+        m_used += file->size();
+        return true;
+    };
+
+    /** restore the image @p name and remove its scratch file
+     *  @return 0 pointer, if the image is not in the store */
+    EntryPtr take(const std::string& name)
+    {
+        std::map<std::string, SpilledEntry>::iterator it = m_entries.find(name);
+        if (it == m_entries.end())
+        {
+            return EntryPtr();
+        };
+        const SpilledEntry& spilled = it->second;
+        EntryPtr entry(new Entry);
+        entry->origType = spilled.origType;
+        entry->iccProfile = spilled.iccProfile;
+        size_t offset = 0;
+        ReadImageBlock(spilled.file->data(), offset, spilled.size8, *entry->image8);
+        ReadImageBlock(spilled.file->data(), offset, spilled.size16, *entry->image16);
+        ReadImageBlock(spilled.file->data(), offset, spilled.sizeFloat, *entry->imageFloat);
+        ReadImageBlock(spilled.file->data(), offset, spilled.sizeMask, *entry->mask);
+        erase(it);
+        return entry;
+    };
+
+    /** @return true, if image @p name is in the store */
+    bool contains(const std::string& name) const
+    {
+        return m_entries.find(name) != m_entries.end();
+    };
+
+    /** remove the scratch file of image @p name */
+    void remove(const std::string& name)
+    {
+        std::map<std::string, SpilledEntry>::iterator it = m_entries.find(name);
+        if (it != m_entries.end())
+        {
+            erase(it);
+        };
+    };
+
+    /** remove the oldest scratch files until at most @p limit bytes are used
+     *  @return number of removed files */
+    unsigned int shrink(const unsigned long long limit)
+    {
+        unsigned int removed = 0;
+        while (m_used > limit && !m_order.empty())
+        {
+            remove(m_order.back());
+            ++removed;
+        };
+        return removed;
+    };
+
+    void clear()
+    {
+        m_entries.clear();
+        m_order.clear();
+        m_used = 0;
+    };
+
+private:
+    struct SpilledEntry
+    {
+        std::shared_ptr<MappedScratchFile> file;
+        std::string origType;
+        ImageCacheICCProfile iccProfile;
+        vigra::Size2D size8;
+        vigra::Size2D size16;
+        vigra::Size2D sizeFloat;
+        vigra::Size2D sizeMask;
+        std::list<std::string>::iterator orderPos;
+    };
+
+    void erase(std::map<std::string, SpilledEntry>::iterator it)
+    {
+        m_used -= it->second.file->size();
+        m_order.erase(it->second.orderPos);
+        m_entries.erase(it);
+    };
+
+    std::string m_requestedDirectory;
+    std::string m_directory;
+    std::map<std::string, SpilledEntry> m_entries;
+    /** names of the spilled images, most recently spilled first */
+    std::list<std::string> m_order;
+    unsigned long long m_used;
+    unsigned long long m_counter;
+};
+
+/** worker threads, which decode the images requested by prefetchImage().
+ *  The workers only load the images, the results are put into the cache
+ *  by the thread, which owns the cache. */
+class ImageCache::PrefetchPool
+{
+public:
+    explicit PrefetchPool(unsigned int threads) : m_sequence(0), m_stop(false)
+    {
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            m_threads.push_back(std::thread(&PrefetchPool::worker, this));
+        };
+    };
+
+    ~PrefetchPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            cancelQueued();
+        }
+        m_queueCondition.notify_all();
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i].join();
+        };
+    };
+
+    /** queue the image, or update the priority of an already queued image */
+    std::shared_future<EntryPtr> add(const std::string& filename, int priority)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        std::map<std::string, Task>::iterator it = m_tasks.find(filename);
+        if (it != m_tasks.end())
+        {
+            Task& task = it->second;
+            if (task.queued && priority > -task.queuePos->first.first)
+            {
+                m_queue.erase(task.queuePos);
+                task.queuePos = m_queue.insert(std::make_pair(std::make_pair(-priority, m_sequence++), filename)).first;
+            };
+            return task.future;
+        };
+        Task& task = m_tasks[filename];
+        task.promise.reset(new std::promise<EntryPtr>);
+        task.future = task.promise->get_future().share();
+        task.queued = true;
+        task.queuePos = m_queue.insert(std::make_pair(std::make_pair(-priority, m_sequence++), filename)).first;
+        lock.unlock();
+        m_queueCondition.notify_one();
+        return task.future;
+    };
+
+    /** remove a queued image, its future receives a 0 pointer */
+    bool cancel(const std::string& filename)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::map<std::string, Task>::iterator it = m_tasks.find(filename);
+        if (it == m_tasks.end())
+        {
+            return false;
+        };
+        if (it->second.queued)
+        {
+            m_queue.erase(it->second.queuePos);
+            it->second.promise->set_value(EntryPtr());
+            m_tasks.erase(it);
+            return true;
+        };
+        // already loading, the result is dropped when the worker finishes
+        it->second.cancelled = true;
+        return false;
+    };
+
+    /** return the future of a prefetched image and forget about it,
+     *  a queued image stays in the queue, use runNow() to load it immediately
+     *  @return false, if the image was not prefetched */
+    bool take(const std::string& filename, std::shared_future<EntryPtr>& future)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::map<std::string, Task>::iterator it = m_tasks.find(filename);
+        if (it == m_tasks.end() || it->second.cancelled)
+        {
+            return false;
+        };
+        future = it->second.future;
+        if (!it->second.queued && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            m_tasks.erase(it);
+        }
+        else
+        {
+            // the caller keeps the future, drop the task when it is finished
+            it->second.cancelled = true;
+        };
+        return true;
+    };
+
+    /** cancel all queued images and forget the finished ones */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cancelQueued();
+        for (std::map<std::string, Task>::iterator it = m_tasks.begin(); it != m_tasks.end();)
+        {
+            if (it->second.future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                m_tasks.erase(it++);
+            }
+            else
+            {
+                it->second.cancelled = true;
+                ++it;
+            };
+        };
+    };
+
+    /** remove all finished images, which nobody has taken yet, from the pool
+     *  and append them to @p finished */
+    void takeFinished(std::vector<std::pair<std::string, EntryPtr> >& finished)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::map<std::string, Task>::iterator it = m_tasks.begin(); it != m_tasks.end();)
+        {
+            if (!it->second.queued && !it->second.cancelled &&
+                it->second.future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                const EntryPtr entry = it->second.future.get();
+                if (entry)
+                {
+                    finished.push_back(std::make_pair(it->first, entry));
+                };
+                m_tasks.erase(it++);
+            }
+            else
+            {
+                ++it;
+            };
+        };
+    };
+
+    /** load a queued image in the calling thread
+     *  @return false, if the image is not queued any more */
+    bool runNow(const std::string& filename)
+    {
+        std::shared_ptr<std::promise<EntryPtr> > promise;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<std::string, Task>::iterator it = m_tasks.find(filename);
+            if (it == m_tasks.end() || !it->second.queued)
+            {
+                return false;
+            };
+            m_queue.erase(it->second.queuePos);
+            it->second.queued = false;
+            promise = it->second.promise;
+        }
+        finish(filename, promise);
+        return true;
+    };
+
+private:
+    struct Task
+    {
+        std::shared_ptr<std::promise<EntryPtr> > promise;
+        std::shared_future<EntryPtr> future;
+        bool queued;
+        /** set if the result is not kept in the pool after loading */
+        bool cancelled;
+        /** key (negative priority, sequence number) in the queue */
+        std::map<std::pair<int, unsigned long long>, std::string>::iterator queuePos;
+
+        Task() : queued(false), cancelled(false) {};
+    };
+
+    /** cancel all queued tasks, the mutex must be locked */
+    void cancelQueued()
+    {
+        for (std::map<std::pair<int, unsigned long long>, std::string>::iterator it = m_queue.begin(); it != m_queue.end(); ++it)
+        {
+            std::map<std::string, Task>::iterator task = m_tasks.find(it->second);
+            if (task != m_tasks.end())
+            {
+                task->second.promise->set_value(EntryPtr());
+                m_tasks.erase(task);
+            };
+        };
+        m_queue.clear();
+    };
+
+    /** load the image and fulfil the promise */
+    void finish(const std::string& filename, std::shared_ptr<std::promise<EntryPtr> > promise)
+    {
+        EntryPtr entry;
+        try
+        {
+            entry = loadImageSafely(filename);
+        }
+        catch (std::exception& e)
+        {
+            DEBUG_ERROR("Error during prefetching " << filename << ": " << e.what());
+        };
+        promise->set_value(entry);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::map<std::string, Task>::iterator it = m_tasks.find(filename);
+        if (it != m_tasks.end() && it->second.cancelled && it->second.promise == promise)
+        {
+            m_tasks.erase(it);
+        };
+    };
+
+    void worker()
+    {
+        while (true)
+        {
+            std::string filename;
+            std::shared_ptr<std::promise<EntryPtr> > promise;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_stop && m_queue.empty())
+                {
+                    m_queueCondition.wait(lock);
+                };
+                if (m_stop)
+                {
+                    return;
+                };
+                // highest priority first
+                filename = m_queue.begin()->second;
+                m_queue.erase(m_queue.begin());
+                Task& task = m_tasks[filename];
+                task.queued = false;
+                promise = task.promise;
+            }
+            finish(filename, promise);
+        };
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::vector<std::thread> m_threads;
+    std::map<std::string, Task> m_tasks;
+    std::map<std::pair<int, unsigned long long>, std::string> m_queue;
+    unsigned long long m_sequence;
+    bool m_stop;
+};
+
 ImageCache * ImageCache::instance = NULL;
 
+ImageCache::ImageCache()
+    : asyncLoadCompleteSignal(0), upperBound(100*1024*1024ull),
+      m_progress(NULL), m_accessCounter(0), m_prefetchThreads(0), m_spillBound(0)
+{
+}
+
+ImageCache::~ImageCache()
+{
+    // wait for the running prefetches
+    m_prefetch.reset();
+    images.clear();
+    m_lru.clear();
+    m_lruPos.clear();
+    // removes the scratch files
+    m_spill.reset();
+    instance = NULL;
+}
+
+void ImageCache::insertEntry(const std::string& name, EntryPtr entry)
+{
+    images[name] = entry;
+    // a scratch file of an older version is no longer needed
+    if (m_spill)
+    {
+        m_spill->remove(name);
+    };
+    touchEntry(name);
+}
+
+void ImageCache::touchEntry(const std::string& name)
+{
+    std::map<std::string, LRUList::iterator>::iterator it = m_lruPos.find(name);
+    if (it != m_lruPos.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+    }
+    else
+    {
+        m_lru.push_front(name);
+        m_lruPos[name] = m_lru.begin();
+    };
+}
+
+void ImageCache::eraseEntry(std::map<std::string, EntryPtr>::iterator it)
+{
+    std::map<std::string, LRUList::iterator>::iterator lruIt = m_lruPos.find(it->first);
+    if (lruIt != m_lruPos.end())
+    {
+        m_lru.erase(lruIt->second);
+        m_lruPos.erase(lruIt);
+    };
+    images.erase(it);
+}
+
+void ImageCache::adoptPrefetched()
+{
+    if (!m_prefetch)
+    {
+        return;
+    };
+    std::vector<std::pair<std::string, EntryPtr> > finished;
+    m_prefetch->takeFinished(finished);
+    for (size_t i = 0; i < finished.size(); ++i)
+    {
+        if (images.find(finished[i].first) == images.end())
+        {
+            insertEntry(finished[i].first, finished[i].second);
+            finished[i].second->lastAccess = m_accessCounter;
+        };
+    };
+}
+
+ImageCache::EntryPtr ImageCache::restoreSpilled(const std::string& name)
+{
+    if (!m_spill)
+    {
+        return EntryPtr();
+    };
+    EntryPtr entry = m_spill->take(name);
+    if (entry)
+    {
+        ++m_statistics.spillHits;
+        insertEntry(name, entry);
+        entry->lastAccess = m_accessCounter;
+    };
+    return entry;
+}
+
+std::shared_future<ImageCache::EntryPtr> ImageCache::prefetchImage(const std::string & filename, int priority)
+{
+    adoptPrefetched();
+    EntryPtr entry = getImageIfAvailable(filename);
+    if (entry)
+    {
+        std::promise<EntryPtr> ready;
+        ready.set_value(entry);
+        return ready.get_future().share();
+    };
+    if (!m_prefetch)
+    {
+        unsigned int threads = m_prefetchThreads;
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        };
+        m_prefetch.reset(new PrefetchPool(threads));
+    };
+    return m_prefetch->add(filename, priority);
+}
+
+bool ImageCache::cancelPrefetch(const std::string & filename)
+{
+    return m_prefetch && m_prefetch->cancel(filename);
+}
+
+void ImageCache::setPrefetchThreads(unsigned int threads)
+{
+    m_prefetchThreads = threads;
+    // the pool is created again with the new number of threads on the next request
+    m_prefetch.reset();
+}
+
+void ImageCache::SetSpillLimit(const unsigned long long newSpillLimit, const std::string& directory)
+{
+    m_spillBound = newSpillLimit;
+    if (m_spillBound == 0)
+    {
+        m_spill.reset();
+        return;
+    };
+    if (!m_spill || m_spill->getRequestedDirectory() != directory)
+    {
+        m_spill.reset(new SpillStore(directory));
+    }
+    else
+    {
+        m_statistics.spillEvictions += m_spill->shrink(m_spillBound);
+    };
+}
+
+ImageCache::Statistics ImageCache::getStatistics() const
+{
+    Statistics statistics(m_statistics);
+    statistics.memoryUsed = 0;
+    for (std::map<std::string, EntryPtr>::const_iterator it = images.begin(); it != images.end(); ++it)
+    {
+        statistics.memoryUsed += it->second->getMemoryUsage();
+    };
+    statistics.spillUsed = m_spill ? m_spill->getUsed() : 0;
+    return statistics;
+}
+
+void ImageCache::resetStatistics()
+{
+    m_statistics = Statistics();
+}
+
 
 void ImageCache::removeImage(const std::string & filename)
 {
     std::map<std::string, EntryPtr>::iterator it = images.find(filename);
     if (it != images.end()) {
-        images.erase(it);
+        eraseEntry(it);
     }
 
     std::string sfilename = filename + std::string(":small");
     it = images.find(sfilename);
     if (it != images.end()) {
-        images.erase(it);
+        eraseEntry(it);
+    }
+    if (m_spill) {
+        m_spill->remove(filename);
+        m_spill->remove(sfilename);
+    }
+    if (m_prefetch) {
+        m_prefetch->cancel(filename);
     }
 
     int level = 0;
@@ -160,6 +916,14 @@ std::string ImageCache::PyramidKey::toString()
 void ImageCache::flush()
 {
     images.clear();
+    m_lru.clear();
+    m_lruPos.clear();
+    if (m_spill) {
+        m_spill->clear();
+    }
+    if (m_prefetch) {
+        m_prefetch->clear();
+    }
 
     for (std::map<std::string, vigra::BImage*>::iterator it = pyrImages.begin();
          it != pyrImages.end();
@@ -177,115 +941,63 @@ void ImageCache::softFlush()
         upperBound = 100 * 1024 * 1024ull;
     };
     const unsigned long long purgeToSize = static_cast<unsigned long long>(0.75 * upperBound);
+    // finished prefetches count against the upper limit like all other images
+    adoptPrefetched();
 
-    // calculate used memory
-    unsigned long long imgMem = 0;
-
-    std::map<std::string, EntryPtr>::iterator imgIt;
-    for(imgIt=images.begin(); imgIt != images.end(); ++imgIt) {
-#ifdef DEBUG
-        std::cout << "Image: " << imgIt->first << std::endl;
-        std::cout << "CacheEntry: " << imgIt->second.use_count() << "last access: " << imgIt->second->lastAccess;
-#endif
-        if (imgIt->second->image8) {
-            imgMem += imgIt->second->image8->width() * imgIt->second->image8->height() * 3;
-#ifdef DEBUG
-            std::cout << " 8bit: " << imgIt->second->image8.use_count();
-#endif
-        }
-        if (imgIt->second->image16) {
-            imgMem += imgIt->second->image16->width() * imgIt->second->image16->height() * 3*2;
+    // calculate used memory, the entries can grow after they have been
+    // inserted (e.g. by get8BitImage()), so sum up the current sizes
+    unsigned long long usedMem = 0;
+    for (std::map<std::string, EntryPtr>::iterator imgIt = images.begin(); imgIt != images.end(); ++imgIt) {
 #ifdef DEBUG
-            std::cout << " 16bit: " << imgIt->second->image8.use_count();
+        std::cout << "Image: " << imgIt->first << " CacheEntry: " << imgIt->second.use_count()
+            << " bytes: " << imgIt->second->getMemoryUsage() << std::endl;
 #endif
-        }
-        if (imgIt->second->imageFloat) {
-            imgMem += imgIt->second->imageFloat->width() * imgIt->second->imageFloat->height() * 3 * 4;
-#ifdef DEBUG
-            std::cout << " float: " << imgIt->second->imageFloat.use_count() ;
-#endif
-        }
-        if (imgIt->second->mask) {
-            imgMem += imgIt->second->mask->width() * imgIt->second->mask->height();
-#ifdef DEBUG
-            std::cout << " mask: " << imgIt->second->mask.use_count() << std::endl;
-#endif
-        }
+        usedMem += imgIt->second->getMemoryUsage();
     }
-
-    unsigned long long pyrMem = 0;
     std::map<std::string, vigra::BImage*>::iterator pyrIt;
     for(pyrIt=pyrImages.begin(); pyrIt != pyrImages.end(); ++pyrIt) {
-        pyrMem += pyrIt->second->width() * pyrIt->second->height();
+        usedMem += pyrIt->second->width() * pyrIt->second->height();
     }
 
-    const unsigned long long usedMem = imgMem + pyrMem;
-
     DEBUG_DEBUG("total: " << (usedMem>>20) << " MB upper bound: " << (purgeToSize>>20) << " MB");
     if (usedMem > upperBound) 
     {
-        // we need to remove images.
-        const unsigned long long purgeAmount = usedMem - purgeToSize;
-        unsigned long long purgedMem = 0;
-        // remove images from cache, first the grey level image,
-        // then the full size images
-
-        // use least recently uses strategy.
-        // sort images by their access time
-        std::map<int,std::string> accessMap;
-        for (std::map<std::string, EntryPtr>::iterator it = images.begin();
-             it != images.end();
-             ++it)
-        {
-            if (it->first.substr(it->first.size()-6) != ":small") {
-                // only consider full images that are not used elsewhere
-                if (it->second.unique()) {
-                    DEBUG_DEBUG("Considering " << it->first << " for deletion");
-                    accessMap.insert(make_pair(it->second->lastAccess, it->first));
-                } else {
-                    DEBUG_DEBUG(it->first << ", usecount: " << it->second.use_count());
-                }
-            }
+        const unsigned long long initialMem = usedMem;
+        // remove the pyramid images first
+        while (usedMem > purgeToSize && !pyrImages.empty()) {
+            vigra::BImage * imgPtr = (*(pyrImages.begin())).second;
+            usedMem -= imgPtr->width() * imgPtr->height();
+            delete imgPtr;
+            pyrImages.erase(pyrImages.begin());
         }
-        while (purgeAmount > purgedMem) {
-            bool deleted = false;
-            if (!pyrImages.empty()) {
-                vigra::BImage * imgPtr = (*(pyrImages.begin())).second;
-                purgedMem += imgPtr->width() * imgPtr->height();
-                delete imgPtr;
-                pyrImages.erase(pyrImages.begin());
-                deleted = true;
-            } else if (!accessMap.empty()) {
-                std::map<int,std::string>::iterator accIt = accessMap.begin();
-                std::map<std::string, EntryPtr>::iterator it = images.find(accIt->second);
-                // check for uniqueness.
-                if (it != images.end()) {
-                    DEBUG_DEBUG("soft flush: removing image: " << it->first);
-                    if (it->second->image8) {
-                        purgedMem += it->second->image8->width() * it->second->image8->height() * 3;
-                    }
-                    if (it->second->image16) {
-                        purgedMem += it->second->image16->width() * it->second->image16->height() * 3 * 2;
-                    }
-                    if (it->second->imageFloat) {
-                        purgedMem += it->second->imageFloat->width() * it->second->imageFloat->height()*3*4;
-                    }
-                    if (it->second->mask) {
-                        purgedMem += it->second->mask->width() * it->second->mask->height();
-                    }
-                    images.erase(it);
-                    accessMap.erase(accIt);
-                    deleted = true;
-                } else {
-                    DEBUG_ASSERT("internal error while purging cache");
-                }
+        // then the images in least recently used order, images which are
+        // still used elsewhere are kept
+        LRUList::iterator lruIt = m_lru.end();
+        while (usedMem > purgeToSize && lruIt != m_lru.begin()) {
+            --lruIt;
+            std::map<std::string, EntryPtr>::iterator it = images.find(*lruIt);
+            if (it == images.end() || !it->second.unique()) {
+                continue;
             }
-            if (!deleted) {
-                break;
+            DEBUG_DEBUG("soft flush: removing image: " << it->first);
+            const unsigned long long bytes = it->second->getMemoryUsage();
+            if (m_spill && bytes <= m_spillBound) {
+                if (m_spill->add(it->first, it->second)) {
+                    ++m_statistics.spills;
+                }
             }
+            usedMem -= bytes;
+            ++m_statistics.evictions;
+            // eraseEntry invalidates lruIt, continue with the next older entry
+            LRUList::iterator next = lruIt;
+            ++next;
+            eraseEntry(it);
+            lruIt = next;
         }
-        DEBUG_DEBUG("purged: " << (purgedMem>>20) << " MB, memory used for images: " << ((usedMem - purgedMem)>>20) << " MB");
-
+        if (m_spill) {
+            m_statistics.spillEvictions += m_spill->shrink(m_spillBound);
+        }
+        DEBUG_DEBUG("purged: " << ((initialMem - usedMem)>>20) << " MB, memory used for images: " << (usedMem>>20) << " MB");
     }
 }
 
@@ -424,8 +1136,27 @@ ImageCache::EntryPtr ImageCache::getImage(const std::string & filename)
     it = images.find(filename);
     if (it != images.end()) {
         it->second->lastAccess = m_accessCounter;
+        touchEntry(filename);
+        ++m_statistics.hits;
         return it->second;
     } else {
+        EntryPtr spilled = restoreSpilled(filename);
+        if (spilled) {
+            return spilled;
+        }
+        std::shared_future<EntryPtr> prefetched;
+        if (m_prefetch && m_prefetch->take(filename, prefetched)) {
+            // load it here, if no worker has started with it yet
+            m_prefetch->runNow(filename);
+            EntryPtr e = prefetched.get();
+            if (e) {
+                ++m_statistics.prefetchHits;
+                insertEntry(filename, e);
+                e->lastAccess = m_accessCounter;
+                return e;
+            }
+        }
+        ++m_statistics.misses;
         if (m_progress) {
             m_progress->setMessage("Loading image:", hugin_utils::stripPath(filename));
         }
@@ -442,7 +1173,7 @@ ImageCache::EntryPtr ImageCache::getImage(const std::string & filename)
             throw std::exception();
         }
         
-        images[filename] = e;
+        insertEntry(filename, e);
         e->lastAccess = m_accessCounter;
         return e;
     }
@@ -629,10 +1360,12 @@ ImageCache::EntryPtr ImageCache::getImageIfAvailable(const std::string & filenam
     if (it != images.end()) {
         m_accessCounter++;
         it->second->lastAccess = m_accessCounter;
+        touchEntry(filename);
+        ++m_statistics.hits;
         return it->second;
     } else {
-        // not found, return 0 pointer.
-        return EntryPtr();
+        // restoring from a scratch file is cheap, otherwise return 0 pointer.
+        return restoreSpilled(filename);
     }
 }
 
@@ -645,18 +1378,34 @@ ImageCache::EntryPtr ImageCache::getSmallImage(const std::string & filename)
     std::string name = filename + std::string(":small");
     it = images.find(name);
     if (it != images.end()) {
+        it->second->lastAccess = m_accessCounter;
+        touchEntry(name);
+        ++m_statistics.hits;
         return it->second;
     } else {
+        EntryPtr spilled = restoreSpilled(name);
+        if (spilled) {
+            return spilled;
+        }
         if (m_progress)
         {
             m_progress->setMessage("Scaling image:", hugin_utils::stripPath(filename));
         }
         DEBUG_DEBUG("creating small image " << name );
-        EntryPtr entry = getImage(filename);
-        
-        EntryPtr small_entry = loadSmallImageSafely(entry);
+        EntryPtr small_entry;
+        // if the full size image is not in the cache, try to decode the file
+        // directly at the reduced size instead of loading the full image
+        if (images.find(filename) == images.end() && !(m_spill && m_spill->contains(filename)))
+        {
+            small_entry = loadReducedImageSafely(filename);
+        };
+        if (!small_entry)
+        {
+            EntryPtr entry = getImage(filename);
+            small_entry = loadSmallImageSafely(entry);
+        };
         small_entry->lastAccess = m_accessCounter;
-        images[name] = small_entry;
+        insertEntry(name, small_entry);
         DEBUG_INFO ( "created small image: " << name);
         if (m_progress) {
             m_progress->taskFinished();
@@ -727,6 +1476,63 @@ ImageCache::EntryPtr ImageCache::loadSmallImageSafely(EntryPtr entry)
     return e;
 }
 
+ImageCache::EntryPtr ImageCache::loadReducedImageSafely(const std::string & filename)
+{
+    try {
+        vigra::ImageImportInfo info(filename.c_str());
+        if (strcmp(info.getPixelType(), "UINT8") != 0)
+        {
+            return EntryPtr();
+        };
+        // same number of levels as in loadSmallImageSafely
+        size_t sz = static_cast<size_t>(info.width()) * info.height();
+        const size_t smallImageSize = 800 * 800l;
+        int nLevel = 0;
+        while (sz > smallImageSize) {
+            sz /= 4;
+            nLevel++;
+        }
+        if (nLevel == 0)
+        {
+            // small image has the same size as the full image
+            return EntryPtr();
+        };
+        // the decoders support reduction by 2, 4 and 8, do the remaining levels by hand
+        const int decodedLevels = std::min(nLevel, 3);
+        vigra::BRGBImage reducedImage;
+        vigra::BImage reducedMask;
+        if (!vigra_ext::importReducedImage(info, 1 << decodedLevels, reducedImage, reducedMask))
+        {
+            return EntryPtr();
+        };
+        EntryPtr e(new Entry);
+        e->origType = "UINT8";
+        if (!info.getICCProfile().empty())
+        {
+            *(e->iccProfile) = info.getICCProfile();
+        };
+        e->image8 = ImageCacheRGB8Ptr(new vigra::BRGBImage);
+        if (nLevel == decodedLevels)
+        {
+            e->image8->swap(reducedImage);
+            e->mask->swap(reducedMask);
+        }
+        else
+        {
+            if (reducedMask.width() != 0) {
+                vigra_ext::reduceNTimes(reducedImage, reducedMask, *(e->image8), *(e->mask), nLevel - decodedLevels);
+            } else {
+                vigra_ext::reduceNTimes(reducedImage, *(e->image8), nLevel - decodedLevels);
+            }
+        };
+        DEBUG_DEBUG(filename << ": decoded small image at reduced size " << e->image8->width() << "x" << e->image8->height());
+        return e;
+    } catch (std::exception & e) {
+        DEBUG_ERROR("Error during reduced image reading: " << e.what());
+        return EntryPtr();
+    }
+}
+
 ImageCache::EntryPtr ImageCache::getSmallImageIfAvailable(const std::string & filename)
 {
     m_accessCounter++;
@@ -736,10 +1542,13 @@ ImageCache::EntryPtr ImageCache::getSmallImageIfAvailable(const std::string & fi
     std::string name = filename + std::string(":small");
     it = images.find(name);
     if (it != images.end()) {
+        it->second->lastAccess = m_accessCounter;
+        touchEntry(name);
+        ++m_statistics.hits;
         return it->second;
     } else {
-        // not found, return 0 pointer.
-        return EntryPtr();
+        // restoring from a scratch file is cheap, otherwise return 0 pointer.
+        return restoreSpilled(name);
     }
 }
 
@@ -790,9 +1599,10 @@ void ImageCache::postEvent(RequestPtr request, EntryPtr entry)
     // Put the loaded image in the cache.
     if (is_small_request) {
         std::string name = filename+std::string(":small");
-        images[name] = entry;
+        insertEntry(name, entry);
     } else {
-        images[filename] = entry;
+        insertEntry(filename, entry);
+        ++m_statistics.misses;
     }
     entry->lastAccess = m_accessCounter;
     // Remove all the completed and no longer wanted requests from the queues.
@@ -935,9 +1745,9 @@ void ImageCache::spawnAsyncThread()
         EntryPtr large = getImageIfAvailable(filename);
         if (large.get() == 0)
         {
-            // the larger one is needed to generate it.
-            RequestPtr request(new Request(filename, false));
-            std::thread thread(loadSafely, request, EntryPtr());
+            // try to decode the small image directly, loadSafely falls back
+            // to loading the larger one, which is then needed to generate it.
+            std::thread thread(loadSafely, it->second, EntryPtr());
             thread.detach();
         } else {
             // we have the large image.
@@ -960,7 +1770,19 @@ void ImageCache::loadSafely(ImageCache::RequestPtr request, EntryPtr large)
     {
         new_entry = loadSmallImageSafely(large);
     } else {
-        new_entry = loadImageSafely(request->getFilename());
+        if (request->getIsSmall())
+        {
+            new_entry = loadReducedImageSafely(request->getFilename());
+            if (!new_entry)
+            {
+                // reduced decoding not possible, load the large image first
+                request = RequestPtr(new Request(request->getFilename(), false));
+            };
+        };
+        if (!new_entry)
+        {
+            new_entry = loadImageSafely(request->getFilename());
+        };
     }
     // pass an event with the load image and request, which can get picked up by
     // the main thread later. This could be a wxEvent for example.
@@ -27,9 +27,11 @@
 #include <hugin_shared.h>
 #include "hugin_config.h"
 #include <map>
+#include <list>
 #include <vector>
 #include <memory>
 #include <functional>
+#include <future>
 #include <vigra/stdimage.hxx>
 #include <vigra/imageinfo.hxx>
 #include <hugin_utils/utils.h>
@@ -48,6 +50,12 @@ namespace HuginBase {
  *  to know how to reproduce the requested images, in case
  *  that they have been deleted.
  *
+ *  The images are evicted in least recently used order, when the memory
+ *  used by the images exceeds the upper limit. If a spill limit is set,
+ *  the pixel data of evicted images are written to memory mapped scratch
+ *  files and restored from there on the next access, instead of decoding
+ *  the image file again.
+ *
  */
 class IMPEX ImageCache
 {
@@ -106,6 +114,9 @@ class IMPEX ImageCache
 
                 ///
                 ImageCacheRGB8Ptr get8BitImage();
+
+                /** return the number of bytes used by the pixel data */
+                unsigned long long getMemoryUsage() const;
         };
 
         /** a shared pointer to the entry */
@@ -150,21 +161,41 @@ class IMPEX ImageCache
          */
         typedef std::shared_ptr<Request> RequestPtr;
 
+        /** counters of the cache accesses */
+        struct Statistics
+        {
+            /** requests which found the image in memory */
+            unsigned long long hits;
+            /** requests which restored the image from a scratch file */
+            unsigned long long spillHits;
+            /** requests which needed to load the image from disc */
+            unsigned long long misses;
+            /** requests which got the image from a finished or running prefetch */
+            unsigned long long prefetchHits;
+            /** images removed from memory by softFlush() */
+            unsigned long long evictions;
+            /** evicted images written to a scratch file */
+            unsigned long long spills;
+            /** scratch files removed to stay below the spill limit */
+            unsigned long long spillEvictions;
+            /** bytes used by the images in memory */
+            unsigned long long memoryUsed;
+            /** bytes used by the scratch files */
+            unsigned long long spillUsed;
+
+            Statistics() : hits(0), spillHits(0), misses(0), prefetchHits(0), evictions(0), spills(0),
+                spillEvictions(0), memoryUsed(0), spillUsed(0)
+            {};
+        };
+
     private:
         // ctor. private, nobody execpt us can create an instance.
-        ImageCache()
-            : asyncLoadCompleteSignal(0), upperBound(100*1024*1024ull),
-              m_progress(NULL), m_accessCounter(0)
-        {};
+        ImageCache();
         
     public:
         /** dtor.
          */
-        virtual ~ImageCache()
-        {
-                images.clear();
-                instance = NULL;
-        }
+        virtual ~ImageCache();
 
         /** get the global ImageCache object */
         static ImageCache & getInstance();
@@ -234,6 +265,36 @@ class IMPEX ImageCache
          */
         RequestPtr requestAsyncSmallImage(const std::string & filename);
 
+        /** load an image in the background, without the need for an event loop.
+         *
+         *  The image is decoded by a pool of worker threads, images with a
+         *  higher @p priority are loaded first, images with the same priority
+         *  in the order of the requests. Prefetching an image which is already
+         *  queued only updates its priority.
+         *  A later getImage() for the same file waits for the prefetch and
+         *  stores the image in the cache. Finished prefetches, which were not
+         *  requested yet, are moved into the cache by the next prefetchImage()
+         *  or softFlush(), so they count against the upper limit and are
+         *  evicted like all other images. Alternatively the returned future can
+         *  be used directly, it contains a 0 pointer if the image could not be
+         *  loaded or the prefetch was cancelled.
+         *
+         *  The cache itself is not thread safe, call prefetchImage(),
+         *  cancelPrefetch() and getImage() from the same thread.
+         */
+        std::shared_future<EntryPtr> prefetchImage(const std::string & filename, int priority = 0);
+
+        /** cancel the prefetch of an image.
+         *  @return true, if the image was removed from the queue, false if it
+         *          was not queued or its loading has already started
+         */
+        bool cancelPrefetch(const std::string & filename);
+
+        /** sets the number of worker threads for prefetchImage(), 0 uses the
+         *  number of cores. Cancels all queued prefetches.
+         */
+        void setPrefetchThreads(unsigned int threads);
+
         /** remove a specific image (and dependant images)
          * from the cache 
          */
@@ -254,6 +315,15 @@ class IMPEX ImageCache
 		/** sets the upper limit, which is used by softFlush() 
 		 */
 		void SetUpperLimit(const unsigned long long newUpperLimit) { upperBound=newUpperLimit; };
+        /** sets the limit for the scratch files of evicted images, 0 disables
+         *  the spilling. The files are created in @p directory, or in the
+         *  temporary directory of the system if it is empty.
+         */
+        void SetSpillLimit(const unsigned long long newSpillLimit, const std::string& directory = std::string());
+        /** return the counters of the cache accesses */
+        Statistics getStatistics() const;
+        /** reset the access counters */
+        void resetStatistics();
         
         /** Signal for when a asynchronous load completes.
          *  If you use the requestAsync functions, ensure there is something
@@ -326,6 +396,33 @@ class IMPEX ImageCache
     private:
         std::map<std::string, EntryPtr> images;
 
+        /** names of the cached images, most recently used first */
+        typedef std::list<std::string> LRUList;
+        LRUList m_lru;
+        std::map<std::string, LRUList::iterator> m_lruPos;
+        /** store a new entry in the cache and mark it as most recently used */
+        void insertEntry(const std::string& name, EntryPtr entry);
+        /** mark the entry as most recently used */
+        void touchEntry(const std::string& name);
+        /** remove the entry from the cache */
+        void eraseEntry(std::map<std::string, EntryPtr>::iterator it);
+        /** move the finished prefetches into the cache */
+        void adoptPrefetched();
+        /** restore an evicted image from its scratch file
+         *  @return 0 pointer, if the image was not spilled */
+        EntryPtr restoreSpilled(const std::string& name);
+
+        /** worker threads for prefetchImage() */
+        class PrefetchPool;
+        std::unique_ptr<PrefetchPool> m_prefetch;
+        unsigned int m_prefetchThreads;
+
+        /** scratch files of evicted images */
+        class SpillStore;
+        std::unique_ptr<SpillStore> m_spill;
+        unsigned long long m_spillBound;
+        Statistics m_statistics;
+
         // our progress display
         AppBase::ProgressDisplay* m_progress;
 
@@ -360,6 +457,13 @@ class IMPEX ImageCache
          * @param entry Large image to scale down.
          */
         static EntryPtr loadSmallImageSafely(EntryPtr entry);
+
+        /** Decode a small image directly from the file at reduced resolution,
+         *  in a way that will work in parallel. Only possible for 8 bit JPEG
+         *  and TIFF files, for all other files a 0 pointer is returned and
+         *  the small image has to be generated from the full size image.
+         */
+        static EntryPtr loadReducedImageSafely(const std::string & filename);
         
     public:
         /** get a pyramid image.
@@ -0,0 +1,139 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/AsyncWriter.cpp
+ *
+ *  Bounded queue, which writes images in background threads
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "AsyncWriter.h"
+
+#include <algorithm>
+
+namespace HuginBase {
+namespace Nona {
+
+AsyncWriter::AsyncWriter(unsigned int nrThreads, size_t memoryBudget)
+    : m_memoryBudget(memoryBudget), m_memoryUsed(0), m_pendingJobs(0), m_stop(false)
+{
+    nrThreads = std::max(nrThreads, 1u);
+    for (unsigned int i = 0; i < nrThreads; ++i)
+    {
+        m_threads.push_back(std::thread(&AsyncWriter::workerLoop, this));
+    };
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_pendingJobs > 0)
+        {
+            m_jobFinished.wait(lock);
+        };
+        m_stop = true;
+    }
+    m_jobAdded.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    };
+}
+
+void AsyncWriter::push(Job* job)
+{
+    const size_t memory = job->getMemoryUsage();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pendingJobs > 0 && m_memoryUsed + memory > m_memoryBudget && !m_error)
+    {
+        m_jobFinished.wait(lock);
+    };
+    if (m_error)
+    {
+        delete job;
+        rethrowError();
+    };
+    m_queue.push_back(job);
+    m_memoryUsed += memory;
+    ++m_pendingJobs;
+    lock.unlock();
+    m_jobAdded.notify_one();
+}
+
+void AsyncWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_pendingJobs > 0)
+    {
+        m_jobFinished.wait(lock);
+    };
+    rethrowError();
+}
+
+void AsyncWriter::rethrowError()
+{
+    if (m_error)
+    {
+        std::exception_ptr error = m_error;
+        m_error = std::exception_ptr();
+        std::rethrow_exception(error);
+    };
+}
+
+void AsyncWriter::workerLoop()
+{
+    while (true)
+    {
+        Job* job = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (m_queue.empty() && !m_stop)
+            {
+                m_jobAdded.wait(lock);
+            };
+            if (m_queue.empty())
+            {
+                return;
+            };
+            job = m_queue.front();
+            m_queue.pop_front();
+        }
+        const size_t memory = job->getMemoryUsage();
+        std::exception_ptr error;
+        try
+        {
+            job->run();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        };
+        delete job;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error)
+            {
+                m_error = error;
+            };
+            m_memoryUsed -= memory;
+            --m_pendingJobs;
+        }
+        m_jobFinished.notify_all();
+    };
+}
+
+} // namespace Nona
+} // namespace HuginBase
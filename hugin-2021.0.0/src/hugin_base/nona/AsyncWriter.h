@@ -0,0 +1,101 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/AsyncWriter.h
+ *
+ *  Bounded queue, which writes images in background threads
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_ASYNCWRITER_H
+#define _NONA_ASYNCWRITER_H
+
+#include <hugin_shared.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace HuginBase {
+namespace Nona {
+
+/** runs write jobs (encoding and writing of images) in background threads.
+ *
+ *  The queue is bounded by a memory budget: push() blocks as long as the
+ *  queued and running jobs together would use more memory than the budget.
+ *  A single job larger than the budget is still accepted when the queue is
+ *  empty, so the writer can't dead lock.
+ *
+ *  Exceptions thrown by a job are stored and rethrown by the next call of
+ *  push() or wait(), the remaining jobs are still executed.
+ */
+class IMPEX AsyncWriter
+{
+public:
+    /** a single job, the AsyncWriter takes ownership */
+    class Job
+    {
+    public:
+        virtual ~Job() {};
+        /** encode and write the data */
+        virtual void run() = 0;
+        /** return the memory used by the job in bytes */
+        virtual size_t getMemoryUsage() const = 0;
+    };
+
+    /** create the writer with @p nrThreads threads and a budget of @p memoryBudget bytes */
+    AsyncWriter(unsigned int nrThreads, size_t memoryBudget);
+    /** waits for all jobs, errors are ignored here, call wait() before to get them */
+    ~AsyncWriter();
+
+    /** add a job to the queue, blocks while the memory budget is exhausted */
+    void push(Job* job);
+    /** wait until all queued jobs are finished, rethrows the first exception of a job */
+    void wait();
+
+private:
+    // not copyable
+    AsyncWriter(const AsyncWriter&);
+    AsyncWriter& operator=(const AsyncWriter&);
+
+    /** main function of the background threads */
+    void workerLoop();
+    /** rethrow a stored exception, needs to be called with locked mutex */
+    void rethrowError();
+
+    std::vector<std::thread> m_threads;
+    std::deque<Job*> m_queue;
+    std::mutex m_mutex;
+    /** signaled when a job was added or the writer is stopped */
+    std::condition_variable m_jobAdded;
+    /** signaled when a job was finished */
+    std::condition_variable m_jobFinished;
+    const size_t m_memoryBudget;
+    /** memory of all queued and running jobs */
+    size_t m_memoryUsed;
+    /** number of queued and running jobs */
+    size_t m_pendingJobs;
+    bool m_stop;
+    std::exception_ptr m_error;
+};
+
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_ASYNCWRITER_H
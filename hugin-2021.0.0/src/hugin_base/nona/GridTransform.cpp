@@ -0,0 +1,174 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/GridTransform.cpp
+ *
+ *  Approximation of the remapping transform by an adaptive sparse grid
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "GridTransform.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace HuginBase {
+namespace Nona {
+
+namespace
+{
+    /** result of the subdivision of a single cell */
+    struct CellGrid
+    {
+        int shift;
+        size_t evaluations;
+        std::vector<double> samples;
+    };
+
+    /** evaluate the transform on a grid with spacing 1<<shift, starting at x0, y0
+     *  @return false, if the transform failed for at least one point */
+    bool EvaluateGrid(const PTools::Transform& transf, int x0, int y0, int samples, int shift, std::vector<double>& values)
+    {
+        values.resize(2 * samples * samples);
+        double* p = &values[0];
+        for (int j = 0; j < samples; ++j)
+        {
+            for (int i = 0; i < samples; ++i, p += 2)
+            {
+                if (!transf.transformImgCoord(p[0], p[1], x0 + (i << shift), y0 + (j << shift)) ||
+                    !std::isfinite(p[0]) || !std::isfinite(p[1]))
+                {
+                    return false;
+                };
+            };
+        };
+        return true;
+    }
+
+    /** return the maximal difference between the values at the odd grid
+     *  positions and the bilinear interpolation of the even grid positions */
+    double InterpolationError(const std::vector<double>& values, int samples)
+    {
+        double maxError = 0;
+        for (int j = 0; j < samples; ++j)
+        {
+            for (int i = 0; i < samples; ++i)
+            {
+                if (i % 2 == 0 && j % 2 == 0)
+                {
+                    continue;
+                };
+                // neighbours on the coarse grid
+                const int i0 = i - i % 2;
+                const int i1 = i + i % 2;
+                const int j0 = j - j % 2;
+                const int j1 = j + j % 2;
+                const double* p00 = &values[2 * (j0 * samples + i0)];
+                const double* p10 = &values[2 * (j0 * samples + i1)];
+                const double* p01 = &values[2 * (j1 * samples + i0)];
+                const double* p11 = &values[2 * (j1 * samples + i1)];
+                const double* p = &values[2 * (j * samples + i)];
+                const double dx = p[0] - 0.25 * (p00[0] + p10[0] + p01[0] + p11[0]);
+                const double dy = p[1] - 0.25 * (p00[1] + p10[1] + p01[1] + p11[1]);
+                maxError = std::max(maxError, dx * dx + dy * dy);
+            };
+        };
+        return std::sqrt(maxError);
+    }
+}
+
+GridTransform::GridTransform() : m_gridSize(0), m_gridShift(0), m_cellsX(0), m_evaluations(0), m_exactCells(0)
+{
+}
+
+void GridTransform::create(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi,
+    int gridSize, double tolerance)
+{
+    m_cells.clear();
+    m_samples.clear();
+    m_evaluations = 0;
+    m_exactCells = 0;
+    m_roi = roi;
+    m_srcSize = src.getSize();
+    m_transf.createTransform(src, dest);
+    // use a power of 2 as grid size, so the cell can be found by shifting
+    m_gridShift = 2;
+    while ((2 << m_gridShift) <= gridSize && m_gridShift < 10)
+    {
+        ++m_gridShift;
+    };
+    m_gridSize = 1 << m_gridShift;
+    if (m_roi.isEmpty())
+    {
+        return;
+    };
+    m_cellsX = (m_roi.width() + m_gridSize - 1) >> m_gridShift;
+    const int cellsY = (m_roi.height() + m_gridSize - 1) >> m_gridShift;
+    const int nrCells = m_cellsX * cellsY;
+    std::vector<CellGrid> grids(nrCells);
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int cellIndex = 0; cellIndex < nrCells; ++cellIndex)
+    {
+        CellGrid& grid = grids[cellIndex];
+        grid.shift = -1;
+        grid.evaluations = 0;
+        const int x0 = m_roi.left() + ((cellIndex % m_cellsX) << m_gridShift);
+        const int y0 = m_roi.top() + ((cellIndex / m_cellsX) << m_gridShift);
+        // evaluate the grid with half the spacing and check if the coarser
+        // grid was already good enough, otherwise refine further
+        for (int shift = m_gridShift - 1; shift >= 1; --shift)
+        {
+            const int samples = (m_gridSize >> shift) + 1;
+            if (!EvaluateGrid(m_transf, x0, y0, samples, shift, grid.samples))
+            {
+                grid.evaluations += samples * samples;
+                break;
+            };
+            grid.evaluations += samples * samples;
+            if (InterpolationError(grid.samples, samples) <= tolerance)
+            {
+                grid.shift = shift;
+                break;
+            };
+        };
+        if (grid.shift < 0)
+        {
+            grid.samples.clear();
+        };
+    };
+    // collect all samples in a single array
+    m_cells.resize(nrCells);
+    size_t nrSamples = 0;
+    for (int i = 0; i < nrCells; ++i)
+    {
+        nrSamples += grids[i].samples.size();
+    };
+    m_samples.reserve(nrSamples);
+    for (int i = 0; i < nrCells; ++i)
+    {
+        m_cells[i].shift = grids[i].shift;
+        m_cells[i].scale = 1.0 / (1 << std::max(grids[i].shift, 0));
+        m_cells[i].offset = m_samples.size();
+        m_samples.insert(m_samples.end(), grids[i].samples.begin(), grids[i].samples.end());
+        m_evaluations += grids[i].evaluations;
+        if (grids[i].shift < 0)
+        {
+            ++m_exactCells;
+        };
+    };
+}
+
+} // namespace Nona
+} // namespace HuginBase
@@ -0,0 +1,155 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/GridTransform.h
+ *
+ *  Approximation of the remapping transform by an adaptive sparse grid
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_GRIDTRANSFORM_H
+#define _NONA_GRIDTRANSFORM_H
+
+#include <hugin_shared.h>
+
+#include <memory>
+#include <vector>
+
+#include <vigra/diff2d.hxx>
+#include <panodata/SrcPanoImage.h>
+#include <panodata/PanoramaOptions.h>
+#include <panotools/PanoToolsInterface.h>
+
+namespace HuginBase {
+namespace Nona {
+
+/** transform which evaluates the PTools::Transform only on a sparse grid
+ *  and interpolates the source coordinates bilinear in between.
+ *
+ *  The output region is divided into cells of gridSize x gridSize pixels.
+ *  For each cell the transform is evaluated on a grid with half the cell
+ *  size and the bilinear interpolation of the coarser grid is compared to
+ *  the exact values at the additional points. If the difference is larger
+ *  than the tolerance the cell is subdivided further, down to a grid spacing
+ *  of 2 pixels. Cells which still do not fit (e.g. near the poles or at the
+ *  +-180 degree seam of a full spherical source image) and cells
+ *  containing points where the transform fails are evaluated exactly for
+ *  every pixel.
+ *
+ *  The subdivision test is a heuristic, discontinuities which do not cross
+ *  any of the tested grid lines are not detected.
+ *
+ *  The class provides the same transformImgCoord() interface as
+ *  PTools::Transform and can be used as TRANSFORM argument of
+ *  vigra_ext::transformImage and vigra_ext::transformImageAlpha. Points
+ *  outside the region given to create() are transformed exactly.
+ */
+class IMPEX GridTransform
+{
+public:
+    /** creates an empty grid, use create() to initialize it */
+    GridTransform();
+
+    /** calculate the grid for image @p src remapped into the region @p roi
+     *  of panorama @p dest.
+     *  @param gridSize size of the coarsest cells, rounded down to a power of 2 (at least 4)
+     *  @param tolerance maximal allowed interpolation error in source image pixels
+     */
+    void create(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi,
+        int gridSize = 16, double tolerance = 0.05);
+
+    /** return true, if the grid was created */
+    bool isValid() const { return !m_cells.empty(); };
+    /** return the output region covered by the grid */
+    const vigra::Rect2D& getROI() const { return m_roi; };
+    /** return the size of the source image for which the grid was created */
+    const vigra::Size2D& getSrcSize() const { return m_srcSize; };
+    /** return the number of exact transformations used to create the grid */
+    size_t getNumberOfEvaluations() const { return m_evaluations; };
+    /** return the number of cells, which are transformed exactly for each pixel */
+    size_t getNumberOfExactCells() const { return m_exactCells; };
+
+    /** transform the panorama pixel @p x_src, @p y_src into source image coordinates
+     *  (interface compatible with PTools::Transform::transformImgCoord)
+     *  @return false, if the transformation failed
+     */
+    bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+    {
+        const double x = x_src - m_roi.left();
+        const double y = y_src - m_roi.top();
+        if (x < 0 || y < 0 || x >= m_roi.width() || y >= m_roi.height())
+        {
+            return m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src);
+        };
+        const int xi = static_cast<int>(x);
+        const int yi = static_cast<int>(y);
+        const int cellX = xi >> m_gridShift;
+        const int cellY = yi >> m_gridShift;
+        const Cell& cell = m_cells[cellY * m_cellsX + cellX];
+        if (cell.shift < 0)
+        {
+            return m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src);
+        };
+        // position inside the cell, in units of the cell grid
+        const int lx = xi & (m_gridSize - 1);
+        const int ly = yi & (m_gridSize - 1);
+        const int mask = (1 << cell.shift) - 1;
+        const int ix = lx >> cell.shift;
+        const int iy = ly >> cell.shift;
+        const double fx = ((lx & mask) + (x - xi)) * cell.scale;
+        const double fy = ((ly & mask) + (y - yi)) * cell.scale;
+        const int samples = (m_gridSize >> cell.shift) + 1;
+        const double* p0 = &m_samples[cell.offset + 2 * (iy * samples + ix)];
+        const double* p1 = p0 + 2 * samples;
+        x_dest = (1 - fy) * ((1 - fx) * p0[0] + fx * p0[2]) + fy * ((1 - fx) * p1[0] + fx * p1[2]);
+        y_dest = (1 - fy) * ((1 - fx) * p0[1] + fx * p0[3]) + fy * ((1 - fx) * p1[1] + fx * p1[3]);
+        return true;
+    };
+
+private:
+    // private, the underlying PTools::Transform can't be copied
+    GridTransform(const GridTransform&);
+    GridTransform& operator=(const GridTransform&);
+
+    /** grid of a single cell */
+    struct Cell
+    {
+        /** log2 of the grid spacing, -1 if the cell is transformed exactly */
+        int shift;
+        /** 1 / grid spacing */
+        double scale;
+        /** offset of the first sample in m_samples */
+        size_t offset;
+    };
+
+    PTools::Transform m_transf;
+    vigra::Rect2D m_roi;
+    vigra::Size2D m_srcSize;
+    int m_gridSize;
+    int m_gridShift;
+    int m_cellsX;
+    std::vector<Cell> m_cells;
+    /** interleaved x and y source coordinates of all cells */
+    std::vector<double> m_samples;
+    size_t m_evaluations;
+    size_t m_exactCells;
+};
+
+typedef std::shared_ptr<const GridTransform> GridTransformPtr;
+
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_GRIDTRANSFORM_H
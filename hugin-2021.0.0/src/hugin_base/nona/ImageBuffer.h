@@ -0,0 +1,68 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/ImageBuffer.h
+ *
+ *  Description of caller owned pixel buffers for in-memory stitching
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_IMAGEBUFFER_H
+#define _NONA_IMAGEBUFFER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace HuginBase {
+namespace Nona {
+
+/** describes an interleaved image in memory, which is owned by the caller.
+ *
+ *  The pixel type uses the same names as vigra::ImageImportInfo::getPixelType()
+ *  ("UINT8", "UINT16", "FLOAT"). The buffer has either 1 (gray) or 3 (RGB)
+ *  color bands. An additional band is interpreted as alpha channel.
+ */
+struct ImageBuffer
+{
+    ImageBuffer() : data(NULL), width(0), height(0), stride(0), bands(0) {};
+    ImageBuffer(void* d, int w, int h, std::ptrdiff_t s, const std::string& type, int b)
+        : data(d), width(w), height(h), stride(s), pixelType(type), bands(b) {};
+
+    /** pointer to the first pixel of the upper left corner */
+    void* data;
+    int width;
+    int height;
+    /** distance between two rows in bytes */
+    std::ptrdiff_t stride;
+    std::string pixelType;
+    /** number of interleaved bands, including the alpha band */
+    int bands;
+
+    /** return the number of color bands (without alpha) */
+    int colorBands() const { return (bands == 2 || bands == 4) ? bands - 1 : bands; };
+    /** return true, if the last band is an alpha channel */
+    bool hasAlpha() const { return bands == 2 || bands == 4; };
+    /** return pointer to the first pixel of row @p y */
+    char* row(int y) const { return static_cast<char*>(data) + y * stride; };
+};
+
+/** input images by image number */
+typedef std::map<unsigned int, ImageBuffer> ImageBufferMap;
+
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_IMAGEBUFFER_H
@@ -28,9 +28,13 @@
 #define _NONA_IMAGEREMAPPER_H
 
 
+#include <map>
 #include <panodata/PanoramaData.h>
 #include <nona/RemappedPanoImage.h>
+#include <nona/RemapPlan.h>
+#include <nona/ImageBuffer.h>
 #include <vigra_ext/impexalpha.hxx>
+#include <hugin_utils/openmp_lock.h>
 
 namespace HuginBase {
 namespace Nona {
@@ -42,7 +46,7 @@ namespace Nona {
     {
         
         public:
-            SingleImageRemapper() : m_advancedOptions()
+            SingleImageRemapper() : m_advancedOptions(), m_storeSrcCoords(false)
             {};
 
             /** create a remapped pano image.
@@ -64,8 +68,38 @@ namespace Nona {
 
             ///
             virtual	void release(RemappedPanoImage<ImageType,AlphaType>* d) = 0;
+
+            /** return true, if getRemapped() and release() can be called
+             *  concurrently from several threads for different images.
+             *  The progress display passed to getRemapped() must not be shared
+             *  between the threads. */
+            virtual bool supportsParallelRemapping() const
+                { return false; }
+
+            /** use the given remap plan for image @p imgNr. The plan is only used
+             *  if it matches the geometry of the image in getRemapped() */
+            void setRemapPlan(unsigned int imgNr, RemapPlanPtr plan)
+                { m_plans[imgNr] = plan; }
+            /** forget all remap plans */
+            void clearRemapPlans()
+                { m_plans.clear(); }
+            /** keep the source coordinates in the remapped images, see
+             *  RemappedPanoImage::setStoreSrcCoords() */
+            void setStoreSrcCoords(bool store)
+                { m_storeSrcCoords = store; }
+
         protected:
+            /** return the remap plan for the given image. Existing plans are reused,
+             *  when the advanced option useRemapPlan or remapPlanDir is set a new
+             *  plan is created (or loaded from the directory given in remapPlanDir) */
+            RemapPlanPtr getRemapPlan(const SrcPanoImage& src, const PanoramaOptions& opts,
+                                      unsigned int imgNr, const vigra::Rect2D& outputROI);
+
             HuginBase::Nona::AdvancedOptions m_advancedOptions;
+            std::map<unsigned int, RemapPlanPtr> m_plans;
+            /** protects m_plans when remapping several images in parallel */
+            hugin_omp::Lock m_plansLock;
+            bool m_storeSrcCoords;
         
     };
 
@@ -77,9 +111,7 @@ namespace Nona {
         
     public:
         FileRemapper() : SingleImageRemapper<ImageType, AlphaType>()
-        {
-            m_remapped = 0;
-        }
+        {}
 
         virtual ~FileRemapper() {};
 
@@ -103,13 +135,137 @@ namespace Nona {
         virtual void release(RemappedPanoImage<ImageType,AlphaType>* d)
             { delete d; }
 
+        /** each image is loaded into its own buffer, so several images can
+         *  be remapped at the same time */
+        virtual bool supportsParallelRemapping() const
+            { return true; }
+
+    };
+
+
+    /** functor to create a remapped image from images in memory.
+     *
+     *  The pixel data are provided by the caller with setImage(), they are not
+     *  copied and must stay valid until the image has been remapped. If the
+     *  pixel type and the number of bands of the buffer fits to ImageType the
+     *  buffer is used directly, otherwise it is converted in the same way as
+     *  FileRemapper does it for images read from disc.
+     */
+    template <typename ImageType, typename AlphaType>
+    class MemoryRemapper : public SingleImageRemapper<ImageType, AlphaType>
+    {
+
+    public:
+        MemoryRemapper() : SingleImageRemapper<ImageType, AlphaType>(), m_keepRemapped(false)
+        {};
+
+        virtual ~MemoryRemapper()
+            { clearRemapped(); }
+
+        /** set the pixel data for image @p imgNr */
+        void setImage(unsigned int imgNr, const ImageBuffer& buffer)
+            { m_images[imgNr] = buffer; }
+        /** set pixel data for several images */
+        void setImages(const ImageBufferMap& buffers)
+            { m_images = buffers; }
+        /** forget all image buffers */
+        void clearImages()
+            { m_images.clear(); }
+
+        ///
+        virtual RemappedPanoImage<ImageType, AlphaType>*
+        getRemapped(const PanoramaData & pano, const PanoramaOptions & opts,
+                    unsigned int imgNr, vigra::Rect2D outputROI,
+                    AppBase::ProgressDisplay* progress);
+
+        ///
+        virtual void release(RemappedPanoImage<ImageType,AlphaType>* d)
+        {
+            hugin_omp::ScopedLock lock(m_remappedLock);
+            for (typename RemappedMap::const_iterator it = m_remapped.begin(); it != m_remapped.end(); ++it)
+            {
+                if (it->second.image == d)
+                {
+                    // kept for the next call
+                    return;
+                };
+            };
+            delete d;
+        }
+
+        /** the pixel data are only read, so several images can be remapped
+         *  at the same time. The same image must not be remapped twice
+         *  concurrently when the remapped images are kept. */
+        virtual bool supportsParallelRemapping() const
+            { return true; }
+
+        /** keep the remapped images after release(). When the same image is
+         *  remapped again into the same region with unchanged geometry,
+         *  photometric variables and output options (see
+         *  CalcRemappedFingerprint()) the remapped image is reused together
+         *  with its transformation and photometric transform, only the
+         *  pixels are remapped again. This is useful when stitching several
+         *  frames with the same geometry. Not used when remapping on the GPU. */
+        void setKeepRemapped(bool keep)
+        {
+            m_keepRemapped = keep;
+            if (!keep)
+            {
+                clearRemapped();
+            };
+        }
+        /** delete all kept remapped images */
+        void clearRemapped()
+        {
+            for (typename RemappedMap::iterator it = m_remapped.begin(); it != m_remapped.end(); ++it)
+            {
+                delete it->second.image;
+            };
+            m_remapped.clear();
+        }
 
     protected:
-        RemappedPanoImage<ImageType,AlphaType> * m_remapped;
+        /** remap the image, reuses the settings of @p remapped if @p reuse is true */
+        template <class SrcImgType>
+        void remap(SrcImgType & srcImg, const AlphaType & srcAlpha, const SrcPanoImage & src,
+                   const PanoramaOptions & opts, const vigra::Rect2D & outputROI,
+                   RemappedPanoImage<ImageType, AlphaType> & remapped, bool reuse,
+                   AppBase::ProgressDisplay* progress);
+
+        /** a kept remapped image and the fingerprint of the inputs it was set up with */
+        struct KeptRemapped
+        {
+            RemappedPanoImage<ImageType, AlphaType>* image;
+            unsigned long long fingerprint;
+        };
+        typedef std::map<unsigned int, KeptRemapped> RemappedMap;
+        ImageBufferMap m_images;
+        bool m_keepRemapped;
+        RemappedMap m_remapped;
+        /** protects m_remapped when remapping several images in parallel */
+        hugin_omp::Lock m_remappedLock;
 
     };
 
 
+    /** copy an image buffer into a vigra image and alpha image, the pixel values are
+     *  scaled to the range of the destination pixel type. @p srcAlpha is only
+     *  filled if the buffer contains an alpha band. */
+    template <class ImageType, class AlphaType>
+    void importImageBuffer(const ImageBuffer& buffer, ImageType& srcImg, AlphaType& srcAlpha);
+
+    /** copy the region @p roi of image and alpha into the caller owned buffer.
+     *  The buffer must have the pixel type of ImageType, if it has an extra band
+     *  the alpha channel is written into it. */
+    template <class ImageType, class AlphaType>
+    void exportImageBuffer(const ImageType& img, const AlphaType& alpha, const vigra::Rect2D& roi, ImageBuffer& buffer);
+
+
+
+    /** load the flatfield image of @p img into @p ffImg, if the flatfield
+     *  vignetting correction is active, otherwise @p ffImg is left empty */
+    template <class FlatImgType>
+    void loadFlatfield(const SrcPanoImage& img, FlatImgType& ffImg, AppBase::ProgressDisplay* progress);
 
     /// load a flatfield image and apply the correction
     template <class FFType, class SrcIter, class SrcAccessor, class DestIter, class DestAccessor>
@@ -135,7 +291,11 @@ namespace Nona {
 // templated implementations
 
 
+#include <sstream>
+#include <iomanip>
 #include <vigra/functorexpression.hxx>
+#include <vigra/basicimageview.hxx>
+#include <hugin_utils/utils.h>
 #include <vigra_ext/VignettingCorrection.h>
 
 
@@ -163,7 +323,7 @@ RemappedPanoImage<ImageType, AlphaType>*
     
     vigra::Size2D destSize(opts.getWidth(), opts.getHeight());
     
-    m_remapped = new RemappedPanoImage<ImageType, AlphaType>;
+    RemappedPanoImage<ImageType, AlphaType>* remapped = new RemappedPanoImage<ImageType, AlphaType>;
     
     // load image
     
@@ -179,7 +339,7 @@ RemappedPanoImage<ImageType, AlphaType>*
     }
 
     ImageType srcImg(width, height);
-    m_remapped->m_ICCProfile = info.getICCProfile();
+    remapped->m_ICCProfile = info.getICCProfile();
     
     if (info.numExtraBands() > 0) {
         srcAlpha.resize(width, height);
@@ -211,6 +371,327 @@ RemappedPanoImage<ImageType, AlphaType>*
     }
     
     // load flatfield, if needed.
+    loadFlatfield(img, ffImg, progress);
+    remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
+    remapped->setStoreSrcCoords(SingleImageRemapper<ImageType, AlphaType>::m_storeSrcCoords);
+    if (!opts.remapUsingGPU)
+    {
+        remapped->setRemapPlan(SingleImageRemapper<ImageType, AlphaType>::getRemapPlan(src, opts, imgNr, outputROI));
+    };
+    // remap the image
+    
+    remapImage(srcImg, srcAlpha, ffImg,
+               pano.getSrcImage(imgNr), opts,
+               outputROI,
+               *remapped,
+               progress);
+    return remapped;
+}
+
+
+template <typename ImageType, typename AlphaType>
+RemapPlanPtr SingleImageRemapper<ImageType, AlphaType>::getRemapPlan(const SrcPanoImage& src, const PanoramaOptions& opts,
+                                                                     unsigned int imgNr, const vigra::Rect2D& outputROI)
+{
+    {
+        hugin_omp::ScopedLock lock(m_plansLock);
+        typename std::map<unsigned int, RemapPlanPtr>::const_iterator it = m_plans.find(imgNr);
+        if (it != m_plans.end() && it->second && it->second->matches(src, opts, outputROI))
+        {
+            return it->second;
+        };
+    }
+    const std::string planDir = GetAdvancedOption(m_advancedOptions, "remapPlanDir");
+    if (!GetAdvancedOption(m_advancedOptions, "useRemapPlan", false) && planDir.empty())
+    {
+        return RemapPlanPtr();
+    };
+    std::string filename;
+    if (!planDir.empty())
+    {
+        std::ostringstream planFilename;
+        planFilename << planDir;
+        if (planDir.back() != '/' && planDir.back() != '\\')
+        {
+            planFilename << '/';
+        };
+        planFilename << "remapplan" << std::setfill('0') << std::setw(4) << imgNr << ".plan";
+        filename = planFilename.str();
+    };
+    // the plan is created without holding the lock, so other images can be
+    // remapped in the meantime
+    RemapPlanPtr plan = GetRemapPlan(src, opts, outputROI, filename);
+    hugin_omp::ScopedLock lock(m_plansLock);
+    m_plans[imgNr] = plan;
+    return plan;
+}
+
+template <typename ImageType, typename AlphaType>
+RemappedPanoImage<ImageType, AlphaType>*
+    MemoryRemapper<ImageType,AlphaType>::getRemapped(const PanoramaData & pano, const PanoramaOptions & opts,
+                              unsigned int imgNr, vigra::Rect2D outputROI,
+                              AppBase::ProgressDisplay* progress)
+{
+    typedef typename ImageType::value_type PixelType;
+    typedef typename vigra_ext::ValueTypeTraits<PixelType>::value_type ComponentType;
+
+    ImageBufferMap::const_iterator it = m_images.find(imgNr);
+    if (it == m_images.end())
+    {
+        UTILS_THROW(std::runtime_error, "No pixel data given for image " << imgNr);
+    };
+    const ImageBuffer& buffer = it->second;
+    const SrcPanoImage src = pano.getSrcImage(imgNr);
+    if (buffer.width != src.getWidth() || buffer.height != src.getHeight())
+    {
+        UTILS_THROW(std::runtime_error, "Pixel data for image " << imgNr << " has size " << buffer.width << "x" << buffer.height
+            << ", but project expects " << src.getWidth() << "x" << src.getHeight());
+    };
+
+    RemappedPanoImage<ImageType, AlphaType>* remapped = NULL;
+    bool reuse = false;
+    const bool keep = m_keepRemapped && !opts.remapUsingGPU;
+    unsigned long long fingerprint = 0;
+    if (keep)
+    {
+        fingerprint = CalcRemappedFingerprint(src, opts, outputROI, SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
+        hugin_omp::ScopedLock lock(m_remappedLock);
+        typename RemappedMap::iterator cached = m_remapped.find(imgNr);
+        if (cached != m_remapped.end())
+        {
+            if (cached->second.fingerprint == fingerprint && cached->second.image->boundingBox() == outputROI)
+            {
+                remapped = cached->second.image;
+                reuse = true;
+            }
+            else
+            {
+                // geometry, photometric or output settings changed
+                delete cached->second.image;
+                m_remapped.erase(cached);
+            };
+        };
+    };
+    if (remapped == NULL)
+    {
+        remapped = new RemappedPanoImage<ImageType, AlphaType>;
+        remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
+        if (!opts.remapUsingGPU)
+        {
+            remapped->setRemapPlan(SingleImageRemapper<ImageType, AlphaType>::getRemapPlan(src, opts, imgNr, outputROI));
+        };
+        if (keep)
+        {
+            hugin_omp::ScopedLock lock(m_remappedLock);
+            KeptRemapped& kept = m_remapped[imgNr];
+            kept.image = remapped;
+            kept.fingerprint = fingerprint;
+        };
+    };
+    remapped->setStoreSrcCoords(SingleImageRemapper<ImageType, AlphaType>::m_storeSrcCoords);
+    AlphaType srcAlpha;
+    if (!opts.remapUsingGPU && !buffer.hasAlpha() && buffer.pixelType == vigra::TypeAsString<ComponentType>::result() &&
+        buffer.colorBands() * sizeof(ComponentType) == sizeof(PixelType) && buffer.stride % sizeof(PixelType) == 0)
+    {
+        // the buffer has already the right format, remap directly from it
+        vigra::BasicImageView<PixelType> srcImg(reinterpret_cast<const PixelType*>(buffer.data),
+            buffer.width, buffer.height, buffer.stride / sizeof(PixelType));
+        remap(srcImg, srcAlpha, src, opts, outputROI, *remapped, reuse, progress);
+    }
+    else
+    {
+        int width = buffer.width;
+        if (opts.remapUsingGPU)
+        {
+            // Extend image width to multiple of 8 for fast GPU transfers.
+            const int r = width % 8;
+            if (r != 0) width += 8 - r;
+        }
+        ImageType srcImg(width, buffer.height);
+        importImageBuffer(buffer, srcImg, srcAlpha);
+        remap(srcImg, srcAlpha, src, opts, outputROI, *remapped, reuse, progress);
+    };
+    return remapped;
+}
+
+template <typename ImageType, typename AlphaType>
+template <class SrcImgType>
+void MemoryRemapper<ImageType, AlphaType>::remap(SrcImgType & srcImg, const AlphaType & srcAlpha, const SrcPanoImage & src,
+                                                 const PanoramaOptions & opts, const vigra::Rect2D & outputROI,
+                                                 RemappedPanoImage<ImageType, AlphaType> & remapped, bool reuse,
+                                                 AppBase::ProgressDisplay* progress)
+{
+    if (reuse)
+    {
+        // transformation and photometric transform are already set up
+        progress->setMessage("remapping", hugin_utils::stripPath(src.getFilename()));
+        if (srcAlpha.size().x > 0)
+        {
+            remapped.remapImage(vigra::srcImageRange(srcImg), vigra::srcImage(srcAlpha), opts.interpolator, progress);
+        }
+        else
+        {
+            remapped.remapImage(vigra::srcImageRange(srcImg), opts.interpolator, progress);
+        };
+    }
+    else
+    {
+        vigra::BasicImage<float> ffImg;
+        loadFlatfield(src, ffImg, progress);
+        remapImage(srcImg, srcAlpha, ffImg, src, opts, outputROI, remapped, progress);
+    };
+}
+
+namespace detail
+{
+    /** access a single band of a gray or RGB pixel */
+    template <class T>
+    inline T getPixelBand(const T& pixel, int band)
+    {
+        return pixel;
+    }
+
+    template <class T>
+    inline T getPixelBand(const vigra::RGBValue<T>& pixel, int band)
+    {
+        return pixel[band];
+    }
+
+    template <class T>
+    inline void setPixelBand(T& pixel, int band, T value)
+    {
+        pixel = value;
+    }
+
+    template <class T>
+    inline void setPixelBand(vigra::RGBValue<T>& pixel, int band, T value)
+    {
+        pixel[band] = value;
+    }
+
+    /** copy the buffer with components of type T into img and alpha */
+    template <class T, class ImageType, class AlphaType>
+    void importImageBufferTyped(const ImageBuffer& buffer, ImageType& img, AlphaType& alpha, const double scale, const double alphaScale)
+    {
+        typedef typename ImageType::value_type PixelType;
+        typedef typename vigra_ext::ValueTypeTraits<PixelType>::value_type ComponentType;
+        typedef typename AlphaType::value_type AlphaValueType;
+        const int colorBands = buffer.colorBands();
+        const bool hasAlpha = buffer.hasAlpha();
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int y = 0; y < buffer.height; ++y)
+        {
+            const T* src = reinterpret_cast<const T*>(buffer.row(y));
+            typename ImageType::row_iterator dest = img.rowBegin(y);
+            for (int x = 0; x < buffer.width; ++x, ++dest)
+            {
+                for (int b = 0; b < colorBands; ++b)
+                {
+                    setPixelBand(*dest, b, vigra::NumericTraits<ComponentType>::fromRealPromote(src[b] * scale));
+                };
+                if (hasAlpha)
+                {
+                    alpha(x, y) = vigra::NumericTraits<AlphaValueType>::fromRealPromote(src[colorBands] * alphaScale);
+                };
+                src += buffer.bands;
+            };
+        };
+    }
+}
+
+template <class ImageType, class AlphaType>
+void importImageBuffer(const ImageBuffer& buffer, ImageType& srcImg, AlphaType& srcAlpha)
+{
+    typedef typename ImageType::value_type PixelType;
+    typedef typename vigra_ext::ValueTypeTraits<PixelType>::value_type ComponentType;
+    vigra_precondition(buffer.data != NULL, "importImageBuffer(): no pixel data given");
+    vigra_precondition(buffer.colorBands() * sizeof(ComponentType) == sizeof(PixelType),
+        "importImageBuffer(): number of bands does not match image type");
+    vigra_precondition(srcImg.width() >= buffer.width && srcImg.height() >= buffer.height,
+        "importImageBuffer(): destination image too small");
+    if (buffer.hasAlpha())
+    {
+        srcAlpha.resize(srcImg.size());
+    };
+    const double maxv = vigra_ext::getMaxValForPixelType(buffer.pixelType);
+    const double scale = vigra_ext::LUTTraits<PixelType>::max() / maxv;
+    const double alphaScale = vigra_ext::LUTTraits<typename AlphaType::value_type>::max() / maxv;
+    if (buffer.pixelType == "UINT8")
+    {
+        detail::importImageBufferTyped<vigra::UInt8>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "UINT16")
+    {
+        detail::importImageBufferTyped<vigra::UInt16>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "INT16")
+    {
+        detail::importImageBufferTyped<vigra::Int16>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "UINT32")
+    {
+        detail::importImageBufferTyped<vigra::UInt32>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "INT32")
+    {
+        detail::importImageBufferTyped<vigra::Int32>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "FLOAT")
+    {
+        detail::importImageBufferTyped<float>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else if (buffer.pixelType == "DOUBLE")
+    {
+        detail::importImageBufferTyped<double>(buffer, srcImg, srcAlpha, scale, alphaScale);
+    }
+    else
+    {
+        UTILS_THROW(std::runtime_error, "Unsupported pixel type: " << buffer.pixelType);
+    };
+}
+
+template <class ImageType, class AlphaType>
+void exportImageBuffer(const ImageType& img, const AlphaType& alpha, const vigra::Rect2D& roi, ImageBuffer& buffer)
+{
+    typedef typename ImageType::value_type PixelType;
+    typedef typename vigra_ext::ValueTypeTraits<PixelType>::value_type ComponentType;
+    vigra_precondition(buffer.data != NULL, "exportImageBuffer(): no output buffer given");
+    vigra_precondition(buffer.width == roi.width() && buffer.height == roi.height(),
+        "exportImageBuffer(): size of output buffer does not match the output region");
+    vigra_precondition(buffer.colorBands() * sizeof(ComponentType) == sizeof(PixelType),
+        "exportImageBuffer(): number of bands does not match image type");
+    vigra_precondition(buffer.pixelType == vigra::TypeAsString<ComponentType>::result(),
+        "exportImageBuffer(): pixel type of output buffer does not match");
+    vigra_precondition(buffer.stride >= static_cast<std::ptrdiff_t>(buffer.width * buffer.bands * sizeof(ComponentType)),
+        "exportImageBuffer(): stride of output buffer too small");
+    vigra_precondition(vigra::Rect2D(img.size()).contains(roi), "exportImageBuffer(): region outside image");
+    const int colorBands = buffer.colorBands();
+    const bool hasAlpha = buffer.hasAlpha();
+    const ComponentType alphaMax = vigra_ext::LUTTraits<ComponentType>::max();
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int y = 0; y < roi.height(); ++y)
+    {
+        ComponentType* dest = reinterpret_cast<ComponentType*>(buffer.row(y));
+        typename ImageType::const_row_iterator src = img.rowBegin(y + roi.top()) + roi.left();
+        typename AlphaType::const_row_iterator srcAlpha = alpha.rowBegin(y + roi.top()) + roi.left();
+        for (int x = 0; x < roi.width(); ++x, ++src, ++srcAlpha)
+        {
+            for (int b = 0; b < colorBands; ++b)
+            {
+                dest[b] = detail::getPixelBand(*src, b);
+            };
+            if (hasAlpha)
+            {
+                dest[colorBands] = (*srcAlpha > 0) ? alphaMax : ComponentType(0);
+            };
+            dest += buffer.bands;
+        };
+    };
+}
+
+template <class FlatImgType>
+void loadFlatfield(const SrcPanoImage& img, FlatImgType& ffImg, AppBase::ProgressDisplay* progress)
+{
     if (img.getVigCorrMode() & SrcPanoImage::VIGCORR_FLATFIELD) {
         // load flatfield image.
         vigra::ImageImportInfo ffInfo(img.getFlatfieldFilename().c_str());
@@ -221,18 +702,8 @@ RemappedPanoImage<ImageType, AlphaType>*
         ffImg.resize(ffInfo.width(), ffInfo.height());
         vigra::importImage(ffInfo, vigra::destImage(ffImg));
     }
-    m_remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
-    // remap the image
-    
-    remapImage(srcImg, srcAlpha, ffImg,
-               pano.getSrcImage(imgNr), opts,
-               outputROI,
-               *m_remapped,
-               progress);
-    return m_remapped;
 }
 
-
 /// load a flatfield image and apply the correction
 template <class FFType, class SrcIter, class SrcAccessor, class DestIter, class DestAccessor>
 void applyFlatfield(vigra::triple<SrcIter, SrcIter, SrcAccessor> srcImg,
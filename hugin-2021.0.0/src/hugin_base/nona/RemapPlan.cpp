@@ -0,0 +1,496 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/RemapPlan.cpp
+ *
+ *  Precomputed remapping coordinates for a fixed image/panorama geometry
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "RemapPlan.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <hugin_utils/utils.h>
+#include <panotools/PanoToolsInterface.h>
+
+namespace HuginBase {
+namespace Nona {
+
+namespace
+{
+    // file header, followed by x coordinates, y coordinates and the valid flags
+    const char RemapPlanMagic[8] = { 'H', 'U', 'G', 'I', 'N', 'R', 'M', 'P' };
+    const unsigned int RemapPlanVersion = 2;
+    const unsigned int RemapPlanByteOrder = 0x01020304;
+
+    struct RemapPlanHeader
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int byteOrder;
+        int roi[4];
+        int srcSize[2];
+        int panoSize[2];
+        unsigned long long fingerprint;
+    };
+
+    /** 64 bit FNV-1a hash of a string */
+    unsigned long long HashString(const std::string& s)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            hash ^= static_cast<unsigned char>(s[i]);
+            hash *= 1099511628211ULL;
+        };
+        return hash;
+    };
+
+    template <class T>
+    void WriteVector(std::ostream& out, const std::vector<T>& v)
+    {
+        out << v.size();
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            out << ' ' << v[i];
+        };
+        out << ';';
+    };
+
+    /** counter to make the names of temporary files unique inside a process */
+    std::atomic<unsigned int> TempFileCounter(0);
+
+    /** checks crop and masks of the source image at the given coordinate */
+    class SrcCropCheck
+    {
+    public:
+        explicit SrcCropCheck(const SrcPanoImage& src) : m_src(src), m_radius2(0)
+        {
+            if (m_src.getCropMode() == SrcPanoImage::CROP_CIRCLE)
+            {
+                const vigra::Rect2D cropRect = m_src.getCropRect();
+                m_cropCenter.x = cropRect.left() + cropRect.width() / 2.0;
+                m_cropCenter.y = cropRect.top() + cropRect.height() / 2.0;
+                m_radius2 = std::min(cropRect.width(), cropRect.height()) / 2.0;
+                m_radius2 *= m_radius2;
+            };
+            m_hasMasks = m_src.hasActiveMasks();
+        };
+
+        bool isValid(double sx, double sy) const
+        {
+            const vigra::Point2D p(hugin_utils::roundi(sx), hugin_utils::roundi(sy));
+            switch (m_src.getCropMode())
+            {
+                case SrcPanoImage::CROP_CIRCLE:
+                    {
+                        const double dx = sx - m_cropCenter.x;
+                        const double dy = sy - m_cropCenter.y;
+                        if (dx * dx + dy * dy > m_radius2)
+                        {
+                            return false;
+                        };
+                    };
+                    break;
+                case SrcPanoImage::CROP_RECTANGLE:
+                    if (!m_src.getCropRect().contains(p))
+                    {
+                        return false;
+                    };
+                    break;
+                default:
+                    break;
+            };
+            if (m_hasMasks)
+            {
+                return !m_src.isInsideMasks(p);
+            };
+            return true;
+        };
+
+    private:
+        const SrcPanoImage& m_src;
+        hugin_utils::FDiff2D m_cropCenter;
+        double m_radius2;
+        bool m_hasMasks;
+    };
+}
+
+/** read only memory mapping of a whole file */
+class RemapPlan::MappedFile
+{
+public:
+    MappedFile() : m_data(NULL), m_size(0)
+#ifdef _WIN32
+        , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+    {};
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+        };
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+        };
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        };
+#else
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        };
+#endif
+    };
+
+    bool open(const std::string& filename)
+    {
+#ifdef _WIN32
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        };
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            return false;
+        };
+        m_size = static_cast<size_t>(fileSize.QuadPart);
+        m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping == NULL)
+        {
+            return false;
+        };
+        m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        return m_data != NULL;
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        };
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        };
+        m_size = static_cast<size_t>(fileStat.st_size);
+        void* data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        // the mapping stays valid after closing the file descriptor
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        };
+        m_data = static_cast<const char*>(data);
+        return true;
+#endif
+    };
+
+    const char* data() const { return m_data; };
+    size_t size() const { return m_size; };
+
+private:
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
+
+RemapPlan::RemapPlan() : m_fingerprint(0), m_coordX(NULL), m_coordY(NULL), m_valid(NULL), m_mappedFile(NULL)
+{
+}
+
+RemapPlan::~RemapPlan()
+{
+    clear();
+}
+
+void RemapPlan::clear()
+{
+    m_coordX = NULL;
+    m_coordY = NULL;
+    m_valid = NULL;
+    m_coords.clear();
+    m_validData.clear();
+    delete m_mappedFile;
+    m_mappedFile = NULL;
+}
+
+void RemapPlan::create(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi)
+{
+    clear();
+    m_roi = roi;
+    m_srcSize = src.getSize();
+    m_panoSize = dest.getSize();
+    m_fingerprint = CalcFingerprint(src, dest, roi);
+    if (m_roi.isEmpty())
+    {
+        return;
+    };
+    const size_t nrPixel = static_cast<size_t>(m_roi.width()) * m_roi.height();
+    m_coords.resize(2 * nrPixel);
+    m_validData.resize(nrPixel);
+
+    PTools::Transform transf;
+    transf.createTransform(src, dest);
+    const SrcCropCheck cropCheck(src);
+    const int width = m_roi.width();
+#pragma omp parallel for schedule(dynamic, 10)
+    for (int y = 0; y < m_roi.height(); ++y)
+    {
+        const size_t offset = static_cast<size_t>(y) * width;
+        float* rowX = &m_coords[offset];
+        float* rowY = &m_coords[nrPixel + offset];
+        unsigned char* rowValid = &m_validData[offset];
+        for (int x = 0; x < width; ++x)
+        {
+            double sx, sy;
+            if (transf.transformImgCoord(sx, sy, x + m_roi.left(), y + m_roi.top()) && cropCheck.isValid(sx, sy))
+            {
+                rowX[x] = static_cast<float>(sx);
+                rowY[x] = static_cast<float>(sy);
+                rowValid[x] = 255;
+            }
+            else
+            {
+                rowX[x] = -1;
+                rowY[x] = -1;
+                rowValid[x] = 0;
+            };
+        };
+    };
+    m_coordX = &m_coords[0];
+    m_coordY = &m_coords[nrPixel];
+    m_valid = &m_validData[0];
+}
+
+bool RemapPlan::save(const std::string& filename) const
+{
+    if (!isValid())
+    {
+        return false;
+    };
+    RemapPlanHeader header;
+    memcpy(header.magic, RemapPlanMagic, sizeof(RemapPlanMagic));
+    header.version = RemapPlanVersion;
+    header.byteOrder = RemapPlanByteOrder;
+    header.roi[0] = m_roi.left();
+    header.roi[1] = m_roi.top();
+    header.roi[2] = m_roi.width();
+    header.roi[3] = m_roi.height();
+    header.srcSize[0] = m_srcSize.width();
+    header.srcSize[1] = m_srcSize.height();
+    header.panoSize[0] = m_panoSize.width();
+    header.panoSize[1] = m_panoSize.height();
+    header.fingerprint = m_fingerprint;
+    const size_t nrPixel = static_cast<size_t>(m_roi.width()) * m_roi.height();
+
+    // other processes may have mapped an older version of the file,
+    // so write into a temporary file and replace the old file afterwards;
+    // the temporary file name is unique, because several processes and
+    // threads may save the same plan at the same time
+    std::ostringstream tempName;
+    tempName << filename << '.'
+#ifdef _WIN32
+        << GetCurrentProcessId()
+#else
+        << getpid()
+#endif
+        << '.' << std::hash<std::thread::id>()(std::this_thread::get_id())
+        << '.' << TempFileCounter++ << ".tmp";
+    const std::string tempFilename(tempName.str());
+    std::ofstream out(tempFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.good())
+    {
+        return false;
+    };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_coordX), nrPixel * sizeof(float));
+    out.write(reinterpret_cast<const char*>(m_coordY), nrPixel * sizeof(float));
+    out.write(reinterpret_cast<const char*>(m_valid), nrPixel);
+    out.close();
+    if (out.fail())
+    {
+        std::remove(tempFilename.c_str());
+        return false;
+    };
+#ifdef _WIN32
+    // rename does not overwrite existing files on Windows
+    std::remove(filename.c_str());
+#endif
+    return std::rename(tempFilename.c_str(), filename.c_str()) == 0;
+}
+
+bool RemapPlan::load(const std::string& filename)
+{
+    clear();
+    MappedFile* mappedFile = new MappedFile();
+    if (!mappedFile->open(filename) || mappedFile->size() < sizeof(RemapPlanHeader))
+    {
+        delete mappedFile;
+        return false;
+    };
+    RemapPlanHeader header;
+    memcpy(&header, mappedFile->data(), sizeof(header));
+    if (memcmp(header.magic, RemapPlanMagic, sizeof(RemapPlanMagic)) != 0 || header.version != RemapPlanVersion
+        || header.byteOrder != RemapPlanByteOrder || header.roi[2] <= 0 || header.roi[3] <= 0)
+    {
+        delete mappedFile;
+        return false;
+    };
+    const size_t nrPixel = static_cast<size_t>(header.roi[2]) * header.roi[3];
+    if (mappedFile->size() != sizeof(RemapPlanHeader) + nrPixel * (2 * sizeof(float) + 1))
+    {
+        // truncated or otherwise damaged file
+        delete mappedFile;
+        return false;
+    };
+    m_roi = vigra::Rect2D(vigra::Point2D(header.roi[0], header.roi[1]), vigra::Size2D(header.roi[2], header.roi[3]));
+    m_srcSize = vigra::Size2D(header.srcSize[0], header.srcSize[1]);
+    m_panoSize = vigra::Size2D(header.panoSize[0], header.panoSize[1]);
+    m_fingerprint = header.fingerprint;
+    m_mappedFile = mappedFile;
+    const char* data = m_mappedFile->data() + sizeof(RemapPlanHeader);
+    m_coordX = reinterpret_cast<const float*>(data);
+    m_coordY = reinterpret_cast<const float*>(data + nrPixel * sizeof(float));
+    m_valid = reinterpret_cast<const unsigned char*>(data + 2 * nrPixel * sizeof(float));
+    return true;
+}
+
+bool RemapPlan::matches(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi) const
+{
+    return isValid() && m_roi == roi && m_srcSize == src.getSize() && m_panoSize == dest.getSize()
+        && m_fingerprint == CalcFingerprint(src, dest, roi);
+}
+
+unsigned long long RemapPlan::CalcFingerprint(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi)
+{
+    // write all inputs with full precision into a string and hash it
+    std::ostringstream out;
+    out.precision(std::numeric_limits<double>::max_digits10);
+    out << "src " << src.getSize().width() << ' ' << src.getSize().height() << ' '
+        << src.getProjection() << ' ' << src.getHFOV() << ' '
+        << src.getRoll() << ' ' << src.getPitch() << ' ' << src.getYaw() << ' '
+        << src.getX() << ' ' << src.getY() << ' ' << src.getZ() << ' '
+        << src.getTranslationPlaneYaw() << ' ' << src.getTranslationPlanePitch() << ' ';
+    WriteVector(out, src.getRadialDistortion());
+    WriteVector(out, src.getRadialDistortionRed());
+    WriteVector(out, src.getRadialDistortionBlue());
+    out << src.getRadialDistortionCenterShift().x << ' ' << src.getRadialDistortionCenterShift().y << ' '
+        << src.getShear().x << ' ' << src.getShear().y << ' ';
+    const vigra::Rect2D cropRect = src.getCropRect();
+    out << "crop " << src.getCropMode() << ' ' << cropRect.left() << ' ' << cropRect.top() << ' '
+        << cropRect.right() << ' ' << cropRect.bottom() << ' ';
+    const MaskPolygonVector masks = src.getActiveMasks();
+    out << "masks " << masks.size();
+    for (size_t i = 0; i < masks.size(); ++i)
+    {
+        const VectorPolygon polygon = masks[i].getMaskPolygon();
+        out << ' ' << masks[i].getMaskType() << ' ' << masks[i].isInverted() << ' ' << polygon.size();
+        for (size_t j = 0; j < polygon.size(); ++j)
+        {
+            out << ' ' << polygon[j].x << ' ' << polygon[j].y;
+        };
+    };
+    out << " dest " << dest.getWidth() << ' ' << dest.getHeight() << ' '
+        << dest.getProjection() << ' ' << dest.getHFOV() << ' ';
+    WriteVector(out, dest.getProjectionParameters());
+    out << dest.getROI().left() << ' ' << dest.getROI().top() << ' '
+        << dest.getROI().right() << ' ' << dest.getROI().bottom() << ' '
+        << dest.interpolator << ' ' << dest.outputMode << ' '
+        << "roi " << roi.left() << ' ' << roi.top() << ' ' << roi.right() << ' ' << roi.bottom();
+    return HashString(out.str());
+}
+
+unsigned long long CalcRemappedFingerprint(const SrcPanoImage& src, const PanoramaOptions& dest,
+    const vigra::Rect2D& roi, const AdvancedOptions& advOptions)
+{
+    std::ostringstream out;
+    out.precision(std::numeric_limits<double>::max_digits10);
+    out << "plan " << RemapPlan::CalcFingerprint(src, dest, roi) << ' '
+        << "photometric " << src.getResponseType() << ' ';
+    WriteVector(out, src.getEMoRParams());
+    out << src.getExposureValue() << ' ' << src.getGamma() << ' '
+        << src.getWhiteBalanceRed() << ' ' << src.getWhiteBalanceBlue() << ' '
+        << src.getVigCorrMode() << ' ' << src.getFlatfieldFilename() << ';';
+    WriteVector(out, src.getRadialVigCorrCoeff());
+    out << src.getRadialVigCorrCenterShift().x << ' ' << src.getRadialVigCorrCenterShift().y << ' '
+        << "output " << dest.outputExposureValue << ' ' << dest.outputRangeCompression << ' '
+        << dest.outputPixelType << ';';
+    WriteVector(out, dest.outputEMoRParams);
+    out << "options " << advOptions.size();
+    for (AdvancedOptions::const_iterator it = advOptions.begin(); it != advOptions.end(); ++it)
+    {
+        out << ' ' << it->first << '=' << it->second << ';';
+    };
+    return HashString(out.str());
+}
+
+RemapPlanPtr GetRemapPlan(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi, const std::string& filename)
+{
+    std::shared_ptr<RemapPlan> plan = std::make_shared<RemapPlan>();
+    if (!filename.empty() && plan->load(filename))
+    {
+        if (plan->matches(src, dest, roi))
+        {
+            return plan;
+        };
+        DEBUG_DEBUG("remap plan " << filename << " does not match current geometry, recreating it");
+    };
+    plan->create(src, dest, roi);
+    if (!filename.empty() && plan->isValid())
+    {
+        // a plan which could not be saved is still valid for this run
+        if (!plan->save(filename))
+        {
+            DEBUG_WARN("could not save remap plan to " << filename);
+        };
+    };
+    return plan;
+}
+
+} // namespace Nona
+} // namespace HuginBase
@@ -0,0 +1,170 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/RemapPlan.h
+ *
+ *  Precomputed remapping coordinates for a fixed image/panorama geometry
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_REMAPPLAN_H
+#define _NONA_REMAPPLAN_H
+
+#include <hugin_shared.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vigra/diff2d.hxx>
+#include <panodata/SrcPanoImage.h>
+#include <panodata/PanoramaOptions.h>
+#include <nona/StitcherOptions.h>
+
+namespace HuginBase {
+namespace Nona {
+
+/** lookup table with the source image coordinates of each pixel of an
+ *  output ROI.
+ *
+ *  When the same image is remapped again and again with unchanged
+ *  geometry (fixed camera rigs, video) the transformation is the same for
+ *  every frame. The plan evaluates the PTools::Transform once for every
+ *  output pixel and stores the result as float coordinates together with
+ *  a validity mask. The validity mask already includes the crop
+ *  (rectangular or circular) and the active masks of the source image,
+ *  so no source alpha image needs to be created for these during replay.
+ *
+ *  The plan provides the same transformImgCoord() interface as
+ *  PTools::Transform and can therefore be used directly as TRANSFORM
+ *  argument of vigra_ext::transformImage and vigra_ext::transformImageAlpha.
+ *
+ *  Coordinates are stored in single precision. For source images up to
+ *  16384 pixels the rounding error is below 1/1000 pixel.
+ *
+ *  Plans can be saved to disc and loaded again. Loading uses a memory
+ *  mapped file, so several worker processes can share the same plan.
+ */
+class IMPEX RemapPlan
+{
+public:
+    /** creates an empty plan, use create() or load() to initialize it */
+    RemapPlan();
+    ~RemapPlan();
+
+    /** calculate the coordinate table for image @p src remapped into the
+     *  region @p roi of panorama @p dest */
+    void create(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi);
+
+    /** save the plan into file @p filename
+     *  @return true, if the file was written successfully */
+    bool save(const std::string& filename) const;
+    /** loads a plan, which was saved with save(). The file is memory mapped,
+     *  the mapping is kept as long as the plan exists
+     *  @return true, if a valid plan could be read */
+    bool load(const std::string& filename);
+
+    /** return true, if the plan contains data */
+    bool isValid() const { return m_coordX != NULL; };
+    /** checks if the plan belongs to the given geometry. Beside the sizes
+     *  the fingerprint of all inputs of the plan is compared, see
+     *  CalcFingerprint(). This catches outdated plan files. */
+    bool matches(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi) const;
+    /** return a hash of everything which influences the plan: the lens and
+     *  geometry variables, crop and active masks of the source image, the
+     *  output projection, size and roi, the interpolator and the output
+     *  region @p roi */
+    static unsigned long long CalcFingerprint(const SrcPanoImage& src, const PanoramaOptions& dest, const vigra::Rect2D& roi);
+    /** return the fingerprint of the inputs, for which the plan was created */
+    unsigned long long getFingerprint() const { return m_fingerprint; };
+
+    /** return the output region covered by the plan */
+    const vigra::Rect2D& getROI() const { return m_roi; };
+    /** return the size of the source image for which the plan was created */
+    const vigra::Size2D& getSrcSize() const { return m_srcSize; };
+
+    /** look up the source coordinates for the panorama pixel @p x_src, @p y_src
+     *  (interface compatible with PTools::Transform::transformImgCoord)
+     *  @return false, if the pixel is outside the roi or marked invalid
+     */
+    bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+    {
+        const int x = static_cast<int>(x_src) - m_roi.left();
+        const int y = static_cast<int>(y_src) - m_roi.top();
+        if (x < 0 || y < 0 || x >= m_roi.width() || y >= m_roi.height())
+        {
+            x_dest = -1;
+            y_dest = -1;
+            return false;
+        };
+        const size_t index = static_cast<size_t>(y) * m_roi.width() + x;
+        if (m_valid[index] == 0)
+        {
+            x_dest = -1;
+            y_dest = -1;
+            return false;
+        };
+        x_dest = m_coordX[index];
+        y_dest = m_coordY[index];
+        return true;
+    };
+
+    /** direct access to the coordinate rows, @p y is relative to the roi */
+    const float* getRowX(int y) const { return m_coordX + static_cast<size_t>(y) * m_roi.width(); };
+    const float* getRowY(int y) const { return m_coordY + static_cast<size_t>(y) * m_roi.width(); };
+    const unsigned char* getRowValid(int y) const { return m_valid + static_cast<size_t>(y) * m_roi.width(); };
+
+private:
+    // private, plans are shared via RemapPlanPtr
+    RemapPlan(const RemapPlan&);
+    RemapPlan& operator=(const RemapPlan&);
+    /** resets all pointers and releases the memory */
+    void clear();
+
+    vigra::Rect2D m_roi;
+    vigra::Size2D m_srcSize;
+    vigra::Size2D m_panoSize;
+    unsigned long long m_fingerprint;
+    // pointers into either the own buffers or the memory mapped file
+    const float* m_coordX;
+    const float* m_coordY;
+    const unsigned char* m_valid;
+    std::vector<float> m_coords;
+    std::vector<unsigned char> m_validData;
+    class MappedFile;
+    MappedFile* m_mappedFile;
+};
+
+typedef std::shared_ptr<const RemapPlan> RemapPlanPtr;
+
+/** return a plan for the given geometry. If @p filename is not empty and a
+ *  matching plan was saved in this file, it is loaded from the file.
+ *  Otherwise a new plan is created and, if @p filename is not empty, saved
+ *  for the next run */
+IMPEX RemapPlanPtr GetRemapPlan(const SrcPanoImage& src, const PanoramaOptions& dest,
+    const vigra::Rect2D& roi, const std::string& filename = std::string());
+
+/** return a hash of all inputs of a remapped image: the inputs of the
+ *  remap plan, see RemapPlan::CalcFingerprint(), the photometric
+ *  variables of @p src, the photometric output settings of @p dest and
+ *  the advanced options @p advOptions. A remapped image can only be
+ *  reused for a new frame when this fingerprint is unchanged. */
+IMPEX unsigned long long CalcRemappedFingerprint(const SrcPanoImage& src, const PanoramaOptions& dest,
+    const vigra::Rect2D& roi, const AdvancedOptions& advOptions);
+
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_REMAPPLAN_H
@@ -36,6 +36,16 @@
 
 #include <appbase/ProgressDisplay.h>
 #include <nona/StitcherOptions.h>
+#include <nona/RemapPlan.h>
+#include <nona/GridTransform.h>
+#include <nona/SpaceTransform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <type_traits>
 
 #include <panodata/SrcPanoImage.h>
 #include <panodata/Mask.h>
@@ -47,6 +57,12 @@
 #define NONA_DEFAULT_EXPOSURE_UPPER_CUTOFF 250/255.0f
 
 
+namespace HuginBase {
+namespace Photometric {
+    template <class VTIn, class VTOut> class InvResponseTransform;
+}
+}
+
 namespace HuginBase {
 namespace Nona {
 
@@ -73,6 +89,136 @@ void estimateImageAlpha(const SrcPanoImage & src,
                          double & scale);
 
 
+namespace detail
+{
+    /** transform used for remapping on the CPU.
+     *
+     *  Evaluates the remap plan, the sparse grid or the exact transform.
+     *  The exact transform uses the fused SpaceTransform for the common
+     *  projections, otherwise the libpano transform. Whole rows are
+     *  transformed with transformImgCoordRow(), in float precision if the
+     *  error of the float version is small enough.
+     *  If coordinate images are given, the source coordinates of each
+     *  transformed pixel are stored, so they are available after remapping
+     *  without transforming the pixel again (invalid pixels are marked
+     *  with NaN).
+     */
+    class RemapTransform
+    {
+    public:
+        RemapTransform(const PTools::Transform& transf, const SpaceTransform* fused, bool fusedFloat,
+                       const RemapPlan* plan, const GridTransform* grid,
+                       vigra::FImage* coordX, vigra::FImage* coordY, const vigra::Point2D& offset)
+            : m_transf(transf), m_fused(fused), m_fusedFloat(fusedFloat), m_plan(plan), m_grid(grid),
+              m_coordX(coordX), m_coordY(coordY), m_offset(offset)
+        {};
+
+        bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+        {
+            bool valid;
+            if (m_plan)
+            {
+                valid = m_plan->transformImgCoord(x_dest, y_dest, x_src, y_src);
+            }
+            else
+            {
+                if (m_grid)
+                {
+                    valid = m_grid->transformImgCoord(x_dest, y_dest, x_src, y_src);
+                }
+                else
+                {
+                    if (m_fused)
+                    {
+                        transformFused(&x_dest, &y_dest, x_src, y_src, 1);
+                        valid = true;
+                    }
+                    else
+                    {
+                        valid = m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src);
+                    };
+                };
+            };
+            storeCoord(x_dest, y_dest, static_cast<int>(x_src), static_cast<int>(y_src), valid);
+            return valid;
+        };
+
+        /** transform the row of pixels (x_src .. x_src+n-1, y_src) */
+        void transformImgCoordRow(double * x_dest, double * y_dest, bool * valid, int x_src, int y_src, int n) const
+        {
+            if (m_plan || m_grid || !m_fused)
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    valid[i] = transformImgCoord(x_dest[i], y_dest[i], x_src + i, y_src);
+                };
+                return;
+            };
+            transformFused(x_dest, y_dest, x_src, y_src, n);
+            for (int i = 0; i < n; ++i)
+            {
+                valid[i] = true;
+                storeCoord(x_dest[i], y_dest[i], x_src + i, y_src, true);
+            };
+        };
+
+    private:
+        /** evaluate the fused transform in the precision selected by the error bound */
+        void transformFused(double * x_dest, double * y_dest, double x_src, double y_src, int n) const
+        {
+            if (!m_fusedFloat)
+            {
+                m_fused->transformImgCoordRow(x_dest, y_dest, x_src, y_src, n);
+                return;
+            };
+            const int chunkSize = 64;
+            float x[chunkSize];
+            float y[chunkSize];
+            for (int start = 0; start < n; start += chunkSize)
+            {
+                const int count = std::min(chunkSize, n - start);
+                m_fused->transformImgCoordRow(x, y, x_src + start, y_src, count);
+                for (int i = 0; i < count; ++i)
+                {
+                    x_dest[start + i] = x[i];
+                    y_dest[start + i] = y[i];
+                };
+            };
+        };
+
+        void storeCoord(double x_dest, double y_dest, int x_src, int y_src, bool valid) const
+        {
+            if (m_coordX)
+            {
+                const int x = x_src - m_offset.x;
+                const int y = y_src - m_offset.y;
+                if (x >= 0 && y >= 0 && x < m_coordX->width() && y < m_coordX->height())
+                {
+                    (*m_coordX)(x, y) = valid ? static_cast<float>(x_dest) : std::numeric_limits<float>::quiet_NaN();
+                    (*m_coordY)(x, y) = valid ? static_cast<float>(y_dest) : std::numeric_limits<float>::quiet_NaN();
+                };
+            };
+        };
+
+        const PTools::Transform& m_transf;
+        const SpaceTransform* m_fused;
+        bool m_fusedFloat;
+        const RemapPlan* m_plan;
+        const GridTransform* m_grid;
+        vigra::FImage* m_coordX;
+        vigra::FImage* m_coordY;
+        vigra::Point2D m_offset;
+    };
+
+    /** row interface for vigra_ext::transformImage, found by argument
+     *  dependent lookup */
+    inline void transformImgCoordRow(RemapTransform& transform, double * x_dest, double * y_dest, bool * valid,
+                                     int x_src, int y_src, int n)
+    {
+        transform.transformImgCoordRow(x_dest, y_dest, valid, x_src, y_src, n);
+    }
+}
+
 /** struct to hold a image state for stitching
  *
  */
@@ -104,7 +250,7 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
          *
          *  the actual remapping is done by the remapImage() function.
          */
-        RemappedPanoImage() : m_advancedOptions()
+        RemappedPanoImage() : m_fusedFloat(false), m_advancedOptions(), m_invResponseWithAlpha(false), m_storeSrcCoords(false), m_hasSrcCoords(false)
         {};
 
         
@@ -117,6 +263,26 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
         {
             m_advancedOptions = advancedOptions;
         };
+        /** use a precomputed remap plan instead of evaluating the transform
+         *  for every pixel. The plan is only used when it covers the same
+         *  region as set with setPanoImage() and when not remapping on the GPU. */
+        void setRemapPlan(RemapPlanPtr plan)
+        {
+            m_plan = plan;
+        };
+        /** store the source coordinates of all pixels during remapImage(),
+         *  calcAlpha() and calcSrcCoordImgs() use them afterwards instead of
+         *  transforming every pixel again. Only used when not remapping on
+         *  the GPU. */
+        void setStoreSrcCoords(bool store)
+        {
+            m_storeSrcCoords = store;
+        };
+        /** return true, if the source coordinates of the last remapImage() call are available */
+        bool hasSrcCoords() const
+        {
+            return m_hasSrcCoords;
+        };
 
     public:
         /** calculate distance map. pixels contain distance from image center
@@ -128,7 +294,8 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
 
         /** calculate only the alpha channel.
          *  works for arbitrary transforms, with holes and so on,
-         *  but is very crude and slow (remapps all image pixels...)
+         *  but is very crude and slow (remapps all image pixels...),
+         *  unless the source coordinates were stored by remapImage()
          *
          *  better transform all images, and get the alpha channel for free!
          *
@@ -160,7 +327,90 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
         SrcPanoImage m_srcImg;
         PanoramaOptions m_destImg;
         PTools::Transform m_transf;
+        /** fused replacement of m_transf, only set when it gives the same
+         *  result, see SpaceTransform::canReplacePanoTools() */
+        std::shared_ptr<SpaceTransform> m_fusedTransf;
+        /** true, if the float version of m_fusedTransf is accurate enough */
+        bool m_fusedFloat;
         AdvancedOptions m_advancedOptions;
+        RemapPlanPtr m_plan;
+        /** sparse grid approximation of m_transf, created on demand */
+        GridTransformPtr m_grid;
+        /** photometric transform of the last remapImage() call, it is reused
+         *  when the same image is remapped again, setPanoImage() resets it */
+        std::shared_ptr<Photometric::InvResponseTransform<component_type, double> > m_invResponse;
+        /** true, if m_invResponse was created by remapImage() with alpha channel */
+        bool m_invResponseWithAlpha;
+        /** source coordinates stored by remapImage(), if m_storeSrcCoords is set */
+        bool m_storeSrcCoords;
+        bool m_hasSrcCoords;
+        vigra::FImage m_srcCoordX;
+        vigra::FImage m_srcCoordY;
+
+    protected:
+        /** return true, if the remap plan can be used for the current remapping */
+        bool canUsePlan() const
+        {
+            return !m_destImg.remapUsingGPU && m_plan && m_plan->isValid() &&
+                m_plan->getROI() == Base::boundingBox() && m_plan->getSrcSize() == m_srcImg.getSize();
+        };
+        /** create the sparse grid transform, if it is activated with the
+         *  advanced option useTransformGrid
+         *  @return true, if the grid should be used instead of m_transf */
+        bool prepareGridTransform()
+        {
+            if (m_destImg.remapUsingGPU || !GetAdvancedOption(m_advancedOptions, "useTransformGrid", false))
+            {
+                return false;
+            };
+            if (!m_grid || m_grid->getROI() != Base::boundingBox() || m_grid->getSrcSize() != m_srcImg.getSize())
+            {
+                std::shared_ptr<GridTransform> grid = std::make_shared<GridTransform>();
+                grid->create(m_srcImg, m_destImg, Base::boundingBox(),
+                    static_cast<int>(GetAdvancedOption(m_advancedOptions, "transformGridSize", 16.0f)),
+                    GetAdvancedOption(m_advancedOptions, "transformGridTolerance", 0.05f));
+                m_grid = grid;
+            };
+            return m_grid->isValid();
+        };
+        /** return the source coordinates of panorama pixel @p x, @p y, uses the
+         *  coordinates stored by remapImage() if available */
+        bool getSrcCoord(double& sx, double& sy, int x, int y, bool useGrid) const
+        {
+            if (m_hasSrcCoords)
+            {
+                const int rx = x - Base::boundingBox().left();
+                const int ry = y - Base::boundingBox().top();
+                sx = m_srcCoordX(rx, ry);
+                sy = m_srcCoordY(rx, ry);
+                return !std::isnan(sx);
+            };
+            if (useGrid)
+            {
+                return m_grid->transformImgCoord(sx, sy, x, y);
+            };
+            return m_transf.transformImgCoord(sx, sy, x, y);
+        };
+        /** return the transform for remapping on the CPU, prepares also the
+         *  images for storing the source coordinates */
+        detail::RemapTransform getRemapTransform(bool usePlan, bool useGrid)
+        {
+            if (m_storeSrcCoords)
+            {
+                m_srcCoordX.resize(Base::boundingBox().size());
+                m_srcCoordY.resize(Base::boundingBox().size());
+                m_hasSrcCoords = true;
+                return detail::RemapTransform(m_transf, m_fusedTransf.get(), m_fusedFloat,
+                    usePlan ? m_plan.get() : NULL, useGrid ? m_grid.get() : NULL,
+                    &m_srcCoordX, &m_srcCoordY, Base::boundingBox().upperLeft());
+            };
+            m_hasSrcCoords = false;
+            m_srcCoordX = vigra::FImage();
+            m_srcCoordY = vigra::FImage();
+            return detail::RemapTransform(m_transf, m_fusedTransf.get(), m_fusedFloat,
+                usePlan ? m_plan.get() : NULL, useGrid ? m_grid.get() : NULL,
+                NULL, NULL, Base::boundingBox().upperLeft());
+        };
 
 };
 
@@ -207,6 +457,72 @@ void remapImage(SrcImgType & srcImg,
 namespace HuginBase {
 namespace Nona {
 
+namespace detail
+{
+    template <class InvResponseType, class CacheType>
+    std::shared_ptr<InvResponseType> getCachedInvResponseIntern(const std::shared_ptr<CacheType>& cache, std::true_type)
+    {
+        return cache;
+    }
+
+    template <class InvResponseType, class CacheType>
+    std::shared_ptr<InvResponseType> getCachedInvResponseIntern(const std::shared_ptr<CacheType>& cache, std::false_type)
+    {
+        return std::shared_ptr<InvResponseType>();
+    }
+
+    /** return the cached photometric transform, if it has the requested type */
+    template <class InvResponseType, class CacheType>
+    std::shared_ptr<InvResponseType> getCachedInvResponse(const std::shared_ptr<CacheType>& cache)
+    {
+        return getCachedInvResponseIntern<InvResponseType>(cache, typename std::is_same<InvResponseType, CacheType>::type());
+    }
+
+    template <class CacheType, class InvResponseType>
+    void setCachedInvResponseIntern(std::shared_ptr<CacheType>& cache, const std::shared_ptr<InvResponseType>& invResponse, std::true_type)
+    {
+        cache = invResponse;
+    }
+
+    template <class CacheType, class InvResponseType>
+    void setCachedInvResponseIntern(std::shared_ptr<CacheType>& cache, const std::shared_ptr<InvResponseType>& invResponse, std::false_type)
+    {
+        cache.reset();
+    }
+
+    /** store the photometric transform in the cache, if it has the type of the cache */
+    template <class CacheType, class InvResponseType>
+    void setCachedInvResponse(std::shared_ptr<CacheType>& cache, const std::shared_ptr<InvResponseType>& invResponse)
+    {
+        setCachedInvResponseIntern(cache, invResponse, typename std::is_same<InvResponseType, CacheType>::type());
+    }
+
+    /** create the lookup tables of the photometric transform, if enabled
+     *  by the advanced option usePhotometricLUT (default off, because the
+     *  output can differ slightly from the exact calculation). With the
+     *  advanced option verifyPhotometricLUT the tables are checked against
+     *  the exact calculation, if the difference is larger than half a step
+     *  of 16 bit output the exact calculation is used */
+    template <class InvResponseType>
+    void preparePhotometricLUT(InvResponseType& invResponse, const AdvancedOptions& advOptions, const bool useGPU)
+    {
+        if (useGPU || !GetAdvancedOption(advOptions, "usePhotometricLUT", false))
+        {
+            return;
+        };
+        if (invResponse.createLUT() && GetAdvancedOption(advOptions, "verifyPhotometricLUT", false))
+        {
+            const double error = invResponse.verifyLUT();
+            DEBUG_INFO("Photometric lookup table: maximal deviation " << error << " of output range");
+            if (error > 0.5 / 65535.0)
+            {
+                DEBUG_INFO("Photometric lookup table is not accurate enough, using exact calculation");
+                invResponse.clearLUT();
+            };
+        };
+    }
+}
+
 
 template <class RemapImage, class AlphaImage>
 void RemappedPanoImage<RemapImage,AlphaImage>::setPanoImage(const SrcPanoImage & src,
@@ -224,6 +540,27 @@ void RemappedPanoImage<RemapImage,AlphaImage>::setPanoImage(const SrcPanoImage &
 
     Base::resize(roi);
     m_transf.createTransform(src, dest);
+    // the fused transform evaluates the common projections faster, the float
+    // version is used if its error is below the advanced option
+    // fusedTransformTolerance (in pixel)
+    m_fusedTransf.reset();
+    m_fusedFloat = false;
+    if (!m_destImg.remapUsingGPU && GetAdvancedOption(m_advancedOptions, "useFusedTransform", true) &&
+        SpaceTransform::canReplacePanoTools(src, dest))
+    {
+        std::shared_ptr<SpaceTransform> fused = std::make_shared<SpaceTransform>();
+        fused->createTransform(src, dest);
+        if (fused->isFused())
+        {
+            m_fusedTransf = fused;
+            m_fusedFloat = fused->getFloatErrorBound() <= GetAdvancedOption(m_advancedOptions, "fusedTransformTolerance", 0.01f);
+        };
+    };
+    m_grid.reset();
+    m_invResponse.reset();
+    m_hasSrcCoords = false;
+    m_srcCoordX = vigra::FImage();
+    m_srcCoordY = vigra::FImage();
 
     DEBUG_DEBUG("after resize: " << Base::m_region);
     DEBUG_DEBUG("m_srcImg size: " << m_srcImg.getSize());
@@ -345,6 +682,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcSrcCoordImgs(DistImgType & im
     typename DistImgType::Iterator yImgY(imgY.upperLeft());
     typename DistImgType::Accessor accX = imgX.accessor();
     typename DistImgType::Accessor accY = imgY.accessor();
+    const bool useGrid = !m_hasSrcCoords && prepareGridTransform();
     // loop over the image and transform
     for(int y=ystart; y < yend; ++y, ++yImgX.y, ++yImgY.y)
     {
@@ -354,7 +692,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcSrcCoordImgs(DistImgType & im
         for(int x=xstart; x < xend; ++x, ++xImgY.x, ++xImgX.x)
         {
             double sx,sy;
-            if (m_transf.transformImgCoord(sx, sy, x, y))
+            if (getSrcCoord(sx, sy, x, y, useGrid))
             {
                 if (m_srcImg.isInside(vigra::Point2D(hugin_utils::roundi(sx), hugin_utils::roundi(sy))))
                 {
@@ -368,7 +706,8 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcSrcCoordImgs(DistImgType & im
 
 /** calculate only the alpha channel.
  *  works for arbitrary transforms, with holes and so on,
- *  but is very crude and slow (remapps all image pixels...)
+ *  but is very crude and slow (remapps all image pixels...),
+ *  unless the source coordinates were stored by remapImage()
  *
  *  better transform all images, and get the alpha channel for free!
  *
@@ -386,6 +725,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcAlpha()
     int xend   = Base::boundingBox().right();
     int ystart = Base::boundingBox().top();
     int yend   = Base::boundingBox().bottom();
+    const bool useGrid = !m_hasSrcCoords && prepareGridTransform();
 
     // loop over the image and transform
 #pragma omp parallel for schedule(dynamic, 10)
@@ -399,7 +739,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcAlpha()
         for(int x=xstart; x < xend; ++x, ++xalpha.x)
         {
             double sx,sy;
-            if(m_transf.transformImgCoord(sx,sy,x,y))
+            if (getSrcCoord(sx, sy, x, y, useGrid))
             {
                 if (m_srcImg.isInside(vigra::Point2D(hugin_utils::roundi(sx),hugin_utils::roundi(sy))))
                 {
@@ -463,27 +803,45 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     // setup photometric transform for this image type
     // this corrects for response curve, white balance, exposure and 
     // radial vignetting
-    Photometric::InvResponseTransform<input_component_type, double> invResponse(m_srcImg);
-    invResponse.enforceMonotonicity();
-    if (m_destImg.outputMode == PanoramaOptions::OUTPUT_LDR) {
-        // select exposure and response curve for LDR output
-        std::vector<double> outLut;
-        if (!m_destImg.outputEMoRParams.empty())
-        {
-            vigra_ext::EMoR::createEMoRLUT(m_destImg.outputEMoRParams, outLut);
-        };
-        double maxVal = vigra_ext::LUTTraits<input_value_type>::max();
-        if (!m_destImg.outputPixelType.empty()) {
-            maxVal = vigra_ext::getMaxValForPixelType(m_destImg.outputPixelType);
-        }
-
-        invResponse.setOutput(1.0/pow(2.0,m_destImg.outputExposureValue), outLut,
-                              maxVal, m_destImg.outputRangeCompression);
-    } else {
-        invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
-    }
+    typedef Photometric::InvResponseTransform<input_component_type, double> InvResponseType;
+    std::shared_ptr<InvResponseType> invResponsePtr;
+    if (!m_invResponseWithAlpha)
+    {
+        invResponsePtr = detail::getCachedInvResponse<InvResponseType>(m_invResponse);
+    };
+    if (!invResponsePtr)
+    {
+        invResponsePtr = std::make_shared<InvResponseType>(m_srcImg);
+        invResponsePtr->enforceMonotonicity();
+        if (m_destImg.outputMode == PanoramaOptions::OUTPUT_LDR) {
+            // select exposure and response curve for LDR output
+            std::vector<double> outLut;
+            if (!m_destImg.outputEMoRParams.empty())
+            {
+                vigra_ext::EMoR::createEMoRLUT(m_destImg.outputEMoRParams, outLut);
+            };
+            double maxVal = vigra_ext::LUTTraits<input_value_type>::max();
+            if (!m_destImg.outputPixelType.empty()) {
+                maxVal = vigra_ext::getMaxValForPixelType(m_destImg.outputPixelType);
+            }
 
-    if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
+            invResponsePtr->setOutput(1.0/pow(2.0,m_destImg.outputExposureValue), outLut,
+                                      maxVal, m_destImg.outputRangeCompression);
+        } else {
+            invResponsePtr->setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
+        }
+        detail::preparePhotometricLUT(*invResponsePtr, m_advancedOptions, useGPU);
+        detail::setCachedInvResponse(m_invResponse, invResponsePtr);
+        m_invResponseWithAlpha = false;
+    };
+    InvResponseType& invResponse = *invResponsePtr;
+
+    // the remap plan contains already the crop and the masks
+    const bool usePlan = canUsePlan();
+    const bool useGrid = !usePlan && prepareGridTransform();
+    m_hasSrcCoords = false;
+    if ((!usePlan && (m_srcImg.hasActiveMasks() || m_srcImg.getCropMode() != SrcPanoImage::NO_CROP)) ||
+        Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
     {
         // need to create and additional alpha image for the crop mask...
         // not very efficient during the remapping phase, but works.
@@ -566,12 +924,13 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 Base::m_region = newBoundingBox;
             };
         } else {
+            detail::RemapTransform remapTransform = getRemapTransform(usePlan, useGrid);
             transformImageAlpha(srcImg,
                                 vigra::srcImage(alpha),
                                 destImageRange(Base::m_image),
                                 destImage(Base::m_mask),
                                 Base::boundingBox().upperLeft(),
-                                m_transf,
+                                remapTransform,
                                 invResponse,
                                 m_srcImg.horizontalWarpNeeded(),
                                 interpol,
@@ -620,11 +979,12 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 Base::m_region = newBoundingBox;
             };
         } else {
+            detail::RemapTransform remapTransform = getRemapTransform(usePlan, useGrid);
             transformImage(srcImg,
                            destImageRange(Base::m_image),
                            destImage(Base::m_mask),
                            Base::boundingBox().upperLeft(),
-                           m_transf,
+                           remapTransform,
                            invResponse,
                            m_srcImg.horizontalWarpNeeded(),
                            interpol,
@@ -669,27 +1029,45 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     // setup photometric transform for this image type
     // this corrects for response curve, white balance, exposure and 
     // radial vignetting
-    Photometric::InvResponseTransform<input_component_type, double> invResponse(m_srcImg);
-    if (m_destImg.outputMode == PanoramaOptions::OUTPUT_LDR) {
-        // select exposure and response curve for LDR output
-        std::vector<double> outLut;
-        // scale up to desired output format
-        double maxVal = vigra_ext::LUTTraits<input_value_type>::max();
-        if (!m_destImg.outputPixelType.empty()) {
-            maxVal = vigra_ext::getMaxValForPixelType(m_destImg.outputPixelType);
+    typedef Photometric::InvResponseTransform<input_component_type, double> InvResponseType;
+    std::shared_ptr<InvResponseType> invResponsePtr;
+    if (m_invResponseWithAlpha)
+    {
+        invResponsePtr = detail::getCachedInvResponse<InvResponseType>(m_invResponse);
+    };
+    if (!invResponsePtr)
+    {
+        invResponsePtr = std::make_shared<InvResponseType>(m_srcImg);
+        if (m_destImg.outputMode == PanoramaOptions::OUTPUT_LDR) {
+            // select exposure and response curve for LDR output
+            std::vector<double> outLut;
+            // scale up to desired output format
+            double maxVal = vigra_ext::LUTTraits<input_value_type>::max();
+            if (!m_destImg.outputPixelType.empty()) {
+                maxVal = vigra_ext::getMaxValForPixelType(m_destImg.outputPixelType);
+            }
+            if (!m_destImg.outputEMoRParams.empty())
+            {
+                vigra_ext::EMoR::createEMoRLUT(m_destImg.outputEMoRParams, outLut);
+                vigra_ext::enforceMonotonicity(outLut);
+            };
+            invResponsePtr->setOutput(1.0/pow(2.0,m_destImg.outputExposureValue), outLut,
+                                      maxVal, m_destImg.outputRangeCompression);
+        } else {
+            invResponsePtr->setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
         }
-        if (!m_destImg.outputEMoRParams.empty())
-        {
-            vigra_ext::EMoR::createEMoRLUT(m_destImg.outputEMoRParams, outLut);
-            vigra_ext::enforceMonotonicity(outLut);
-        };
-        invResponse.setOutput(1.0/pow(2.0,m_destImg.outputExposureValue), outLut,
-                              maxVal, m_destImg.outputRangeCompression);
-    } else {
-        invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
-    }
-
-    if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false)) {
+        detail::preparePhotometricLUT(*invResponsePtr, m_advancedOptions, useGPU);
+        detail::setCachedInvResponse(m_invResponse, invResponsePtr);
+        m_invResponseWithAlpha = true;
+    };
+    InvResponseType& invResponse = *invResponsePtr;
+
+    // the remap plan contains already the crop and the masks
+    const bool usePlan = canUsePlan();
+    const bool useGrid = !usePlan && prepareGridTransform();
+    m_hasSrcCoords = false;
+    if ((!usePlan && (m_srcImg.hasActiveMasks() || m_srcImg.getCropMode() != SrcPanoImage::NO_CROP)) ||
+        Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false)) {
         vigra::BImage alpha(srcImgSize);
         vigra::Rect2D cR = m_srcImg.getCropRect();
         switch (m_srcImg.getCropMode()) {
@@ -761,12 +1139,13 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 Base::m_region = newBoundingBox;
             };
         } else {
+            detail::RemapTransform remapTransform = getRemapTransform(usePlan, useGrid);
             vigra_ext::transformImageAlpha(srcImg,
                                            vigra::srcImage(alpha),
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
+                                           remapTransform,
                                            invResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
@@ -796,12 +1175,13 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                 Base::m_region = newBoundingBox;
             };
         } else {
+            detail::RemapTransform remapTransform = getRemapTransform(usePlan, useGrid);
             vigra_ext::transformImageAlpha(srcImg,
                                            alphaImg,
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
+                                           remapTransform,
                                            invResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
@@ -25,13 +25,22 @@
  */
 
 #include "SpaceTransform.h"
+#include "SpaceTransformFused.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
 
 namespace HuginBase {
 namespace Nona {
         
 
 /// ctor
-SpaceTransform::SpaceTransform() : m_srcTX(0), m_srcTY(0), m_destTX(0), m_destTY(0)
+SpaceTransform::SpaceTransform() : m_srcTX(0), m_srcTY(0), m_destTX(0), m_destTY(0), m_floatErrorBound(0)
 {
 
 	m_Initialized = false;
@@ -1052,6 +1061,7 @@ void SpaceTransform::InitRadialCorrect(const vigra::Size2D & sz, const std::vect
 //    double  imheight= src.getSize().y;
 
     m_Stack.clear();
+    m_fused.reset();
     m_srcTX = sz.x/2.0;
     m_srcTY = sz.y/2.0;
     m_destTX = sz.x/2.0;
@@ -1081,6 +1091,7 @@ void SpaceTransform::InitInvRadialCorrect(const SrcPanoImage & src, int channel)
 //    double  imheight= src.getSize().y;
 
     m_Stack.clear();
+    m_fused.reset();
     m_srcTX = src.getSize().x/2.0;
     m_srcTY = src.getSize().y/2.0;
     m_destTX = src.getSize().x/2.0;
@@ -1139,6 +1150,7 @@ void SpaceTransform::InitRadialCorrect(const SrcPanoImage & src, int channel)
 //    double  imheight= src.getSize().y;
 
     m_Stack.clear();
+    m_fused.reset();
     m_srcTX = src.getSize().x/2.0;
     m_srcTY = src.getSize().y/2.0;
     m_destTX = src.getSize().x/2.0;
@@ -1228,6 +1240,7 @@ void SpaceTransform::Init(
 //    double  pnheight= destSize.y;
 
     m_Stack.clear();
+    m_fused.reset();
     m_srcTX = destSize.x/2.0;
     m_srcTY = destSize.y/2.0;    
     m_destTX = srcSize.x/2.0;
@@ -1404,6 +1417,7 @@ void SpaceTransform::Init(
 
 	stack[i].func  = (trfn)NULL;*/
 
+    compileStack(destSize);
 }
 
 void SpaceTransform::InitInv(
@@ -1437,6 +1451,7 @@ void SpaceTransform::InitInv(
 //    double  pnheight= destSize.y;
 
     m_Stack.clear();
+    m_fused.reset();
     m_srcTX = destSize.x/2.0;
     m_srcTY = destSize.y/2.0;
     m_destTX = srcSize.x/2.0;
@@ -1689,9 +1704,238 @@ void SpaceTransform::createInvTransform(const vigra::Diff2D & srcSize,
 }
 
 
+namespace
+{
+    template <int PANO>
+    detail::FusedSpaceTransform* createFusedTransform(int imageProj, const detail::FusedParams<double>& params)
+    {
+        switch (imageProj)
+        {
+            case detail::FUSED_IMAGE_RECTILINEAR:
+                return new detail::FusedSpaceTransformImpl<PANO, detail::FUSED_IMAGE_RECTILINEAR>(params);
+            case detail::FUSED_IMAGE_FISHEYE:
+                return new detail::FusedSpaceTransformImpl<PANO, detail::FUSED_IMAGE_FISHEYE>(params);
+            case detail::FUSED_IMAGE_EQUIRECTANGULAR:
+                return new detail::FusedSpaceTransformImpl<PANO, detail::FUSED_IMAGE_EQUIRECTANGULAR>(params);
+        };
+        return NULL;
+    }
+
+    /** float error bounds of the fused transforms by their parameters */
+    std::map<std::string, double>& FloatErrorBounds()
+    {
+        static std::map<std::string, double> bounds;
+        return bounds;
+    }
+
+    std::mutex& FloatErrorBoundMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+}
+
+void SpaceTransform::compileStack(const vigra::Diff2D & destSize)
+{
+    m_fused.reset();
+    m_floatErrorBound = 0;
+    // check if the stack matches the one created by Init()
+    detail::FusedParams<double> params;
+    std::vector<double> distances;
+    size_t i = 0;
+    int panoProj = detail::FUSED_PANO_EQUIRECTANGULAR;
+    if (i < m_Stack.size() && (m_Stack[i].func == &erect_rect || m_Stack[i].func == &erect_pano))
+    {
+        panoProj = (m_Stack[i].func == &erect_rect) ? detail::FUSED_PANO_RECTILINEAR : detail::FUSED_PANO_CYLINDRICAL;
+        distances.push_back(m_Stack[i].param.distance);
+        ++i;
+    };
+    if (m_Stack.size() < i + 4 || m_Stack[i].func != &rotate_erect || m_Stack[i + 1].func != &sphere_tp_erect ||
+        m_Stack[i + 2].func != &persp_sphere)
+    {
+        return;
+    };
+    params.rot180 = m_Stack[i].param.var0;
+    params.rotShift = m_Stack[i].param.var1;
+    distances.push_back(m_Stack[i + 1].param.distance);
+    params.distance = m_Stack[i + 2].param.distance;
+    for (int j = 0; j < 3; ++j)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            params.mt[j][k] = m_Stack[i + 2].param.mt.m[j][k];
+        };
+    };
+    i += 3;
+    int imageProj = detail::FUSED_IMAGE_FISHEYE;
+    if (m_Stack[i].func == &rect_sphere_tp || m_Stack[i].func == &erect_sphere_tp)
+    {
+        imageProj = (m_Stack[i].func == &rect_sphere_tp) ? detail::FUSED_IMAGE_RECTILINEAR : detail::FUSED_IMAGE_EQUIRECTANGULAR;
+        distances.push_back(m_Stack[i].param.distance);
+        ++i;
+    };
+    if (i >= m_Stack.size() || m_Stack[i].func != &resize)
+    {
+        return;
+    };
+    params.scaleX = m_Stack[i].param.var0;
+    params.scaleY = m_Stack[i].param.var1;
+    ++i;
+    if (i < m_Stack.size() && m_Stack[i].func == &radial)
+    {
+        params.hasRadial = true;
+        params.rad[0] = m_Stack[i].param.var0;
+        params.rad[1] = m_Stack[i].param.var1;
+        params.rad[2] = m_Stack[i].param.var2;
+        params.rad[3] = m_Stack[i].param.var3;
+        params.rad[4] = m_Stack[i].param.var4;
+        params.rad[5] = m_Stack[i].param.var5;
+        ++i;
+    };
+    if (i < m_Stack.size() && m_Stack[i].func == &vert)
+    {
+        params.shiftY = m_Stack[i].param.shift;
+        ++i;
+    };
+    if (i < m_Stack.size() && m_Stack[i].func == &horiz)
+    {
+        params.shiftX = m_Stack[i].param.shift;
+        ++i;
+    };
+    if (i != m_Stack.size())
+    {
+        return;
+    };
+    // the fused function uses a single distance for all stages
+    for (size_t j = 0; j < distances.size(); ++j)
+    {
+        if (distances[j] != params.distance)
+        {
+            return;
+        };
+    };
+    switch (panoProj)
+    {
+        case detail::FUSED_PANO_RECTILINEAR:
+            m_fused.reset(createFusedTransform<detail::FUSED_PANO_RECTILINEAR>(imageProj, params));
+            break;
+        case detail::FUSED_PANO_CYLINDRICAL:
+            m_fused.reset(createFusedTransform<detail::FUSED_PANO_CYLINDRICAL>(imageProj, params));
+            break;
+        case detail::FUSED_PANO_EQUIRECTANGULAR:
+            m_fused.reset(createFusedTransform<detail::FUSED_PANO_EQUIRECTANGULAR>(imageProj, params));
+            break;
+    };
+    if (!m_fused)
+    {
+        return;
+    };
+    // the error of the float version depends only on the fused stack and
+    // the sizes, measure it only once for each of them
+    std::ostringstream signature;
+    signature.precision(std::numeric_limits<double>::max_digits10);
+    signature << panoProj << ' ' << imageProj << ' ' << params.distance << ' ' << params.rot180 << ' ' << params.rotShift;
+    for (int j = 0; j < 3; ++j)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            signature << ' ' << params.mt[j][k];
+        };
+    };
+    signature << ' ' << params.scaleX << ' ' << params.scaleY << ' ' << params.hasRadial;
+    for (int j = 0; j < 6; ++j)
+    {
+        signature << ' ' << params.rad[j];
+    };
+    signature << ' ' << params.shiftX << ' ' << params.shiftY << ' ' << destSize.x << ' ' << destSize.y << ' '
+        << m_srcTX << ' ' << m_srcTY << ' ' << m_destTX << ' ' << m_destTY;
+    const std::string key(signature.str());
+    {
+        std::lock_guard<std::mutex> lock(FloatErrorBoundMutex());
+        std::map<std::string, double>::const_iterator cached = FloatErrorBounds().find(key);
+        if (cached != FloatErrorBounds().end())
+        {
+            m_floatErrorBound = cached->second;
+            return;
+        };
+    };
+    m_floatErrorBound = measureFloatErrorBound(destSize);
+    std::lock_guard<std::mutex> lock(FloatErrorBoundMutex());
+    // don't grow without limit when many different transforms are created
+    if (FloatErrorBounds().size() >= 1024)
+    {
+        FloatErrorBounds().clear();
+    };
+    FloatErrorBounds()[key] = m_floatErrorBound;
+}
+
+double SpaceTransform::measureFloatErrorBound(const vigra::Diff2D & destSize) const
+{
+    double bound = 0;
+    const int steps = 32;
+    for (int iy = 0; iy <= steps; ++iy)
+    {
+        for (int ix = 0; ix <= steps; ++ix)
+        {
+            const double x = static_cast<double>(destSize.x) * ix / steps;
+            const double y = static_cast<double>(destSize.y) * iy / steps;
+            double xd, yd;
+            float xf, yf;
+            transformImgCoordRow(&xd, &yd, x, y, 1);
+            transformImgCoordRow(&xf, &yf, x, y, 1);
+            if (xd >= 0 && xd <= 2 * m_destTX && yd >= 0 && yd <= 2 * m_destTY)
+            {
+                double error = std::max(std::abs(xd - xf), std::abs(yd - yf));
+                if (!(error < std::numeric_limits<double>::max()))
+                {
+                    // NaN or inf
+                    error = std::numeric_limits<double>::infinity();
+                };
+                bound = std::max(bound, error);
+            };
+        };
+    };
+    return bound;
+}
+
+bool SpaceTransform::canReplacePanoTools(const SrcPanoImage & src, const PanoramaOptions & dest)
+{
+    switch (dest.getProjection())
+    {
+        case PanoramaOptions::RECTILINEAR:
+        case PanoramaOptions::CYLINDRICAL:
+        case PanoramaOptions::EQUIRECTANGULAR:
+            break;
+        default:
+            return false;
+    };
+    switch (src.getProjection())
+    {
+        case SrcPanoImage::RECTILINEAR:
+        case SrcPanoImage::FULL_FRAME_FISHEYE:
+        case SrcPanoImage::CIRCULAR_FISHEYE:
+        case SrcPanoImage::EQUIRECTANGULAR:
+            break;
+        default:
+            return false;
+    };
+    if (src.getX() != 0 || src.getY() != 0 || src.getZ() != 0 || src.getShear().x != 0 || src.getShear().y != 0)
+    {
+        return false;
+    };
+    // Init() always uses d = 1 - (a + b + c)
+    const std::vector<double> radial = src.getRadialDistortion();
+    return radial.size() == 4 && std::abs(radial[3] - (1.0 - (radial[0] + radial[1] + radial[2]))) < 1e-10;
+}
+
 //
 bool SpaceTransform::transform(hugin_utils::FDiff2D& dest, const hugin_utils::FDiff2D & src) const
 {
+    if (m_fused)
+    {
+        m_fused->transformRow(&dest.x, &dest.y, src.x, src.y, 1);
+        return true;
+    };
 	double xd = src.x, yd = src.y;
 	std::vector<fDescription>::const_iterator tI;
 	
@@ -1718,6 +1962,51 @@ bool SpaceTransform::transformImgCoord(double & x_dest, double & y_dest, double
         return true;
 }
 
+void SpaceTransform::transformImgCoordRow(double * x_dest, double * y_dest, double x_src, double y_src, int n) const
+{
+    if (m_fused)
+    {
+        m_fused->transformRow(x_dest, y_dest, x_src - m_srcTX + 0.5, y_src - m_srcTY + 0.5, n);
+        for (int i = 0; i < n; ++i)
+        {
+            x_dest[i] += m_destTX - 0.5;
+            y_dest[i] += m_destTY - 0.5;
+        };
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            transformImgCoord(x_dest[i], y_dest[i], x_src + i, y_src);
+        };
+    };
+}
+
+void SpaceTransform::transformImgCoordRow(float * x_dest, float * y_dest, double x_src, double y_src, int n) const
+{
+    if (m_fused)
+    {
+        m_fused->transformRow(x_dest, y_dest, static_cast<float>(x_src - m_srcTX + 0.5), static_cast<float>(y_src - m_srcTY + 0.5), n);
+        const float offsetX = static_cast<float>(m_destTX - 0.5);
+        const float offsetY = static_cast<float>(m_destTY - 0.5);
+        for (int i = 0; i < n; ++i)
+        {
+            x_dest[i] += offsetX;
+            y_dest[i] += offsetY;
+        };
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            double x, y;
+            transformImgCoord(x, y, x_src + i, y_src);
+            x_dest[i] = static_cast<float>(x);
+            y_dest[i] = static_cast<float>(y);
+        };
+    };
+}
+
 
 } // namespace
 } // namespace
@@ -30,6 +30,7 @@
 #ifndef _NONA_SPACETRANSFORM_H
 #define _NONA_SPACETRANSFORM_H
     
+#include <memory>
 #include <vigra/diff2d.hxx>
 #include <hugin_math/Matrix3.h>
 
@@ -76,6 +77,11 @@ typedef struct _fDesc
     _FuncParams	param;	// parameters to be used
 } fDescription;
 
+namespace detail
+{
+    class FusedSpaceTransform;
+}
+
 
 
 /**
@@ -170,6 +176,17 @@ class IMPEX SpaceTransform
         {
             return transformImgCoord(dest.x, dest.y, src.x, src.y);
         }
+
+        /** transform a whole row of points (x_src .. x_src+n-1, y_src),
+         *  returns image coordinates like transformImgCoord
+         */
+        void transformImgCoordRow(double * x_dest, double * y_dest, double x_src, double y_src, int n) const;
+
+        /** like transformImgCoordRow, but in float precision.
+         *  This is only faster for fused transforms (see isFused()), the
+         *  maximal error against the double version is given by getFloatErrorBound()
+         */
+        void transformImgCoordRow(float * x_dest, float * y_dest, double x_src, double y_src, int n) const;
         
         
     public:
@@ -179,11 +196,48 @@ class IMPEX SpaceTransform
             return m_Stack.empty();
         }
 
+        /** returns true if the stack was compiled into a single function.
+         *
+         *  This is done by Init() for rectilinear, cylindrical or equirectangular
+         *  panoramas with rectilinear, fisheye or equirectangular images.
+         */
+        bool isFused() const
+        {
+            return m_fused.get() != NULL;
+        }
+
+        /** returns the maximal difference in pixels between the float and
+         *  the double version of transformImgCoordRow.
+         *
+         *  It is measured on a grid of 33x33 points over the panorama, taking
+         *  into account only points which are mapped inside the source image.
+         *  The measurement is done only once for each set of fused parameters
+         *  and sizes and reused by later calls of Init().
+         *  Typically it is in the order of 1e-3 pixel for images with a
+         *  few thousand pixels, and grows linear with the image size.
+         */
+        double getFloatErrorBound() const
+        {
+            return m_floatErrorBound;
+        }
+
+        /** returns true if Init() models all parameters of @p src and @p dest,
+         *  so the fused transform gives the same result as the libpano
+         *  transform (PTools::Transform) used by the remapper. This is not the
+         *  case for translation, shear, non-default radial distortion
+         *  parameter d and fisheye variants other than the equidistant one.
+         */
+        static bool canReplacePanoTools(const SrcPanoImage & src, const PanoramaOptions & dest);
+
         
     private:
         /// add a new transformation
         void AddTransform( trfn function_name, double var0, double var1 = 0.0f, double var2 = 0.0f, double var3 = 0.0f, double var4=0.0f, double var5=0.0f, double var6=0.0f, double var7=0.0f );
         void AddTransform( trfn function_name, Matrix3 m, double var0, double var1=0.0f, double var2=0.0f, double var3=0.0f);
+        /// replace the stack by a fused function, if there is one for this stack
+        void compileStack(const vigra::Diff2D & destSize);
+        /// maximal difference between the float and double fused transform on a grid over the panorama
+        double measureFloatErrorBound(const vigra::Diff2D & destSize) const;
         
         
     private:
@@ -197,6 +251,10 @@ class IMPEX SpaceTransform
         /// vector of transformations
         std::vector<fDescription>	m_Stack;
 
+        /// fused version of m_Stack, shared between copies
+        std::shared_ptr<const detail::FusedSpaceTransform> m_fused;
+        double m_floatErrorBound;
+
 };
 
 
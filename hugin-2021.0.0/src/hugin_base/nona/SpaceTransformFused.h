@@ -0,0 +1,280 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/SpaceTransformFused.h
+ *
+ *  @brief fused evaluation of the common SpaceTransform stacks
+ *
+ *  Internal header, only used by SpaceTransform.cpp. The functions
+ *  duplicate the stack functions of SpaceTransform.cpp, so any change
+ *  there has to be made here too.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_SPACETRANSFORMFUSED_H
+#define _NONA_SPACETRANSFORMFUSED_H
+
+#include <cmath>
+#include <hugin_math/hugin_math.h>
+#include <hugin_math/Matrix3.h>
+
+namespace HuginBase {
+namespace Nona {
+namespace detail {
+
+/** projection of the panorama, which is converted to equirectangular
+ *  (first stage of the stack) */
+enum FusedPanoProjection
+{
+    FUSED_PANO_RECTILINEAR,   // erect_rect
+    FUSED_PANO_CYLINDRICAL,   // erect_pano
+    FUSED_PANO_EQUIRECTANGULAR
+};
+
+/** projection of the source image, which is converted from spherical
+ *  (stage after persp_sphere) */
+enum FusedImageProjection
+{
+    FUSED_IMAGE_RECTILINEAR,  // rect_sphere_tp
+    FUSED_IMAGE_FISHEYE,      // no conversion
+    FUSED_IMAGE_EQUIRECTANGULAR // erect_sphere_tp
+};
+
+/** all parameters of the fused stack */
+template <class T>
+struct FusedParams
+{
+    /** distance used by all projection stages */
+    T distance;
+    /** rotate_erect: 180 degree in screen points, yaw in screen points */
+    T rot180, rotShift;
+    /** persp_sphere */
+    T mt[3][3];
+    /** resize */
+    T scaleX, scaleY;
+    /** radial: polynomial, normalisation radius and correction radius,
+     *  only used if hasRadial is true */
+    bool hasRadial;
+    T rad[6];
+    /** vert and horiz, 0 if not in the stack */
+    T shiftX, shiftY;
+
+    FusedParams() : distance(1), rot180(0), rotShift(0), scaleX(1), scaleY(1), hasRadial(false), shiftX(0), shiftY(0)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                mt[i][j] = (i == j) ? 1 : 0;
+            };
+        };
+        for (int i = 0; i < 6; ++i)
+        {
+            rad[i] = 0;
+        };
+    };
+
+    template <class T2>
+    explicit FusedParams(const FusedParams<T2>& other)
+        : distance(other.distance), rot180(other.rot180), rotShift(other.rotShift),
+          scaleX(other.scaleX), scaleY(other.scaleY), hasRadial(other.hasRadial),
+          shiftX(other.shiftX), shiftY(other.shiftY)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                mt[i][j] = static_cast<T>(other.mt[i][j]);
+            };
+        };
+        for (int i = 0; i < 6; ++i)
+        {
+            rad[i] = static_cast<T>(other.rad[i]);
+        };
+    };
+};
+
+/** evaluates the whole stack for a single point, all stages are inlined,
+ *  the projections are template parameters, so the switches are resolved
+ *  at compile time */
+template <int PANO, int IMAGE, class T>
+inline void fusedTransform(const FusedParams<T>& p, T x, T y, T& x_src, T& y_src)
+{
+    const T pi = static_cast<T>(PI);
+    const T d = p.distance;
+    // panorama -> equirect
+    if (PANO == FUSED_PANO_RECTILINEAR)
+    {
+        // erect_rect
+        const T xt = d * std::atan2(x, d);
+        y = d * std::atan2(y, std::sqrt(d * d + x * x));
+        x = xt;
+    }
+    else
+    {
+        if (PANO == FUSED_PANO_CYLINDRICAL)
+        {
+            // erect_pano
+            y = d * std::atan(y / d);
+        };
+    };
+    // rotate_erect
+    x += p.rotShift;
+    while (x < -p.rot180)
+    {
+        x += 2 * p.rot180;
+    };
+    while (x > p.rot180)
+    {
+        x -= 2 * p.rot180;
+    };
+    // sphere_tp_erect
+    {
+        T phi = x / d;
+        T theta = -y / d + pi / 2;
+        if (theta < 0)
+        {
+            theta = -theta;
+            phi += pi;
+        };
+        if (theta > pi)
+        {
+            theta = pi - (theta - pi);
+            phi += pi;
+        };
+        const T s = std::sin(theta);
+        const T v0 = s * std::sin(phi);
+        const T v1 = std::cos(theta);
+        const T r = std::sqrt(v1 * v1 + v0 * v0);
+        theta = d * std::atan2(r, s * std::cos(phi));
+        x = theta * v0 / r;
+        y = theta * v1 / r;
+    }
+    // persp_sphere
+    {
+        T r = std::sqrt(x * x + y * y);
+        T theta = r / d;
+        const T s = (r == 0) ? 0 : std::sin(theta) / r;
+        const T vx = s * x;
+        const T vy = s * y;
+        const T vz = std::cos(theta);
+        const T v2x = vx * p.mt[0][0] + vy * p.mt[1][0] + vz * p.mt[2][0];
+        const T v2y = vx * p.mt[0][1] + vy * p.mt[1][1] + vz * p.mt[2][1];
+        const T v2z = vx * p.mt[0][2] + vy * p.mt[1][2] + vz * p.mt[2][2];
+        r = std::sqrt(v2x * v2x + v2y * v2y);
+        theta = (r == 0) ? 0 : d * std::atan2(r, v2z) / r;
+        x = theta * v2x;
+        y = theta * v2y;
+    }
+    // spherical -> image projection
+    if (IMAGE == FUSED_IMAGE_RECTILINEAR)
+    {
+        // rect_sphere_tp
+        const T theta = std::sqrt(x * x + y * y) / d;
+        T rho;
+        if (theta >= pi / 2)
+        {
+            rho = static_cast<T>(1.6e16);
+        }
+        else
+        {
+            rho = (theta == 0) ? 1 : std::tan(theta) / theta;
+        };
+        x *= rho;
+        y *= rho;
+    }
+    else
+    {
+        if (IMAGE == FUSED_IMAGE_EQUIRECTANGULAR)
+        {
+            // erect_sphere_tp
+            const T r = std::sqrt(x * x + y * y);
+            const T theta = r / d;
+            const T s = (theta == 0) ? 1 / d : std::sin(theta) / r;
+            const T v1 = s * x;
+            const T v0 = std::cos(theta);
+            const T xt = d * std::atan2(v1, v0);
+            y = d * std::atan(s * y / std::sqrt(v0 * v0 + v1 * v1));
+            x = xt;
+        };
+    };
+    // resize
+    x *= p.scaleX;
+    y *= p.scaleY;
+    // radial
+    if (p.hasRadial)
+    {
+        const T r = std::sqrt(x * x + y * y) / p.rad[4];
+        T scale;
+        if (r < p.rad[5])
+        {
+            scale = ((p.rad[3] * r + p.rad[2]) * r + p.rad[1]) * r + p.rad[0];
+        }
+        else
+        {
+            scale = 1000;
+        };
+        x *= scale;
+        y *= scale;
+    };
+    // vert, horiz
+    x_src = x + p.shiftX;
+    y_src = y + p.shiftY;
+}
+
+/** interface of the fused transforms */
+class FusedSpaceTransform
+{
+public:
+    virtual ~FusedSpaceTransform() {};
+    /** transform the row (x .. x+n-1, y), in cartesian coordinates */
+    virtual void transformRow(double* x_src, double* y_src, double x, double y, int n) const = 0;
+    /** transform the row (x .. x+n-1, y), in cartesian coordinates, using float precision */
+    virtual void transformRow(float* x_src, float* y_src, float x, float y, int n) const = 0;
+};
+
+/** fused transform for the given panorama and image projection */
+template <int PANO, int IMAGE>
+class FusedSpaceTransformImpl : public FusedSpaceTransform
+{
+public:
+    explicit FusedSpaceTransformImpl(const FusedParams<double>& params) : m_params(params), m_paramsFloat(params) {};
+
+    virtual void transformRow(double* x_src, double* y_src, double x, double y, int n) const
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            fusedTransform<PANO, IMAGE>(m_params, x + i, y, x_src[i], y_src[i]);
+        };
+    };
+
+    virtual void transformRow(float* x_src, float* y_src, float x, float y, int n) const
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            fusedTransform<PANO, IMAGE>(m_paramsFloat, x + i, y, x_src[i], y_src[i]);
+        };
+    };
+
+private:
+    FusedParams<double> m_params;
+    FusedParams<float> m_paramsFloat;
+};
+
+} // namespace detail
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_SPACETRANSFORMFUSED_H
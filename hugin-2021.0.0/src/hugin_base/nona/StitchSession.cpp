@@ -0,0 +1,247 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/StitchSession.cpp
+ *
+ *  Repeated stitching of frames with the same project
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "StitchSession.h"
+
+#include <fstream>
+
+#include "Stitcher.h"
+
+namespace HuginBase {
+namespace Nona {
+
+/** interface of the pixel type dependent part of the session */
+class StitchSession::Impl
+{
+public:
+    virtual ~Impl() {};
+    virtual void stitch(const ImageBufferMap& frames, ImageBuffer& output) = 0;
+};
+
+namespace
+{
+    /** keeps remapper, stitcher and panorama canvas of the given type alive,
+     *  the canvas covers only the output region */
+    template <class ImageType, class AlphaType>
+    class StitchSessionImpl : public StitchSession::Impl
+    {
+    public:
+        StitchSessionImpl(const PanoramaData& pano, const PanoramaOptions& opts, const UIntSet& images,
+                          const AdvancedOptions& advOptions, AppBase::ProgressDisplay* progress)
+            : m_opts(opts), m_images(images), m_advOptions(advOptions),
+              m_weightedStitcher(pano, progress), m_reduceStitcher(pano, progress),
+              m_panoImage(opts.getROI().size()), m_panoMask(opts.getROI().size())
+        {
+            m_remapper.setAdvancedOptions(m_advOptions);
+            m_remapper.setKeepRemapped(true);
+        };
+
+        virtual void stitch(const ImageBufferMap& frames, ImageBuffer& output)
+        {
+            m_remapper.setImages(frames);
+            // the canvas is reused, so clear the result of the last frame
+            m_panoImage.init(vigra::NumericTraits<typename ImageType::value_type>::zero());
+            m_panoMask.init(0);
+            try
+            {
+                if (m_opts.outputMode == PanoramaOptions::OUTPUT_HDR)
+                {
+                    vigra_ext::ReduceToHDRFunctor<typename ImageType::value_type> hdrmerge;
+                    m_reduceStitcher.stitch(m_opts, m_images, vigra::destImageRange(m_panoImage), vigra::destImage(m_panoMask),
+                        m_remapper, hdrmerge);
+                }
+                else
+                {
+                    m_weightedStitcher.stitch(m_opts, m_images, std::string(), m_panoImage, m_panoMask, m_remapper, m_advOptions);
+                };
+            }
+            catch (...)
+            {
+                // don't keep pointers to the caller buffers
+                m_remapper.clearImages();
+                throw;
+            };
+            m_remapper.clearImages();
+            exportImageBuffer(m_panoImage, m_panoMask, vigra::Rect2D(m_panoImage.size()), output);
+        };
+
+    private:
+        PanoramaOptions m_opts;
+        UIntSet m_images;
+        AdvancedOptions m_advOptions;
+        MemoryRemapper<ImageType, AlphaType> m_remapper;
+        WeightedStitcher<ImageType, AlphaType> m_weightedStitcher;
+        ReduceStitcher<ImageType, AlphaType> m_reduceStitcher;
+        ImageType m_panoImage;
+        AlphaType m_panoMask;
+    };
+}
+
+StitchSession::StitchSession() : m_pano(new Panorama), m_progress(&m_dummyProgress), m_implBands(0)
+{
+}
+
+StitchSession::~StitchSession()
+{
+}
+
+bool StitchSession::readProject(const std::string& filename)
+{
+    std::ifstream prjfile(filename.c_str());
+    if (!prjfile.good())
+    {
+        return false;
+    };
+    std::unique_ptr<Panorama> pano(new Panorama);
+    pano->setFilePrefix(hugin_utils::getPathPrefix(filename));
+    if (pano->readData(prjfile) != AppBase::DocumentData::SUCCESSFUL)
+    {
+        return false;
+    };
+    m_pano = std::move(pano);
+    reset();
+    return true;
+}
+
+void StitchSession::setPanorama(const Panorama& pano)
+{
+    m_pano.reset(new Panorama(pano.duplicate()));
+    reset();
+}
+
+void StitchSession::setAdvancedOptions(const AdvancedOptions& advOptions)
+{
+    m_advOptions = advOptions;
+    reset();
+}
+
+void StitchSession::setProgressDisplay(AppBase::ProgressDisplay* progress)
+{
+    m_progress = (progress == NULL) ? &m_dummyProgress : progress;
+    reset();
+}
+
+vigra::Size2D StitchSession::getOutputSize() const
+{
+    return m_pano->getOptions().getROI().size();
+}
+
+void StitchSession::reset()
+{
+    m_impl.reset();
+    m_implPixelType.clear();
+    m_implBands = 0;
+}
+
+void StitchSession::stitch(const ImageBufferMap& frames, ImageBuffer& output)
+{
+    if (m_impl && (m_implPixelType != output.pixelType || m_implBands != output.colorBands()))
+    {
+        reset();
+    };
+    if (!m_impl)
+    {
+        m_images = m_pano->getActiveImages();
+        if (m_images.empty())
+        {
+            UTILS_THROW(std::runtime_error, "No active images in project");
+        };
+        m_opts = m_pano->getOptions();
+        m_opts.outputPixelType = output.pixelType;
+        if (m_opts.outputMode == PanoramaOptions::OUTPUT_HDR)
+        {
+            if (output.pixelType != "FLOAT")
+            {
+                UTILS_THROW(std::runtime_error, "HDR output requires pixel type FLOAT, not " << output.pixelType);
+            };
+        }
+        else
+        {
+            if (m_pano->getImage(*m_images.begin()).getResponseType() == HuginBase::BaseSrcPanoImage::RESPONSE_EMOR)
+            {
+                m_opts.outputEMoRParams = m_pano->getSrcImage(*m_images.begin()).getEMoRParams();
+            }
+            else
+            {
+                m_opts.outputEMoRParams.clear();
+            };
+        };
+        // keep the coordinates of the remapping in memory, unless explicitly disabled
+        AdvancedOptions advOptions(m_advOptions);
+        if (advOptions.find("useRemapPlan") == advOptions.end())
+        {
+            SetAdvancedOption(advOptions, "useRemapPlan", true);
+        };
+        if (output.colorBands() == 1)
+        {
+            if (output.pixelType == "UINT8")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::BImage, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            }
+            else if (output.pixelType == "UINT16")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::UInt16Image, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            }
+            else if (output.pixelType == "FLOAT")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::FImage, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            };
+        }
+        else if (output.colorBands() == 3)
+        {
+            if (output.pixelType == "UINT8")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::BRGBImage, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            }
+            else if (output.pixelType == "UINT16")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::UInt16RGBImage, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            }
+            else if (output.pixelType == "FLOAT")
+            {
+                m_impl.reset(new StitchSessionImpl<vigra::FRGBImage, vigra::BImage>(*m_pano, m_opts, m_images, advOptions, m_progress));
+            };
+        };
+        if (!m_impl)
+        {
+            UTILS_THROW(std::runtime_error, "Unsupported output format: " << output.pixelType << " with " << output.bands << " bands");
+        };
+        m_implPixelType = output.pixelType;
+        m_implBands = output.colorBands();
+    };
+    for (UIntSet::const_iterator it = m_images.begin(); it != m_images.end(); ++it)
+    {
+        ImageBufferMap::const_iterator img = frames.find(*it);
+        if (img == frames.end() || img->second.data == NULL)
+        {
+            UTILS_THROW(std::runtime_error, "No pixel data given for image " << *it);
+        };
+        if (img->second.colorBands() != output.colorBands())
+        {
+            UTILS_THROW(std::runtime_error, "image " << *it << " has " << img->second.colorBands()
+                << " channels, while output uses: " << output.colorBands());
+        };
+    };
+    m_impl->stitch(frames, output);
+}
+
+} // namespace Nona
+} // namespace HuginBase
@@ -0,0 +1,107 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/StitchSession.h
+ *
+ *  Repeated stitching of frames with the same project
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_STITCHSESSION_H
+#define _NONA_STITCHSESSION_H
+
+#include <hugin_shared.h>
+
+#include <memory>
+#include <string>
+
+#include <panodata/Panorama.h>
+#include <appbase/ProgressDisplay.h>
+#include <nona/ImageBuffer.h>
+#include <nona/StitcherOptions.h>
+
+namespace HuginBase {
+namespace Nona {
+
+/** stitches frames with the same project again and again.
+ *
+ *  Stitching a single panorama with stitchPanorama() or
+ *  stitchPanoramaToMemory() sets up everything from scratch: the output
+ *  regions of all images, the transformations, the photometric transforms
+ *  and the blending order. For a fixed camera rig this is the same for
+ *  every frame.
+ *
+ *  The session reads the project once and keeps all this data between the
+ *  calls of stitch(), so that each call only remaps and blends the pixels.
+ *  The cached data are created on the first call of stitch() and are
+ *  recreated only when the pixel type or the number of bands of the output
+ *  changes or when the project or the options are changed.
+ */
+class IMPEX StitchSession
+{
+public:
+    /** create an empty session, use readProject() or setPanorama() before stitching */
+    StitchSession();
+    ~StitchSession();
+
+    /** read the project from the given file
+     *  @return true, if the project could be read */
+    bool readProject(const std::string& filename);
+    /** use a copy of the given panorama */
+    void setPanorama(const Panorama& pano);
+    /** set the advanced stitching options */
+    void setAdvancedOptions(const AdvancedOptions& advOptions);
+    /** set progress display, the default does not output anything */
+    void setProgressDisplay(AppBase::ProgressDisplay* progress);
+
+    /** return the panorama of the session */
+    const Panorama& getPanorama() const { return *m_pano; };
+    /** return the size of the output buffer (size of the output region) */
+    vigra::Size2D getOutputSize() const;
+
+    /** stitch one set of frames.
+     *  @param frames pixel data for all active images of the project, the
+     *         buffers are only accessed during the call
+     *  @param output caller owned buffer of the size getOutputSize(), its pixel
+     *         type (UINT8, UINT16 or FLOAT) is the output pixel type, an extra
+     *         band receives the alpha channel
+     */
+    void stitch(const ImageBufferMap& frames, ImageBuffer& output);
+
+    /** release all cached data, they are recreated at the next stitch() */
+    void reset();
+
+    class Impl;
+
+private:
+    // not copyable
+    StitchSession(const StitchSession&);
+    StitchSession& operator=(const StitchSession&);
+
+    std::unique_ptr<Panorama> m_pano;
+    PanoramaOptions m_opts;
+    UIntSet m_images;
+    AdvancedOptions m_advOptions;
+    AppBase::DummyProgressDisplay m_dummyProgress;
+    AppBase::ProgressDisplay* m_progress;
+    std::unique_ptr<Impl> m_impl;
+    std::string m_implPixelType;
+    int m_implBands;
+};
+
+} // namespace Nona
+} // namespace HuginBase
+
+#endif // _NONA_STITCHSESSION_H
@@ -32,6 +32,9 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <exception>
 #include <utility>
 #include <cctype>
 #include <algorithm>
@@ -52,6 +55,8 @@
 #include <algorithms/nona/ComputeImageROI.h>
 #include <nona/RemappedPanoImage.h>
 #include <nona/ImageRemapper.h>
+#include <nona/AsyncWriter.h>
+#include <nona/ImageBuffer.h>
 #include <nona/StitcherOptions.h>
 #include <algorithms/basic/LayerStacks.h>
 
@@ -72,7 +77,7 @@ class Stitcher
 public:
     /** create a stitcher for the given panorama */
     Stitcher(const PanoramaData & pano, AppBase::ProgressDisplay* progress)
-	: m_pano(pano), m_progress(progress)
+	: m_pano(pano), m_progress(progress), m_roiFingerprint(0)
     {
     }
 
@@ -88,6 +93,7 @@ public:
     {
         m_images=images;
         calcOutputROIS(opts, images);
+        m_roiFingerprint = calcROIFingerprint(opts, images);
     };
 
 
@@ -111,21 +117,96 @@ protected:
         m_rois = HuginBase::ComputeImageROI::computeROIS(m_pano, opts, images);
     }
 
+    /** return a hash of everything the output regions and the blending order
+     *  depend on: the geometry of all images, the canvas and the color
+     *  reference image */
+    unsigned long long calcROIFingerprint(const PanoramaOptions & opts, const UIntSet & images) const
+    {
+        unsigned long long fingerprint = opts.colorReferenceImage;
+        for (UIntSet::const_iterator it = images.begin(); it != images.end(); ++it)
+        {
+            fingerprint = (fingerprint * 1099511628211ULL) ^ *it;
+            fingerprint = (fingerprint * 1099511628211ULL) ^ RemapPlan::CalcFingerprint(m_pano.getImage(*it), opts, opts.getROI());
+        };
+        return fingerprint;
+    }
+
+    /** return true, if the output regions were calculated for the given
+     *  images and unchanged geometry and canvas */
+    bool hasOutputROIS(const PanoramaOptions & opts, const UIntSet & images) const
+    {
+        return m_images == images && m_rois.size() == images.size() && m_roiFingerprint == calcROIFingerprint(opts, images);
+    }
+
     const PanoramaData & m_pano;
     AppBase::ProgressDisplay* m_progress;
     UIntSet m_images;
     std::vector<vigra::Rect2D> m_rois;
+    unsigned long long m_roiFingerprint;
 };
 
 namespace detail
 {
+    /** return the position of the canvas with size @p canvasSize in the
+     *  panorama: the canvas is either the complete panorama or only its
+     *  output region */
+    inline vigra::Diff2D canvasOffset(const PanoramaOptions& opts, const vigra::Size2D& canvasSize)
+    {
+        if (canvasSize == opts.getSize())
+        {
+            return vigra::Diff2D(0, 0);
+        };
+        vigra_precondition(canvasSize == opts.getROI().size(), "canvas must cover the panorama or its output region");
+        return vigra::Diff2D(opts.getROI().upperLeft());
+    }
+
+    /** job for AsyncWriter, which exports an image with or without alpha channel */
+    template<typename ImageType, typename AlphaType>
+    class ExportImageJob : public AsyncWriter::Job
+    {
+    public:
+        ExportImageJob(const vigra::ImageExportInfo& exinfo, const bool withAlpha)
+            : m_exinfo(exinfo), m_withAlpha(withAlpha)
+        {};
+
+        virtual void run()
+        {
+            if (m_withAlpha)
+            {
+                vigra::exportImageAlpha(srcImageRange(m_image), srcImage(m_alpha), m_exinfo);
+            }
+            else
+            {
+                vigra::exportImage(srcImageRange(m_image), m_exinfo);
+            };
+        };
+
+        virtual size_t getMemoryUsage() const
+        {
+            return static_cast<size_t>(m_image.width()) * m_image.height() * sizeof(typename ImageType::value_type) +
+                static_cast<size_t>(m_alpha.width()) * m_alpha.height() * sizeof(typename AlphaType::value_type);
+        };
+
+        ImageType& image() { return m_image; };
+        AlphaType& alpha() { return m_alpha; };
+
+    private:
+        ImageType m_image;
+        AlphaType m_alpha;
+        vigra::ImageExportInfo m_exinfo;
+        const bool m_withAlpha;
+    };
+
+    /** save the remapped image, if @p writer is not NULL the image is copied
+     *  and written by the background threads of the writer */
     template<typename ImageType, typename AlphaType>
     void saveRemapped(RemappedPanoImage<ImageType, AlphaType> & remapped,
         unsigned int imgNr, unsigned int nImg,
         const PanoramaOptions & opts,
         const std::string& basename,
         const bool useBigTIFF,
-        AppBase::ProgressDisplay* progress)
+        AppBase::ProgressDisplay* progress,
+        AsyncWriter* writer = NULL)
     {
         ImageType * final_img = 0;
         AlphaType * alpha_img = 0;
@@ -234,6 +315,23 @@ namespace detail
             };
         }
 
+        if (writer != NULL)
+        {
+            ExportImageJob<ImageType, AlphaType>* job = new ExportImageJob<ImageType, AlphaType>(exinfo, supportsAlpha);
+            if (final_img == &complete)
+            {
+                // the full size images are not needed any more
+                job->image().swap(complete);
+                job->alpha().swap(alpha);
+            }
+            else
+            {
+                job->image() = *final_img;
+                job->alpha() = *alpha_img;
+            };
+            writer->push(job);
+            return;
+        };
         if (supportsAlpha)
         {
             vigra::exportImageAlpha(srcImageRange(*final_img), srcImage(*alpha_img), exinfo);
@@ -243,6 +341,115 @@ namespace detail
             vigra::exportImage(srcImageRange(*final_img), exinfo);
         };
     };
+
+    /** remap the images @p images into the regions @p rois and pass each
+     *  remapped image to @p functor, in the order given by @p images.
+     *
+     *  The functor is called as functor(remapped, imgNr, modOptions), the remapped
+     *  image is released afterwards.
+     *
+     *  If the advanced option parallelImages is larger than 1 and the remapper
+     *  supports it, up to this number of images are loaded and remapped at the
+     *  same time. The functor is still called sequentially and in the given order,
+     *  so the blending order is kept and the output is identical to the
+     *  sequential processing. Each image is then remapped by a single thread,
+     *  at most parallelImages remapped images are kept in memory.
+     */
+    template <typename ImageType, typename AlphaType, class FUNCTOR>
+    void remapImagesOrdered(const PanoramaData & pano, const PanoramaOptions & opts,
+        const UIntVector & images, const std::vector<vigra::Rect2D> & rois,
+        SingleImageRemapper<ImageType, AlphaType> & remapper,
+        const AdvancedOptions & advOptions,
+        AppBase::ProgressDisplay* progress, FUNCTOR & functor)
+    {
+        DEBUG_ASSERT(images.size() == rois.size());
+        const bool ignoreExposure = GetAdvancedOption(advOptions, "ignoreExposure", false);
+        const int nrImages = images.size();
+        int nrWorkers = static_cast<int>(GetAdvancedOption(advOptions, "parallelImages", 1.0f));
+        if (nrWorkers > nrImages)
+        {
+            nrWorkers = nrImages;
+        };
+        if (nrWorkers < 2 || opts.remapUsingGPU || !remapper.supportsParallelRemapping())
+        {
+            for (int i = 0; i < nrImages; ++i)
+            {
+                // get a remapped image.
+                DEBUG_DEBUG("remapping image: " << images[i]);
+                PanoramaOptions modOptions(opts);
+                if (ignoreExposure)
+                {
+                    modOptions.outputExposureValue = pano.getImage(images[i]).getExposureValue();
+                    modOptions.outputRangeCompression = 0.0;
+                };
+                RemappedPanoImage<ImageType, AlphaType>* remapped = remapper.getRemapped(pano, modOptions, images[i], rois[i], progress);
+                functor(*remapped, images[i], modOptions);
+                // free remapped image
+                remapper.release(remapped);
+            };
+            return;
+        };
+        // the first exception, it is rethrown after all workers have finished
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(nrWorkers)
+        for (int i = 0; i < nrImages; ++i)
+        {
+            PanoramaOptions modOptions(opts);
+            if (ignoreExposure)
+            {
+                modOptions.outputExposureValue = pano.getImage(images[i]).getExposureValue();
+                modOptions.outputRangeCompression = 0.0;
+            };
+            RemappedPanoImage<ImageType, AlphaType>* remapped = NULL;
+            std::exception_ptr remapError;
+            if (!failed)
+            {
+                // the progress display can't be shared between the threads
+                AppBase::DummyProgressDisplay dummy;
+                try
+                {
+                    remapped = remapper.getRemapped(pano, modOptions, images[i], rois[i], &dummy);
+                }
+                catch (...)
+                {
+                    remapError = std::current_exception();
+                };
+            };
+            // merge stage, executed for one image after the other in the given order
+#pragma omp ordered
+            {
+                if (remapError && !error)
+                {
+                    error = remapError;
+                };
+                if (remapped != NULL)
+                {
+                    if (!error)
+                    {
+                        try
+                        {
+                            progress->setMessage("remapped", hugin_utils::stripPath(pano.getImage(images[i]).getFilename()));
+                            functor(*remapped, images[i], modOptions);
+                        }
+                        catch (...)
+                        {
+                            error = std::current_exception();
+                        };
+                    };
+                    remapper.release(remapped);
+                };
+                if (error)
+                {
+                    failed = true;
+                };
+            }
+        };
+        if (error)
+        {
+            std::rethrow_exception(error);
+        };
+    };
 } // namespace detail
 
 /** remap a set of images, and store the individual remapped files. */
@@ -280,33 +487,30 @@ public:
 
         // setup the output.
         prepareOutputFile(opts, advOptions);
-
-        // remap each image and save
-        int i=0;
-        for (UIntSet::const_iterator it = images.begin();
-             it != images.end(); ++it)
+        // the coordinate images and the alpha channel for HDR output are
+        // calculated from the source coordinates of the remapping step
+        remapper.setStoreSrcCoords(opts.saveCoordImgs || opts.outputMode == PanoramaOptions::OUTPUT_HDR);
+
+        // remap each image and save, the images are written in the order of
+        // the image numbers, also when several images are remapped in parallel
+        const UIntVector imageVector(images.begin(), images.end());
+        // with a write queue the images are encoded and written in background threads,
+        // while the next images are remapped
+        const int writeThreads = hugin_utils::roundi(GetAdvancedOption(advOptions, "writeQueueThreads", 0.0f));
+        if (writeThreads > 0 && opts.outputFormat != PanoramaOptions::TIFF_multilayer)
         {
-            // get a remapped image.
-            PanoramaOptions modOptions(opts);
-            if (GetAdvancedOption(advOptions, "ignoreExposure", false))
-            {
-                modOptions.outputExposureValue = Base::m_pano.getImage(*it).getExposureValue();
-                modOptions.outputRangeCompression = 0.0;
-            };
-            RemappedPanoImage<ImageType, AlphaType> *
-                remapped = remapper.getRemapped(Base::m_pano, modOptions, *it, 
-                                                Base::m_rois[i], Base::m_progress);
-            try {
-                saveRemapped(*remapped, *it, Base::m_pano.getNrOfImages(), opts, advOptions);
-            } catch (vigra::PreconditionViolation & e) {
-                // this can be thrown, if an image
-                // is completely out of the pano
-                std::cerr << e.what();
-            }
-            // free remapped image
-            remapper.release(remapped);
-            i++;
-        }
+            const double memoryBudget = GetAdvancedOption(advOptions, "writeQueueMemory", 1024.0f);
+            m_writer.reset(new AsyncWriter(writeThreads, static_cast<size_t>(memoryBudget * 1024 * 1024)));
+        };
+        SaveFunctor saveFunctor(*this, opts, advOptions);
+        detail::remapImagesOrdered(Base::m_pano, opts, imageVector, Base::m_rois, remapper, advOptions, Base::m_progress, saveFunctor);
+        if (m_writer)
+        {
+            Base::m_progress->setMessage("waiting for pending writes");
+            m_writer->wait();
+            m_writer.reset();
+        };
+        remapper.setStoreSrcCoords(false);
         finalizeOutputFile(opts);
         Base::m_progress->taskFinished();
     }
@@ -323,7 +527,7 @@ public:
                               const PanoramaOptions & opts,
                               const AdvancedOptions& advOptions)
     {
-        detail::saveRemapped(remapped, imgNr, nImg, opts, m_basename, GetAdvancedOption(advOptions, "useBigTIFF", false), Base::m_progress);
+        detail::saveRemapped(remapped, imgNr, nImg, opts, m_basename, GetAdvancedOption(advOptions, "useBigTIFF", false), Base::m_progress, m_writer.get());
 
         if (opts.saveCoordImgs) {
             vigra::UInt16Image xImg;
@@ -384,7 +588,34 @@ public:
     }
 
 protected:
+    /** saves each remapped image */
+    class SaveFunctor
+    {
+    public:
+        SaveFunctor(MultiImageRemapper& stitcher, const PanoramaOptions& opts, const AdvancedOptions& advOptions)
+            : m_stitcher(stitcher), m_opts(opts), m_advOptions(advOptions)
+        {};
+
+        void operator()(RemappedPanoImage<ImageType, AlphaType>& remapped, unsigned int imgNr, const PanoramaOptions& modOptions)
+        {
+            try {
+                m_stitcher.saveRemapped(remapped, imgNr, m_stitcher.m_pano.getNrOfImages(), m_opts, m_advOptions);
+            } catch (vigra::PreconditionViolation & e) {
+                // this can be thrown, if an image
+                // is completely out of the pano
+                std::cerr << e.what();
+            }
+        };
+
+    private:
+        MultiImageRemapper& m_stitcher;
+        const PanoramaOptions& m_opts;
+        const AdvancedOptions& m_advOptions;
+    };
+
     std::string m_basename;
+    /** background writer, only used with the advanced option writeQueueThreads */
+    std::unique_ptr<AsyncWriter> m_writer;
 };
 
 
@@ -473,6 +704,12 @@ public:
                         const AdvancedOptions& advOptions)
     {
         const unsigned int nImg = imgSet.size();
+        if (!Base::hasOutputROIS(opts, imgSet))
+        {
+            // output regions not yet calculated
+            Base::stitch(opts, imgSet, filename, remapper);
+            m_blendingOrder.clear();
+        };
 
         Base::m_progress->setMessage("Remapping and stitching");
 
@@ -486,51 +723,22 @@ public:
         }
         else
         {
-            images = HuginBase::getEstimatedBlendingOrder(Base::m_pano, imgSet, opts.colorReferenceImage);
+            // the blending order depends only on the geometry, so calculate it
+            // only once when stitching several times with the same images
+            if (m_blendingOrder.empty())
+            {
+                m_blendingOrder = HuginBase::getEstimatedBlendingOrder(Base::m_pano, imgSet, opts.colorReferenceImage);
+            };
+            images = m_blendingOrder;
         };
+        std::vector<vigra::Rect2D> rois;
         for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
         {
-            // get a remapped image.
-            DEBUG_DEBUG("remapping image: " << *it);
-            PanoramaOptions modOptions(opts);
-            if (GetAdvancedOption(advOptions, "ignoreExposure", false))
-            {
-                modOptions.outputExposureValue = Base::m_pano.getImage(*it).getExposureValue();
-                modOptions.outputRangeCompression = 0.0;
-            };
-            RemappedPanoImage<ImageType, AlphaType> *
-                remapped = remapper.getRemapped(Base::m_pano, modOptions, *it,
-                    Base::m_rois[std::distance(imgSet.begin(), imgSet.find(*it))], Base::m_progress);
-            if(iccProfile.empty())
-            {
-                iccProfile=remapped->m_ICCProfile;
-            };
-            if (GetAdvancedOption(advOptions, "saveIntermediateImages", false))
-            {
-                modOptions.outputFormat = PanoramaOptions::TIFF_m;
-                modOptions.tiff_saveROI = true;
-                std::string finalFilename(GetAdvancedOption(advOptions, "basename", filename));
-                const std::string suffix(GetAdvancedOption(advOptions, "saveIntermediateImagesSuffix"));
-                if (!suffix.empty())
-                {
-                    finalFilename.append(suffix);
-                };
-                detail::saveRemapped(*remapped, *it, nImg, modOptions, finalFilename, GetAdvancedOption(advOptions, "useBigTIFF", false), Base::m_progress);
-            }
-            Base::m_progress->setMessage("blending", hugin_utils::stripPath(Base::m_pano.getImage(*it).getFilename()));
-            // add image to pano and panoalpha, adjusts panoROI as well.
-            try {
-                vigra_ext::MergeImages<ImageType, AlphaType>(panoImage, alpha, remapped->m_image, remapped->m_mask, vigra::Diff2D(remapped->boundingBox().upperLeft()), wrap, hardSeam);
-                // update bounding box of the panorama
-                m_panoROI |= remapped->boundingBox();
-            } catch (vigra::PreconditionViolation & e) {
-                DEBUG_ERROR("exception during stitching" << e.what());
-                // this can be thrown, if an image
-                // is completely out of the pano
-            }
-            // free remapped image
-            remapper.release(remapped);
-        }
+            rois.push_back(Base::m_rois[std::distance(imgSet.begin(), imgSet.find(*it))]);
+        };
+        MergeFunctor mergeFunctor(*this, filename, panoImage, alpha, detail::canvasOffset(opts, panoImage.size()),
+                                  nImg, wrap, hardSeam, advOptions);
+        detail::remapImagesOrdered(Base::m_pano, opts, images, rois, remapper, advOptions, Base::m_progress, mergeFunctor);
         // check if our intermediate image covers whole canvas
         // if not update m_panoROI
         if (m_panoROI.width() < opts.getROI().width() || m_panoROI.height() < opts.getROI().height())
@@ -545,8 +753,6 @@ public:
                         SingleImageRemapper<ImageType, AlphaType> & remapper,
                         const AdvancedOptions& advOptions)
     {
-        Base::stitch(opts, imgSet, filename, remapper);
-
         std::string basename = filename;
 
 	// create panorama canvas
@@ -607,11 +813,249 @@ public:
     }
 
 protected:
+    /** blends each remapped image into the panorama */
+    class MergeFunctor
+    {
+    public:
+        MergeFunctor(WeightedStitcher& stitcher, const std::string& filename, ImageType& panoImage, AlphaType& alpha,
+                     const vigra::Diff2D& offset, const unsigned int nImg, const bool wrap, const bool hardSeam,
+                     const AdvancedOptions& advOptions)
+            : m_stitcher(stitcher), m_filename(filename), m_panoImage(panoImage), m_alpha(alpha), m_offset(offset),
+              m_nImg(nImg), m_wrap(wrap), m_hardSeam(hardSeam), m_advOptions(advOptions)
+        {};
+
+        void operator()(RemappedPanoImage<ImageType, AlphaType>& remapped, unsigned int imgNr, PanoramaOptions& modOptions)
+        {
+            if (m_stitcher.iccProfile.empty())
+            {
+                m_stitcher.iccProfile = remapped.m_ICCProfile;
+            };
+            if (GetAdvancedOption(m_advOptions, "saveIntermediateImages", false))
+            {
+                modOptions.outputFormat = PanoramaOptions::TIFF_m;
+                modOptions.tiff_saveROI = true;
+                std::string finalFilename(GetAdvancedOption(m_advOptions, "basename", m_filename));
+                const std::string suffix(GetAdvancedOption(m_advOptions, "saveIntermediateImagesSuffix"));
+                if (!suffix.empty())
+                {
+                    finalFilename.append(suffix);
+                };
+                detail::saveRemapped(remapped, imgNr, m_nImg, modOptions, finalFilename, GetAdvancedOption(m_advOptions, "useBigTIFF", false), m_stitcher.m_progress);
+            }
+            m_stitcher.m_progress->setMessage("blending", hugin_utils::stripPath(m_stitcher.m_pano.getImage(imgNr).getFilename()));
+            // add image to pano and panoalpha, adjusts panoROI as well.
+            try {
+                vigra_ext::MergeImages<ImageType, AlphaType>(m_panoImage, m_alpha, remapped.m_image, remapped.m_mask, vigra::Diff2D(remapped.boundingBox().upperLeft()) - m_offset, m_wrap, m_hardSeam);
+                // update bounding box of the panorama
+                m_stitcher.m_panoROI |= remapped.boundingBox();
+            } catch (vigra::PreconditionViolation & e) {
+                DEBUG_ERROR("exception during stitching" << e.what());
+                // this can be thrown, if an image
+                // is completely out of the pano
+            }
+        };
+
+    private:
+        WeightedStitcher& m_stitcher;
+        const std::string& m_filename;
+        ImageType& m_panoImage;
+        AlphaType& m_alpha;
+        const vigra::Diff2D m_offset;
+        const unsigned int m_nImg;
+        const bool m_wrap;
+        const bool m_hardSeam;
+        const AdvancedOptions& m_advOptions;
+    };
+
     vigra::ImageImportInfo::ICCProfile iccProfile;
     vigra::Rect2D m_panoROI;
+    UIntVector m_blendingOrder;
 };
 
 
+/** stitcher for very large panoramas, which does not keep the complete
+ *  panorama in memory.
+ *
+ *  The output region is processed in horizontal bands with the height of
+ *  a tile, finished bands are written directly into a tiled TIFF (or BigTIFF)
+ *  file. Each image is remapped once, when the first band overlapping
+ *  its output region is processed, and released after the last band which
+ *  needs it. So only the band and the remapped images overlapping it are
+ *  in memory at the same time.
+ *
+ *  The seams are calculated for each band separately. The band is extended
+ *  by half a tile above and below, so that the seams of neighbouring bands
+ *  match at the band borders in most cases.
+ */
+template <typename ImageType, typename AlphaType>
+class TiledStitcher : public Stitcher<ImageType, AlphaType>
+{
+public:
+    typedef Stitcher<ImageType, AlphaType> Base;
+    typedef RemappedPanoImage<ImageType, AlphaType> RemappedImage;
+
+    TiledStitcher(const PanoramaData & pano,
+                  AppBase::ProgressDisplay* progress)
+        : Stitcher<ImageType, AlphaType>(pano, progress)
+    {
+    }
+
+    virtual ~TiledStitcher() {};
+
+    void stitch(const PanoramaOptions & opts, UIntSet & imgSet,
+                const std::string & filename,
+                SingleImageRemapper<ImageType, AlphaType> & remapper,
+                const AdvancedOptions& advOptions)
+    {
+        Base::stitch(opts, imgSet, filename, remapper);
+        // tile size needs to be a multiple of 16
+        const int tileSize = std::max(16, hugin_utils::roundi(GetAdvancedOption(advOptions, "tileSize", 512.0f) / 16) * 16);
+        const int margin = tileSize / 2;
+        const vigra::Rect2D roi = opts.getROI();
+        const bool wrap = (opts.getHFOV() == 360.0) && (opts.getWidth() == roi.width());
+        const bool hardSeam = GetAdvancedOption(advOptions, "hardSeam", true);
+        UIntVector images;
+        if (hardSeam)
+        {
+            std::copy(imgSet.begin(), imgSet.end(), std::back_inserter(images));
+        }
+        else
+        {
+            images = HuginBase::getEstimatedBlendingOrder(Base::m_pano, imgSet, opts.colorReferenceImage);
+        };
+
+        std::string basename = filename;
+        std::string cext = hugin_utils::tolower(hugin_utils::getExtension(basename));
+        // remove extension only if it specifies the same file type, otherwise
+        // its probably part of the filename.
+        if (cext == opts.getOutputExtension())
+        {
+            basename = hugin_utils::stripExtension(basename);
+        };
+        const std::string outputfile = basename + "." + opts.getOutputExtension();
+
+        vigra_ext::TiledTiffWriter<typename ImageType::value_type> writer;
+        vigra::ImageImportInfo::ICCProfile iccProfile;
+        // remapped images, which are needed by the following bands
+        std::map<unsigned int, RemappedImage*> remappedImages;
+        try
+        {
+            for (int bandTop = roi.top(); bandTop < roi.bottom(); bandTop += tileSize)
+            {
+                const int bandBottom = std::min(bandTop + tileSize, roi.bottom());
+                const vigra::Rect2D bandRect(roi.left(), std::max(roi.top(), bandTop - margin),
+                    roi.right(), std::min(roi.bottom(), bandBottom + margin));
+                ImageType bandImage(bandRect.size());
+                AlphaType bandMask(bandRect.size());
+                Base::m_progress->setMessage("Remapping and stitching", hugin_utils::stripPath(outputfile));
+                for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
+                {
+                    const vigra::Rect2D& imgROI = Base::m_rois[std::distance(imgSet.begin(), imgSet.find(*it))];
+                    if ((imgROI & bandRect).isEmpty())
+                    {
+                        continue;
+                    };
+                    RemappedImage* remapped = getRemapped(remappedImages, opts, *it, imgROI, remapper, advOptions);
+                    if (iccProfile.empty())
+                    {
+                        iccProfile = remapped->m_ICCProfile;
+                    };
+                    vigra::Rect2D overlap = remapped->boundingBox() & bandRect;
+                    if (overlap.isEmpty())
+                    {
+                        continue;
+                    };
+                    ImageType image(overlap.size());
+                    AlphaType mask(overlap.size());
+                    vigra::copyImage(vigra_ext::applyRect(overlap, vigra_ext::srcImageRange(*remapped)), vigra::destImage(image));
+                    vigra::copyImage(vigra_ext::applyRect(overlap, vigra_ext::srcMaskRange(*remapped)), vigra::destImage(mask));
+                    try
+                    {
+                        vigra_ext::MergeImages<ImageType, AlphaType>(bandImage, bandMask, image, mask,
+                            vigra::Diff2D(overlap.upperLeft() - bandRect.upperLeft()), wrap, hardSeam);
+                    }
+                    catch (vigra::PreconditionViolation & e)
+                    {
+                        DEBUG_ERROR("exception during stitching" << e.what());
+                    };
+                };
+                // release all images, which are not needed by the next band
+                const int nextBandRectTop = bandBottom - margin;
+                for (typename std::map<unsigned int, RemappedImage*>::iterator it = remappedImages.begin(); it != remappedImages.end();)
+                {
+                    if (it->second->boundingBox().bottom() <= nextBandRectTop)
+                    {
+                        remapper.release(it->second);
+                        remappedImages.erase(it++);
+                    }
+                    else
+                    {
+                        ++it;
+                    };
+                };
+                // write the finished band
+                if (!writer.isOpen())
+                {
+                    Base::m_progress->setMessage("saving result", hugin_utils::stripPath(outputfile));
+                    if (!writer.open(outputfile, roi.size(), tileSize, opts.tiffCompression, GetAdvancedOption(advOptions, "useBigTIFF", false),
+                        roi.upperLeft(), opts.getSize(), iccProfile, GetAdvancedOption(advOptions, "tiledOverviews", false)))
+                    {
+                        UTILS_THROW(std::runtime_error, "Could not create output file " << outputfile);
+                    };
+                };
+                const vigra::Diff2D bandOffset(0, bandTop - bandRect.top());
+                if (!writer.writeTileRow(bandTop - roi.top(), bandImage.upperLeft() + bandOffset, bandImage.accessor(),
+                    bandMask.upperLeft() + bandOffset, bandMask.accessor()))
+                {
+                    UTILS_THROW(std::runtime_error, "Could not write to output file " << outputfile);
+                };
+            };
+        }
+        catch (...)
+        {
+            releaseAll(remappedImages, remapper);
+            throw;
+        };
+        releaseAll(remappedImages, remapper);
+        if (!writer.close())
+        {
+            UTILS_THROW(std::runtime_error, "Could not write overviews to output file " << outputfile);
+        };
+    }
+
+protected:
+    /** return the remapped image @p imgNr, remaps it if it is not yet available */
+    RemappedImage* getRemapped(std::map<unsigned int, RemappedImage*>& remappedImages, const PanoramaOptions& opts,
+                               unsigned int imgNr, const vigra::Rect2D& imgROI,
+                               SingleImageRemapper<ImageType, AlphaType> & remapper, const AdvancedOptions& advOptions)
+    {
+        typename std::map<unsigned int, RemappedImage*>::iterator it = remappedImages.find(imgNr);
+        if (it != remappedImages.end())
+        {
+            return it->second;
+        };
+        PanoramaOptions modOptions(opts);
+        if (GetAdvancedOption(advOptions, "ignoreExposure", false))
+        {
+            modOptions.outputExposureValue = Base::m_pano.getImage(imgNr).getExposureValue();
+            modOptions.outputRangeCompression = 0.0;
+        };
+        RemappedImage* remapped = remapper.getRemapped(Base::m_pano, modOptions, imgNr, imgROI, Base::m_progress);
+        remappedImages[imgNr] = remapped;
+        return remapped;
+    }
+
+    /** release all remaining remapped images */
+    void releaseAll(std::map<unsigned int, RemappedImage*>& remappedImages, SingleImageRemapper<ImageType, AlphaType> & remapper)
+    {
+        for (typename std::map<unsigned int, RemappedImage*>::iterator it = remappedImages.begin(); it != remappedImages.end(); ++it)
+        {
+            remapper.release(it->second);
+        };
+        remappedImages.clear();
+    }
+};
+
 /** Difference reduce functor */
 template<class VALUETYPE>
 struct ReduceToDifferenceFunctor
@@ -664,6 +1108,10 @@ struct ReduceToDifferenceFunctor
 /** create a panorama using the reduce operation on all overlapping
  *  pixels. WARNING: this version is very memory hungry for large
  *  panoramas (> 3 images ;-)
+ *
+ *  The reduction to a HDR image with ReduceToHDRFunctor is an exception,
+ *  it adds the images one after the other to a ReduceToHDRAccumulator, so
+ *  only one remapped image is kept in memory.
  */
 template <typename ImageType, typename AlphaType>
 class ReduceStitcher : public Stitcher<ImageType, AlphaType>
@@ -696,7 +1144,7 @@ public:
         AlphaType panoMask(opts.getWidth(), opts.getHeight());
 
         stitch(opts, imgSet, vigra::destImageRange(pano), vigra::destImage(panoMask),
-               remapper, reduce);
+               remapper, reduce, advOptions);
 
     	std::string ext = opts.getOutputExtension();
         std::string cext = hugin_utils::tolower(hugin_utils::getExtension(basename));
@@ -747,12 +1195,17 @@ public:
                 vigra::triple<ImgIter, ImgIter, ImgAccessor> pano,
                 std::pair<AlphaIter, AlphaAccessor> alpha,
                 SingleImageRemapper<ImageType, AlphaType> & remapper,
-                FUNCTOR & reduce)
+                FUNCTOR & reduce,
+                const AdvancedOptions& advOptions = AdvancedOptions())
     {
         typedef typename vigra::NumericTraits<typename ImageType::value_type> Traits;
         typedef typename AlphaAccessor::value_type MaskType;
 
-        Base::stitch(opts, imgSet, "dummy", remapper);
+        if (!Base::hasOutputROIS(opts, imgSet))
+        {
+            // output regions not yet calculated
+            Base::stitch(opts, imgSet, "dummy", remapper);
+        };
 
         // remap all images..
         typedef std::vector<RemappedPanoImage<ImageType, AlphaType> *> RemappedVector;
@@ -807,6 +1260,63 @@ public:
         }
     }
 
+    /** reduce to a HDR image. Each image is added to the accumulator directly
+     *  after remapping and released afterwards. The advanced option
+     *  parallelImages is used for the remapping. */
+    template<class ImgIter, class ImgAccessor,
+             class AlphaIter, class AlphaAccessor,
+             class VALUETYPE>
+    void stitch(const PanoramaOptions & opts, UIntSet & imgSet,
+                vigra::triple<ImgIter, ImgIter, ImgAccessor> pano,
+                std::pair<AlphaIter, AlphaAccessor> alpha,
+                SingleImageRemapper<ImageType, AlphaType> & remapper,
+                vigra_ext::ReduceToHDRFunctor<VALUETYPE> & reduce,
+                const AdvancedOptions& advOptions = AdvancedOptions())
+    {
+        if (!Base::hasOutputROIS(opts, imgSet))
+        {
+            // output regions not yet calculated
+            Base::stitch(opts, imgSet, "dummy", remapper);
+        };
+
+        Base::m_progress->setMessage("Stitching");
+        vigra_ext::ReduceToHDRAccumulator<VALUETYPE> accumulator(vigra::Size2D(pano.second - pano.first));
+        // the exposure is part of the HDR merging, so only pass the
+        // option for the parallel remapping
+        AdvancedOptions remapOptions;
+        SetAdvancedOption(remapOptions, "parallelImages", GetAdvancedOption(advOptions, "parallelImages", 1.0f));
+        const UIntVector images(imgSet.begin(), imgSet.end());
+        AddFunctor<VALUETYPE> addFunctor(*this, accumulator, detail::canvasOffset(opts, vigra::Size2D(pano.second - pano.first)));
+        detail::remapImagesOrdered(Base::m_pano, opts, images, Base::m_rois, remapper, remapOptions, Base::m_progress, addFunctor);
+        accumulator.getResult(pano, alpha);
+    }
+
+protected:
+    /** adds each remapped image to the HDR accumulator */
+    template <class VALUETYPE>
+    class AddFunctor
+    {
+    public:
+        AddFunctor(ReduceStitcher& stitcher, vigra_ext::ReduceToHDRAccumulator<VALUETYPE>& accumulator, const vigra::Diff2D& offset)
+            : m_stitcher(stitcher), m_accumulator(accumulator), m_offset(offset)
+        {};
+
+        void operator()(RemappedPanoImage<ImageType, AlphaType>& remapped, unsigned int imgNr, const PanoramaOptions& modOptions)
+        {
+            if (m_stitcher.iccProfile.empty())
+            {
+                m_stitcher.iccProfile = remapped.m_ICCProfile;
+            };
+            m_accumulator.add(vigra::srcImageRange(remapped.m_image), vigra::srcImage(remapped.m_mask),
+                              vigra::Diff2D(remapped.boundingBox().upperLeft()) - m_offset);
+        };
+
+    private:
+        ReduceStitcher& m_stitcher;
+        vigra_ext::ReduceToHDRAccumulator<VALUETYPE>& m_accumulator;
+        const vigra::Diff2D m_offset;
+    };
+
 public:
     vigra::ImageImportInfo::ICCProfile iccProfile;
 };
@@ -992,8 +1502,19 @@ static void stitchPanoIntern(const PanoramaData & pano,
                 ReduceStitcher<ImageType, AlphaType> stitcher(pano, progress);
                 stitcher.stitch(opts, imgs, basename, m, hdrmerge, advOptions);
             } else {
-                WeightedStitcher<ImageType, AlphaType> stitcher(pano, progress);
                 m.setAdvancedOptions(advOptions);
+                if (opts.outputFormat == PanoramaOptions::TIFF && GetAdvancedOption(advOptions, "tiledOutput", false))
+                {
+                    if (opts.outputPixelType.empty() || opts.outputPixelType == vigra::TypeAsString<typename vigra_ext::ValueTypeTraits<typename ImageType::value_type>::value_type>::result())
+                    {
+                        TiledStitcher<ImageType, AlphaType> stitcher(pano, progress);
+                        stitcher.stitch(opts, imgs, basename, m, advOptions);
+                        break;
+                    };
+                    std::cerr << "Tiled output does not support the conversion to pixel type " << opts.outputPixelType
+                        << ", writing a normal TIFF file." << std::endl;
+                };
+                WeightedStitcher<ImageType, AlphaType> stitcher(pano, progress);
                 stitcher.stitch(opts, imgs, basename, m, advOptions);
             }
             break;
@@ -1025,10 +1546,47 @@ static void stitchPanoIntern(const PanoramaData & pano,
     }
 }
 
+/** stitch the images given in @p images into the panorama canvas and copy
+ *  the output region into the caller owned buffer @p output */
+template<typename ImageType, typename AlphaType>
+static void stitchPanoToMemoryIntern(const PanoramaData & pano,
+                                     const PanoramaOptions & opts,
+                                     AppBase::ProgressDisplay* progress,
+                                     const ImageBufferMap & images,
+                                     UIntSet imgs,
+                                     ImageBuffer & output,
+                                     const AdvancedOptions& advOptions)
+{
+    MemoryRemapper<ImageType, AlphaType> m;
+    m.setAdvancedOptions(advOptions);
+    m.setImages(images);
+    // only the output region is allocated, the stitchers place the
+    // remapped images relative to its upper left corner
+    ImageType panoImage(opts.getROI().size());
+    AlphaType panoMask(opts.getROI().size());
+    if (opts.outputMode == PanoramaOptions::OUTPUT_HDR) {
+        vigra_ext::ReduceToHDRFunctor<typename ImageType::value_type> hdrmerge;
+        ReduceStitcher<ImageType, AlphaType> stitcher(pano, progress);
+        stitcher.stitch(opts, imgs, vigra::destImageRange(panoImage), vigra::destImage(panoMask), m, hdrmerge);
+    } else {
+        WeightedStitcher<ImageType, AlphaType> stitcher(pano, progress);
+        stitcher.stitch(opts, imgs, std::string(), panoImage, panoMask, m, advOptions);
+    }
+    exportImageBuffer(panoImage, panoMask, vigra::Rect2D(panoImage.size()), output);
+}
+
 /** stitch a panorama
+ *
+ * For single TIFF output the advanced option tiledOutput selects the
+ * TiledStitcher, which does not keep the complete output image in memory,
+ * tiledOverviews adds reduced resolution overviews to the tiled file.
+ * The advanced option parallelImages sets the number of images, which are
+ * loaded and remapped at the same time for the blended and the multiple
+ * images output.
+ * For multiple images output writeQueueThreads > 0 writes the images in
+ * background threads, the queue is limited to writeQueueMemory MB.
  *
  * @todo vignetting correction
- * @todo do not keep complete output image in memory
  *
  */
 IMPEX void stitchPanorama(const PanoramaData & pano,
@@ -1038,6 +1596,23 @@ IMPEX void stitchPanorama(const PanoramaData & pano,
                     const UIntSet & usedImgs,
                     const AdvancedOptions& advOptions = AdvancedOptions());
 
+/** stitch a panorama from images in memory.
+ *
+ *  The images are given as caller owned buffers in @p images, the output region
+ *  of the panorama is written into @p output, which needs to have the size of
+ *  the output region. Its pixel type (UINT8, UINT16 or FLOAT) determines the
+ *  output pixel type, an extra band receives the alpha channel.
+ *  The output format of @p opts is ignored, blending is done as for the
+ *  single image formats (TIFF, JPEG).
+ */
+IMPEX void stitchPanoramaToMemory(const PanoramaData & pano,
+                    const PanoramaOptions & opts,
+                    AppBase::ProgressDisplay* progress,
+                    const ImageBufferMap & images,
+                    const UIntSet & usedImgs,
+                    ImageBuffer & output,
+                    const AdvancedOptions& advOptions = AdvancedOptions());
+
 // the instantiations of the stitching functions have been divided into two .cpp
 // files, because g++ will use too much memory otherwise (> 1.5 GB)
 
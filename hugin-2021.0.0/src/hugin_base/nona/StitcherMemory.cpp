@@ -0,0 +1,100 @@
+// -*- c-basic-offset: 4 -*-
+/** @file StitcherMemory.cpp
+ *
+ *  Stitching of images in memory into a caller owned buffer
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Stitcher.h"
+
+namespace HuginBase {
+namespace Nona {
+
+void stitchPanoramaToMemory(const PanoramaData & pano,
+                            const PanoramaOptions & opt,
+                            AppBase::ProgressDisplay* progress,
+                            const ImageBufferMap & images,
+                            const UIntSet & usedImgs,
+                            ImageBuffer & output,
+                            const AdvancedOptions& advOptions)
+{
+    if (usedImgs.empty())
+    {
+        UTILS_THROW(std::runtime_error, "No images to stitch");
+    };
+    // check that all images are available and have the same number of channels
+    for (UIntSet::const_iterator it = usedImgs.begin(); it != usedImgs.end(); ++it)
+    {
+        ImageBufferMap::const_iterator img = images.find(*it);
+        if (img == images.end() || img->second.data == NULL)
+        {
+            UTILS_THROW(std::runtime_error, "No pixel data given for image " << *it);
+        };
+        if (img->second.colorBands() != output.colorBands())
+        {
+            UTILS_THROW(std::runtime_error, "image " << *it << " has " << img->second.colorBands()
+                << " channels, while output uses: " << output.colorBands());
+        };
+    };
+
+    PanoramaOptions opts = opt;
+    opts.outputPixelType = output.pixelType;
+    if (opts.outputMode == PanoramaOptions::OUTPUT_HDR) {
+        if (output.pixelType != "FLOAT") {
+            UTILS_THROW(std::runtime_error, "HDR output requires pixel type FLOAT, not " << output.pixelType);
+        }
+    } else {
+        if (pano.getImage(*usedImgs.begin()).getResponseType() == HuginBase::BaseSrcPanoImage::RESPONSE_EMOR)
+        {
+            // get the emor parameters.
+            opts.outputEMoRParams = pano.getSrcImage(*usedImgs.begin()).getEMoRParams();
+        }
+        else
+        {
+            // clear the parameters to indicatate these should not be used
+            opts.outputEMoRParams.clear();
+        };
+    }
+
+    if (output.colorBands() == 1) {
+        if (output.pixelType == "UINT8") {
+            stitchPanoToMemoryIntern<vigra::BImage, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else if (output.pixelType == "UINT16") {
+            stitchPanoToMemoryIntern<vigra::UInt16Image, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else if (output.pixelType == "FLOAT") {
+            stitchPanoToMemoryIntern<vigra::FImage, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else {
+            UTILS_THROW(std::runtime_error, "Unsupported pixel type: " << output.pixelType);
+        }
+    } else if (output.colorBands() == 3) {
+        if (output.pixelType == "UINT8") {
+            stitchPanoToMemoryIntern<vigra::BRGBImage, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else if (output.pixelType == "UINT16") {
+            stitchPanoToMemoryIntern<vigra::UInt16RGBImage, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else if (output.pixelType == "FLOAT") {
+            stitchPanoToMemoryIntern<vigra::FRGBImage, vigra::BImage>(pano, opts, progress, images, usedImgs, output, advOptions);
+        } else {
+            UTILS_THROW(std::runtime_error, "Unsupported pixel type: " << output.pixelType);
+        }
+    } else {
+        DEBUG_ERROR("unsupported depth, only images with 1 and 3 channel images are supported");
+        throw std::runtime_error("unsupported depth, only images with 1 and 3 channel images are supported");
+    }
+}
+
+} // namespace Nona
+} // namespace HuginBase
@@ -28,6 +28,7 @@
 #include <functional>
 #include "hugin_config.h"
 #include <random>
+#include <type_traits>
 
 #include <vigra/stdimage.hxx>
 #include <vigra/numerictraits.hxx>
@@ -176,9 +177,40 @@ class InvResponseTransform : public ResponseTransform<VTIn>
 				vigra_ext::enforceMonotonicity(Base::m_lutR);
                 invertLUT();
 		        m_lutRInvFunc = vigra_ext::LUTFunctor<VT1, LUT>(m_lutRInv);
+                clearLUT();
 			}
 		}
 
+        /** create the lookup tables for the fast path of apply().
+         *
+         *  For 8 and 16 bit input and LDR output the inverse response, the
+         *  exposure and the white balance are combined into a single table
+         *  indexed by the input value, the radial vignetting correction is
+         *  tabulated as function of the squared radius and the range
+         *  compression and the output response are combined into a second table.
+         *  Must be called after setOutput() or setHDROutput(), calling one of
+         *  them again disables the fast path.
+         *  @return true, if the fast path is used, false for floating point
+         *          input or HDR output, which use always the exact calculation
+         */
+        bool createLUT();
+        /** return true, if apply() uses the lookup tables */
+        bool usesLUT() const { return m_useLUT; };
+        /** delete the lookup tables, apply() uses the exact calculation */
+        void clearLUT()
+        {
+            m_useLUT = false;
+            m_lutIn.clear();
+            m_lutInvVig.clear();
+            m_lutOut.clear();
+        };
+        /** compare the fast path with the exact calculation for all input values
+         *  at a grid of positions in the image.
+         *  @return the maximal difference, relative to the full output range
+         *          (without dithering)
+         */
+        double verifyLUT() const;
+
         /** Dithering is used to fool the eye into seeing gradients that are finer
          * than the precision of the pixel type.
          * This prevents the occurence of cleanly-bordered regions in the output where
@@ -226,6 +258,52 @@ class InvResponseTransform : public ResponseTransform<VTIn>
         void emitGLSL(std::ostringstream& oss, std::vector<double>& invLut, std::vector<double>& destLut) const;
 
     private:
+        /** exact calculation of the gray value, without dithering */
+        typename vigra::NumericTraits<dest_type>::RealPromote applyExact(VT1 v, const hugin_utils::FDiff2D & pos) const;
+        /** exact calculation of the color value, without dithering */
+        typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote applyExact(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos) const;
+        /** calculation of the gray value with the lookup tables, without dithering */
+        typename vigra::NumericTraits<dest_type>::RealPromote applyLUT(VT1 v, const hugin_utils::FDiff2D & pos) const;
+        /** calculation of the color value with the lookup tables, without dithering */
+        typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote applyLUT(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos) const;
+        /** return the inverse vignetting factor using the lookup table */
+        double invVigFactorLUT(const hugin_utils::FDiff2D & pos) const
+        {
+            if (!m_lutInvVig.empty())
+            {
+                const double dx = (pos.x - Base::m_RadialVigCorrCenter.x) * Base::m_radiusScale;
+                const double dy = (pos.y - Base::m_RadialVigCorrCenter.y) * Base::m_radiusScale;
+                const double f = (dx * dx + dy * dy) * m_lutInvVigScale;
+                const size_t i = static_cast<size_t>(f);
+                if (i + 1 < m_lutInvVig.size())
+                {
+                    const double a = f - i;
+                    return (1 - a) * m_lutInvVig[i] + a * m_lutInvVig[i + 1];
+                };
+            };
+            return 1.0 / Base::calcVigFactor(pos);
+        };
+        /** apply range compression and output response using the lookup table */
+        double applyOutputLUT(double v) const
+        {
+            if (m_lutOut.empty())
+            {
+                return v;
+            };
+            // same clipping as the output LUTFunctor
+            if (v < 0)
+            {
+                return 0;
+            };
+            const double f = v * m_lutOutScale;
+            const size_t i = static_cast<size_t>(f);
+            if (i + 1 >= m_lutOut.size())
+            {
+                return m_lutOut.back();
+            };
+            const double a = f - i;
+            return (1 - a) * m_lutOut[i] + a * m_lutOut[i + 1];
+        };
         void invertLUT()
         {
             m_lutRInv.clear();
@@ -249,6 +327,19 @@ class InvResponseTransform : public ResponseTransform<VTIn>
         bool m_hdrMode;
         double m_intScale;
         double m_rangeCompression;
+        // lookup tables of the fast path, see createLUT()
+        bool m_useLUT;
+        /** inverse response multiplied with the exposure correction, indexed by the input value */
+        LUT m_lutIn;
+        /** inverse white balance factors for red and blue */
+        double m_lutWhiteBalanceRed;
+        double m_lutWhiteBalanceBlue;
+        /** inverse radial vignetting factor, indexed by the squared normalized radius */
+        LUT m_lutInvVig;
+        double m_lutInvVigScale;
+        /** range compression and output response, for values in 0..1 */
+        LUT m_lutOut;
+        double m_lutOutScale;
 
     private:
         std::mt19937 Twister;
@@ -423,6 +514,7 @@ InvResponseTransform<VTIn,VTOut>::InvResponseTransform()
     m_hdrMode = false;
     m_rangeCompression = 0.0;
     m_intScale = 1;
+    clearLUT();
 }
 
 template <class VTIn, class VTOut>
@@ -431,6 +523,7 @@ InvResponseTransform<VTIn,VTOut>::InvResponseTransform(const HuginBase::SrcPanoI
 {
     m_destExposure = 1.0;
     m_intScale = 1;
+    clearLUT();
     if (!Base::m_lutR.empty()) {
         invertLUT();
         m_lutRInvFunc = vigra_ext::LUTFunctor<VT1, LUT>(m_lutRInv);
@@ -443,6 +536,7 @@ void InvResponseTransform<VTIn,VTOut>::init(const HuginBase::SrcPanoImage & src)
     m_destExposure = 1.0;
     m_intScale = 1;
     m_rangeCompression = 0.0;
+    clearLUT();
     Base::init(src);
     if (!Base::m_lutR.empty()) {
         invertLUT();
@@ -458,6 +552,7 @@ void InvResponseTransform<VTIn,VTOut>::setHDROutput(bool hdrMode, double destExp
     m_destExposure = destExposure;
     m_destLut.clear();
     m_rangeCompression = 0.0;
+    clearLUT();
 }
 
 template <class VTIn, class VTOut>
@@ -475,6 +570,122 @@ void InvResponseTransform<VTIn,VTOut>::setOutput(double destExposure, const LUTD
     };
     m_destExposure = destExposure;
     m_intScale = scale;
+    clearLUT();
+}
+
+template <class VTIn, class VTOut>
+bool InvResponseTransform<VTIn,VTOut>::createLUT()
+{
+    clearLUT();
+    // the input value is used as index, so only 8 and 16 bit unsigned input
+    // can be handled, HDR output needs the exact values
+    if (m_hdrMode || !std::is_integral<VT1>::value || !std::is_unsigned<VT1>::value || sizeof(VT1) > 2)
+    {
+        return false;
+    };
+    // inverse response and exposure
+    const double maxVal = vigra_ext::LUTTraits<VT1>::max();
+    const double exposure = m_destExposure / Base::m_srcExposure;
+    m_lutIn.resize(static_cast<size_t>(maxVal) + 1);
+    for (size_t i = 0; i < m_lutIn.size(); ++i)
+    {
+        const VT1 v = static_cast<VT1>(i);
+        if (!Base::m_lutR.empty())
+        {
+            m_lutIn[i] = m_lutRInvFunc(v) * exposure;
+        }
+        else
+        {
+            m_lutIn[i] = i / maxVal * exposure;
+        };
+    };
+    m_lutWhiteBalanceRed = 1.0 / Base::m_WhiteBalanceRed;
+    m_lutWhiteBalanceBlue = 1.0 / Base::m_WhiteBalanceBlue;
+    // radial vignetting, tabulated up to the image corners plus a small
+    // margin for the interpolation at the border, outside the exact value is used
+    if (Base::m_VigCorrMode & HuginBase::SrcPanoImage::VIGCORR_RADIAL)
+    {
+        const double width = Base::m_src.getSize().x;
+        const double height = Base::m_src.getSize().y;
+        double r2Max = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const double dx = ((i % 2 == 0) ? -2.0 - Base::m_RadialVigCorrCenter.x : width + 2.0 - Base::m_RadialVigCorrCenter.x) * Base::m_radiusScale;
+            const double dy = ((i / 2 == 0) ? -2.0 - Base::m_RadialVigCorrCenter.y : height + 2.0 - Base::m_RadialVigCorrCenter.y) * Base::m_radiusScale;
+            r2Max = std::max(r2Max, dx * dx + dy * dy);
+        };
+        const size_t nrEntries = 4096;
+        m_lutInvVigScale = nrEntries / r2Max;
+        m_lutInvVig.resize(nrEntries + 1);
+        for (size_t i = 0; i < m_lutInvVig.size(); ++i)
+        {
+            const double r2 = i / m_lutInvVigScale;
+            double vig = Base::m_RadialVigCorrCoeff[0];
+            double r = r2;
+            for (unsigned int j = 1; j < 4; j++)
+            {
+                vig += Base::m_RadialVigCorrCoeff[j] * r;
+                r *= r2;
+            };
+            if (!(vig > 1e-6))
+            {
+                // vignetting curve with zero crossing, use the exact calculation
+                clearLUT();
+                return false;
+            };
+            m_lutInvVig[i] = 1.0 / vig;
+        };
+    };
+    // range compression and output response, the output LUT clips values
+    // outside 0..1, so only this range needs to be tabulated. The table is a
+    // multiple of the output LUT, so without range compression it is exact.
+    if (!m_destLut.empty())
+    {
+        m_lutOut.resize(16 * (m_destLut.size() - 1) + 1);
+        m_lutOutScale = m_lutOut.size() - 1;
+        for (size_t i = 0; i < m_lutOut.size(); ++i)
+        {
+            double v = i / m_lutOutScale;
+            if (m_rangeCompression > 0.0)
+            {
+                v = log2(m_rangeCompression * v + 1) / log2(m_rangeCompression + 1);
+            };
+            m_lutOut[i] = m_destLutFunc(v);
+        };
+    };
+    m_useLUT = true;
+    return true;
+}
+
+template <class VTIn, class VTOut>
+double InvResponseTransform<VTIn,VTOut>::verifyLUT() const
+{
+    if (!m_useLUT)
+    {
+        return 0;
+    };
+    const double width = Base::m_src.getSize().x;
+    const double height = Base::m_src.getSize().y;
+    double maxError = 0;
+    // use the same value in all channels, so also the white balance is checked
+    for (int j = 0; j <= 4; ++j)
+    {
+        for (int i = 0; i <= 4; ++i)
+        {
+            const hugin_utils::FDiff2D pos(i * (width - 1) / 4.0, j * (height - 1) / 4.0);
+            for (size_t v = 0; v < m_lutIn.size(); ++v)
+            {
+                const vigra::RGBValue<VT1> value(static_cast<VT1>(v));
+                const typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote exact = applyExact(value, pos);
+                const typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote fast = applyLUT(value, pos);
+                for (size_t c = 0; c < 3; ++c)
+                {
+                    maxError = std::max<double>(maxError, std::abs(exact[c] - fast[c]));
+                };
+            };
+        };
+    };
+    return maxError;
 }
 
 
@@ -501,6 +712,25 @@ double InvResponseTransform<VTIn,VTOut>::dither(const double &v) const
 template <class VTIn, class VTOut>
 typename vigra::NumericTraits<typename InvResponseTransform<VTIn,VTOut>::dest_type>::RealPromote
 InvResponseTransform<VTIn,VTOut>::apply(VT1 v, const hugin_utils::FDiff2D & pos, vigra::VigraTrueType) const
+{
+    typename vigra::NumericTraits<dest_type>::RealPromote ret = m_useLUT ? applyLUT(v, pos) : applyExact(v, pos);
+    // dither all integer images
+    if ( m_intScale > 1) {
+        return dither(ret * m_intScale);
+    }
+    return ret;
+}
+
+template <class VTIn, class VTOut>
+typename vigra::NumericTraits<typename InvResponseTransform<VTIn,VTOut>::dest_type>::RealPromote
+InvResponseTransform<VTIn,VTOut>::applyLUT(VT1 v, const hugin_utils::FDiff2D & pos) const
+{
+    return applyOutputLUT(m_lutIn[static_cast<size_t>(v)] * invVigFactorLUT(pos));
+}
+
+template <class VTIn, class VTOut>
+typename vigra::NumericTraits<typename InvResponseTransform<VTIn,VTOut>::dest_type>::RealPromote
+InvResponseTransform<VTIn,VTOut>::applyExact(VT1 v, const hugin_utils::FDiff2D & pos) const
 {
     // inverse response
     typename vigra::NumericTraits<VT1>::RealPromote ret(v);
@@ -519,10 +749,6 @@ InvResponseTransform<VTIn,VTOut>::apply(VT1 v, const hugin_utils::FDiff2D & pos,
         };
         ret = m_destLutFunc(ret);
     }
-    // dither all integer images
-    if ( m_intScale > 1) {
-        return dither(ret * m_intScale);
-    }
     return ret;
 }
 
@@ -530,6 +756,32 @@ InvResponseTransform<VTIn,VTOut>::apply(VT1 v, const hugin_utils::FDiff2D & pos,
 template <class VTIn, class VTOut>
 typename vigra::NumericTraits<vigra::RGBValue<typename InvResponseTransform<VTIn,VTOut>::VT1> >::RealPromote
 InvResponseTransform<VTIn,VTOut>::apply(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos, vigra::VigraFalseType) const
+{
+    typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote ret = m_useLUT ? applyLUT(v, pos) : applyExact(v, pos);
+    // dither 8 bit images.
+    if (m_intScale > 1) {
+        for (size_t i=0; i < 3; i++) {
+            ret[i] = dither(ret[i] * m_intScale);
+        }
+    }
+    return ret;
+}
+
+template <class VTIn, class VTOut>
+typename vigra::NumericTraits<vigra::RGBValue<typename InvResponseTransform<VTIn,VTOut>::VT1> >::RealPromote
+InvResponseTransform<VTIn,VTOut>::applyLUT(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos) const
+{
+    const double vig = invVigFactorLUT(pos);
+    typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote ret;
+    ret.red() = applyOutputLUT(m_lutIn[static_cast<size_t>(v.red())] * vig * m_lutWhiteBalanceRed);
+    ret.green() = applyOutputLUT(m_lutIn[static_cast<size_t>(v.green())] * vig);
+    ret.blue() = applyOutputLUT(m_lutIn[static_cast<size_t>(v.blue())] * vig * m_lutWhiteBalanceBlue);
+    return ret;
+}
+
+template <class VTIn, class VTOut>
+typename vigra::NumericTraits<vigra::RGBValue<typename InvResponseTransform<VTIn,VTOut>::VT1> >::RealPromote
+InvResponseTransform<VTIn,VTOut>::applyExact(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos) const
 {
     typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote ret(v);
     if (!Base::m_lutR.empty()) {
@@ -552,12 +804,6 @@ InvResponseTransform<VTIn,VTOut>::apply(vigra::RGBValue<VT1> v, const hugin_util
         };
         ret = m_destLutFunc(ret);
     }
-    // dither 8 bit images.
-    if (m_intScale > 1) {
-        for (size_t i=0; i < 3; i++) {
-            ret[i] = dither(ret[i] * m_intScale);
-        }
-    }
     return ret;
 }
 
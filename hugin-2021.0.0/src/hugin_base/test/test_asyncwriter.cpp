@@ -0,0 +1,258 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_asyncwriter.cpp
+ *
+ *  @brief checks the memory budget and the error handling of AsyncWriter
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <nona/AsyncWriter.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** time after which a blocked push is considered blocked */
+    const std::chrono::milliseconds BlockTime(200);
+
+    /** keeps jobs running until it is opened */
+    class Gate
+    {
+    public:
+        Gate() : m_open(false) {};
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_open)
+            {
+                m_opened.wait(lock);
+            };
+        };
+        void open()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_open = true;
+            }
+            m_opened.notify_all();
+        };
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_opened;
+        bool m_open;
+    };
+
+    /** records the running jobs and the maximal memory of all running jobs */
+    struct JobStatistics
+    {
+        JobStatistics() : running(0), finished(0), memoryRunning(0), maxMemoryRunning(0) {};
+        std::mutex mutex;
+        int running;
+        int finished;
+        size_t memoryRunning;
+        size_t maxMemoryRunning;
+    };
+
+    /** job with a given memory usage, which waits for a gate and optionally throws */
+    class TestJob : public Nona::AsyncWriter::Job
+    {
+    public:
+        TestJob(JobStatistics& statistics, size_t memory, Gate* gate = NULL, bool fail = false) :
+            m_statistics(statistics), m_memory(memory), m_gate(gate), m_fail(fail)
+        {};
+        virtual void run()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_statistics.mutex);
+                ++m_statistics.running;
+                m_statistics.memoryRunning += m_memory;
+                m_statistics.maxMemoryRunning = std::max(m_statistics.maxMemoryRunning, m_statistics.memoryRunning);
+            }
+            if (m_gate != NULL)
+            {
+                m_gate->wait();
+            };
+            {
+                std::lock_guard<std::mutex> lock(m_statistics.mutex);
+                --m_statistics.running;
+                ++m_statistics.finished;
+                m_statistics.memoryRunning -= m_memory;
+            }
+            if (m_fail)
+            {
+                throw std::runtime_error("job failed");
+            };
+        };
+        virtual size_t getMemoryUsage() const { return m_memory; };
+    private:
+        JobStatistics& m_statistics;
+        const size_t m_memory;
+        Gate* m_gate;
+        const bool m_fail;
+    };
+
+    /** pushes a job from a second thread, so the caller can check if push blocks */
+    class BackgroundPush
+    {
+    public:
+        BackgroundPush(Nona::AsyncWriter& writer, Nona::AsyncWriter::Job* job) : m_returned(false)
+        {
+            m_thread = std::thread([this, &writer, job]()
+            {
+                writer.push(job);
+                m_returned = true;
+            });
+        };
+        ~BackgroundPush()
+        {
+            m_thread.join();
+        };
+        bool returned() const { return m_returned; };
+    private:
+        std::thread m_thread;
+        std::atomic<bool> m_returned;
+    };
+
+    /** all jobs are started and finished */
+    bool AllFinished(JobStatistics& statistics, int count)
+    {
+        std::lock_guard<std::mutex> lock(statistics.mutex);
+        return statistics.finished == count && statistics.running == 0;
+    };
+}
+
+int main()
+{
+    // push blocks, while a running job uses most of the budget
+    {
+        JobStatistics statistics;
+        Gate gate;
+        Nona::AsyncWriter writer(2, 100);
+        writer.push(new TestJob(statistics, 60, &gate));
+        {
+            BackgroundPush push(writer, new TestJob(statistics, 60));
+            std::this_thread::sleep_for(BlockTime);
+            check(!push.returned(), "push blocks while the budget is exhausted");
+            gate.open();
+        }
+        writer.wait();
+        check(AllFinished(statistics, 2), "blocked job is run after the first job finished");
+        check(statistics.maxMemoryRunning <= 100, "running jobs stay within the budget");
+    }
+
+    // jobs, which fit into the budget together, run concurrently
+    {
+        JobStatistics statistics;
+        Gate gate;
+        Nona::AsyncWriter writer(2, 100);
+        writer.push(new TestJob(statistics, 40, &gate));
+        {
+            BackgroundPush push(writer, new TestJob(statistics, 40, &gate));
+            std::this_thread::sleep_for(BlockTime);
+            check(push.returned(), "push does not block within the budget");
+            gate.open();
+        }
+        writer.wait();
+        check(AllFinished(statistics, 2), "jobs within the budget are finished");
+        check(statistics.maxMemoryRunning == 80, "jobs within the budget run concurrently");
+    }
+
+    // an exception of a job is rethrown by wait, the other jobs are still run
+    {
+        JobStatistics statistics;
+        Gate gate;
+        Nona::AsyncWriter writer(2, 100);
+        // the failing job waits until all jobs are queued, otherwise push
+        // would already rethrow the exception
+        writer.push(new TestJob(statistics, 10, &gate, true));
+        writer.push(new TestJob(statistics, 10));
+        writer.push(new TestJob(statistics, 10));
+        gate.open();
+        bool rethrown = false;
+        try
+        {
+            writer.wait();
+        }
+        catch (std::runtime_error& e)
+        {
+            rethrown = std::string(e.what()) == "job failed";
+        };
+        check(rethrown, "wait rethrows the exception of a job");
+        check(AllFinished(statistics, 3), "all jobs are run despite the exception");
+        bool thrownAgain = false;
+        try
+        {
+            writer.wait();
+        }
+        catch (...)
+        {
+            thrownAgain = true;
+        };
+        check(!thrownAgain, "the exception is rethrown only once");
+    }
+
+    // a single job larger than the budget is accepted, when nothing is pending,
+    // otherwise it waits until all pending jobs are finished
+    {
+        JobStatistics statistics;
+        Gate gate;
+        Nona::AsyncWriter writer(2, 100);
+        {
+            BackgroundPush push(writer, new TestJob(statistics, 500));
+            std::this_thread::sleep_for(BlockTime);
+            check(push.returned(), "oversized job is accepted by an empty writer");
+        }
+        writer.wait();
+        check(AllFinished(statistics, 1), "oversized job is run");
+        writer.push(new TestJob(statistics, 10, &gate));
+        {
+            BackgroundPush push(writer, new TestJob(statistics, 500));
+            std::this_thread::sleep_for(BlockTime);
+            check(!push.returned(), "oversized job waits for the pending jobs");
+            gate.open();
+        }
+        writer.wait();
+        check(AllFinished(statistics, 3), "oversized job is run after the pending jobs");
+        check(statistics.maxMemoryRunning == 500, "oversized job runs alone");
+    }
+
+    if (failures == 0)
+    {
+        std::cout << "all async writer tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
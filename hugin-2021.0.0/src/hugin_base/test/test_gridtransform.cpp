@@ -0,0 +1,185 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_gridtransform.cpp
+ *
+ *  @brief checks that the adaptive GridTransform stays within its tolerance
+ *         of the exact transform and falls back to the exact transform at
+ *         discontinuities
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <nona/GridTransform.h>
+#include <panotools/PanoToolsInterface.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    PanoramaOptions CreateOptions()
+    {
+        PanoramaOptions opts;
+        opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+        opts.setHFOV(360);
+        opts.setWidth(720);
+        opts.setHeight(360);
+        return opts;
+    };
+
+    /** maximal distance between grid and exact transform at all pixels and
+     *  pixel centers of the roi, which are mapped inside the source image */
+    double MaxError(const Nona::GridTransform& grid, const PTools::Transform& exact, const SrcPanoImage& src,
+        const vigra::Rect2D& roi)
+    {
+        const double offsets[] = { 0.0, 0.25, 0.5 };
+        double maxError = 0;
+        for (int y = roi.top(); y < roi.bottom(); ++y)
+        {
+            for (int x = roi.left(); x < roi.right(); ++x)
+            {
+                for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+                {
+                    double xExact, yExact;
+                    if (!exact.transformImgCoord(xExact, yExact, x + offsets[i], y + offsets[i]) ||
+                        xExact < 0 || xExact > src.getWidth() || yExact < 0 || yExact > src.getHeight())
+                    {
+                        continue;
+                    };
+                    double xGrid, yGrid;
+                    if (!grid.transformImgCoord(xGrid, yGrid, x + offsets[i], y + offsets[i]))
+                    {
+                        return std::numeric_limits<double>::infinity();
+                    };
+                    const double error = std::sqrt((xGrid - xExact) * (xGrid - xExact) + (yGrid - yExact) * (yGrid - yExact));
+                    if (!(error <= maxError))
+                    {
+                        maxError = std::isnan(error) ? std::numeric_limits<double>::infinity() : error;
+                    };
+                };
+            };
+        };
+        return maxError;
+    };
+}
+
+int main()
+{
+    const PanoramaOptions opts = CreateOptions();
+
+    // a smooth transform is interpolated within the tolerance with much
+    // fewer exact evaluations
+    {
+        SrcPanoImage src;
+        src.setSize(vigra::Size2D(300, 200));
+        src.setProjection(SrcPanoImage::RECTILINEAR);
+        src.setHFOV(60);
+        src.setYaw(20);
+        src.setPitch(35);
+        src.setRoll(5);
+        const vigra::Rect2D roi(330, 30, 500, 150);
+        PTools::Transform exact;
+        exact.createTransform(src, opts);
+        const double tolerances[] = { 0.2, 0.05, 0.01 };
+        for (size_t i = 0; i < sizeof(tolerances) / sizeof(tolerances[0]); ++i)
+        {
+            Nona::GridTransform grid;
+            grid.create(src, opts, roi, 16, tolerances[i]);
+            std::ostringstream name;
+            name << "rectilinear image, tolerance " << tolerances[i];
+            check(grid.isValid(), name.str() + ": grid is created");
+            check(grid.getNumberOfEvaluations() < static_cast<size_t>(roi.area()) / 2, name.str() + ": grid saves evaluations");
+            const double maxError = MaxError(grid, exact, src, roi);
+            std::ostringstream description;
+            description << name.str() << ": grid stays within tolerance (max error " << maxError << " pixel)";
+            check(maxError <= tolerances[i], description.str());
+        };
+    };
+
+    // the +-180 degree seam of a full spherical image is a discontinuity,
+    // the cells crossing it use the exact transform
+    {
+        SrcPanoImage src;
+        src.setSize(vigra::Size2D(720, 360));
+        src.setProjection(SrcPanoImage::EQUIRECTANGULAR);
+        src.setHFOV(360);
+        src.setYaw(100);
+        src.setPitch(10);
+        const vigra::Rect2D roi(0, 40, 720, 320);
+        PTools::Transform exact;
+        exact.createTransform(src, opts);
+        const double tolerance = 0.05;
+        Nona::GridTransform grid;
+        grid.create(src, opts, roi, 16, tolerance);
+        check(grid.isValid(), "spherical image: grid is created");
+        check(grid.getNumberOfExactCells() > 0, "spherical image: some cells are transformed exactly");
+
+        // find the pixels next to the seam, there the source coordinate jumps
+        // by nearly the image width between neighbouring pixels
+        int seamPixels = 0;
+        bool seamExact = true;
+        for (int y = roi.top(); y < roi.bottom(); ++y)
+        {
+            for (int x = roi.left(); x + 1 < roi.right(); ++x)
+            {
+                double x0, y0, x1, y1;
+                if (!exact.transformImgCoord(x0, y0, x, y) || !exact.transformImgCoord(x1, y1, x + 1, y) ||
+                    std::abs(x1 - x0) < src.getWidth() / 2)
+                {
+                    continue;
+                };
+                ++seamPixels;
+                for (int i = 0; i < 2; ++i)
+                {
+                    double xExact, yExact, xGrid, yGrid;
+                    exact.transformImgCoord(xExact, yExact, x + i, y);
+                    if (!grid.transformImgCoord(xGrid, yGrid, x + i, y) || xGrid != xExact || yGrid != yExact)
+                    {
+                        seamExact = false;
+                    };
+                };
+            };
+        };
+        check(seamPixels >= roi.height(), "spherical image: seam crosses every row of the roi");
+        check(seamExact, "spherical image: pixels at the seam are transformed exactly");
+        const double maxError = MaxError(grid, exact, src, roi);
+        std::ostringstream description;
+        description << "spherical image: grid stays within tolerance (max error " << maxError << " pixel)";
+        check(maxError <= tolerance, description.str());
+    };
+
+    if (failures == 0)
+    {
+        std::cout << "all grid transform tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_hdrmerge.cpp
+ *
+ *  @brief checks that ReduceToHDRAccumulator, which adds one image after
+ *         the other, gives the result of ReduceToHDRFunctor
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <vigra_ext/HDRUtils.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    const int Width = 48;
+    const int Height = 32;
+
+    /** one image of the bracketed stack, placed at offset in the output */
+    struct Exposure
+    {
+        vigra::FRGBImage image;
+        vigra::BImage mask;
+        vigra::Diff2D offset;
+    };
+
+    /** scene radiance, includes a bright block which is overexposed in all
+     *  images and a region which is dark in all images */
+    vigra::RGBValue<double> Radiance(int x, int y)
+    {
+        if (x >= 4 && x < 10 && y >= 4 && y < 10)
+        {
+            return vigra::RGBValue<double>(50.0, 40.0, 30.0);
+        };
+        const double base = 0.002 + 2.0 * (x + Width * y) / (Width * Height);
+        return vigra::RGBValue<double>(base, 0.8 * base + 0.01 * (x % 5), 0.6 * base + 0.02 * (y % 3));
+    };
+
+    /** create the stack with exposure factors 1/4, 1 and 4, the mask is the
+     *  clipped brightness like in a remapped image, pixels outside the image
+     *  and every 11th pixel have mask 0 */
+    std::vector<Exposure> CreateStack()
+    {
+        const double factors[] = { 0.25, 1.0, 4.0 };
+        const vigra::Diff2D offsets[] = { vigra::Diff2D(0, 0), vigra::Diff2D(3, -2), vigra::Diff2D(-5, 4) };
+        std::vector<Exposure> stack(3);
+        for (int i = 0; i < 3; ++i)
+        {
+            Exposure& exposure = stack[i];
+            exposure.image.resize(Width, Height);
+            exposure.mask.resize(Width, Height);
+            exposure.offset = offsets[i];
+            for (int y = 0; y < Height; ++y)
+            {
+                for (int x = 0; x < Width; ++x)
+                {
+                    const vigra::RGBValue<double> radiance = Radiance(x + offsets[i].x, y + offsets[i].y);
+                    const double brightness = std::max(radiance.red(), std::max(radiance.green(), radiance.blue())) * factors[i];
+                    // the linearized value, which varies a little between the
+                    // images, as in a real stack
+                    exposure.image(x, y) = vigra::RGBValue<float>(radiance * (1.0 + 0.01 * i));
+                    exposure.mask(x, y) = static_cast<vigra::UInt8>(std::min(255.0, std::floor(255.0 * brightness + 0.5)));
+                    if ((x + 7 * y + i) % 11 == 0)
+                    {
+                        exposure.mask(x, y) = 0;
+                    };
+                };
+            };
+        };
+        return stack;
+    };
+
+    bool Close(const vigra::RGBValue<float>& a, const vigra::RGBValue<float>& b)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            if (!(std::abs(a[i] - b[i]) <= 1e-6f * std::max(1.0f, std::abs(b[i]))))
+            {
+                return false;
+            };
+        };
+        return true;
+    };
+}
+
+int main()
+{
+    const std::vector<Exposure> stack = CreateStack();
+
+    // add the images one after the other
+    vigra_ext::ReduceToHDRAccumulator<vigra::RGBValue<float> > accumulator(vigra::Size2D(Width, Height));
+    for (size_t i = 0; i < stack.size(); ++i)
+    {
+        accumulator.add(vigra::srcImageRange(stack[i].image), vigra::srcImage(stack[i].mask), stack[i].offset);
+    };
+    vigra::FRGBImage accumulated(Width, Height);
+    vigra::BImage accumulatedMask(Width, Height);
+    accumulator.getResult(vigra::destImageRange(accumulated), vigra::destImage(accumulatedMask));
+
+    // the functor gets all values of a pixel at once
+    bool sameMask = true;
+    bool sameValues = true;
+    int overexposed = 0;
+    int covered = 0;
+    for (int y = 0; y < Height; ++y)
+    {
+        for (int x = 0; x < Width; ++x)
+        {
+            vigra_ext::ReduceToHDRFunctor<vigra::RGBValue<float> > reduce;
+            bool used = false;
+            bool allOver = true;
+            for (size_t i = 0; i < stack.size(); ++i)
+            {
+                const vigra::Point2D p = vigra::Point2D(x, y) - stack[i].offset;
+                if (p.x < 0 || p.y < 0 || p.x >= Width || p.y >= Height || stack[i].mask[p] == 0)
+                {
+                    continue;
+                };
+                reduce(stack[i].image[p], stack[i].mask[p]);
+                used = true;
+                allOver = allOver && stack[i].mask[p] == 255;
+            };
+            if (used != (accumulatedMask(x, y) > 0))
+            {
+                sameMask = false;
+            };
+            if (!used)
+            {
+                continue;
+            };
+            ++covered;
+            if (allOver)
+            {
+                ++overexposed;
+            };
+            const vigra::RGBValue<float> expected = vigra::NumericTraits<vigra::RGBValue<float> >::fromRealPromote(reduce());
+            if (!Close(accumulated(x, y), expected))
+            {
+                sameValues = false;
+            };
+        };
+    };
+    check(covered > Width * Height / 2, "stack covers the output");
+    check(overexposed > 0, "some pixels are overexposed in all images");
+    check(overexposed < covered, "most pixels are well exposed in some image");
+    check(sameMask, "accumulator covers the pixels with values");
+    check(sameValues, "accumulator gives the values of ReduceToHDRFunctor");
+
+    if (failures == 0)
+    {
+        std::cout << "all HDR merge tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_imagecache.cpp
+ *
+ *  @brief checks that ImageCache evicts the least recently used images,
+ *         restores spilled images from their scratch files and keeps
+ *         prefetched images within the upper limit
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <vigra/impex.hxx>
+#include <huginapp/ImageCache.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** a different image for each @p index */
+    vigra::BRGBImage CreateImage(int index)
+    {
+        vigra::BRGBImage image(64, 48);
+        for (int y = 0; y < image.height(); ++y)
+        {
+            for (int x = 0; x < image.width(); ++x)
+            {
+                image(x, y) = vigra::RGBValue<vigra::UInt8>(static_cast<vigra::UInt8>(x + 40 * index),
+                    static_cast<vigra::UInt8>(y + 20 * index), static_cast<vigra::UInt8>(x * y + index));
+            };
+        };
+        return image;
+    };
+
+    /** write the test images and return their file names */
+    std::vector<std::string> WriteImages(const std::string& dir, int count)
+    {
+        std::vector<std::string> filenames;
+        for (int i = 0; i < count; ++i)
+        {
+            const std::string filename(dir + "/test_imagecache_" + std::string(1, static_cast<char>('a' + i)) + ".tif");
+            const vigra::BRGBImage image = CreateImage(i);
+            vigra::exportImage(vigra::srcImageRange(image), vigra::ImageExportInfo(filename.c_str()));
+            filenames.push_back(filename);
+        };
+        return filenames;
+    };
+
+    bool SamePixels(const ImageCache::EntryPtr& entry, int index)
+    {
+        const vigra::BRGBImage expected = CreateImage(index);
+        if (!entry || entry->image8->size() != expected.size())
+        {
+            return false;
+        };
+        for (int y = 0; y < expected.height(); ++y)
+        {
+            for (int x = 0; x < expected.width(); ++x)
+            {
+                if ((*entry->image8)(x, y) != expected(x, y))
+                {
+                    return false;
+                };
+            };
+        };
+        return true;
+    };
+
+    /** loads images a, b and c, uses a again and then loads d, the upper
+     *  limit allows 3.5 images, so softFlush() has to evict two images
+     *  @return memory used by a single image */
+    unsigned long long LoadImages(ImageCache& cache, const std::vector<std::string>& filenames)
+    {
+        cache.getImage(filenames[0]);
+        const unsigned long long imageSize = cache.getStatistics().memoryUsed;
+        cache.SetUpperLimit(imageSize * 7 / 2);
+        cache.getImage(filenames[1]);
+        cache.getImage(filenames[2]);
+        cache.getImage(filenames[0]);
+        cache.softFlush();
+        check(cache.getStatistics().evictions == 0, "no eviction below the upper limit");
+        cache.getImage(filenames[3]);
+        cache.softFlush();
+        return imageSize;
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string dir(argc > 1 ? argv[1] : ".");
+    const std::vector<std::string> filenames = WriteImages(dir, 4);
+    ImageCache& cache = ImageCache::getInstance();
+
+    // least recently used images are evicted first: b and c, not a, which
+    // was loaded first, but used again
+    {
+        cache.SetSpillLimit(0);
+        cache.flush();
+        cache.resetStatistics();
+        const unsigned long long imageSize = LoadImages(cache, filenames);
+        const ImageCache::Statistics statistics = cache.getStatistics();
+        check(imageSize > 0, "image uses memory");
+        check(statistics.evictions == 2, "two images are evicted");
+        check(statistics.memoryUsed == 2 * imageSize, "two images stay in memory");
+        check(statistics.spills == 0, "no image is spilled without spill limit");
+        check(cache.getImageIfAvailable(filenames[0]).get() != NULL, "recently used image stays in cache");
+        check(cache.getImageIfAvailable(filenames[3]).get() != NULL, "newest image stays in cache");
+        check(cache.getImageIfAvailable(filenames[1]).get() == NULL, "least recently used image is evicted");
+        check(cache.getImageIfAvailable(filenames[2]).get() == NULL, "second least recently used image is evicted");
+    }
+
+    // a prefetched image is taken over by getImage, finished prefetches
+    // count against the upper limit
+    {
+        cache.SetSpillLimit(0);
+        cache.SetUpperLimit(100 * 1024 * 1024);
+        cache.setPrefetchThreads(2);
+        cache.flush();
+        cache.resetStatistics();
+        check(cache.prefetchImage(filenames[0]).get().get() != NULL, "prefetch loads the image");
+        const ImageCache::EntryPtr prefetched = cache.getImage(filenames[0]);
+        ImageCache::Statistics statistics = cache.getStatistics();
+        check(statistics.prefetchHits == 1, "getImage takes the prefetched image");
+        check(statistics.misses == 0, "prefetched image is not loaded again");
+        check(SamePixels(prefetched, 0), "prefetched image has the original pixels");
+        const unsigned long long imageSize = statistics.memoryUsed;
+
+        cache.flush();
+        cache.resetStatistics();
+        cache.SetUpperLimit(imageSize * 7 / 2);
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            cache.prefetchImage(filenames[i]).wait();
+        };
+        cache.softFlush();
+        statistics = cache.getStatistics();
+        check(statistics.evictions == 2, "finished prefetches are evicted above the upper limit");
+        check(statistics.memoryUsed == 2 * imageSize, "finished prefetches are counted as used memory");
+        bool samePixels = true;
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            samePixels = samePixels && SamePixels(cache.getImage(filenames[i]), static_cast<int>(i));
+        };
+        check(samePixels, "getImage after prefetch gives the original pixels");
+        statistics = cache.getStatistics();
+        check(statistics.hits == 2 && statistics.misses == 2, "getImage finds the prefetches, which were not evicted");
+    }
+
+    // evicted images are spilled to scratch files and restored from there,
+    // even when the image file itself is gone
+    {
+        cache.SetSpillLimit(1024 * 1024, dir);
+        cache.flush();
+        cache.resetStatistics();
+        LoadImages(cache, filenames);
+        ImageCache::Statistics statistics = cache.getStatistics();
+        check(statistics.evictions == 2, "two images are evicted with spill limit");
+        check(statistics.spills == 2, "evicted images are spilled");
+        check(statistics.spillUsed > 0, "scratch files use space");
+        check(statistics.misses == 4, "each image is loaded once from disc");
+        std::remove(filenames[1].c_str());
+        const ImageCache::EntryPtr restored = cache.getImage(filenames[1]);
+        statistics = cache.getStatistics();
+        check(statistics.spillHits == 1, "spilled image is restored from scratch file");
+        check(statistics.misses == 4, "spilled image is not loaded from disc");
+        check(SamePixels(restored, 1), "restored image has the original pixels");
+        check(cache.getImageIfAvailable(filenames[2]).get() != NULL, "spilled image is available without loading");
+        check(cache.getStatistics().spillHits == 2, "second spilled image is restored");
+        check(cache.getStatistics().spillUsed == 0, "restored images remove their scratch files");
+    }
+    cache.flush();
+    cache.SetSpillLimit(0);
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        std::remove(filenames[i].c_str());
+    };
+
+    if (failures == 0)
+    {
+        std::cout << "all image cache tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
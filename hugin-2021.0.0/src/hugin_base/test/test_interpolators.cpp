@@ -0,0 +1,241 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_interpolators.cpp
+ *
+ *  @brief checks that the vectorized interpolation kernels give the same
+ *         results as ImageInterpolator, especially near the image border
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <vigra/basicimageview.hxx>
+#include <vigra_ext/ImageTransforms.h>
+#include <vigra_ext/utils.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    const int ImageWidth = 40;
+    const int ImageHeight = 30;
+    /** the image is surrounded by this number of pixels with a marker value,
+     *  an interpolated value which contains a marker pixel indicates a read
+     *  outside of the image */
+    const int Padding = 4;
+
+    /** float image with NaN as marker, NaN stays NaN even with zero weight */
+    struct FloatPixel
+    {
+        typedef float PixelType;
+        static PixelType Marker() { return std::numeric_limits<float>::quiet_NaN(); };
+        static PixelType Value(int x, int y) { return static_cast<float>(0.5 + 0.2 * sin(x / 3.0) + 0.1 * cos(y / 2.0)); };
+        static bool Close(PixelType a, PixelType b) { return std::abs(a - b) <= 1e-4; };
+    };
+
+    /** 8 bit RGB image, the marker is far outside the range of the values */
+    struct RGBPixel
+    {
+        typedef vigra::RGBValue<vigra::UInt8> PixelType;
+        static PixelType Marker() { return PixelType(255, 255, 255); };
+        static PixelType Value(int x, int y)
+        {
+            return PixelType(static_cast<vigra::UInt8>(40 + (7 * x + 3 * y) % 60), static_cast<vigra::UInt8>(40 + (5 * x * y) % 60),
+                static_cast<vigra::UInt8>(100 - x - y));
+        };
+        static bool Close(PixelType a, PixelType b)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                if (std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])) > 1)
+                {
+                    return false;
+                };
+            };
+            return true;
+        };
+    };
+
+    /** coordinates along one axis of length @p size: the image center and
+     *  points within half a pixel of all positions where the interpolation
+     *  kernel reaches the border */
+    std::vector<double> BorderCoordinates(int size, int kernelSize)
+    {
+        const double offsets[] = { -0.5, -0.3, -1e-6, -1e-9, 0.0, 1e-9, 1e-6, 0.3, 0.49 };
+        const int borders[] = { 0, kernelSize / 2, kernelSize / 2 + 1, size - kernelSize / 2 - 1, size - kernelSize / 2, size };
+        std::vector<double> coords;
+        coords.push_back(size / 2 + 0.25);
+        for (size_t i = 0; i < sizeof(borders) / sizeof(borders[0]); ++i)
+        {
+            for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j)
+            {
+                coords.push_back(borders[i] + offsets[j]);
+            };
+        };
+        return coords;
+    };
+
+    /** maps each output pixel to a given source coordinate */
+    struct CoordinateListTransform
+    {
+        std::vector<double> xs;
+        std::vector<double> ys;
+
+        bool transformImgCoord(double& sx, double& sy, double x, double y) const
+        {
+            sx = xs[static_cast<size_t>(x)];
+            sy = ys[static_cast<size_t>(y)];
+            return true;
+        };
+    };
+
+    const char* InstructionSetName(vigra_ext::simd::InstructionSet instructionSet)
+    {
+        switch (instructionSet)
+        {
+            case vigra_ext::simd::SIMD_AVX2:
+                return "AVX2";
+            case vigra_ext::simd::SIMD_SSE41:
+                return "SSE4.1";
+            default:
+                return "scalar";
+        };
+    };
+
+    template <class TRAITS, class INTERPOLATOR>
+    void TestInterpolator(const std::string& name)
+    {
+        typedef typename TRAITS::PixelType PixelType;
+        typedef vigra::BasicImageView<PixelType> ImageView;
+        typedef vigra_ext::detail::SIMDPixelTraits<PixelType> PixelTraits;
+        typedef vigra_ext::ImageInterpolator<typename ImageView::const_traverser, typename ImageView::ConstAccessor, INTERPOLATOR> Interpolator;
+
+        // the image is a view into a larger buffer with marker pixels around it
+        const int bufferWidth = ImageWidth + 2 * Padding;
+        std::vector<PixelType> buffer(bufferWidth * (ImageHeight + 2 * Padding), TRAITS::Marker());
+        for (int y = 0; y < ImageHeight; ++y)
+        {
+            for (int x = 0; x < ImageWidth; ++x)
+            {
+                buffer[(y + Padding) * bufferWidth + x + Padding] = TRAITS::Value(x, y);
+            };
+        };
+        const ImageView image(&buffer[Padding * bufferWidth + Padding], ImageWidth, ImageHeight, bufferWidth);
+        INTERPOLATOR interp;
+        const Interpolator interpol(vigra::srcImageRange(image), interp, false);
+
+        CoordinateListTransform transform;
+        transform.xs = BorderCoordinates(ImageWidth, INTERPOLATOR::size);
+        transform.ys = BorderCoordinates(ImageHeight, INTERPOLATOR::size);
+
+        const vigra_ext::simd::InstructionSet supported = vigra_ext::simd::GetSupportedInstructionSet();
+        for (int set = vigra_ext::simd::SIMD_SCALAR; set <= supported; ++set)
+        {
+            const vigra_ext::simd::InstructionSet instructionSet = static_cast<vigra_ext::simd::InstructionSet>(set);
+            vigra_ext::simd::SetInstructionSet(instructionSet);
+            const std::string description = name + ", " + InstructionSetName(instructionSet);
+
+            // the batch kernel at all float coordinates which ImageInterpolator
+            // interpolates without boundary handling
+            const vigra_ext::simd::BatchInterpolator batchInterpol(image.data(), ImageWidth, ImageHeight, bufferWidth * PixelTraits::channels,
+                PixelTraits::channels, PixelTraits::type, vigra_ext::detail::SIMDKernelTraits<INTERPOLATOR>::kernel);
+            check(batchInterpol.isValid(), description + ": kernel exists");
+            if (!batchInterpol.isValid())
+            {
+                continue;
+            };
+            bool batchMatches = true;
+            int insidePoints = 0;
+            for (size_t j = 0; j < transform.ys.size(); ++j)
+            {
+                for (size_t i = 0; i < transform.xs.size(); ++i)
+                {
+                    const float fx = static_cast<float>(transform.xs[i]);
+                    const float fy = static_cast<float>(transform.ys[j]);
+                    if (!interpol.isInside(fx, fy))
+                    {
+                        continue;
+                    };
+                    ++insidePoints;
+                    float values[PixelTraits::channels];
+                    batchInterpol(&fx, &fy, 1, values);
+                    PixelType expected;
+                    if (!interpol(fx, fy, expected) || !TRAITS::Close(PixelTraits::fromFloat(values), expected))
+                    {
+                        batchMatches = false;
+                    };
+                };
+            };
+            check(insidePoints > 0, description + ": some points are inside");
+            check(batchMatches, description + ": BatchInterpolator gives the values of ImageInterpolator");
+
+            // transformImage with coordinates, which are inside in double
+            // precision, but on the border in float precision
+            vigra::BasicImage<PixelType> remapped(transform.xs.size(), transform.ys.size());
+            vigra::BImage alpha(remapped.size());
+            vigra_ext::PassThroughFunctor<PixelType> identity;
+            vigra_ext::transformImageIntern(vigra::srcImageRange(image), vigra::destImageRange(remapped), vigra::destImage(alpha),
+                transform, identity, vigra::Diff2D(0, 0), interp, false, NULL, true);
+            bool remapMatches = true;
+            for (size_t j = 0; j < transform.ys.size(); ++j)
+            {
+                for (size_t i = 0; i < transform.xs.size(); ++i)
+                {
+                    PixelType expected;
+                    const bool ok = interpol(transform.xs[i], transform.ys[j], expected);
+                    if (ok != (alpha(i, j) > 0) || (ok && !TRAITS::Close(remapped(i, j), vigra_ext::zeroNegative(expected))))
+                    {
+                        remapMatches = false;
+                    };
+                };
+            };
+            check(remapMatches, description + ": transformImage near the border gives the values of ImageInterpolator");
+        };
+        vigra_ext::simd::SetInstructionSet(supported);
+    };
+}
+
+int main()
+{
+    TestInterpolator<FloatPixel, vigra_ext::interp_nearest>("float, nearest");
+    TestInterpolator<FloatPixel, vigra_ext::interp_bilin>("float, bilinear");
+    TestInterpolator<FloatPixel, vigra_ext::interp_cubic>("float, cubic");
+    TestInterpolator<FloatPixel, vigra_ext::interp_spline16>("float, spline16");
+    TestInterpolator<RGBPixel, vigra_ext::interp_nearest>("RGB, nearest");
+    TestInterpolator<RGBPixel, vigra_ext::interp_bilin>("RGB, bilinear");
+    TestInterpolator<RGBPixel, vigra_ext::interp_cubic>("RGB, cubic");
+    TestInterpolator<RGBPixel, vigra_ext::interp_spline16>("RGB, spline16");
+
+    if (failures == 0)
+    {
+        std::cout << "all interpolator tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_poisson.cpp
+ *
+ *  @brief checks that the multigrid Poisson solver finds a known solution and
+ *         gives the result of a serial Gauss-Seidel solver
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <vigra/stdimage.hxx>
+#include <vigra_ext/BlendPoisson.h>
+#include <hugin_math/hugin_math.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** labels like in MergeImages: 1 for image 1, 5 for image 2 and 0 for a
+     *  hole in image 2. Without wrap around image 1 is on the left, with wrap
+     *  around it is in the middle, so that image 2 crosses the left and right
+     *  border. */
+    vigra::BImage CreateLabels(const vigra::Size2D& size, bool doWrap)
+    {
+        vigra::BImage labels(size);
+        const int left = doWrap ? size.width() / 3 : 0;
+        const int right = doWrap ? 2 * size.width() / 3 : size.width() / 4;
+        for (int y = 0; y < size.height(); ++y)
+        {
+            for (int x = 0; x < size.width(); ++x)
+            {
+                if (x >= left && x < right)
+                {
+                    labels(x, y) = 1;
+                }
+                else
+                {
+                    const bool hole = std::abs(x - (right + size.width()) / 2) < size.width() / 10 &&
+                        std::abs(y - size.height() / 2) < size.height() / 6;
+                    labels(x, y) = hole ? 0 : 5;
+                };
+            };
+        };
+        return labels;
+    };
+
+    /** the known solution at the unknown pixels, periodic in x for the wrap
+     *  around, all other pixels are 0 like in MergeImages */
+    vigra::DImage CreateSolution(const vigra::Int8Image& seams)
+    {
+        vigra::DImage solution(seams.size());
+        for (int y = 0; y < seams.height(); ++y)
+        {
+            for (int x = 0; x < seams.width(); ++x)
+            {
+                if (seams(x, y) > 1)
+                {
+                    solution(x, y) = 100.0 + 30.0 * sin(2.0 * M_PI * x / seams.width()) + 20.0 * cos(y / 9.0);
+                };
+            };
+        };
+        return solution;
+    };
+
+    /** the serial solver used before the multigrid solver: SOR sweeps in row
+     *  order until the changes vanish */
+    void SolveSerialSOR(vigra::DImage& target, const vigra::DImage& gradient, const vigra::Int8Image& seams, bool doWrap)
+    {
+        for (int iter = 0; iter < 20000; ++iter)
+        {
+            double error = 0;
+            for (int y = 0; y < target.height(); ++y)
+            {
+                for (int x = 0; x < target.width(); ++x)
+                {
+                    if (seams(x, y) > 1)
+                    {
+                        error += vigra_ext::poisson::detail::RelaxPixel(x, y, target, gradient, seams, 1.9f, doWrap);
+                    };
+                };
+            };
+            if (error < 1e-24)
+            {
+                break;
+            };
+        };
+    };
+
+    /** maximal difference at the unknown pixels */
+    double MaxDifference(const vigra::DImage& a, const vigra::DImage& b, const vigra::Int8Image& seams)
+    {
+        double maxDiff = 0;
+        for (int y = 0; y < seams.height(); ++y)
+        {
+            for (int x = 0; x < seams.width(); ++x)
+            {
+                if (seams(x, y) > 1)
+                {
+                    maxDiff = std::max(maxDiff, std::abs(a(x, y) - b(x, y)));
+                };
+            };
+        };
+        return maxDiff;
+    };
+
+    void TestSolver(const vigra::Size2D& size, bool doWrap)
+    {
+        std::ostringstream name;
+        name << size.width() << "x" << size.height() << (doWrap ? " with wrap around" : "");
+        const vigra::BImage labels = CreateLabels(size, doWrap);
+        vigra::ImagePyramid<vigra::Int8Image> seams;
+        const int minLength = 8;
+        vigra_ext::poisson::BuildSeamPyramid(labels, seams, minLength);
+        check(seams.highestLevel() >= 2, name.str() + ": pyramid has several levels");
+
+        // the right hand side, for which the known solution has zero residual
+        const vigra::DImage solution = CreateSolution(seams[0]);
+        vigra::DImage gradient(size);
+        vigra::DImage zero(size);
+        vigra_ext::poisson::detail::CalcResidualError(gradient, solution, zero, seams[0], doWrap);
+
+        const double tolerance = 1e-8;
+        vigra::DImage target(size);
+        const vigra_ext::poisson::MultigridReport report = vigra_ext::poisson::SolveMultigrid(target, gradient, seams, minLength, tolerance, 50, doWrap);
+        check(report.initialResidual > 0, name.str() + ": initial residual is not zero");
+        check(report.converged, name.str() + ": multigrid converges");
+        check(report.finalResidual <= tolerance * report.initialResidual, name.str() + ": residual drops below the tolerance");
+        check(static_cast<int>(report.residuals.size()) == report.cycles, name.str() + ": report contains residual of each cycle");
+        vigra::DImage error(size);
+        const double residual = vigra_ext::poisson::detail::CalcResidualError(error, target, gradient, seams[0], doWrap);
+        check(residual == report.finalResidual, name.str() + ": report contains residual of result");
+
+        std::ostringstream description;
+        const double solutionError = MaxDifference(target, solution, seams[0]);
+        description << name.str() << ": multigrid finds the known solution (max error " << solutionError << ")";
+        check(solutionError < 1e-3, description.str());
+
+        vigra::DImage serial(size);
+        SolveSerialSOR(serial, gradient, seams[0], doWrap);
+        const double serialError = MaxDifference(serial, solution, seams[0]);
+        description.str("");
+        description << name.str() << ": serial SOR finds the known solution (max error " << serialError << ")";
+        check(serialError < 1e-3, description.str());
+        const double difference = MaxDifference(target, serial, seams[0]);
+        description.str("");
+        description << name.str() << ": multigrid and serial SOR agree (max difference " << difference << ")";
+        check(difference < 1e-3, description.str());
+    };
+}
+
+int main()
+{
+    TestSolver(vigra::Size2D(101, 67), false);
+    TestSolver(vigra::Size2D(101, 67), true);
+    TestSolver(vigra::Size2D(96, 65), true);
+
+    if (failures == 0)
+    {
+        std::cout << "all Poisson solver tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,369 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_reducedimport.cpp
+ *
+ *  @brief checks that importReducedImage gives the same result as the full
+ *         size import followed by a downscale, and that the coordinates of
+ *         the reduced image are converted back to the full size image
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <vigra/stdimage.hxx>
+#include <vigra/impex.hxx>
+#include <vigra_ext/impexalpha.hxx>
+#include <vigra_ext/tiffUtils.h>
+#include <vigra_ext/ReducedImport.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** smooth colors, so that the JPEG compression does not dominate the differences */
+    vigra::BRGBImage CreateImage(const vigra::Size2D& size)
+    {
+        vigra::BRGBImage image(size);
+        for (int y = 0; y < size.y; ++y)
+        {
+            for (int x = 0; x < size.x; ++x)
+            {
+                image(x, y) = vigra::RGBValue<vigra::UInt8>(static_cast<vigra::UInt8>(128 + 100 * sin(x / 15.0)),
+                    static_cast<vigra::UInt8>(128 + 100 * cos(y / 13.0)), static_cast<vigra::UInt8>(40 + x + y / 2));
+            };
+        };
+        return image;
+    };
+
+    /** a gray gaussian blob centered at (@p cx, @p cy) */
+    vigra::BRGBImage CreateBlob(const vigra::Size2D& size, double cx, double cy)
+    {
+        vigra::BRGBImage image(size);
+        for (int y = 0; y < size.y; ++y)
+        {
+            for (int x = 0; x < size.x; ++x)
+            {
+                const double r2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                const vigra::UInt8 value = static_cast<vigra::UInt8>(20.5 + 200.0 * exp(-r2 / 72.0));
+                image(x, y) = vigra::RGBValue<vigra::UInt8>(value, value, value);
+            };
+        };
+        return image;
+    };
+
+    /** the downscale, which importReducedImage replaces: the rounded average
+     *  of the valid pixels in each factor x factor block.
+     *  @param anyValid if true, a reduced pixel is valid if one pixel of its
+     *         block is valid (like the overviews of TiledTiffWriter), otherwise
+     *         at least half of the block has to be valid */
+    void BoxReduce(const vigra::BRGBImage& image, const vigra::BImage* mask, int factor, bool anyValid,
+        vigra::BRGBImage& reduced, vigra::BImage& reducedMask)
+    {
+        const vigra::Size2D size((image.width() + factor - 1) / factor, (image.height() + factor - 1) / factor);
+        reduced.resize(size);
+        reducedMask.resize(size);
+        for (int y = 0; y < size.y; ++y)
+        {
+            for (int x = 0; x < size.x; ++x)
+            {
+                unsigned int sum[3] = { 0, 0, 0 };
+                unsigned int count = 0;
+                int area = 0;
+                for (int dy = factor * y; dy < std::min(factor * (y + 1), image.height()); ++dy)
+                {
+                    for (int dx = factor * x; dx < std::min(factor * (x + 1), image.width()); ++dx)
+                    {
+                        ++area;
+                        if (mask != NULL && (*mask)(dx, dy) < 128)
+                        {
+                            continue;
+                        };
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            sum[c] += image(dx, dy)[c];
+                        };
+                        ++count;
+                    };
+                };
+                for (int c = 0; c < 3; ++c)
+                {
+                    reduced(x, y)[c] = count > 0 ? static_cast<vigra::UInt8>((sum[c] + count / 2) / count) : 0;
+                };
+                const bool valid = anyValid ? count > 0 : 2 * count >= static_cast<unsigned int>(area);
+                reducedMask(x, y) = valid ? 255 : 0;
+            };
+        };
+    };
+
+    /** maximal and mean difference of all channels, only pixels inside
+     *  @p mask are compared, if it is given */
+    void Differences(const vigra::BRGBImage& a, const vigra::BRGBImage& b, const vigra::BImage* mask,
+        int& maxDiff, double& meanDiff)
+    {
+        maxDiff = 0;
+        meanDiff = 0;
+        int count = 0;
+        for (int y = 0; y < a.height(); ++y)
+        {
+            for (int x = 0; x < a.width(); ++x)
+            {
+                if (mask != NULL && (*mask)(x, y) == 0)
+                {
+                    continue;
+                };
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int diff = std::abs(static_cast<int>(a(x, y)[c]) - static_cast<int>(b(x, y)[c]));
+                    maxDiff = std::max(maxDiff, diff);
+                    meanDiff += diff;
+                    ++count;
+                };
+            };
+        };
+        if (count > 0)
+        {
+            meanDiff /= count;
+        };
+    };
+
+    /** compares the result of importReducedImage with the box reduced full
+     *  size image, the colors within @p tolerance */
+    void CompareReduced(const std::string& filename, int factor, const vigra::BRGBImage& expected,
+        const vigra::BImage* expectedMask, int tolerance, double meanTolerance, const std::string& name)
+    {
+        vigra::ImageImportInfo info(filename.c_str());
+        vigra::BRGBImage reduced;
+        vigra::BImage reducedMask;
+        if (!vigra_ext::importReducedImage(info, factor, reduced, reducedMask))
+        {
+            check(false, name + ": reduced import is supported");
+            return;
+        };
+        if (reduced.size() != expected.size())
+        {
+            check(false, name + ": reduced image has the rounded up size");
+            return;
+        };
+        if (expectedMask == NULL)
+        {
+            check(reducedMask.width() == 0, name + ": no mask without alpha channel");
+        }
+        else
+        {
+            check(reducedMask.size() == expected.size() &&
+                std::equal(reducedMask.begin(), reducedMask.end(), expectedMask->begin()), name + ": mask matches");
+        };
+        int maxDiff;
+        double meanDiff;
+        Differences(reduced, expected, expectedMask, maxDiff, meanDiff);
+        std::ostringstream description;
+        description << name << ": reduced image matches downscaled full image (max difference " << maxDiff
+            << ", mean difference " << meanDiff << ")";
+        check(maxDiff <= tolerance && meanDiff <= meanTolerance, description.str());
+    };
+
+    /** the libjpeg DCT scaling approximates the block average */
+    void TestJPEG(const std::string& dir)
+    {
+        const std::string filename(dir + "/test_reducedimport.jpg");
+        vigra::ImageExportInfo exportInfo(filename.c_str());
+        exportInfo.setCompression("JPEG QUALITY=100");
+        vigra::exportImage(vigra::srcImageRange(CreateImage(vigra::Size2D(101, 75))), exportInfo);
+        vigra::ImageImportInfo info(filename.c_str());
+        vigra::BRGBImage full(info.size());
+        vigra::importImage(info, vigra::destImage(full));
+        for (int factor = 2; factor <= 8; factor *= 2)
+        {
+            vigra::BRGBImage expected;
+            vigra::BImage expectedMask;
+            BoxReduce(full, NULL, factor, false, expected, expectedMask);
+            std::ostringstream name;
+            name << "JPEG, factor " << factor;
+            CompareReduced(filename, factor, expected, NULL, 10, 2.0, name.str());
+        };
+        std::remove(filename.c_str());
+    };
+
+    /** a TIFF file without overviews is reduced while reading the strips,
+     *  this gives exactly the block average */
+    void TestTIFFStrips(const std::string& dir)
+    {
+        const std::string filename(dir + "/test_reducedimport.tif");
+        const vigra::BRGBImage image = CreateImage(vigra::Size2D(101, 75));
+        // a region, where only one pixel of each 2x2 block is valid
+        vigra::BImage mask(image.size(), vigra::UInt8(255));
+        for (int y = 16; y < 40; ++y)
+        {
+            for (int x = 40; x < 80; ++x)
+            {
+                mask(x, y) = (x % 2 == 0 && y % 2 == 0) ? 255 : 0;
+            };
+        };
+        vigra::exportImageAlpha(vigra::srcImageRange(image), vigra::srcImage(mask), vigra::ImageExportInfo(filename.c_str()));
+        vigra::ImageImportInfo info(filename.c_str());
+        vigra::BRGBImage full(info.size());
+        vigra::BImage fullMask(info.size());
+        vigra::importImageAlpha(info, vigra::destImage(full), vigra::destImage(fullMask));
+        for (int factor = 2; factor <= 8; factor *= 2)
+        {
+            vigra::BRGBImage expected;
+            vigra::BImage expectedMask;
+            BoxReduce(full, &fullMask, factor, false, expected, expectedMask);
+            std::ostringstream name;
+            name << "TIFF strips, factor " << factor;
+            CompareReduced(filename, factor, expected, &expectedMask, 0, 0.0, name.str());
+        };
+        std::remove(filename.c_str());
+    };
+
+    /** a tiled TIFF file with overviews, the overview of the requested size
+     *  is read instead of the full image. The overviews mark a block valid,
+     *  if any of its pixels is valid, the box reduction needs half of the
+     *  block, so the mask shows which path was taken. The tiles are lossless,
+     *  so the full size image is the written image. */
+    void TestTIFFOverviews(const std::string& dir)
+    {
+        const std::string filename(dir + "/test_reducedimport_tiled.tif");
+        const vigra::Size2D size(150, 100);
+        const vigra::BRGBImage image = CreateImage(size);
+        vigra::BImage mask(size, vigra::UInt8(255));
+        for (int y = 16; y < 40; ++y)
+        {
+            for (int x = 40; x < 80; ++x)
+            {
+                mask(x, y) = (x % 2 == 0 && y % 2 == 0) ? 255 : 0;
+            };
+        };
+        {
+            vigra_ext::TiledTiffWriter<vigra::RGBValue<vigra::UInt8> > writer;
+            check(writer.open(filename, size, 32, "DEFLATE", false, vigra::Diff2D(0, 0), size,
+                vigra::ImageExportInfo::ICCProfile(), true), "tiled TIFF is created");
+            for (int y = 0; y < size.y; y += 32)
+            {
+                writer.writeTileRow(y, image.upperLeft() + vigra::Diff2D(0, y), image.accessor(),
+                    mask.upperLeft() + vigra::Diff2D(0, y), mask.accessor());
+            };
+            check(writer.close(), "overviews are written");
+        }
+        // the overviews are averaged level by level, so the colors differ by rounding
+        for (int factor = 2; factor <= 8; factor *= 2)
+        {
+            vigra::BRGBImage expected;
+            vigra::BImage expectedMask;
+            BoxReduce(image, &mask, factor, true, expected, expectedMask);
+            std::ostringstream name;
+            name << "TIFF overview, factor " << factor;
+            CompareReduced(filename, factor, expected, &expectedMask, factor / 2, 0.5, name.str());
+        };
+        std::remove(filename.c_str());
+    };
+
+    /** intensity weighted centroid of the blob above the background */
+    void Centroid(const vigra::BRGBImage& image, double& cx, double& cy)
+    {
+        double sum = 0;
+        cx = 0;
+        cy = 0;
+        for (int y = 0; y < image.height(); ++y)
+        {
+            for (int x = 0; x < image.width(); ++x)
+            {
+                const double weight = std::max(0, image(x, y)[0] - 20);
+                sum += weight;
+                cx += weight * x;
+                cy += weight * y;
+            };
+        };
+        cx /= sum;
+        cy /= sum;
+    };
+
+    /** a feature found in the reduced image is mapped back by
+     *  ReducedToFullCoordinate to its position in the full size image, like
+     *  the keypoints of the downscaled detection in cpfind */
+    void TestCoordinates(const std::string& filename, int factor, double tolerance, const std::string& name)
+    {
+        vigra::ImageImportInfo info(filename.c_str());
+        vigra::BRGBImage full(info.size());
+        vigra::importImage(info, vigra::destImage(full));
+        double fullX, fullY;
+        Centroid(full, fullX, fullY);
+        vigra::BRGBImage reduced;
+        vigra::BImage reducedMask;
+        if (!vigra_ext::importReducedImage(info, factor, reduced, reducedMask))
+        {
+            check(false, name + ": reduced import is supported");
+            return;
+        };
+        double reducedX, reducedY;
+        Centroid(reduced, reducedX, reducedY);
+        const double dx = vigra_ext::ReducedToFullCoordinate(reducedX, factor) - fullX;
+        const double dy = vigra_ext::ReducedToFullCoordinate(reducedY, factor) - fullY;
+        std::ostringstream description;
+        description << name << ": feature is mapped back to full size position (offset " << dx << ", " << dy << ")";
+        check(std::abs(dx) < tolerance && std::abs(dy) < tolerance, description.str());
+        // only scaling the coordinates is (factor - 1) / 2 pixels off
+        check(std::abs(factor * reducedX - fullX) > 0.5 * (factor - 1) - tolerance,
+            name + ": scaling alone misses the block center");
+    };
+
+    void TestKeypointRescale(const std::string& dir)
+    {
+        const vigra::BRGBImage blob = CreateBlob(vigra::Size2D(101, 75), 47.3, 36.6);
+        const std::string tiffname(dir + "/test_reducedimport_blob.tif");
+        vigra::exportImage(vigra::srcImageRange(blob), vigra::ImageExportInfo(tiffname.c_str()));
+        TestCoordinates(tiffname, 2, 0.1, "TIFF blob, factor 2");
+        TestCoordinates(tiffname, 4, 0.15, "TIFF blob, factor 4");
+        std::remove(tiffname.c_str());
+
+        const std::string jpegname(dir + "/test_reducedimport_blob.jpg");
+        vigra::ImageExportInfo exportInfo(jpegname.c_str());
+        exportInfo.setCompression("JPEG QUALITY=100");
+        vigra::exportImage(vigra::srcImageRange(blob), exportInfo);
+        TestCoordinates(jpegname, 2, 0.2, "JPEG blob, factor 2");
+        std::remove(jpegname.c_str());
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string dir(argc > 1 ? argv[1] : ".");
+    TestJPEG(dir);
+    TestTIFFStrips(dir);
+    TestTIFFOverviews(dir);
+    TestKeypointRescale(dir);
+
+    if (failures == 0)
+    {
+        std::cout << "all reduced import tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_remapplan.cpp
+ *
+ *  @brief checks that cached remap plans give the same remapping as the
+ *         exact transform and are invalidated when an input changes
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <vigra/stdimage.hxx>
+#include <nona/RemapPlan.h>
+#include <panotools/PanoToolsInterface.h>
+#include <vigra_ext/ImageTransforms.h>
+#include <vigra_ext/utils.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    SrcPanoImage CreateSrcImage()
+    {
+        SrcPanoImage src;
+        src.setSize(vigra::Size2D(120, 80));
+        src.setProjection(SrcPanoImage::RECTILINEAR);
+        src.setHFOV(50);
+        src.setYaw(5);
+        return src;
+    };
+
+    PanoramaOptions CreateOptions()
+    {
+        PanoramaOptions opts;
+        opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+        opts.setHFOV(90);
+        opts.setWidth(200);
+        opts.setHeight(100);
+        return opts;
+    };
+
+    /** smooth test image, so that the small rounding error of the plan
+     *  coordinates changes the interpolated values only slightly */
+    vigra::FImage CreateImage(const vigra::Size2D& size)
+    {
+        vigra::FImage image(size);
+        for (int y = 0; y < size.height(); ++y)
+        {
+            for (int x = 0; x < size.width(); ++x)
+            {
+                image(x, y) = static_cast<float>(0.5 + 0.25 * sin(x / 7.0) + 0.25 * cos(y / 5.0));
+            };
+        };
+        return image;
+    };
+
+    /** remap @p image into the region @p roi with @p transform */
+    template <class TRANSFORM>
+    void Remap(const vigra::FImage& image, const vigra::Rect2D& roi, TRANSFORM& transform,
+        vigra::FImage& remapped, vigra::BImage& alpha)
+    {
+        remapped.resize(roi.size());
+        alpha.resize(roi.size());
+        vigra_ext::PassThroughFunctor<float> identity;
+        vigra_ext::transformImage(vigra::srcImageRange(image), vigra::destImageRange(remapped), vigra::destImage(alpha),
+            roi.upperLeft(), transform, identity, false, vigra_ext::INTERP_BILINEAR, NULL, true);
+    };
+
+    bool NearInteger(double x)
+    {
+        return std::abs(x - std::floor(x + 0.5)) < 1e-3;
+    };
+
+    /** compares the replay of @p plan with the remapping with the exact
+     *  transform. The plan stores single precision coordinates, so the
+     *  pixel values may differ slightly, and the alpha channel may only
+     *  differ where the exact source coordinate is so close to an integer
+     *  that the rounding changes the interpolation window at the border */
+    bool ReplayMatches(const SrcPanoImage& src, const PanoramaOptions& opts, const vigra::Rect2D& roi,
+        const Nona::RemapPlan& plan)
+    {
+        const vigra::FImage image = CreateImage(src.getSize());
+        PTools::Transform transform;
+        transform.createTransform(src, opts);
+        vigra::FImage direct;
+        vigra::BImage directAlpha;
+        Remap(image, roi, transform, direct, directAlpha);
+        vigra::FImage replay;
+        vigra::BImage replayAlpha;
+        Remap(image, roi, plan, replay, replayAlpha);
+
+        int validPixels = 0;
+        for (int y = 0; y < roi.height(); ++y)
+        {
+            for (int x = 0; x < roi.width(); ++x)
+            {
+                if (directAlpha(x, y) != replayAlpha(x, y))
+                {
+                    double sx, sy;
+                    if (!transform.transformImgCoord(sx, sy, x + roi.left(), y + roi.top()) ||
+                        !(NearInteger(sx) || NearInteger(sy)))
+                    {
+                        return false;
+                    };
+                }
+                else
+                {
+                    if (directAlpha(x, y) > 0)
+                    {
+                        ++validPixels;
+                        if (std::abs(direct(x, y) - replay(x, y)) > 1e-3)
+                        {
+                            return false;
+                        };
+                    };
+                };
+            };
+        };
+        // the image covers only a part of the roi
+        return validPixels > 0 && validPixels < roi.area();
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const SrcPanoImage src = CreateSrcImage();
+    const PanoramaOptions opts = CreateOptions();
+    const vigra::Rect2D roi(50, 20, 150, 80);
+    const unsigned long long fingerprint = Nona::RemapPlan::CalcFingerprint(src, opts, roi);
+
+    // every input of the plan changes the fingerprint
+    check(fingerprint == Nona::RemapPlan::CalcFingerprint(src, opts, roi), "fingerprint is deterministic");
+    {
+        SrcPanoImage changed(src);
+        changed.setYaw(5.0001);
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(changed, opts, roi), "yaw changes fingerprint");
+    }
+    {
+        SrcPanoImage changed(src);
+        std::vector<double> distortion(changed.getRadialDistortion());
+        distortion[1] = 0.01;
+        changed.setRadialDistortion(distortion);
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(changed, opts, roi), "lens distortion changes fingerprint");
+    }
+    {
+        SrcPanoImage changed(src);
+        changed.setCropMode(SrcPanoImage::CROP_RECTANGLE);
+        changed.setCropRect(vigra::Rect2D(10, 10, 110, 70));
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(changed, opts, roi), "crop changes fingerprint");
+    }
+    {
+        SrcPanoImage changed(src);
+        MaskPolygon mask;
+        mask.addPoint(hugin_utils::FDiff2D(10, 10));
+        mask.addPoint(hugin_utils::FDiff2D(40, 10));
+        mask.addPoint(hugin_utils::FDiff2D(40, 40));
+        changed.addActiveMask(mask);
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(changed, opts, roi), "mask changes fingerprint");
+    }
+    {
+        PanoramaOptions changed(opts);
+        changed.interpolator = vigra_ext::INTERP_BILINEAR;
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(src, changed, roi), "interpolator changes fingerprint");
+    }
+    {
+        PanoramaOptions changed(opts);
+        changed.setProjection(PanoramaOptions::CYLINDRICAL);
+        check(fingerprint != Nona::RemapPlan::CalcFingerprint(src, changed, roi), "output projection changes fingerprint");
+    }
+
+    // a kept remapped image also depends on the photometric and output settings
+    {
+        const Nona::AdvancedOptions advOptions;
+        const unsigned long long remapped = Nona::CalcRemappedFingerprint(src, opts, roi, advOptions);
+        check(remapped == Nona::CalcRemappedFingerprint(src, opts, roi, advOptions), "remapped fingerprint is deterministic");
+        SrcPanoImage exposure(src);
+        exposure.setExposureValue(src.getExposureValue() + 1.0);
+        check(remapped != Nona::CalcRemappedFingerprint(exposure, opts, roi, advOptions), "exposure changes remapped fingerprint");
+        SrcPanoImage yaw(src);
+        yaw.setYaw(src.getYaw() + 1.0);
+        check(remapped != Nona::CalcRemappedFingerprint(yaw, opts, roi, advOptions), "geometry changes remapped fingerprint");
+        PanoramaOptions output(opts);
+        output.outputExposureValue = opts.outputExposureValue + 1.0;
+        check(remapped != Nona::CalcRemappedFingerprint(src, output, roi, advOptions), "output exposure changes remapped fingerprint");
+        Nona::AdvancedOptions changedOptions(advOptions);
+        Nona::SetAdvancedOption(changedOptions, "ignoreExposure", true);
+        check(remapped != Nona::CalcRemappedFingerprint(src, opts, roi, changedOptions), "advanced options change remapped fingerprint");
+    }
+
+    // a saved plan is reused for the same inputs, but not after an input changed
+    const std::string dir(argc > 1 ? argv[1] : ".");
+    const std::string filename(dir + "/test_remapplan.plan");
+    Nona::RemapPlanPtr plan = Nona::GetRemapPlan(src, opts, roi, filename);
+    check(plan && plan->isValid(), "plan is created");
+    check(plan && ReplayMatches(src, opts, roi, *plan), "replayed plan gives the same pixels and alpha as the transform");
+    {
+        Nona::RemapPlan loaded;
+        check(loaded.load(filename), "plan is loaded from file");
+        check(loaded.matches(src, opts, roi), "loaded plan matches unchanged inputs");
+        check(loaded.getFingerprint() == fingerprint, "fingerprint is stored in file");
+        check(ReplayMatches(src, opts, roi, loaded), "replayed loaded plan gives the same pixels and alpha as the transform");
+        SrcPanoImage changed(src);
+        changed.setRoll(0.5);
+        check(!loaded.matches(changed, opts, roi), "loaded plan is invalidated by changed roll");
+        MaskPolygon mask;
+        mask.addPoint(hugin_utils::FDiff2D(0, 0));
+        mask.addPoint(hugin_utils::FDiff2D(60, 0));
+        mask.addPoint(hugin_utils::FDiff2D(60, 60));
+        SrcPanoImage masked(src);
+        masked.addActiveMask(mask);
+        check(!loaded.matches(masked, opts, roi), "loaded plan is invalidated by new mask");
+    }
+    {
+        // the outdated file is replaced by a plan for the changed inputs
+        SrcPanoImage changed(src);
+        changed.setYaw(-3);
+        changed.setPitch(4);
+        Nona::RemapPlanPtr changedPlan = Nona::GetRemapPlan(changed, opts, roi, filename);
+        check(changedPlan && changedPlan->matches(changed, opts, roi), "changed inputs give a new plan");
+        check(changedPlan && !changedPlan->matches(src, opts, roi), "new plan does not match old inputs");
+        check(changedPlan && ReplayMatches(changed, opts, roi, *changedPlan), "new plan gives the pixels of the changed transform");
+        Nona::RemapPlan loaded;
+        check(loaded.load(filename) && loaded.matches(changed, opts, roi), "outdated plan file is replaced");
+    }
+    std::remove(filename.c_str());
+
+    if (failures == 0)
+    {
+        std::cout << "all remap plan tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_spacetransform.cpp
+ *
+ *  @brief checks that the fused SpaceTransform gives the same coordinates as
+ *         the transformation stack of libpano for all fused projections
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nona/SpaceTransform.h>
+#include <panotools/PanoToolsInterface.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** pseudo random numbers in [0,1), the same on all platforms */
+    double NextRandom(unsigned int& state)
+    {
+        state = state * 1103515245U + 12345U;
+        return ((state >> 8) & 0xffffffU) / 16777216.0;
+    };
+
+    SrcPanoImage CreateSrcImage(SrcPanoImage::Projection projection, bool radial)
+    {
+        SrcPanoImage src;
+        src.setProjection(projection);
+        switch (projection)
+        {
+            case SrcPanoImage::EQUIRECTANGULAR:
+                src.setSize(vigra::Size2D(400, 200));
+                src.setHFOV(360);
+                break;
+            case SrcPanoImage::RECTILINEAR:
+                src.setSize(vigra::Size2D(300, 200));
+                src.setHFOV(60);
+                break;
+            default:
+                src.setSize(vigra::Size2D(300, 200));
+                src.setHFOV(150);
+                break;
+        };
+        src.setYaw(12);
+        src.setPitch(-7);
+        src.setRoll(3);
+        if (radial)
+        {
+            // Init() models only d = 1 - (a + b + c)
+            std::vector<double> distortion(4);
+            distortion[0] = 0.002;
+            distortion[1] = -0.01;
+            distortion[2] = 0.005;
+            distortion[3] = 1.0 - (distortion[0] + distortion[1] + distortion[2]);
+            src.setRadialDistortion(distortion);
+            src.setRadialDistortionCenterShift(hugin_utils::FDiff2D(3, -2));
+        };
+        return src;
+    };
+
+    PanoramaOptions CreateOptions(PanoramaOptions::ProjectionFormat projection)
+    {
+        PanoramaOptions opts;
+        opts.setProjection(projection);
+        switch (projection)
+        {
+            case PanoramaOptions::RECTILINEAR:
+                opts.setHFOV(100);
+                break;
+            case PanoramaOptions::CYLINDRICAL:
+                opts.setHFOV(180);
+                break;
+            default:
+                opts.setHFOV(360);
+                break;
+        };
+        opts.setWidth(600);
+        opts.setHeight(300);
+        return opts;
+    };
+
+    /** compares the fused transform with libpano at random points of the
+     *  panorama, which are mapped into the source image */
+    void TestProjections(SrcPanoImage::Projection imageProjection, PanoramaOptions::ProjectionFormat panoProjection,
+        bool radial, const std::string& name)
+    {
+        const SrcPanoImage src = CreateSrcImage(imageProjection, radial);
+        const PanoramaOptions opts = CreateOptions(panoProjection);
+        check(Nona::SpaceTransform::canReplacePanoTools(src, opts), name + ": can replace libpano");
+
+        Nona::SpaceTransform fused;
+        fused.createTransform(src, opts);
+        check(fused.isFused(), name + ": stack is fused");
+        check(fused.getFloatErrorBound() < 0.01, name + ": float error bound is small");
+        Nona::SpaceTransform again;
+        again.createTransform(src, opts);
+        check(again.getFloatErrorBound() == fused.getFloatErrorBound(), name + ": float error bound is reused");
+
+        PTools::Transform unfused;
+        unfused.createTransform(src, opts);
+
+        unsigned int state = 1;
+        int insidePoints = 0;
+        double maxError = 0;
+        for (int i = 0; i < 20000; ++i)
+        {
+            const double x = NextRandom(state) * opts.getWidth();
+            const double y = NextRandom(state) * opts.getHeight();
+            double xExpected, yExpected;
+            if (!unfused.transformImgCoord(xExpected, yExpected, x, y) ||
+                xExpected < 0 || xExpected > src.getWidth() || yExpected < 0 || yExpected > src.getHeight())
+            {
+                continue;
+            };
+            ++insidePoints;
+            double xFused, yFused;
+            fused.transformImgCoord(xFused, yFused, x, y);
+            double xRow, yRow;
+            fused.transformImgCoordRow(&xRow, &yRow, x, y, 1);
+            maxError = std::max(maxError, std::max(std::abs(xFused - xExpected), std::abs(yFused - yExpected)));
+            maxError = std::max(maxError, std::max(std::abs(xRow - xExpected), std::abs(yRow - yExpected)));
+            if (!(maxError < 1e-6))
+            {
+                break;
+            };
+        };
+        check(insidePoints > 1000, name + ": enough points inside the image");
+        std::ostringstream description;
+        description << name << ": fused and libpano transform agree (max error " << maxError << " pixel)";
+        check(maxError < 1e-6, description.str());
+    };
+}
+
+int main()
+{
+    const SrcPanoImage::Projection imageProjections[] = { SrcPanoImage::RECTILINEAR, SrcPanoImage::FULL_FRAME_FISHEYE,
+        SrcPanoImage::CIRCULAR_FISHEYE, SrcPanoImage::EQUIRECTANGULAR };
+    const char* imageNames[] = { "rectilinear", "full frame fisheye", "circular fisheye", "equirectangular" };
+    const PanoramaOptions::ProjectionFormat panoProjections[] = { PanoramaOptions::RECTILINEAR, PanoramaOptions::CYLINDRICAL,
+        PanoramaOptions::EQUIRECTANGULAR };
+    const char* panoNames[] = { "rectilinear", "cylindrical", "equirectangular" };
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            for (int radial = 0; radial < 2; ++radial)
+            {
+                const std::string name = std::string(imageNames[i]) + " image in " + panoNames[j] + " panorama" +
+                    (radial ? " with distortion" : "");
+                TestProjections(imageProjections[i], panoProjections[j], radial == 1, name);
+            };
+        };
+    };
+
+    if (failures == 0)
+    {
+        std::cout << "all space transform tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
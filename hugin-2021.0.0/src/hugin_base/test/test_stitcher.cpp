@@ -0,0 +1,231 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_stitcher.cpp
+ *
+ *  @brief checks that stitchers and stitch sessions which are used several
+ *         times recalculate their cached output regions when the canvas
+ *         changes
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <panodata/Panorama.h>
+#include <nona/Stitcher.h>
+#include <nona/StitchSession.h>
+
+using namespace HuginBase;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** two overlapping images with a smooth pattern */
+    Panorama CreatePanorama()
+    {
+        Panorama pano;
+        for (int i = 0; i < 2; ++i)
+        {
+            SrcPanoImage src;
+            src.setSize(vigra::Size2D(80, 60));
+            src.setProjection(SrcPanoImage::RECTILINEAR);
+            src.setHFOV(50);
+            src.setYaw(i == 0 ? -15 : 15);
+            pano.addImage(src);
+        };
+        PanoramaOptions opts;
+        opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+        opts.setHFOV(120);
+        opts.setWidth(300);
+        opts.setHeight(120);
+        opts.outputPixelType = "FLOAT";
+        pano.setOptions(opts);
+        return pano;
+    };
+
+    /** the same panorama on a larger canvas with a different output region */
+    PanoramaOptions ChangedCanvas(const PanoramaOptions& opts)
+    {
+        PanoramaOptions changed(opts);
+        changed.setWidth(400);
+        changed.setHeight(160);
+        changed.setROI(vigra::Rect2D(60, 20, 340, 140));
+        return changed;
+    };
+
+    /** pixel data for all images of @p pano, stored in @p pixels */
+    Nona::ImageBufferMap CreateFrames(const Panorama& pano, std::vector<std::vector<float> >& pixels)
+    {
+        Nona::ImageBufferMap frames;
+        pixels.resize(pano.getNrOfImages());
+        for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+        {
+            const int width = pano.getImage(i).getWidth();
+            const int height = pano.getImage(i).getHeight();
+            pixels[i].resize(width * height);
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    pixels[i][y * width + x] = static_cast<float>(0.5 + 0.2 * sin(x / 6.0 + i) + 0.2 * cos(y / 4.0));
+                };
+            };
+            frames[i] = Nona::ImageBuffer(&pixels[i][0], width, height, width * sizeof(float), "FLOAT", 1);
+        };
+        return frames;
+    };
+
+    /** stitch with @p stitcher into a canvas of the size of the output region */
+    void Stitch(Nona::WeightedStitcher<vigra::FImage, vigra::BImage>& stitcher, Nona::MemoryRemapper<vigra::FImage, vigra::BImage>& remapper,
+        const PanoramaOptions& opts, const UIntSet& images, const Nona::AdvancedOptions& advOptions,
+        vigra::FImage& panoImage, vigra::BImage& panoMask)
+    {
+        UIntSet imgSet(images);
+        panoImage.resize(opts.getROI().size());
+        panoMask.resize(opts.getROI().size());
+        stitcher.stitch(opts, imgSet, std::string(), panoImage, panoMask, remapper, advOptions);
+    };
+
+    bool SameImages(const vigra::FImage& image1, const vigra::BImage& mask1, const vigra::FImage& image2, const vigra::BImage& mask2)
+    {
+        return image1.size() == image2.size() && mask1.size() == mask2.size() &&
+            std::equal(image1.begin(), image1.end(), image2.begin()) &&
+            std::equal(mask1.begin(), mask1.end(), mask2.begin());
+    };
+
+    /** number of pixels with nonzero alpha */
+    int CoveredPixels(const vigra::BImage& mask)
+    {
+        int covered = 0;
+        for (vigra::BImage::const_iterator it = mask.begin(); it != mask.end(); ++it)
+        {
+            if (*it > 0)
+            {
+                ++covered;
+            };
+        };
+        return covered;
+    };
+
+    /** stitch @p frames with @p session and return the result as float image and alpha */
+    void RunSession(Nona::StitchSession& session, const Nona::ImageBufferMap& frames,
+        vigra::FImage& panoImage, vigra::BImage& panoMask)
+    {
+        const vigra::Size2D size = session.getOutputSize();
+        std::vector<float> output(size.area() * 2);
+        Nona::ImageBuffer buffer(&output[0], size.width(), size.height(), size.width() * 2 * sizeof(float), "FLOAT", 2);
+        session.stitch(frames, buffer);
+        panoImage.resize(size);
+        panoMask.resize(size);
+        for (int y = 0; y < size.height(); ++y)
+        {
+            for (int x = 0; x < size.width(); ++x)
+            {
+                panoImage(x, y) = output[2 * (y * size.width() + x)];
+                panoMask(x, y) = output[2 * (y * size.width() + x) + 1] > 0 ? 255 : 0;
+            };
+        };
+    };
+}
+
+int main()
+{
+    const Panorama pano = CreatePanorama();
+    const UIntSet images = pano.getActiveImages();
+    const PanoramaOptions opts = pano.getOptions();
+    const PanoramaOptions changedOpts = ChangedCanvas(opts);
+    std::vector<std::vector<float> > pixels;
+    const Nona::ImageBufferMap frames = CreateFrames(pano, pixels);
+    AppBase::DummyProgressDisplay progress;
+
+    // a stitcher used first with one canvas and then with another gives the
+    // same result as a new stitcher for the second canvas, with hard seams
+    // and with the blending order
+    for (int hardSeam = 0; hardSeam < 2; ++hardSeam)
+    {
+        Nona::AdvancedOptions advOptions;
+        Nona::SetAdvancedOption(advOptions, "hardSeam", hardSeam == 1);
+
+        Nona::MemoryRemapper<vigra::FImage, vigra::BImage> remapper;
+        remapper.setAdvancedOptions(advOptions);
+        remapper.setKeepRemapped(true);
+        remapper.setImages(frames);
+        Nona::WeightedStitcher<vigra::FImage, vigra::BImage> stitcher(pano, &progress);
+        vigra::FImage first;
+        vigra::BImage firstMask;
+        Stitch(stitcher, remapper, opts, images, advOptions, first, firstMask);
+        vigra::FImage again;
+        vigra::BImage againMask;
+        Stitch(stitcher, remapper, changedOpts, images, advOptions, again, againMask);
+
+        Nona::MemoryRemapper<vigra::FImage, vigra::BImage> freshRemapper;
+        freshRemapper.setAdvancedOptions(advOptions);
+        freshRemapper.setImages(frames);
+        Nona::WeightedStitcher<vigra::FImage, vigra::BImage> freshStitcher(pano, &progress);
+        vigra::FImage fresh;
+        vigra::BImage freshMask;
+        Stitch(freshStitcher, freshRemapper, changedOpts, images, advOptions, fresh, freshMask);
+
+        check(CoveredPixels(freshMask) > 0, "images cover the changed canvas");
+        check(SameImages(again, againMask, fresh, freshMask), "reused stitcher gives the result of a new stitcher after a canvas change");
+    };
+
+    // the same for a session which is set up again with a changed canvas
+    {
+        Nona::StitchSession session;
+        session.setPanorama(pano);
+        vigra::FImage first;
+        vigra::BImage firstMask;
+        RunSession(session, frames, first, firstMask);
+        check(first.size() == opts.getROI().size(), "session output has the size of the output region");
+        check(CoveredPixels(firstMask) > 0, "session output is not empty");
+
+        Panorama changedPano(pano.duplicate());
+        changedPano.setOptions(changedOpts);
+        session.setPanorama(changedPano);
+        vigra::FImage again;
+        vigra::BImage againMask;
+        RunSession(session, frames, again, againMask);
+
+        Nona::StitchSession freshSession;
+        freshSession.setPanorama(changedPano);
+        vigra::FImage fresh;
+        vigra::BImage freshMask;
+        StitchSession(freshSession, frames, fresh, freshMask);
+
+        check(again.size() == changedOpts.getROI().size(), "session output follows the changed output region");
+        check(SameImages(again, againMask, fresh, freshMask), "re-run session gives the result of a new session after a canvas change");
+    };
+
+    if (failures == 0)
+    {
+        std::cout << "all stitcher tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
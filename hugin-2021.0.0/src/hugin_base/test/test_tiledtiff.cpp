@@ -0,0 +1,260 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_tiledtiff.cpp
+ *
+ *  @brief checks that TiledTiffWriter writes tiles and overviews, which
+ *         libtiff reads back with the original pixels
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <vigra_ext/tiffUtils.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    const int TileSize = 32;
+
+    /** 8 bit RGB image */
+    struct RGBPixel
+    {
+        typedef vigra::RGBValue<vigra::UInt8> PixelType;
+        static PixelType Value(int x, int y)
+        {
+            return PixelType(static_cast<vigra::UInt8>(x + y), static_cast<vigra::UInt8>(3 * x), static_cast<vigra::UInt8>(200 - y));
+        };
+    };
+
+    /** float gray image */
+    struct FloatPixel
+    {
+        typedef float PixelType;
+        static PixelType Value(int x, int y) { return 0.01f * x - 0.02f * y + 0.3f; };
+    };
+
+    /** interleaved colors and alpha of an image */
+    template <class Component>
+    struct Interleaved
+    {
+        vigra::Size2D size;
+        int samples;
+        std::vector<Component> data;
+        const Component* pixel(int x, int y) const { return &data[(static_cast<size_t>(y) * size.x + x) * samples]; };
+    };
+
+    /** the next overview level, like TiledTiffWriter calculates it: the average
+     *  of the pixels with alpha in each 2x2 block, clamped at the right and
+     *  bottom border */
+    template <class Component>
+    Interleaved<Component> Reduce(const Interleaved<Component>& src)
+    {
+        Interleaved<Component> dest;
+        dest.size = vigra::Size2D((src.size.x + 1) / 2, (src.size.y + 1) / 2);
+        dest.samples = src.samples;
+        dest.data.resize(static_cast<size_t>(dest.size.area()) * dest.samples);
+        const int channels = src.samples - 1;
+        for (int y = 0; y < dest.size.y; ++y)
+        {
+            const int y2 = std::min(2 * y + 1, src.size.y - 1);
+            for (int x = 0; x < dest.size.x; ++x)
+            {
+                const int x2 = std::min(2 * x + 1, src.size.x - 1);
+                const Component* pixels[4] = { src.pixel(2 * x, 2 * y), src.pixel(x2, 2 * y), src.pixel(2 * x, y2), src.pixel(x2, y2) };
+                double sum[3] = { 0, 0, 0 };
+                int count = 0;
+                Component alpha = Component();
+                for (int j = 0; j < 4; ++j)
+                {
+                    if (pixels[j][channels] > 0)
+                    {
+                        for (int c = 0; c < channels; ++c)
+                        {
+                            sum[c] += pixels[j][c];
+                        };
+                        alpha = std::max(alpha, pixels[j][channels]);
+                        ++count;
+                    };
+                };
+                Component* p = &dest.data[(static_cast<size_t>(y) * dest.size.x + x) * dest.samples];
+                for (int c = 0; c < channels; ++c)
+                {
+                    p[c] = count > 0 ? vigra::NumericTraits<Component>::fromRealPromote(sum[c] / count) : Component();
+                };
+                p[channels] = alpha;
+            };
+        };
+        return dest;
+    };
+
+    /** reads all tiles of the current directory and compares them with @p expected */
+    template <class Component>
+    bool TilesMatch(TIFF* tiff, const Interleaved<Component>& expected)
+    {
+        std::vector<Component> tile(TIFFTileSize(tiff) / sizeof(Component));
+        for (int ty = 0; ty < expected.size.y; ty += TileSize)
+        {
+            for (int tx = 0; tx < expected.size.x; tx += TileSize)
+            {
+                if (TIFFReadTile(tiff, &tile[0], tx, ty, 0, 0) < 0)
+                {
+                    return false;
+                };
+                for (int y = ty; y < std::min(ty + TileSize, expected.size.y); ++y)
+                {
+                    for (int x = tx; x < std::min(tx + TileSize, expected.size.x); ++x)
+                    {
+                        const Component* read = &tile[(static_cast<size_t>(y - ty) * TileSize + x - tx) * expected.samples];
+                        if (!std::equal(read, read + expected.samples, expected.pixel(x, y)))
+                        {
+                            return false;
+                        };
+                    };
+                };
+            };
+        };
+        return true;
+    };
+
+    /** checks the size and the tile structure of the current directory */
+    bool DirectoryMatches(TIFF* tiff, const vigra::Size2D& size, int samples, uint16 compression)
+    {
+        uint32 width = 0, height = 0, tileWidth = 0, tileHeight = 0;
+        uint16 samplesPerPixel = 0, readCompression = 0;
+        return TIFFIsTiled(tiff) &&
+            TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) && width == static_cast<uint32>(size.x) &&
+            TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height) && height == static_cast<uint32>(size.y) &&
+            TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth) && tileWidth == TileSize &&
+            TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight) && tileHeight == TileSize &&
+            TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel) && samplesPerPixel == samples &&
+            TIFFGetField(tiff, TIFFTAG_COMPRESSION, &readCompression) && readCompression == compression;
+    };
+
+    template <class TRAITS>
+    void TestRoundTrip(const std::string& dir, const std::string& compression, uint16 tiffCompression, const std::string& name)
+    {
+        typedef typename TRAITS::PixelType PixelType;
+        typedef vigra_ext::TiledTiffWriter<PixelType> Writer;
+        typedef typename Writer::component_type Component;
+        const vigra::Size2D size(150, 100);
+        const int channels = sizeof(PixelType) / sizeof(Component);
+
+        // some transparent pixels, a fully transparent block and an
+        // image size, which is not a multiple of the tile size
+        vigra::BasicImage<PixelType> image(size);
+        vigra::BImage mask(size);
+        Interleaved<Component> expected;
+        expected.size = size;
+        expected.samples = channels + 1;
+        expected.data.resize(static_cast<size_t>(size.area()) * expected.samples);
+        const Component opaque = vigra::NumericTraits<Component>::fromRealPromote(255 * vigra_ext::TiffTileTraits<Component>::alphaScale());
+        for (int y = 0; y < size.y; ++y)
+        {
+            for (int x = 0; x < size.x; ++x)
+            {
+                image(x, y) = TRAITS::Value(x, y);
+                const bool transparent = (x + 2 * y) % 7 == 0 || (x >= 40 && x < 80 && y >= 10 && y < 30);
+                mask(x, y) = transparent ? 0 : 255;
+                Component* p = &expected.data[(static_cast<size_t>(y) * size.x + x) * expected.samples];
+                for (int c = 0; c < channels; ++c)
+                {
+                    p[c] = vigra_ext::getTiffTileComponent(image(x, y), c);
+                };
+                p[channels] = transparent ? Component() : opaque;
+            };
+        };
+
+        const std::string filename(dir + "/test_tiledtiff.tif");
+        {
+            Writer writer;
+            check(writer.open(filename, size, TileSize, compression, false, vigra::Diff2D(0, 0), size,
+                vigra::ImageExportInfo::ICCProfile(), true), name + ": file is created");
+            bool written = true;
+            for (int y = 0; y < size.y; y += TileSize)
+            {
+                written = written && writer.writeTileRow(y, image.upperLeft() + vigra::Diff2D(0, y), image.accessor(),
+                    mask.upperLeft() + vigra::Diff2D(0, y), mask.accessor());
+            };
+            check(written, name + ": all tile rows are written");
+            check(writer.close(), name + ": overviews are written");
+        }
+
+        TIFF* tiff = TIFFOpen(filename.c_str(), "r");
+        check(tiff != NULL, name + ": file is read");
+        if (tiff == NULL)
+        {
+            return;
+        };
+        check(DirectoryMatches(tiff, size, expected.samples, tiffCompression), name + ": full resolution image has tile structure");
+        check(TilesMatch(tiff, expected), name + ": full resolution tiles have the original pixels");
+        // overviews until the image fits into a single tile: 75x50, 38x25, 19x13
+        int levels = 0;
+        Interleaved<Component> level = expected;
+        while (level.size.x > TileSize || level.size.y > TileSize)
+        {
+            level = Reduce(level);
+            ++levels;
+            std::ostringstream levelName;
+            levelName << name << ": overview " << levels;
+            if (!TIFFReadDirectory(tiff))
+            {
+                check(false, levelName.str() + " exists");
+                break;
+            };
+            uint32 subfileType = 0;
+            check(TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &subfileType) && subfileType == FILETYPE_REDUCEDIMAGE,
+                levelName.str() + " is a reduced image");
+            check(DirectoryMatches(tiff, level.size, expected.samples, tiffCompression), levelName.str() + " has tile structure");
+            check(TilesMatch(tiff, level), levelName.str() + " has the averaged pixels");
+        };
+        check(levels == 3, name + ": three overview levels");
+        check(!TIFFReadDirectory(tiff), name + ": no further directories");
+        TIFFClose(tiff);
+        std::remove(filename.c_str());
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string dir(argc > 1 ? argv[1] : ".");
+    // DEFLATE tiles are compressed by TiledTiffWriter, LZW tiles by libtiff
+    TestRoundTrip<RGBPixel>(dir, "DEFLATE", COMPRESSION_DEFLATE, "RGB, DEFLATE");
+    TestRoundTrip<RGBPixel>(dir, "LZW", COMPRESSION_LZW, "RGB, LZW");
+    TestRoundTrip<FloatPixel>(dir, "DEFLATE", COMPRESSION_DEFLATE, "float, DEFLATE");
+    TestRoundTrip<FloatPixel>(dir, "NONE", COMPRESSION_NONE, "float, uncompressed");
+
+    if (failures == 0)
+    {
+        std::cout << "all tiled tiff tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
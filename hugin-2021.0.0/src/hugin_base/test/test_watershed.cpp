@@ -0,0 +1,222 @@
+// -*- c-basic-offset: 4 -*-
+/** @file test_watershed.cpp
+ *
+ *  @brief checks that the parallel and the coarse-to-fine watershed give a
+ *         valid seam, which matches the serial seam away from the seam band
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <vigra/stdimage.hxx>
+#include <vigra_ext/StitchWatershed.h>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << description << std::endl;
+            ++failures;
+        };
+    };
+
+    /** seeds of image 1 on the left and of image 2 on the right, the overlap
+     *  in between is unlabeled. A hole inside the left part is unlabeled too
+     *  and surrounded only by seeds of image 1. */
+    vigra::BImage CreateSeeds(const vigra::Size2D& size)
+    {
+        vigra::BImage labels(size);
+        for (int y = 0; y < size.height(); ++y)
+        {
+            for (int x = 0; x < size.width(); ++x)
+            {
+                if (x < size.width() / 4)
+                {
+                    const bool hole = x > size.width() / 16 && x < size.width() / 8 && y > size.height() / 3 && y < size.height() / 2;
+                    labels(x, y) = hole ? 0 : 1;
+                }
+                else
+                {
+                    labels(x, y) = (x < 3 * size.width() / 4) ? 0 : 2;
+                };
+            };
+        };
+        return labels;
+    };
+
+    /** high cost with a curved valley through the overlap and some noise */
+    vigra::BImage CreateCost(const vigra::Size2D& size)
+    {
+        vigra::BImage cost(size);
+        unsigned int state = 1;
+        for (int y = 0; y < size.height(); ++y)
+        {
+            const double valley = size.width() / 2 + size.width() / 10 * sin(y / (size.height() / 6.0));
+            for (int x = 0; x < size.width(); ++x)
+            {
+                state = state * 1103515245U + 12345U;
+                const int noise = (state >> 16) % 20;
+                const double distance = std::abs(x - valley);
+                cost(x, y) = static_cast<vigra::UInt8>(std::min(235.0, 8.0 * distance) + noise);
+            };
+        };
+        return cost;
+    };
+
+    /** the seam of the serial watershed */
+    vigra::BImage SerialWatershed(const vigra::BImage& cost, const vigra::BImage& seeds)
+    {
+        vigra::BImage labels(seeds);
+        vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
+        vigra::fastSeededRegionGrowing(vigra::srcImageRange(cost), vigra::destImage(labels), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+        return labels;
+    };
+
+    /** all pixels are labeled 1 or 2, the seeds are unchanged and each
+     *  labeled area is connected to the seeds with the same label */
+    bool ValidSeam(const vigra::BImage& labels, const vigra::BImage& seeds)
+    {
+        const int width = labels.width();
+        const int height = labels.height();
+        std::vector<bool> reached(width * height, false);
+        std::vector<int> queue;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                if ((labels(x, y) != 1 && labels(x, y) != 2) || (seeds(x, y) != 0 && labels(x, y) != seeds(x, y)))
+                {
+                    return false;
+                };
+                if (seeds(x, y) != 0)
+                {
+                    reached[y * width + x] = true;
+                    queue.push_back(y * width + x);
+                };
+            };
+        };
+        // flood fill from the seeds through pixels with the same label
+        while (!queue.empty())
+        {
+            const int index = queue.back();
+            queue.pop_back();
+            const int x = index % width;
+            const int y = index / width;
+            const int neighbours[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+            for (int i = 0; i < 4; ++i)
+            {
+                const int nx = neighbours[i][0];
+                const int ny = neighbours[i][1];
+                if (nx >= 0 && ny >= 0 && nx < width && ny < height && !reached[ny * width + nx] && labels(nx, ny) == labels(x, y))
+                {
+                    reached[ny * width + nx] = true;
+                    queue.push_back(ny * width + nx);
+                };
+            };
+        };
+        return std::find(reached.begin(), reached.end(), false) == reached.end();
+    };
+
+    /** mark all pixels within @p radius of a pixel with a different 4-neighbour */
+    vigra::BImage SeamBand(const vigra::BImage& labels, int radius)
+    {
+        vigra::BImage band(labels.size(), vigra::UInt8(0));
+        for (int y = 0; y < labels.height(); ++y)
+        {
+            for (int x = 0; x < labels.width(); ++x)
+            {
+                const bool seam = (x + 1 < labels.width() && labels(x + 1, y) != labels(x, y)) ||
+                    (y + 1 < labels.height() && labels(x, y + 1) != labels(x, y));
+                if (!seam)
+                {
+                    continue;
+                };
+                for (int dy = std::max(y - radius, 0); dy <= std::min(y + radius + 1, labels.height() - 1); ++dy)
+                {
+                    for (int dx = std::max(x - radius, 0); dx <= std::min(x + radius + 1, labels.width() - 1); ++dx)
+                    {
+                        band(dx, dy) = 1;
+                    };
+                };
+            };
+        };
+        return band;
+    };
+
+    /** number of pixels outside the band, where the labels differ */
+    int DifferencesOutsideBand(const vigra::BImage& labels, const vigra::BImage& reference, const vigra::BImage& band)
+    {
+        int differences = 0;
+        for (int y = 0; y < labels.height(); ++y)
+        {
+            for (int x = 0; x < labels.width(); ++x)
+            {
+                if (band(x, y) == 0 && labels(x, y) != reference(x, y))
+                {
+                    ++differences;
+                };
+            };
+        };
+        return differences;
+    };
+
+    /** compare the seam with the serial watershed
+     *  @param bandRadius distance from the serial seam, beyond which the labels must match */
+    void TestSeam(const vigra::Size2D& size, int bandRadius, const std::string& name)
+    {
+        const vigra::BImage cost = CreateCost(size);
+        const vigra::BImage seeds = CreateSeeds(size);
+        const vigra::BImage serial = SerialWatershed(cost, seeds);
+        check(ValidSeam(serial, seeds), name + ": serial seam is valid");
+
+        vigra::BImage parallel(seeds);
+        vigra_ext::detail::SeededRegionGrowingParallel(cost, parallel);
+        check(ValidSeam(parallel, seeds), name + ": parallel seam is valid");
+        check(DifferencesOutsideBand(parallel, serial, SeamBand(serial, 2)) == 0, name + ": parallel seam matches serial seam");
+
+        vigra::BImage watershed(seeds);
+        vigra_ext::detail::SeamWatershed(cost, watershed);
+        check(ValidSeam(watershed, seeds), name + ": watershed seam is valid");
+        check(DifferencesOutsideBand(watershed, serial, SeamBand(serial, bandRadius)) == 0,
+            name + ": watershed seam matches serial seam away from the band");
+        // the hole is only surrounded by image 1
+        check(watershed(size.width() / 10, size.height() * 5 / 12) == 1, name + ": enclosed region gets the surrounding label");
+    };
+}
+
+int main()
+{
+    // below 1 megapixel the watershed runs at full resolution
+    TestSeam(vigra::Size2D(640, 480), 2, "full resolution");
+    // above it is reduced by 2, the band around the coarse seam is 3 reduced
+    // pixels wide
+    TestSeam(vigra::Size2D(1200, 1000), 8, "coarse to fine");
+
+    if (failures == 0)
+    {
+        std::cout << "all watershed tests passed" << std::endl;
+    };
+    return failures == 0 ? 0 : 1;
+}
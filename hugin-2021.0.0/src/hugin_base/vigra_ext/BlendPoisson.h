@@ -29,6 +29,7 @@
 #define POISSON_BLEND_H
 
 #include <iostream>
+#include <vector>
 #include <vigra/stdimage.hxx>
 #include <vigra/convolution.hxx>
 #include <vigra/stdconvolution.hxx>
@@ -293,290 +294,198 @@ double GetRealValue(const ComponentType& val) { return val; }
 template <class ComponentType>
 double GetRealValue(const vigra::RGBValue<ComponentType>& val) { return val.magnitude(); }
 
+// sum of the 4 neighbours of pixel x, y with the special handling of the image borders,
+// the seam border pixels (seam mask value 2) and the wrap around
 template <class Image, class SeamMask>
-void SOR(Image& target, const Image& gradient, const SeamMask& seams, const float omega, const float errorThreshold, const int maxIter, const bool doWrap)
+inline typename Image::PixelType GetNeighborSum(const int x, const int y, const Image& target, const SeamMask& seams, const bool doWrap)
 {
-    typedef typename Image::PixelType TargetPixelType;
+    typedef typename Image::PixelType ImagePixelType;
     const int width = target.width();
     const int height = target.height();
-
-    // changes in last iteration
-    double oldError = 0;
-    for (int j = 0; j < maxIter; j++)
+    ImagePixelType sum;
+    // horizontal neighbours
+    if (x == 0)
     {
-        // changes in current iteration
-        double error = 0;
-        // special treatment of first line
-        if (seams[0][0] > 1)
+        sum = doWrap ? ImagePixelType(target[y][1] + target[y][width - 1]) : ImagePixelType(2 * target[y][1]);
+    }
+    else
+    {
+        if (x == width - 1)
         {
-            if (doWrap)
+            sum = doWrap ? ImagePixelType(target[y][width - 2] + target[y][0]) : ImagePixelType(2 * target[y][width - 2]);
+        }
+        else
+        {
+            if (y == 0 || y == height - 1 || seams[y][x] == 2)
             {
-                const TargetPixelType delta = omega * ((gradient[0][0] + target[0][1] + 2 * target[1][0] + target[0][width - 1]) / 4.0f - target[0][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][0] += delta;
+                sum = GetBorderValues(x, y, 1, 0, target, seams);
             }
             else
             {
-                const TargetPixelType delta = omega * ((gradient[0][0] + 2 * target[0][1] + 2 * target[1][0]) / 4.0f - target[0][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][0] += delta;
+                sum = target[y][x - 1] + target[y][x + 1];
             };
         };
-        for (int x = 1; x < width - 1; ++x)
+    };
+    // vertical neighbours
+    if (y == 0)
+    {
+        sum += 2 * target[1][x];
+    }
+    else
+    {
+        if (y == height - 1)
         {
-            if (seams[0][x] > 1)
-            {
-                const TargetPixelType delta = omega * ((gradient[0][x] + detail::GetBorderValues(x, 0, 1, 0, target, seams) + 2 * target[1][x]) / 4.0f - target[0][x]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][x] += delta;
-            };
-        };
-        if (seams[0][width - 1] > 1)
+            sum += 2 * target[height - 2][x];
+        }
+        else
         {
-            if (doWrap)
+            if (x == 0 || x == width - 1 || seams[y][x] == 2)
             {
-                const TargetPixelType delta = omega * ((gradient[0][width - 1] + target[0][width - 2] + 2 * target[1][width - 1] + target[0][0]) / 4.0f - target[0][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][width - 1] += delta;
+                sum += GetBorderValues(x, y, 0, 1, target, seams);
             }
             else
             {
-                const TargetPixelType delta = omega * ((gradient[0][width - 1] + 2 * target[0][width - 2] + 2 * target[1][width - 1]) / 4.0f - target[0][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[0][width - 1] += delta;
+                sum += target[y - 1][x] + target[y + 1][x];
             };
         };
-#pragma omp parallel for reduction(+: error) schedule(dynamic, 100)
-        for (int y = 1; y < height - 1; ++y)
+    };
+    return sum;
+};
+
+// one SOR update of pixel x, y, returns the squared change
+template <class Image, class SeamMask>
+inline double RelaxPixel(const int x, const int y, Image& target, const Image& gradient, const SeamMask& seams, const float omega, const bool doWrap)
+{
+    const typename Image::PixelType delta = omega * ((gradient[y][x] + GetNeighborSum(x, y, target, seams, doWrap)) / 4.0f - target[y][x]);
+    target[y][x] += delta;
+    return GetRealValue(delta * delta);
+};
+
+// size of the tiles, which are processed in parallel by the SOR sweeps
+const int PoissonTileSize = 64;
+
+/** red-black SOR, with omega=1 this is a red-black Gauss-Seidel smoother.
+ *  All pixels of one colour depend only on pixels of the other colour, so each half sweep
+ *  can be processed in parallel without races. The work is split into tiles which are
+ *  distributed dynamically to the threads.
+ *  The iteration stops early when the changes decrease by less than errorThreshold (log10)
+ *  between two iterations, with errorThreshold=0 always maxIter iterations are done.
+ *  @return number of iterations done
+ */
+template <class Image, class SeamMask>
+int SOR(Image& target, const Image& gradient, const SeamMask& seams, const float omega, const float errorThreshold, const int maxIter, const bool doWrap)
+{
+    const int width = target.width();
+    const int height = target.height();
+    const int tilesX = (width + PoissonTileSize - 1) / PoissonTileSize;
+    const int tilesY = (height + PoissonTileSize - 1) / PoissonTileSize;
+    const int nrTiles = tilesX * tilesY;
+    // with wrap around and an odd width the first and the last column have the same colour
+    // and are neighbours, so the last column is updated separately after the tiles
+    const bool separateLastColumn = doWrap && (width % 2 == 1);
+    const int tilesRight = separateLastColumn ? width - 1 : width;
+
+    // changes in last iteration
+    double oldError = 0;
+    int iter = 0;
+    while (iter < maxIter)
+    {
+        ++iter;
+        // changes in current iteration
+        double error = 0;
+        for (int colour = 0; colour < 2; ++colour)
         {
-            if (seams[y][0] > 1)
-            {
-                if (doWrap)
-                {
-                    const TargetPixelType delta = omega * ((gradient[y][0] + detail::GetBorderValues(0, y, 0, 1, target, seams)
-                        + target[y][1] + target[y][width - 1]) / 4.0f - target[y][0]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][0] += delta;
-                }
-                else
-                {
-                    const TargetPixelType delta = omega * ((gradient[y][0] + detail::GetBorderValues(0, y, 0, 1, target, seams) + 2 * target[y][1]) / 4.0f - target[y][0]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][0] += delta;
-                };
-            };
-            for (int x = 1; x < width - 1; ++x)
+#pragma omp parallel for reduction(+: error) schedule(dynamic, 1)
+            for (int tile = 0; tile < nrTiles; ++tile)
             {
-                const typename SeamMask::value_type maskValue = seams[y][x];
-                if (maskValue > 1)
+                const int left = (tile % tilesX) * PoissonTileSize;
+                const int top = (tile / tilesX) * PoissonTileSize;
+                const int right = std::min(left + PoissonTileSize, tilesRight);
+                const int bottom = std::min(top + PoissonTileSize, height);
+                for (int y = top; y < bottom; ++y)
                 {
-                    if (maskValue == 2)
+                    // start with the first pixel of the current colour in this row
+                    for (int x = left + ((left + y + colour) & 1); x < right; x += 2)
                     {
-                        // border pixel
-                        const TargetPixelType sum = detail::GetBorderValues(x, y, 1, 0, target, seams) + detail::GetBorderValues(x, y, 0, 1, target, seams);
-                        const TargetPixelType delta = omega * ((gradient[y][x] + sum) / 4.0f - target[y][x]);
-                        error += detail::GetRealValue(delta*delta);
-                        target[y][x] += delta;
-                    }
-                    else
-                    {
-                        const TargetPixelType sum = target[y + 1][x] + target[y][x + 1] + target[y - 1][x] + target[y][x - 1];
-                        const TargetPixelType delta = omega * ((gradient[y][x] + sum) / 4.0f - target[y][x]);
-                        error += detail::GetRealValue(delta*delta);
-                        target[y][x] += delta;
+                        if (seams[y][x] > 1)
+                        {
+                            error += RelaxPixel(x, y, target, gradient, seams, omega, doWrap);
+                        };
                     };
                 };
             };
-            if (seams[y][width - 1] > 1)
+            if (separateLastColumn)
             {
-                if (doWrap)
+#pragma omp parallel for reduction(+: error)
+                for (int y = (width - 1 + colour) & 1; y < height; y += 2)
                 {
-                    const TargetPixelType delta = omega * ((gradient[y][width - 1] + detail::GetBorderValues(width - 1, y, 0, 1, target, seams) + target[y][width - 2] + target[y][0]) / 4.0f - target[y][width - 1]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][width - 1] += delta;
-                }
-                else
-                {
-                    const TargetPixelType delta = omega * ((gradient[y][width - 1] + detail::GetBorderValues(width - 1, y, 0, 1, target, seams) + 2 * target[y][width - 2]) / 4.0f - target[y][width - 1]);
-                    error += detail::GetRealValue(delta*delta);
-                    target[y][width - 1] += delta;
+                    if (seams[y][width - 1] > 1)
+                    {
+                        error += RelaxPixel(width - 1, y, target, gradient, seams, omega, doWrap);
+                    };
                 };
             };
         };
-        // last line
-        if (seams[height - 1][0] > 1)
-        {
-            if (doWrap)
-            {
-                const TargetPixelType delta = omega * ((gradient[height - 1][0] + 2 * target[height - 2][0] + target[height - 1][1] + target[height - 1][width - 1]) / 4.0f - target[height - 1][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][0] += delta;
-            }
-            else
-            {
-                const TargetPixelType delta = omega * ((gradient[height - 1][0] + 2 * target[height - 2][0] + 2 * target[height - 1][1]) / 4.0f - target[height - 1][0]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][0] += delta;
-            };
-        };
-        for (int x = 1; x < width - 1; ++x)
-        {
-            if (seams[height - 1][x] > 1)
-            {
-                const TargetPixelType delta = omega * ((gradient[height - 1][x] + detail::GetBorderValues(x, height - 1, 1, 0, target, seams) + 2 * target[height - 2][x]) / 4.0f - target[height - 1][x]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][x] += delta;
-            };
-        };
-        if (seams[height - 1][width - 1] > 1)
-        {
-            if (doWrap)
-            {
-                const TargetPixelType delta = omega * ((gradient[height - 1][width - 1] + 2 * target[height - 2][width - 1] + target[height - 1][width - 2] + target[height - 1][0]) / 4.0f - target[height - 1][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][width - 1] += delta;
-            }
-            else
-            {
-                const TargetPixelType delta = omega * ((gradient[height - 1][width - 1] + 2 * target[height - 2][width - 1] + 2 * target[height - 1][width - 2]) / 4.0f - target[height - 1][width - 1]);
-                error += detail::GetRealValue(delta*delta);
-                target[height - 1][width - 1] += delta;
-            };
-        };
-
-        if (oldError > 0 && log(oldError / error) / log(10.0) < errorThreshold)
+        if (error == 0 || (errorThreshold > 0 && oldError > 0 && log(oldError / error) / log(10.0) < errorThreshold))
         {
             break;
         }
         oldError = error;
     }
+    return iter;
 }
 
+/** calculates the residual of the current solution into error
+ *  @return root mean square of the residual of all unknown pixels */
 template <class Image, class SeamMask>
-void CalcResidualError(Image& error, const Image& target, const Image& gradient, const SeamMask& seam, const bool doWrap)
+double CalcResidualError(Image& error, const Image& target, const Image& gradient, const SeamMask& seam, const bool doWrap)
 {
-    typedef typename Image::PixelType ImagePixelType;
     const int width = target.width();
     const int height = target.height();
-
-    if (seam[0][0] > 1)
+    double sumSquares = 0;
+    long long count = 0;
+#pragma omp parallel for reduction(+: sumSquares, count) schedule(dynamic, 100)
+    for (int y = 0; y < height; ++y)
     {
-        if (doWrap)
-        {
-            const ImagePixelType sum = 2 * target[1][0] + target[0][1] + target[0][width - 1];
-            error[0][0] = (4 * target[0][0] - sum - gradient[0][0]);
-        }
-        else
+        for (int x = 0; x < width; ++x)
         {
-            const ImagePixelType sum = 2 * target[1][0] + 2 * target[0][1];
-            error[0][0] = (4 * target[0][0] - sum - gradient[0][0]);
-        };
-    };
-    for (int x = 1; x < width - 1; ++x)
-    {
-        if (seam[0][x]>1)
-        {
-            const ImagePixelType sum = 2 * target[1][x] + detail::GetBorderValues(x, 0, 1, 0, target, seam);
-            error[0][x] = (4 * target[0][x] - sum - gradient[0][x]);
+            if (seam[y][x] > 1)
+            {
+                error[y][x] = 4 * target[y][x] - GetNeighborSum(x, y, target, seam, doWrap) - gradient[y][x];
+                sumSquares += GetRealValue(error[y][x] * error[y][x]);
+                ++count;
+            };
         };
     };
-    if (seam[0][width - 1] > 1)
-    {
-        if (doWrap)
-        {
-            const ImagePixelType sum = 2 * target[1][width - 1] + target[0][width - 2] + target[0][0];
-            error[0][width - 1] = (4 * target[0][width - 1] - sum - gradient[0][width - 1]);
-        }
-        else
-        {
-            const ImagePixelType sum = 2 * target[1][width - 1] + 2 * target[0][width - 2];
-            error[0][width - 1] = (4 * target[0][width - 1] - sum - gradient[0][width - 1]);
-        }
-    };
+    return count > 0 ? sqrt(sumSquares / count) : 0.0;
+}
+
+/** bilinear prolongation of the coarse grid correction and subtraction from the solution,
+ *  only the interior pixels (seam mask > 2) are corrected */
+template <class Image, class SeamMask>
+void ProlongateAndCorrect(const Image& coarse, Image& target, const SeamMask& seam)
+{
+    const int width = target.width();
+    const int height = target.height();
+    const int coarseWidth = coarse.width();
+    const int coarseHeight = coarse.height();
 #pragma omp parallel for schedule(dynamic, 100)
-    for (int y = 1; y < height - 1; ++y)
+    for (int y = 0; y < height; ++y)
     {
-        if (seam[y][0] > 1)
+        // the fine pixel centers are at a quarter of the coarse pixel size
+        // from the coarse pixel center
+        const int cy = std::min(y / 2, coarseHeight - 1);
+        const int cy2 = (y % 2 == 0) ? std::max(cy - 1, 0) : std::min(cy + 1, coarseHeight - 1);
+        for (int x = 0; x < width; ++x)
         {
-            if (doWrap)
+            if (seam[y][x] > 2)
             {
-                const ImagePixelType sum = detail::GetBorderValues(0, y, 0, 1, target, seam) + target[y][1] + target[y][width - 1];
-                error[y][0] = (4 * target[y][0] - sum - gradient[y][0]);
-            }
-            else
-            {
-                const ImagePixelType sum = detail::GetBorderValues(0, y, 0, 1, target, seam) + 2 * target[y][1];
-                error[y][0] = (4 * target[y][0] - sum - gradient[y][0]);
-            };
-        }
-        for (int x = 1; x < width - 1; ++x)
-        {
-            const typename SeamMask::value_type maskValue = seam[y][x];
-            if (maskValue > 1)
-            {
-                if (maskValue == 2)
-                {
-                    // border pixel
-                    const ImagePixelType sum = detail::GetBorderValues(x, y, 1, 0, target, seam) + detail::GetBorderValues(x, y, 0, 1, target, seam);
-                    error[y][x] = (4 * target[y][x] - sum - gradient[y][x]);
-                }
-                else
-                {
-                    const ImagePixelType sum = target[y + 1][x] + target[y][x + 1] + target[y - 1][x] + target[y][x - 1];
-                    error[y][x] = (4 * target[y][x] - sum - gradient[y][x]);
-                };
-            };
-        };
-        if (seam[y][width - 1] > 1)
-        {
-            if (doWrap)
-            {
-                const ImagePixelType sum = detail::GetBorderValues(width - 1, y, 0, 1, target, seam) + target[y][width - 2] + target[y][0];
-                error[y][width - 1] = (4 * target[y][width - 1] - sum - gradient[y][width - 1]);
-            }
-            else
-            {
-                const ImagePixelType sum = detail::GetBorderValues(width - 1, y, 0, 1, target, seam) + 2 * target[y][width - 2];
-                error[y][width - 1] = (4 * target[y][width - 1] - sum - gradient[y][width - 1]);
+                const int cx = std::min(x / 2, coarseWidth - 1);
+                const int cx2 = (x % 2 == 0) ? std::max(cx - 1, 0) : std::min(cx + 1, coarseWidth - 1);
+                target[y][x] -= 0.5625f * coarse[cy][cx] + 0.1875f * (coarse[cy][cx2] + coarse[cy2][cx]) + 0.0625f * coarse[cy2][cx2];
             };
         };
     };
-    // last line
-    if (seam[height - 1][0] > 1)
-    {
-        if (doWrap)
-        {
-            const ImagePixelType sum = 2 * target[height - 2][0] + target[height - 1][width - 1] + target[height - 1][1];
-            error[height - 1][0] = (4 * target[height - 1][0] - sum - gradient[height - 1][0]);
-        }
-        else
-        {
-            const ImagePixelType sum = 2 * target[height - 2][0] + 2 * target[height - 1][1];
-            error[height - 1][0] = (4 * target[height - 1][0] - sum - gradient[height - 1][0]);
-        };
-    };
-    for (int x = 1; x < width - 1; ++x)
-    {
-        if (seam[height - 1][x]>1)
-        {
-            const ImagePixelType sum = 2 * target[height-2][x] + detail::GetBorderValues(x, height - 1, 1, 0, target, seam);
-            error[height - 1][x] = (4 * target[height - 1][x] - sum - gradient[height - 1][x]);
-        };
-    };
-    if (seam[height - 1][width - 1] > 1)
-    {
-        if (doWrap)
-        {
-            const ImagePixelType sum = 2 * target[height - 2][width - 1] + target[height - 1][width - 2] + target[height - 1][0];
-            error[height - 1][width - 1] = (4 * target[height - 1][width - 1] - sum - gradient[height - 1][width - 1]);
-        }
-        else
-        {
-            const ImagePixelType sum = 2 * target[height - 2][width - 1] + 2 * target[height - 1][width - 2];
-            error[height - 1][width - 1] = (4 * target[height - 1][width - 1] - sum - gradient[height - 1][width - 1]);
-        };
-    };
-
 }
 
 } // namespace detail
@@ -837,19 +746,37 @@ void BuildGradientMap(const Image& image1, const Image& image2, const Mask& mask
     };
 };
 
+/** convergence report of SolveMultigrid */
+struct MultigridReport
+{
+    /** number of V-cycles done */
+    int cycles;
+    /** rms of the residual before the first and after the last cycle */
+    double initialResidual;
+    double finalResidual;
+    /** rms of the residual after each cycle */
+    std::vector<double> residuals;
+    /** true, if the requested reduction of the residual was reached */
+    bool converged;
+    MultigridReport() : cycles(0), initialResidual(0), finalResidual(0), converged(false) {};
+};
+
+/** one multigrid V-cycle: red-black Gauss-Seidel smoothing on each level, restriction of the residual
+ *  with RestrictErrorToNextLevel and bilinear prolongation of the coarse grid correction.
+ *  The coarsest level is solved with maxIter iterations of SOR, the coarse grid correction
+ *  is only effective when this level is solved accurately */
 template <class Image, class SeamMask>
-void Multigrid(Image& out, const Image& gradient, const vigra::ImagePyramid<SeamMask>& seamMaskPyramid, int minLen, const float errorThreshold, const int maxIter, const bool doWrap)
+void Multigrid(Image& out, const Image& gradient, const vigra::ImagePyramid<SeamMask>& seamMaskPyramid, int minLen, const int maxIter, const bool doWrap)
 {
     const int width = out.width();
     const int height = out.height();
+    // number of smoothing sweeps before and after the coarse grid correction
+    const int smoothingSteps = 2;
 
     if (width < minLen || height < minLen)
     {
         return;
     }
-    Image err(width, height);
-    Image err2((width + 1) / 2, (height + 1) / 2);
-    Image out2(err2.size());
     int maskIndex = -1;
     for (int i = 0; i <= seamMaskPyramid.highestLevel(); ++i)
     {
@@ -865,25 +792,62 @@ void Multigrid(Image& out, const Image& gradient, const vigra::ImagePyramid<Seam
             << "searching " << out.size() << ", finest " << seamMaskPyramid[seamMaskPyramid.highestLevel()].size() << std::endl;
         return;
     };
+    const SeamMask& seams = seamMaskPyramid[maskIndex];
+    if (maskIndex == seamMaskPyramid.highestLevel() || (width + 1) / 2 < minLen || (height + 1) / 2 < minLen)
+    {
+        // coarsest level, solve directly
+        detail::SOR(out, gradient, seams, 1.95f, 0.0f, maxIter, doWrap);
+        return;
+    };
+    Image err(width, height);
+    Image err2((width + 1) / 2, (height + 1) / 2);
+    Image out2(err2.size());
     // pre-smoothing
-    detail::SOR(out, gradient, seamMaskPyramid[maskIndex], 1.95f, errorThreshold, maxIter, doWrap);
-    detail::CalcResidualError(err, out, gradient, seamMaskPyramid[maskIndex], doWrap);    // Fehler berechnen
+    detail::SOR(out, gradient, seams, 1.0f, 0.0f, smoothingSteps, doWrap);
+    detail::CalcResidualError(err, out, gradient, seams, doWrap);
     detail::RestrictErrorToNextLevel(err, err2);
-    Multigrid(out2, err2, seamMaskPyramid, minLen, errorThreshold, maxIter, doWrap);
-    // when using a W cycle calculation another run of multigrid would follow
-    // Multigrid(out2, err2, seamMaskPyramid, minLen, errorThreshold, maxIter, doWrap); 
-    // this results in artefacts, maybe there is still a small error in other lines
-    // so trying to disable the W cycle and remain in a V cycle
-    vigra::resizeImageNoInterpolation(srcImageRange(out2), destImageRange(err)); 
-    vigra::omp::combineTwoImagesIf(vigra::srcImageRange(out), vigra::srcImage(err),
-        vigra::srcImage(seamMaskPyramid[maskIndex], MaskGreaterAccessor<typename SeamMask::PixelType>(2)),
-        vigra::destImage(out),
-        vigra::functor::Arg1() - vigra::functor::Arg2());
+    Multigrid(out2, err2, seamMaskPyramid, minLen, maxIter, doWrap);
+    // a W cycle would do a second run of multigrid here, but this resulted in artefacts,
+    // so remain in a V cycle
+    detail::ProlongateAndCorrect(out2, out, seams);
     // post smoothing
-    detail::SOR(out, gradient, seamMaskPyramid[maskIndex], 1.95f, 2.0f * errorThreshold, maxIter, doWrap);
+    detail::SOR(out, gradient, seams, 1.0f, 0.0f, smoothingSteps, doWrap);
     return;
 }
 
+/** solves the Poisson equation by repeated V-cycles until the rms of the residual has dropped
+ *  below tolerance times the initial residual, or the residual does not decrease any more.
+ *  @return convergence report */
+template <class Image, class SeamMask>
+MultigridReport SolveMultigrid(Image& out, const Image& gradient, const vigra::ImagePyramid<SeamMask>& seamMaskPyramid, int minLen, const double tolerance, const int maxCycles, const bool doWrap)
+{
+    MultigridReport report;
+    if (out.width() < minLen || out.height() < minLen)
+    {
+        return report;
+    };
+    Image err(out.size());
+    report.initialResidual = detail::CalcResidualError(err, out, gradient, seamMaskPyramid[0], doWrap);
+    report.finalResidual = report.initialResidual;
+    report.converged = report.initialResidual == 0;
+    while (!report.converged && report.cycles < maxCycles)
+    {
+        Multigrid(out, gradient, seamMaskPyramid, minLen, 500, doWrap);
+        ++report.cycles;
+        const double residual = detail::CalcResidualError(err, out, gradient, seamMaskPyramid[0], doWrap);
+        report.residuals.push_back(residual);
+        report.converged = residual <= tolerance * report.initialResidual;
+        // stop when the cycles don't improve the solution any more
+        const bool stalled = residual > 0.9 * report.finalResidual;
+        report.finalResidual = residual;
+        if (stalled)
+        {
+            break;
+        };
+    };
+    return report;
+}
+
 } // namespace poisson
 } // namespace vigra_ext
 
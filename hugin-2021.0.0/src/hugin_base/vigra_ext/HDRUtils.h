@@ -24,6 +24,7 @@
 #ifndef _VIGRA_EXT_HDRUTILS_H
 #define _VIGRA_EXT_HDRUTILS_H
 
+#include <vigra/stdimage.hxx>
 #include "ROIImage.h"
 #include "utils.h"
 #include "lut.h"
@@ -128,6 +129,163 @@ protected:
     double minW;
 };
 
+/** reduces a stack of images to a HDR image, one image after the other.
+ *
+ *  Gives the same result as ReduceToHDRFunctor applied to all values of a
+ *  pixel, but the images can be added one after the other, so the images of
+ *  the stack need not to be in memory at the same time. For each pixel only
+ *  the weighted sum, the sum of the weights and the brightest (or darkest)
+ *  value are stored. The brightest value is only needed as long as all values
+ *  of the pixel are overexposed, the darkest only as long as all values are
+ *  underexposed, so a single value is enough.
+ */
+template<class VALUETYPE=vigra::RGBValue<float> >
+class ReduceToHDRAccumulator
+{
+public:
+    typedef typename vigra::NumericTraits<VALUETYPE> Traits;
+    typedef typename Traits::RealPromote real_type;
+
+    /** create an accumulator for an output image of the given size */
+    explicit ReduceToHDRAccumulator(const vigra::Size2D& size)
+        : m_result(size), m_weight(size), m_extreme(size), m_state(size, vigra::UInt8(STATE_EMPTY))
+    {
+    }
+
+    /** add an image, the upper left corner of the image is at @p offset in the
+     *  output image. Pixels with a zero mask value are ignored. */
+    template <class SrcIter, class SrcAccessor, class MaskIter, class MaskAccessor>
+    void add(vigra::triple<SrcIter, SrcIter, SrcAccessor> src,
+             std::pair<MaskIter, MaskAccessor> mask,
+             vigra::Diff2D offset)
+    {
+        typedef typename MaskAccessor::value_type MaskType;
+        const vigra::Diff2D srcSize = src.second - src.first;
+        // only the part inside the output image
+        const vigra::Rect2D roi = vigra::Rect2D(vigra::Point2D(offset), vigra::Size2D(srcSize)) & vigra::Rect2D(m_state.size());
+        if (roi.isEmpty())
+        {
+            return;
+        };
+        const double eps = 1e-7;
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int y = roi.top(); y < roi.bottom(); ++y)
+        {
+            SrcIter sx = src.first + vigra::Diff2D(roi.left() - offset.x, y - offset.y);
+            MaskIter mx = mask.first + vigra::Diff2D(roi.left() - offset.x, y - offset.y);
+            for (int x = roi.left(); x < roi.right(); ++x, ++sx.x, ++mx.x)
+            {
+                const MaskType m = mask.second(mx);
+                if (!m)
+                {
+                    continue;
+                };
+                const VALUETYPE v = src.third(sx);
+                // same weight function as ReduceToHDRFunctor
+                const double nm = m / (double)vigra_ext::LUTTraits<MaskType>::max();
+                const double w = 0.5 - fabs(nm - 0.5);
+                m_result(x, y) += w * v;
+                m_weight(x, y) += w;
+                // track the brightest or darkest value, as long as all values are
+                // over- or underexposed
+                const bool over = nm > (1.0 - eps);
+                const bool under = nm < eps;
+                vigra::UInt8& state = m_state(x, y);
+                switch (state)
+                {
+                    case STATE_EMPTY:
+                        state = over ? STATE_OVEREXPOSED : (under ? STATE_UNDEREXPOSED : STATE_MIXED);
+                        m_extreme(x, y) = v;
+                        break;
+                    case STATE_OVEREXPOSED:
+                        if (!over)
+                        {
+                            state = STATE_MIXED;
+                        }
+                        else
+                        {
+                            if (getMaxComponent(v) > getMaxComponent(m_extreme(x, y)))
+                            {
+                                m_extreme(x, y) = v;
+                            };
+                        };
+                        break;
+                    case STATE_UNDEREXPOSED:
+                        if (!under)
+                        {
+                            state = STATE_MIXED;
+                        }
+                        else
+                        {
+                            if (getMaxComponent(v) < getMaxComponent(m_extreme(x, y)))
+                            {
+                                m_extreme(x, y) = v;
+                            };
+                        };
+                        break;
+                    default:
+                        break;
+                };
+            };
+        };
+    }
+
+    /** write the HDR image and its mask, the mask is set for all pixels
+     *  covered by at least one image */
+    template <class DestIter, class DestAccessor, class AlphaIter, class AlphaAccessor>
+    void getResult(vigra::triple<DestIter, DestIter, DestAccessor> dest,
+                   std::pair<AlphaIter, AlphaAccessor> alpha) const
+    {
+        typedef typename vigra::NumericTraits<typename DestAccessor::value_type> DestTraits;
+        typedef typename AlphaAccessor::value_type AlphaValue;
+        const vigra::Diff2D size = dest.second - dest.first;
+        vigra_precondition(size == vigra::Diff2D(m_state.size()), "ReduceToHDRAccumulator::getResult(): wrong image size");
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int y = 0; y < size.y; ++y)
+        {
+            DestIter dx = dest.first + vigra::Diff2D(0, y);
+            AlphaIter ax = alpha.first + vigra::Diff2D(0, y);
+            for (int x = 0; x < size.x; ++x, ++dx.x, ++ax.x)
+            {
+                const vigra::UInt8 state = m_state(x, y);
+                real_type value;
+                if (state == STATE_OVEREXPOSED || state == STATE_UNDEREXPOSED)
+                {
+                    // all pixels over- or underexposed, use brightest or darkest value
+                    value = m_extreme(x, y);
+                }
+                else
+                {
+                    if (m_weight(x, y) > 0)
+                    {
+                        value = m_result(x, y) / m_weight(x, y);
+                    }
+                    else
+                    {
+                        value = m_result(x, y);
+                    };
+                };
+                dest.third.set(DestTraits::fromRealPromote(value), dx);
+                alpha.second.set(state == STATE_EMPTY ? AlphaValue(0) : vigra_ext::LUTTraits<AlphaValue>::max(), ax);
+            };
+        };
+    }
+
+private:
+    enum PixelState
+    {
+        STATE_EMPTY = 0,
+        STATE_OVEREXPOSED,
+        STATE_UNDEREXPOSED,
+        STATE_MIXED
+    };
+    vigra::BasicImage<real_type> m_result;
+    // double like ReduceToHDRFunctor, so both give the same result
+    vigra::DImage m_weight;
+    vigra::BasicImage<real_type> m_extreme;
+    vigra::BImage m_state;
+};
+
 #if 0
 /** This is a sigmoid function. It is monotonous, and needs to be
  *  transformed before used for weighting the HDR image. However,
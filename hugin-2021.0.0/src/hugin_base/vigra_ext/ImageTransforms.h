@@ -28,10 +28,14 @@
 #define _VIGRA_EXT_IMAGETRANSFORMS_H
 
 #include <fstream>
+#include <algorithm>
+#include <type_traits>
 
 #include <vigra/basicimage.hxx>
+#include <vigra/rgbvalue.hxx>
 #include <vigra_ext/ROIImage.h>
 #include <vigra_ext/Interpolators.h>
+#include <vigra_ext/InterpolatorsSIMD.h>
 
 #include <hugin_math/hugin_math.h>
 #include <hugin_utils/utils.h>
@@ -61,6 +65,275 @@ vigra::RGBValue<T> zeroNegative(vigra::RGBValue<T> p)
     return p;
 }
 
+namespace detail
+{
+    /** channel layout of the pixel types supported by simd::BatchInterpolator */
+    template <class PixelType>
+    struct SIMDPixelTraits
+    {
+        static const bool supported = false;
+        static const int channels = 0;
+        static const simd::ComponentType type = simd::COMPONENT_FLOAT;
+    };
+
+    template <class T, simd::ComponentType TYPE>
+    struct SIMDScalarPixelTraits
+    {
+        static const bool supported = true;
+        static const int channels = 1;
+        static const simd::ComponentType type = TYPE;
+        static T fromFloat(const float* v)
+        {
+            return vigra::NumericTraits<T>::fromRealPromote(v[0]);
+        };
+    };
+
+    template <>
+    struct SIMDPixelTraits<vigra::UInt8> : public SIMDScalarPixelTraits<vigra::UInt8, simd::COMPONENT_UINT8> {};
+    template <>
+    struct SIMDPixelTraits<vigra::UInt16> : public SIMDScalarPixelTraits<vigra::UInt16, simd::COMPONENT_UINT16> {};
+    template <>
+    struct SIMDPixelTraits<float> : public SIMDScalarPixelTraits<float, simd::COMPONENT_FLOAT> {};
+
+    template <class T>
+    struct SIMDPixelTraits<vigra::RGBValue<T> >
+    {
+        static const bool supported = SIMDPixelTraits<T>::supported;
+        static const int channels = 3;
+        static const simd::ComponentType type = SIMDPixelTraits<T>::type;
+        static vigra::RGBValue<T> fromFloat(const float* v)
+        {
+            return vigra::RGBValue<T>(SIMDPixelTraits<T>::fromFloat(v), SIMDPixelTraits<T>::fromFloat(v + 1),
+                                      SIMDPixelTraits<T>::fromFloat(v + 2));
+        };
+    };
+
+    /** image iterators which point to continuous rows in memory */
+    template <class Iterator>
+    struct SIMDIteratorTraits
+    {
+        typedef void pixel_type;
+    };
+    template <class P>
+    struct SIMDIteratorTraits<vigra::BasicImageIterator<P, P**> > { typedef P pixel_type; };
+    template <class P>
+    struct SIMDIteratorTraits<vigra::ConstBasicImageIterator<P, P**> > { typedef P pixel_type; };
+    template <class P>
+    struct SIMDIteratorTraits<vigra::ImageIterator<P> > { typedef P pixel_type; };
+    template <class P>
+    struct SIMDIteratorTraits<vigra::ConstImageIterator<P> > { typedef P pixel_type; };
+
+    /** accessors which return the pixel unmodified */
+    template <class Accessor, class PixelType>
+    struct SIMDAccessorTraits { static const bool supported = false; };
+    template <class P>
+    struct SIMDAccessorTraits<vigra::StandardValueAccessor<P>, P> { static const bool supported = true; };
+    template <class P>
+    struct SIMDAccessorTraits<vigra::StandardConstValueAccessor<P>, P> { static const bool supported = true; };
+    template <class P>
+    struct SIMDAccessorTraits<vigra::StandardAccessor<P>, P> { static const bool supported = true; };
+    template <class P>
+    struct SIMDAccessorTraits<vigra::StandardConstAccessor<P>, P> { static const bool supported = true; };
+    template <class P>
+    struct SIMDAccessorTraits<vigra::RGBAccessor<P>, P> { static const bool supported = true; };
+
+    /** interpolators with a vectorized implementation */
+    template <class Interpolator>
+    struct SIMDKernelTraits
+    {
+        static const bool supported = false;
+        static const simd::KernelType kernel = simd::KERNEL_NEAREST;
+    };
+    template <>
+    struct SIMDKernelTraits<interp_nearest>
+    {
+        static const bool supported = true;
+        static const simd::KernelType kernel = simd::KERNEL_NEAREST;
+    };
+    template <>
+    struct SIMDKernelTraits<interp_bilin>
+    {
+        static const bool supported = true;
+        static const simd::KernelType kernel = simd::KERNEL_BILINEAR;
+    };
+    template <>
+    struct SIMDKernelTraits<interp_cubic>
+    {
+        static const bool supported = true;
+        static const simd::KernelType kernel = simd::KERNEL_CUBIC;
+    };
+    template <>
+    struct SIMDKernelTraits<interp_spline16>
+    {
+        static const bool supported = true;
+        static const simd::KernelType kernel = simd::KERNEL_SPLINE16;
+    };
+
+    /** true, if the source image can be interpolated with simd::BatchInterpolator */
+    template <class SrcImageIterator, class SrcAccessor, class Interpolator>
+    struct SIMDSupported
+        : public std::integral_constant<bool,
+            SIMDPixelTraits<typename SIMDIteratorTraits<SrcImageIterator>::pixel_type>::supported &&
+            SIMDAccessorTraits<SrcAccessor, typename SIMDIteratorTraits<SrcImageIterator>::pixel_type>::supported &&
+            SIMDKernelTraits<Interpolator>::supported>
+    {};
+
+    /** transform the row of pixels (x .. x+n-1, y) with @p transform.
+     *  Transforms, which can evaluate a whole row faster, provide an overload
+     *  in their namespace */
+    template <class TRANSFORM>
+    inline void transformImgCoordRow(TRANSFORM& transform, double* x_dest, double* y_dest, bool* valid, int x, int y, int n)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            valid[i] = transform.transformImgCoord(x_dest[i], y_dest[i], x + i, y);
+        };
+    }
+
+    /** fallback for images and interpolators without vectorized kernel */
+    template <class SrcImageIterator, class SrcAccessor,
+              class DestImageIterator, class DestAccessor,
+              class TRANSFORM,
+              class PixelTransform,
+              class AlphaImageIterator, class AlphaAccessor,
+              class Interpolator, class ImageInterpolatorType>
+    bool transformImageSIMD(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+                            vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest,
+                            std::pair<AlphaImageIterator, AlphaAccessor> alpha,
+                            TRANSFORM & transform,
+                            PixelTransform & pixelTransform,
+                            vigra::Diff2D destUL,
+                            Interpolator interp,
+                            const ImageInterpolatorType& interpol,
+                            bool singleThreaded,
+                            std::false_type)
+    {
+        return false;
+    };
+
+    /** transform image, the pixels which are not near the border are
+     *  interpolated in batches with simd::BatchInterpolator, the remaining
+     *  pixels with the scalar interpolator
+     *  @return false, if there is no kernel for the image and nothing was done
+     */
+    template <class SrcImageIterator, class SrcAccessor,
+              class DestImageIterator, class DestAccessor,
+              class TRANSFORM,
+              class PixelTransform,
+              class AlphaImageIterator, class AlphaAccessor,
+              class Interpolator, class ImageInterpolatorType>
+    bool transformImageSIMD(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> src,
+                            vigra::triple<DestImageIterator, DestImageIterator, DestAccessor> dest,
+                            std::pair<AlphaImageIterator, AlphaAccessor> alpha,
+                            TRANSFORM & transform,
+                            PixelTransform & pixelTransform,
+                            vigra::Diff2D destUL,
+                            Interpolator interp,
+                            const ImageInterpolatorType& interpol,
+                            bool singleThreaded,
+                            std::true_type)
+    {
+        typedef typename SrcAccessor::value_type PixelType;
+        typedef SIMDPixelTraits<PixelType> PixelTraits;
+        const vigra::Diff2D srcSize = src.second - src.first;
+        if (srcSize.x <= 0 || srcSize.y <= 0)
+        {
+            return false;
+        };
+        const PixelType* srcData = &(*src.first);
+        std::ptrdiff_t stride = srcSize.x;
+        if (srcSize.y > 1)
+        {
+            stride = &(*(src.first + vigra::Diff2D(0, 1))) - srcData;
+        };
+        const simd::BatchInterpolator batchInterpol(srcData, srcSize.x, srcSize.y, stride * PixelTraits::channels,
+            PixelTraits::channels, PixelTraits::type, SIMDKernelTraits<Interpolator>::kernel);
+        if (!batchInterpol.isValid())
+        {
+            return false;
+        };
+
+        const vigra::Diff2D destSize = dest.second - dest.first;
+        const int xstart = destUL.x;
+        const int xend = destUL.x + destSize.x;
+        const int ystart = destUL.y;
+        const int yend = destUL.y + destSize.y;
+
+#pragma omp parallel for if(!singleThreaded) schedule(dynamic)
+        for (int y = ystart; y < yend; ++y)
+        {
+            // create x iterators
+            DestImageIterator xd(dest.first);
+            xd.y += y - ystart;
+            AlphaImageIterator xdm(alpha.first);
+            xdm.y += y - ystart;
+            double sx[simd::BatchSize];
+            double sy[simd::BatchSize];
+            bool valid[simd::BatchSize];
+            int batchIndex[simd::BatchSize];
+            float batchX[simd::BatchSize];
+            float batchY[simd::BatchSize];
+            float values[simd::BatchSize * PixelTraits::channels];
+            PixelType tempval;
+            for (int x = xstart; x < xend; x += simd::BatchSize)
+            {
+                const int n = std::min<int>(simd::BatchSize, xend - x);
+                // collect all points which can be interpolated without boundary handling
+                int nBatch = 0;
+                transformImgCoordRow(transform, sx, sy, valid, x, y, n);
+                for (int i = 0; i < n; ++i)
+                {
+                    // check the float coordinates used by the kernel, rounding
+                    // can move a point just below the border onto the border
+                    const float fx = static_cast<float>(sx[i]);
+                    const float fy = static_cast<float>(sy[i]);
+                    if (valid[i] && interpol.isInside(fx, fy))
+                    {
+                        batchX[nBatch] = fx;
+                        batchY[nBatch] = fy;
+                        batchIndex[i] = nBatch++;
+                    }
+                    else
+                    {
+                        batchIndex[i] = -1;
+                    };
+                };
+                if (nBatch > 0)
+                {
+                    batchInterpol(batchX, batchY, nBatch, values);
+                };
+                for (int i = 0; i < n; ++i, ++xd.x, ++xdm.x)
+                {
+                    bool ok = false;
+                    if (batchIndex[i] >= 0)
+                    {
+                        tempval = PixelTraits::fromFloat(values + batchIndex[i] * PixelTraits::channels);
+                        ok = true;
+                    }
+                    else
+                    {
+                        if (valid[i])
+                        {
+                            ok = interpol(sx[i], sy[i], tempval);
+                        };
+                    };
+                    if (ok)
+                    {
+                        // apply pixel transform and write to output
+                        dest.third.set(zeroNegative(pixelTransform(tempval, hugin_utils::FDiff2D(sx[i], sy[i]))), xd);
+                        alpha.second.set(pixelTransform.hdrWeight(tempval, vigra::UInt8(255)), xdm);
+                    }
+                    else
+                    {
+                        alpha.second.set(0, xdm);
+                    };
+                };
+            };
+        };
+        return true;
+    };
+} // namespace detail
+
 
 /** Transform an image into the panorama
  *
@@ -114,6 +387,13 @@ void transformImageIntern(vigra::triple<SrcImageIterator, SrcImageIterator, SrcA
     vigra_ext::ImageInterpolator<SrcImageIterator, SrcAccessor, Interpolator>
         interpol(src, interp, warparound);
 
+    // use the vectorized kernels, if there are some for this image type and interpolator
+    if (detail::transformImageSIMD(src, dest, alpha, transform, pixelTransform, destUL, interp, interpol, singleThreaded,
+            detail::SIMDSupported<SrcImageIterator, SrcAccessor, Interpolator>()))
+    {
+        return;
+    };
+
     // loop over the image and transform
 #pragma omp parallel for if(!singleThreaded) schedule(dynamic) 
     for (int y = ystart; y < yend; ++y)
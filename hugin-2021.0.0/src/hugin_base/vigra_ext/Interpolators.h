@@ -335,6 +335,18 @@ public:
     {
     }
 
+    /** returns true, if the whole neighbourhood of the point is inside the image,
+     *  so that the interpolation does not need any boundary handling */
+    bool isInside(double x, double y) const
+    {
+        if (x < -INTERPOLATOR::size/2 || x > m_w + INTERPOLATOR::size/2) return false;
+        if (y < -INTERPOLATOR::size/2 || y > m_h + INTERPOLATOR::size/2) return false;
+        const int srcx = int(floor(x));
+        const int srcy = int(floor(y));
+        return srcx > INTERPOLATOR::size/2 && srcx < m_w - INTERPOLATOR::size/2 &&
+               srcy > INTERPOLATOR::size/2 && srcy < m_h - INTERPOLATOR::size/2;
+    }
+
     /** Interpolate without mask, but return dummy alpha value nevertheless */
     bool operator()(double x, double y,
                     PixelType & result, MaskType & mask) const
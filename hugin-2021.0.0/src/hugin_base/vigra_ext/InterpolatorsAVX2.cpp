@@ -0,0 +1,88 @@
+// -*- c-basic-offset: 4 -*-
+/** @file InterpolatorsAVX2.cpp
+ *
+ *  Batch interpolation kernels using AVX2 and FMA, this file is compiled
+ *  with AVX2 enabled and only called if the cpu supports it.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "InterpolatorsSIMDImpl.h"
+
+#if defined __AVX2__ && (defined __FMA__ || defined _MSC_VER)
+#define HUGIN_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace vigra_ext {
+namespace simd {
+namespace detail {
+
+#ifdef HUGIN_HAVE_AVX2
+namespace
+{
+    /** 8 floats */
+    struct VecAVX2
+    {
+        typedef __m256 Float;
+        typedef __m256i Int;
+        static const int width = 8;
+
+        static Float load(const float* p) { return _mm256_loadu_ps(p); };
+        static void store(float* p, Float v) { _mm256_storeu_ps(p, v); };
+        static Float set1(float v) { return _mm256_set1_ps(v); };
+        static Float add(Float a, Float b) { return _mm256_add_ps(a, b); };
+        static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); };
+        static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); };
+        static Float madd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); };
+        static Float floor(Float a) { return _mm256_floor_ps(a); };
+        static Int toInt(Float a) { return _mm256_cvttps_epi32(a); };
+        static Int iset1(int v) { return _mm256_set1_epi32(v); };
+        static Int iadd(Int a, Int b) { return _mm256_add_epi32(a, b); };
+        static Int imul(Int a, int b) { return _mm256_mullo_epi32(a, _mm256_set1_epi32(b)); };
+        static Float gather(const float* p, Int index)
+        {
+            return _mm256_i32gather_ps(p, index, 4);
+        };
+        // the integer types are gathered as 32 bit values ending with the wanted
+        // element, this never reads outside the image because the kernels only
+        // access pixels with a distance of at least 2 rows from the image start
+        static Float gather(const uint16_t* p, Int index)
+        {
+            const Int v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(p - 1), index, 2);
+            return _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+        };
+        static Float gather(const uint8_t* p, Int index)
+        {
+            const Int v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(p - 3), index, 1);
+            return _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24));
+        };
+    };
+}
+#endif
+
+BatchInterpolator::BatchFunction GetBatchFunctionAVX2(ComponentType type, int channels, KernelType kernel)
+{
+#ifdef HUGIN_HAVE_AVX2
+    return selectBatchFunction<VecAVX2>(type, channels, kernel);
+#else
+    return NULL;
+#endif
+}
+
+} // namespace detail
+} // namespace simd
+} // namespace vigra_ext
@@ -0,0 +1,164 @@
+// -*- c-basic-offset: 4 -*-
+/** @file InterpolatorsSIMD.cpp
+ *
+ *  Runtime selection of the batch interpolation kernels and scalar fallback
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "InterpolatorsSIMDImpl.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#endif
+
+namespace vigra_ext {
+namespace simd {
+
+namespace detail
+{
+    /** "vector" with a single element, used on cpus without SSE4.1 */
+    struct VecScalar
+    {
+        typedef float Float;
+        typedef int Int;
+        static const int width = 1;
+
+        static Float load(const float* p) { return *p; };
+        static void store(float* p, Float v) { *p = v; };
+        static Float set1(float v) { return v; };
+        static Float add(Float a, Float b) { return a + b; };
+        static Float sub(Float a, Float b) { return a - b; };
+        static Float mul(Float a, Float b) { return a * b; };
+        static Float madd(Float a, Float b, Float c) { return a * b + c; };
+        static Float floor(Float a) { return std::floor(a); };
+        static Int toInt(Float a) { return static_cast<int>(a); };
+        static Int iset1(int v) { return v; };
+        static Int iadd(Int a, Int b) { return a + b; };
+        static Int imul(Int a, int b) { return a * b; };
+        template <class T>
+        static Float gather(const T* p, Int index) { return static_cast<float>(p[index]); };
+    };
+
+    BatchInterpolator::BatchFunction GetBatchFunctionScalar(ComponentType type, int channels, KernelType kernel)
+    {
+        return selectBatchFunction<VecScalar>(type, channels, kernel);
+    };
+
+    /** detect the instruction set of the cpu */
+    InstructionSet DetectInstructionSet()
+    {
+#if (defined __GNUC__ || defined __clang__) && (defined __x86_64__ || defined __i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return SIMD_AVX2;
+        };
+        if (__builtin_cpu_supports("sse4.1"))
+        {
+            return SIMD_SSE41;
+        };
+#elif defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLevel = info[0];
+        if (maxLevel >= 1)
+        {
+            __cpuid(info, 1);
+            const bool sse41 = (info[2] & (1 << 19)) != 0;
+            const bool fma = (info[2] & (1 << 12)) != 0;
+            // the os needs to save the ymm registers
+            const bool osAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                (_xgetbv(0) & 0x6) == 0x6;
+            if (maxLevel >= 7 && fma && osAVX)
+            {
+                __cpuidex(info, 7, 0);
+                if ((info[1] & (1 << 5)) != 0)
+                {
+                    return SIMD_AVX2;
+                };
+            };
+            if (sse41)
+            {
+                return SIMD_SSE41;
+            };
+        };
+#endif
+        return SIMD_SCALAR;
+    };
+
+    InstructionSet& CurrentInstructionSet()
+    {
+        static InstructionSet instructionSet = GetSupportedInstructionSet();
+        return instructionSet;
+    };
+} // namespace detail
+
+InstructionSet GetSupportedInstructionSet()
+{
+    static const InstructionSet supported = detail::DetectInstructionSet();
+    return supported;
+}
+
+InstructionSet GetInstructionSet()
+{
+    return detail::CurrentInstructionSet();
+}
+
+void SetInstructionSet(InstructionSet instructionSet)
+{
+    detail::CurrentInstructionSet() = std::min(instructionSet, GetSupportedInstructionSet());
+}
+
+BatchInterpolator::BatchInterpolator(const void* data, int width, int height, std::ptrdiff_t stride, int channels,
+                                     ComponentType type, KernelType kernel)
+    : m_data(data), m_stride(0), m_channels(channels), m_kernelSize(kernel == KERNEL_CUBIC || kernel == KERNEL_SPLINE16 ? 4 : 2),
+      m_function(NULL)
+{
+    // the kernels use 32 bit offsets
+    if (data == NULL || width <= 0 || height <= 0 || stride < static_cast<std::ptrdiff_t>(width) * channels ||
+        stride * height > std::numeric_limits<int>::max())
+    {
+        return;
+    };
+    m_stride = static_cast<int>(stride);
+    switch (GetInstructionSet())
+    {
+        case SIMD_AVX2:
+            m_function = detail::GetBatchFunctionAVX2(type, channels, kernel);
+            if (m_function != NULL)
+            {
+                break;
+            };
+            // fall through
+        case SIMD_SSE41:
+            m_function = detail::GetBatchFunctionSSE41(type, channels, kernel);
+            if (m_function != NULL)
+            {
+                break;
+            };
+            // fall through
+        case SIMD_SCALAR:
+            m_function = detail::GetBatchFunctionScalar(type, channels, kernel);
+            break;
+    };
+}
+
+} // namespace simd
+} // namespace vigra_ext
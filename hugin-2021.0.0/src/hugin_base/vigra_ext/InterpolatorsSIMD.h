@@ -0,0 +1,124 @@
+// -*- c-basic-offset: 4 -*-
+/** @file InterpolatorsSIMD.h
+ *
+ *  Vectorized interpolation of many points for the remapping
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VIGRA_EXT_INTERPOLATORSSIMD_H
+#define VIGRA_EXT_INTERPOLATORSSIMD_H
+
+#include <hugin_shared.h>
+#include <cstddef>
+
+namespace vigra_ext {
+namespace simd {
+
+/** instruction sets for which interpolation kernels are available */
+enum InstructionSet
+{
+    SIMD_SCALAR = 0,
+    SIMD_SSE41,
+    SIMD_AVX2
+};
+
+/** returns the best instruction set supported by the cpu */
+IMPEX InstructionSet GetSupportedInstructionSet();
+/** returns the instruction set used for the interpolation */
+IMPEX InstructionSet GetInstructionSet();
+/** limit the used instruction set, e.g. to compare the results with the scalar code,
+ *  the instruction set is never set higher than supported by the cpu */
+IMPEX void SetInstructionSet(InstructionSet instructionSet);
+
+/** type of the channels in the source image */
+enum ComponentType
+{
+    COMPONENT_UINT8 = 0,
+    COMPONENT_UINT16,
+    COMPONENT_FLOAT
+};
+
+/** supported interpolation kernels, these match interp_nearest, interp_bilin,
+ *  interp_cubic and interp_spline16 */
+enum KernelType
+{
+    KERNEL_NEAREST = 0,
+    KERNEL_BILINEAR,
+    KERNEL_CUBIC,
+    KERNEL_SPLINE16
+};
+
+/** number of points which should be collected before calling BatchInterpolator */
+static const int BatchSize = 16;
+
+/** interpolates an interleaved image at many points at once.
+ *
+ *  The points are processed in groups of 8 (AVX2) or 4 (SSE4.1) with float
+ *  precision. The instruction set is selected at runtime, on other cpus
+ *  the scalar code is used.
+ *
+ *  There is no boundary handling: all points must be inside the image
+ *  so that the whole interpolation kernel is inside, this is the same
+ *  condition as ImageInterpolator::isInside() checks.
+ */
+class IMPEX BatchInterpolator
+{
+public:
+    typedef void (*BatchFunction)(const BatchInterpolator& interp, const float* x, const float* y, int n, float* result);
+
+    /** create interpolator for image
+     *  @param data pointer to first channel of upper left pixel
+     *  @param width, height size of image
+     *  @param stride distance between rows, in channels (not bytes)
+     *  @param channels number of interleaved channels, 1 or 3
+     *  @param type type of a single channel
+     *  @param kernel interpolation kernel
+     */
+    BatchInterpolator(const void* data, int width, int height, std::ptrdiff_t stride, int channels,
+                      ComponentType type, KernelType kernel);
+
+    /** returns true, if there is a kernel for the given image and interpolator */
+    bool isValid() const { return m_function != NULL; };
+    /** returns size of the neighbourhood used by the kernel */
+    int getKernelSize() const { return m_kernelSize; };
+
+    /** interpolate at n points
+     *  @param x, y coordinates of the points
+     *  @param n number of points
+     *  @param result interpolated values, n * channels interleaved values
+     */
+    void operator()(const float* x, const float* y, int n, float* result) const
+    {
+        m_function(*this, x, y, n, result);
+    };
+
+    const void* getData() const { return m_data; };
+    int getStride() const { return m_stride; };
+    int getChannels() const { return m_channels; };
+
+private:
+    const void* m_data;
+    int m_stride;
+    int m_channels;
+    int m_kernelSize;
+    BatchFunction m_function;
+};
+
+} // namespace simd
+} // namespace vigra_ext
+
+#endif // VIGRA_EXT_INTERPOLATORSSIMD_H
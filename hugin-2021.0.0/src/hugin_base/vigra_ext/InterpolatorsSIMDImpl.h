@@ -0,0 +1,288 @@
+// -*- c-basic-offset: 4 -*-
+/** @file InterpolatorsSIMDImpl.h
+ *
+ *  Generic implementation of the batch interpolation kernels, included by
+ *  the source files for the different instruction sets. Don't include it
+ *  anywhere else.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VIGRA_EXT_INTERPOLATORSSIMDIMPL_H
+#define VIGRA_EXT_INTERPOLATORSSIMDIMPL_H
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "InterpolatorsSIMD.h"
+
+namespace vigra_ext {
+namespace simd {
+namespace detail {
+
+// functions of the different instruction sets, they return NULL if the
+// instruction set was not available at compile time
+BatchInterpolator::BatchFunction GetBatchFunctionScalar(ComponentType type, int channels, KernelType kernel);
+BatchInterpolator::BatchFunction GetBatchFunctionSSE41(ComponentType type, int channels, KernelType kernel);
+BatchInterpolator::BatchFunction GetBatchFunctionAVX2(ComponentType type, int channels, KernelType kernel);
+
+// everything below is compiled with different compiler flags in each source
+// file, so keep it local to the translation unit
+namespace
+{
+
+/** nearest neighbour, only used for its size, the kernel is special cased */
+template <class V>
+struct KernelNearest
+{
+    static const int size = 2;
+};
+
+/** bilinear weights, see interp_bilin */
+template <class V>
+struct KernelBilinear
+{
+    typedef typename V::Float F;
+    static const int size = 2;
+
+    static void calcCoeff(F x, F* w)
+    {
+        w[1] = x;
+        w[0] = V::sub(V::set1(1.0f), x);
+    };
+};
+
+/** cubic weights, see interp_cubic (A=-0.75) */
+template <class V>
+struct KernelCubic
+{
+    typedef typename V::Float F;
+    static const int size = 4;
+
+    // 0 <= x < 1
+    static F cubic01(F x)
+    {
+        // (( A + 2.0 )*x - ( A + 3.0 ))*x*x +1.0
+        const F t = V::madd(V::set1(1.25f), x, V::set1(-2.25f));
+        return V::madd(V::mul(t, x), x, V::set1(1.0f));
+    };
+    // 1 <= x < 2
+    static F cubic12(F x)
+    {
+        // (( A * x - 5.0 * A ) * x + 8.0 * A ) * x - 4.0 * A
+        F t = V::madd(V::set1(-0.75f), x, V::set1(3.75f));
+        t = V::madd(t, x, V::set1(-6.0f));
+        return V::madd(t, x, V::set1(3.0f));
+    };
+    static void calcCoeff(F x, F* w)
+    {
+        const F one = V::set1(1.0f);
+        w[3] = cubic12(V::sub(V::set1(2.0f), x));
+        w[2] = cubic01(V::sub(one, x));
+        w[1] = cubic01(x);
+        w[0] = cubic12(V::add(x, one));
+    };
+};
+
+/** spline16 weights, see interp_spline16 */
+template <class V>
+struct KernelSpline16
+{
+    typedef typename V::Float F;
+    static const int size = 4;
+
+    static F poly(F x, float a, float b, float c, float d)
+    {
+        return V::madd(V::madd(V::madd(V::set1(a), x, V::set1(b)), x, V::set1(c)), x, V::set1(d));
+    };
+    static void calcCoeff(F x, F* w)
+    {
+        w[3] = poly(x, 1.0f / 3.0f, -1.0f / 5.0f, -2.0f / 15.0f, 0.0f);
+        w[2] = poly(x, -1.0f, 6.0f / 5.0f, 4.0f / 5.0f, 0.0f);
+        w[1] = poly(x, 1.0f, -9.0f / 5.0f, -1.0f / 5.0f, 1.0f);
+        w[0] = poly(x, -1.0f / 3.0f, 4.0f / 5.0f, -7.0f / 15.0f, 0.0f);
+    };
+};
+
+/** copies up to V::width coordinates, unused lanes repeat the first point,
+ *  so that all lanes access valid memory */
+template <class V>
+inline void loadCoordinates(const float* x, const float* y, int m, float* xs, float* ys)
+{
+    for (int j = 0; j < V::width; ++j)
+    {
+        const int k = (j < m) ? j : 0;
+        xs[j] = x[k];
+        ys[j] = y[k];
+    };
+};
+
+/** stores the channel vectors interleaved into result */
+template <class V, int CHANNELS>
+inline void storeResult(const typename V::Float* sum, int m, float* result)
+{
+    float values[CHANNELS][V::width];
+    for (int c = 0; c < CHANNELS; ++c)
+    {
+        V::store(values[c], sum[c]);
+    };
+    for (int j = 0; j < m; ++j)
+    {
+        for (int c = 0; c < CHANNELS; ++c)
+        {
+            result[j * CHANNELS + c] = values[c][j];
+        };
+    };
+};
+
+/** separable interpolation with kernel KERNEL at n points */
+template <class V, class T, int CHANNELS, template <class> class KERNEL>
+void interpolateBatch(const BatchInterpolator& interp, const float* x, const float* y, int n, float* result)
+{
+    typedef typename V::Float F;
+    typedef typename V::Int I;
+    typedef KERNEL<V> Kernel;
+    const int size = Kernel::size;
+    const T* data = static_cast<const T*>(interp.getData());
+    const int stride = interp.getStride();
+    for (int i = 0; i < n; i += V::width)
+    {
+        const int m = std::min<int>(V::width, n - i);
+        float xs[V::width];
+        float ys[V::width];
+        loadCoordinates<V>(x + i, y + i, m, xs, ys);
+        const F vx = V::load(xs);
+        const F vy = V::load(ys);
+        const F tx = V::floor(vx);
+        const F ty = V::floor(vy);
+        F wx[size];
+        F wy[size];
+        Kernel::calcCoeff(V::sub(vx, tx), wx);
+        Kernel::calcCoeff(V::sub(vy, ty), wy);
+        // offset of upper left pixel of the neighbourhood
+        const I offset = V::iadd(V::imul(V::iadd(V::toInt(ty), V::iset1(1 - size / 2)), stride),
+                                 V::imul(V::iadd(V::toInt(tx), V::iset1(1 - size / 2)), CHANNELS));
+        F sum[CHANNELS];
+        for (int c = 0; c < CHANNELS; ++c)
+        {
+            sum[c] = V::set1(0.0f);
+        };
+        // first pass of separable filter in x, then in y
+        for (int ky = 0; ky < size; ++ky)
+        {
+            const I rowOffset = V::iadd(offset, V::iset1(ky * stride));
+            F rowSum[CHANNELS];
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                rowSum[c] = V::set1(0.0f);
+            };
+            for (int kx = 0; kx < size; ++kx)
+            {
+                const I index = V::iadd(rowOffset, V::iset1(kx * CHANNELS));
+                for (int c = 0; c < CHANNELS; ++c)
+                {
+                    rowSum[c] = V::madd(wx[kx], V::gather(data + c, index), rowSum[c]);
+                };
+            };
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                sum[c] = V::madd(wy[ky], rowSum[c], sum[c]);
+            };
+        };
+        storeResult<V, CHANNELS>(sum, m, result + i * CHANNELS);
+    };
+};
+
+/** nearest neighbour, fetch only a single pixel */
+template <class V, class T, int CHANNELS>
+void interpolateBatchNearest(const BatchInterpolator& interp, const float* x, const float* y, int n, float* result)
+{
+    typedef typename V::Float F;
+    typedef typename V::Int I;
+    const T* data = static_cast<const T*>(interp.getData());
+    const int stride = interp.getStride();
+    const F half = V::set1(0.5f);
+    for (int i = 0; i < n; i += V::width)
+    {
+        const int m = std::min<int>(V::width, n - i);
+        float xs[V::width];
+        float ys[V::width];
+        loadCoordinates<V>(x + i, y + i, m, xs, ys);
+        // same as interp_nearest: use right/lower pixel for fraction >= 0.5
+        const I ix = V::toInt(V::floor(V::add(V::load(xs), half)));
+        const I iy = V::toInt(V::floor(V::add(V::load(ys), half)));
+        const I index = V::iadd(V::imul(iy, stride), V::imul(ix, CHANNELS));
+        F sum[CHANNELS];
+        for (int c = 0; c < CHANNELS; ++c)
+        {
+            sum[c] = V::gather(data + c, index);
+        };
+        storeResult<V, CHANNELS>(sum, m, result + i * CHANNELS);
+    };
+};
+
+template <class V, class T, int CHANNELS>
+BatchInterpolator::BatchFunction selectKernel(KernelType kernel)
+{
+    switch (kernel)
+    {
+        case KERNEL_NEAREST:
+            return &interpolateBatchNearest<V, T, CHANNELS>;
+        case KERNEL_BILINEAR:
+            return &interpolateBatch<V, T, CHANNELS, KernelBilinear>;
+        case KERNEL_CUBIC:
+            return &interpolateBatch<V, T, CHANNELS, KernelCubic>;
+        case KERNEL_SPLINE16:
+            return &interpolateBatch<V, T, CHANNELS, KernelSpline16>;
+    };
+    return NULL;
+};
+
+template <class V, class T>
+BatchInterpolator::BatchFunction selectChannels(int channels, KernelType kernel)
+{
+    switch (channels)
+    {
+        case 1:
+            return selectKernel<V, T, 1>(kernel);
+        case 3:
+            return selectKernel<V, T, 3>(kernel);
+    };
+    return NULL;
+};
+
+/** return the kernel for the vector type V */
+template <class V>
+BatchInterpolator::BatchFunction selectBatchFunction(ComponentType type, int channels, KernelType kernel)
+{
+    switch (type)
+    {
+        case COMPONENT_UINT8:
+            return selectChannels<V, uint8_t>(channels, kernel);
+        case COMPONENT_UINT16:
+            return selectChannels<V, uint16_t>(channels, kernel);
+        case COMPONENT_FLOAT:
+            return selectChannels<V, float>(channels, kernel);
+    };
+    return NULL;
+};
+
+} // anonymous namespace
+} // namespace detail
+} // namespace simd
+} // namespace vigra_ext
+
+#endif // VIGRA_EXT_INTERPOLATORSSIMDIMPL_H
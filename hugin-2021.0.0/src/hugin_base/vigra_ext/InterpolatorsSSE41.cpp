@@ -0,0 +1,79 @@
+// -*- c-basic-offset: 4 -*-
+/** @file InterpolatorsSSE41.cpp
+ *
+ *  Batch interpolation kernels using SSE4.1, this file is compiled with
+ *  SSE4.1 enabled and only called if the cpu supports it.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "InterpolatorsSIMDImpl.h"
+
+#if defined __SSE4_1__ || (defined _MSC_VER && (defined _M_X64 || defined _M_IX86))
+#define HUGIN_HAVE_SSE41 1
+#include <smmintrin.h>
+#endif
+
+namespace vigra_ext {
+namespace simd {
+namespace detail {
+
+#ifdef HUGIN_HAVE_SSE41
+namespace
+{
+    /** 4 floats, there is no gather instruction, so load the elements one by one */
+    struct VecSSE41
+    {
+        typedef __m128 Float;
+        typedef __m128i Int;
+        static const int width = 4;
+
+        static Float load(const float* p) { return _mm_loadu_ps(p); };
+        static void store(float* p, Float v) { _mm_storeu_ps(p, v); };
+        static Float set1(float v) { return _mm_set1_ps(v); };
+        static Float add(Float a, Float b) { return _mm_add_ps(a, b); };
+        static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); };
+        static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); };
+        static Float madd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); };
+        static Float floor(Float a) { return _mm_floor_ps(a); };
+        static Int toInt(Float a) { return _mm_cvttps_epi32(a); };
+        static Int iset1(int v) { return _mm_set1_epi32(v); };
+        static Int iadd(Int a, Int b) { return _mm_add_epi32(a, b); };
+        static Int imul(Int a, int b) { return _mm_mullo_epi32(a, _mm_set1_epi32(b)); };
+        template <class T>
+        static Float gather(const T* p, Int index)
+        {
+            return _mm_setr_ps(static_cast<float>(p[_mm_cvtsi128_si32(index)]),
+                               static_cast<float>(p[_mm_extract_epi32(index, 1)]),
+                               static_cast<float>(p[_mm_extract_epi32(index, 2)]),
+                               static_cast<float>(p[_mm_extract_epi32(index, 3)]));
+        };
+    };
+}
+#endif
+
+BatchInterpolator::BatchFunction GetBatchFunctionSSE41(ComponentType type, int channels, KernelType kernel)
+{
+#ifdef HUGIN_HAVE_SSE41
+    return selectBatchFunction<VecSSE41>(type, channels, kernel);
+#else
+    return NULL;
+#endif
+}
+
+} // namespace detail
+} // namespace simd
+} // namespace vigra_ext
@@ -0,0 +1,354 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ReducedImport.cpp
+ *
+ *  Import of images at a reduced resolution, without decoding the full image
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ReducedImport.h"
+
+#include <cstdio>
+#include <csetjmp>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <jpeglib.h>
+}
+#include <tiffio.h>
+
+namespace vigra_ext {
+
+namespace
+{
+
+/** averages blocks of factor x factor pixels of the rows passed to addRow()
+ *  and writes the result into the reduced image and mask */
+class BlockReducer
+{
+public:
+    BlockReducer(const int width, const int height, const int factor, const bool hasAlpha,
+        vigra::BRGBImage& image, vigra::BImage& mask)
+        : m_width(width), m_height(height), m_factor(factor), m_hasAlpha(hasAlpha),
+          m_image(image), m_mask(mask)
+    {
+        const int reducedWidth = (width + factor - 1) / factor;
+        const int reducedHeight = (height + factor - 1) / factor;
+        m_image.resize(reducedWidth, reducedHeight);
+        if (m_hasAlpha)
+        {
+            m_mask.resize(reducedWidth, reducedHeight);
+        };
+        m_sums.resize(4 * reducedWidth, 0);
+    };
+
+    /** adds row @p y, @p row contains @p bands interleaved values per pixel,
+     *  if the image has an alpha channel it is the last band */
+    void addRow(const int y, const vigra::UInt8* row, const int bands)
+    {
+        const int colorBands = m_hasAlpha ? bands - 1 : bands;
+        for (int x = 0; x < m_width; ++x, row += bands)
+        {
+            // only pixels inside the mask contribute to the average
+            if (m_hasAlpha && row[bands - 1] < 128)
+            {
+                continue;
+            };
+            unsigned int* sum = &m_sums[4 * (x / m_factor)];
+            if (colorBands >= 3)
+            {
+                sum[0] += row[0];
+                sum[1] += row[1];
+                sum[2] += row[2];
+            }
+            else
+            {
+                sum[0] += row[0];
+                sum[1] += row[0];
+                sum[2] += row[0];
+            };
+            ++sum[3];
+        };
+        if ((y + 1) % m_factor == 0 || y == m_height - 1)
+        {
+            flushRow(y / m_factor, std::min(m_factor, y % m_factor + 1));
+        };
+    };
+
+private:
+    void flushRow(const int reducedY, const int blockHeight)
+    {
+        vigra::BRGBImage::traverser imgIt = m_image.upperLeft() + vigra::Diff2D(0, reducedY);
+        for (int x = 0; x < m_image.width(); ++x, ++imgIt.x)
+        {
+            unsigned int* sum = &m_sums[4 * x];
+            const unsigned int count = sum[3];
+            if (count > 0)
+            {
+                *imgIt = vigra::RGBValue<vigra::UInt8>((sum[0] + count / 2) / count,
+                    (sum[1] + count / 2) / count, (sum[2] + count / 2) / count);
+            }
+            else
+            {
+                *imgIt = vigra::RGBValue<vigra::UInt8>(0, 0, 0);
+            };
+            if (m_hasAlpha)
+            {
+                // a reduced pixel is inside the mask, if at least half of the block is valid
+                const int blockWidth = std::min(m_factor, m_width - x * m_factor);
+                m_mask(x, reducedY) = (2 * count >= static_cast<unsigned int>(blockWidth * blockHeight)) ? 255 : 0;
+            };
+        };
+        std::fill(m_sums.begin(), m_sums.end(), 0);
+    };
+
+    const int m_width;
+    const int m_height;
+    const int m_factor;
+    const bool m_hasAlpha;
+    vigra::BRGBImage& m_image;
+    vigra::BImage& m_mask;
+    std::vector<unsigned int> m_sums;
+};
+
+/** error manager for libjpeg, which returns to the caller instead of exiting */
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf setjmpBuffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    longjmp(err->setjmpBuffer, 1);
+};
+
+void JpegOutputMessage(j_common_ptr)
+{
+    // warnings are reported by the full size import, don't print them twice
+};
+
+/** decode a JPEG file with the DCT scaling of libjpeg,
+ *  only the coefficients needed for the reduced size are evaluated */
+bool importReducedJPEG(const char* filename, const int factor, vigra::BRGBImage& image)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return false;
+    };
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JpegErrorExit;
+    jerr.pub.output_message = JpegOutputMessage;
+    // no objects with destructors between setjmp and longjmp,
+    // the row buffer is allocated from the memory pool of libjpeg
+    if (setjmp(jerr.setjmpBuffer))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        return false;
+    };
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+        // libjpeg can't convert CMYK to RGB, leave this to the full import
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        return false;
+    };
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = factor;
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    image.resize(cinfo.output_width, cinfo.output_height);
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE,
+        cinfo.output_width * cinfo.output_components, 1);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        const int y = cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, buffer, 1);
+        const JSAMPLE* src = buffer[0];
+        vigra::BRGBImage::traverser imgIt = image.upperLeft() + vigra::Diff2D(0, y);
+        for (unsigned int x = 0; x < cinfo.output_width; ++x, ++imgIt.x, src += 3)
+        {
+            *imgIt = vigra::RGBValue<vigra::UInt8>(src[0], src[1], src[2]);
+        };
+    };
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+    return true;
+};
+
+/** reads the current directory of @p tiff and reduces it by @p factor */
+bool readReducedTIFFDirectory(TIFF* tiff, const int factor, vigra::BRGBImage& image, vigra::BImage& mask)
+{
+    uint32 width = 0;
+    uint32 height = 0;
+    uint16 bitsPerSample = 0;
+    uint16 samplesPerPixel = 0;
+    uint16 planarConfig = 0;
+    uint16 photometric = 0;
+    if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) || !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height) ||
+        !TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric))
+    {
+        return false;
+    };
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+    if (bitsPerSample != 8 || planarConfig != PLANARCONFIG_CONTIG)
+    {
+        return false;
+    };
+    bool hasAlpha;
+    if (photometric == PHOTOMETRIC_RGB && (samplesPerPixel == 3 || samplesPerPixel == 4))
+    {
+        hasAlpha = samplesPerPixel == 4;
+    }
+    else
+    {
+        if (photometric == PHOTOMETRIC_MINISBLACK && (samplesPerPixel == 1 || samplesPerPixel == 2))
+        {
+            hasAlpha = samplesPerPixel == 2;
+        }
+        else
+        {
+            return false;
+        };
+    };
+    BlockReducer reducer(width, height, factor, hasAlpha, image, mask);
+    if (TIFFIsTiled(tiff))
+    {
+        // read one row of tiles after the other, only this row is kept in memory
+        uint32 tileWidth = 0;
+        uint32 tileLength = 0;
+        if (!TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth) || !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileLength))
+        {
+            return false;
+        };
+        std::vector<vigra::UInt8> tileBuffer(TIFFTileSize(tiff));
+        std::vector<vigra::UInt8> rowBuffer(static_cast<size_t>(width) * samplesPerPixel * tileLength);
+        for (uint32 ty = 0; ty < height; ty += tileLength)
+        {
+            const uint32 rows = std::min(tileLength, height - ty);
+            for (uint32 tx = 0; tx < width; tx += tileWidth)
+            {
+                if (TIFFReadTile(tiff, &tileBuffer[0], tx, ty, 0, 0) < 0)
+                {
+                    return false;
+                };
+                const uint32 cols = std::min(tileWidth, width - tx);
+                for (uint32 r = 0; r < rows; ++r)
+                {
+                    memcpy(&rowBuffer[(static_cast<size_t>(r) * width + tx) * samplesPerPixel],
+                        &tileBuffer[static_cast<size_t>(r) * tileWidth * samplesPerPixel], cols * samplesPerPixel);
+                };
+            };
+            for (uint32 r = 0; r < rows; ++r)
+            {
+                reducer.addRow(ty + r, &rowBuffer[static_cast<size_t>(r) * width * samplesPerPixel], samplesPerPixel);
+            };
+        };
+    }
+    else
+    {
+        std::vector<vigra::UInt8> scanline(TIFFScanlineSize(tiff));
+        for (uint32 y = 0; y < height; ++y)
+        {
+            if (TIFFReadScanline(tiff, &scanline[0], y, 0) < 0)
+            {
+                return false;
+            };
+            reducer.addRow(y, &scanline[0], samplesPerPixel);
+        };
+    };
+    return true;
+};
+
+/** import a TIFF file reduced by @p factor, prefers a matching overview */
+bool importReducedTIFF(const char* filename, const int factor, vigra::BRGBImage& image, vigra::BImage& mask)
+{
+    TIFF* tiff = TIFFOpen(filename, "r");
+    if (tiff == NULL)
+    {
+        return false;
+    };
+    uint32 width = 0;
+    uint32 height = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+    const uint32 reducedWidth = (width + factor - 1) / factor;
+    const uint32 reducedHeight = (height + factor - 1) / factor;
+    bool success = false;
+    bool foundOverview = false;
+    // the overviews follow the full resolution image as reduced resolution directories
+    for (tdir_t dir = 1; !foundOverview && TIFFSetDirectory(tiff, dir); ++dir)
+    {
+        uint32 subfileType = 0;
+        uint32 dirWidth = 0;
+        uint32 dirHeight = 0;
+        if (TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &subfileType) && (subfileType & FILETYPE_REDUCEDIMAGE) &&
+            TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &dirWidth) && TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &dirHeight) &&
+            dirWidth == reducedWidth && dirHeight == reducedHeight)
+        {
+            foundOverview = true;
+            success = readReducedTIFFDirectory(tiff, 1, image, mask);
+        };
+    };
+    if (!success && TIFFSetDirectory(tiff, 0))
+    {
+        success = readReducedTIFFDirectory(tiff, factor, image, mask);
+    };
+    TIFFClose(tiff);
+    return success;
+};
+
+} // anonymous namespace
+
+bool importReducedImage(const vigra::ImageImportInfo& info, const int factor,
+    vigra::BRGBImage& image, vigra::BImage& mask)
+{
+    if ((factor != 2 && factor != 4 && factor != 8) || strcmp(info.getPixelType(), "UINT8") != 0 ||
+        info.getImageIndex() != 0)
+    {
+        return false;
+    };
+    const std::string fileType(info.getFileType());
+    if (fileType == "JPEG")
+    {
+        if (info.numExtraBands() > 0)
+        {
+            return false;
+        };
+        return importReducedJPEG(info.getFileName(), factor, image);
+    };
+    if (fileType == "TIFF")
+    {
+        return importReducedTIFF(info.getFileName(), factor, image, mask);
+    };
+    return false;
+};
+
+} // namespace vigra_ext
@@ -0,0 +1,60 @@
+// -*- c-basic-offset: 4 -*-
+/** @file ReducedImport.h
+ *
+ *  Import of images at a reduced resolution, without decoding the full image
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VIGRA_EXT_REDUCEDIMPORT_H
+#define VIGRA_EXT_REDUCEDIMPORT_H
+
+#include <hugin_shared.h>
+#include <vigra/stdimage.hxx>
+#include <vigra/imageinfo.hxx>
+
+namespace vigra_ext {
+
+/** import an 8 bit image reduced by @p factor (2, 4 or 8) in each direction.
+ *
+ *  The reduced image has the size ceil(width/factor) x ceil(height/factor),
+ *  each pixel is the average of the corresponding factor x factor block.
+ *  JPEG files are decoded with the DCT scaling of libjpeg, so only a fraction
+ *  of the decoding work is done. For TIFF files a reduced resolution
+ *  directory (overview) of the right size is used if the file contains one,
+ *  otherwise the strips or tiles are reduced while they are read, so the full
+ *  size image is never held in memory.
+ *  Gray scale images are returned as RGB image. @p mask is only resized and
+ *  filled if the image has an alpha channel.
+ *
+ *  @return false, if the reduced import is not supported for this file
+ *          (other file formats, pixel types other than UINT8, CMYK, ...), the
+ *          caller should then import the full size image
+ */
+IMPEX bool importReducedImage(const vigra::ImageImportInfo& info, const int factor,
+    vigra::BRGBImage& image, vigra::BImage& mask);
+
+/** convert coordinate @p x of an image imported with importReducedImage()
+ *  and @p factor into the coordinate of the full size image, a reduced pixel
+ *  is the center of its factor x factor block */
+inline double ReducedToFullCoordinate(const double x, const int factor)
+{
+    return factor * x + 0.5 * (factor - 1);
+}
+
+} // namespace vigra_ext
+
+#endif // VIGRA_EXT_REDUCEDIMPORT_H
@@ -27,6 +27,8 @@
  
 #include <vigra/seededregiongrowing.hxx>
 #include <vigra/convolution.hxx>
+#include <vigra/labelimage.hxx>
+#include <vigra/inspectimage.hxx>
 #include "vigra_ext/BlendPoisson.h"
 #ifdef HAVE_OPENMP
 #include <omp.h>
@@ -106,6 +108,160 @@ namespace vigra_ext
             };
         };
 
+        /** run the seeded region growing for the seeds 1 and 2 in @p labels,
+         *  unlabeled pixels have the value 0.
+         *
+         *  Each connected region of unlabeled pixels depends only on the seeds at its
+         *  border, so the regions are processed independently and in parallel */
+        inline void SeededRegionGrowingParallel(const vigra::BImage& cost, vigra::BImage& labels)
+        {
+            // find the connected regions of unlabeled pixels
+            vigra::BImage unlabeled(labels.size());
+            vigra::omp::transformImage(vigra::srcImageRange(labels), vigra::destImage(unlabeled),
+                vigra::functor::ifThenElse(vigra::functor::Arg1() == vigra::functor::Param(0), vigra::functor::Param(1), vigra::functor::Param(0)));
+            vigra::IImage regions(labels.size());
+            const int nrRegions = vigra::labelImageWithBackground(vigra::srcImageRange(unlabeled), vigra::destImage(regions), false, 0);
+            unlabeled.resize(0, 0);
+            if (nrRegions == 0)
+            {
+                return;
+            };
+            if (nrRegions == 1)
+            {
+                vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
+                vigra::fastSeededRegionGrowing(vigra::srcImageRange(cost), vigra::destImage(labels), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+                return;
+            };
+            vigra::ArrayOfRegionStatistics<vigra::FindBoundingRectangle> rects(nrRegions);
+            vigra::inspectTwoImages(vigra::srcIterRange<vigra::Diff2D>(vigra::Diff2D(0, 0), regions.size()), vigra::srcImage(regions), rects);
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 1; i <= nrRegions; ++i)
+            {
+                // include the seeds around the region
+                vigra::Rect2D rect(vigra::Point2D(rects.regions[i].upperLeft), vigra::Point2D(rects.regions[i].lowerRight));
+                rect.addBorder(1);
+                rect &= vigra::Rect2D(labels.size());
+                // pixels of the other regions are never neighbours of this region,
+                // they are only marked with a third label
+                vigra::BImage localLabels(rect.size());
+                for (int y = rect.top(); y < rect.bottom(); ++y)
+                {
+                    for (int x = rect.left(); x < rect.right(); ++x)
+                    {
+                        const int region = regions(x, y);
+                        if (region == 0)
+                        {
+                            localLabels(x - rect.left(), y - rect.top()) = labels(x, y);
+                        }
+                        else
+                        {
+                            localLabels(x - rect.left(), y - rect.top()) = (region == i) ? 0 : 3;
+                        };
+                    };
+                };
+                vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
+                vigra::fastSeededRegionGrowing(vigra::srcImageRange(cost, rect), vigra::destImage(localLabels), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+                // copy back only the pixels of this region
+                for (int y = rect.top(); y < rect.bottom(); ++y)
+                {
+                    for (int x = rect.left(); x < rect.right(); ++x)
+                    {
+                        if (regions(x, y) == i)
+                        {
+                            labels(x, y) = localLabels(x - rect.left(), y - rect.top());
+                        };
+                    };
+                };
+            };
+        };
+
+        /** find the seam between the seeds 1 and 2 in @p labels with the watershed
+         *  algorithm, unlabeled pixels have the value 0.
+         *
+         *  Large areas are first processed at reduced resolution (at most about
+         *  1 megapixel), afterwards only a band of the width of 3 reduced pixels
+         *  around the seam is processed again at full resolution. */
+        inline void SeamWatershed(const vigra::BImage& cost, vigra::BImage& labels)
+        {
+            const int maxCoarseArea = 1 << 20;
+            int factor = 1;
+            while ((cost.width() / factor) * (cost.height() / factor) > maxCoarseArea)
+            {
+                factor *= 2;
+            };
+            if (factor == 1)
+            {
+                SeededRegionGrowingParallel(cost, labels);
+                return;
+            };
+            // reduce the cost image by averaging and the labels, a reduced pixel
+            // is only a seed if all its pixels are seeds of the same image
+            const vigra::Size2D coarseSize((cost.width() + factor - 1) / factor, (cost.height() + factor - 1) / factor);
+            vigra::BImage coarseCost(coarseSize);
+            vigra::BImage coarseLabels(coarseSize);
+#pragma omp parallel for
+            for (int cy = 0; cy < coarseSize.height(); ++cy)
+            {
+                for (int cx = 0; cx < coarseSize.width(); ++cx)
+                {
+                    const int x0 = cx * factor;
+                    const int y0 = cy * factor;
+                    const int x1 = std::min(x0 + factor, cost.width());
+                    const int y1 = std::min(y0 + factor, cost.height());
+                    unsigned int sum = 0;
+                    const vigra::UInt8 label = labels(x0, y0);
+                    bool uniform = true;
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        for (int x = x0; x < x1; ++x)
+                        {
+                            sum += cost(x, y);
+                            uniform = uniform && (labels(x, y) == label);
+                        };
+                    };
+                    const unsigned int count = (x1 - x0) * (y1 - y0);
+                    coarseCost(cx, cy) = static_cast<vigra::UInt8>((sum + count / 2) / count);
+                    coarseLabels(cx, cy) = uniform ? label : 0;
+                };
+            };
+            SeededRegionGrowingParallel(coarseCost, coarseLabels);
+            coarseCost.resize(0, 0);
+            // mark the reduced pixels near the seam
+            vigra::BImage coarseBand(coarseSize);
+#pragma omp parallel for
+            for (int cy = 0; cy < coarseSize.height(); ++cy)
+            {
+                for (int cx = 0; cx < coarseSize.width(); ++cx)
+                {
+                    const vigra::UInt8 label = coarseLabels(cx, cy);
+                    bool nearSeam = (label == 0);
+                    for (int dy = std::max(cy - 1, 0); !nearSeam && dy <= std::min(cy + 1, coarseSize.height() - 1); ++dy)
+                    {
+                        for (int dx = std::max(cx - 1, 0); !nearSeam && dx <= std::min(cx + 1, coarseSize.width() - 1); ++dx)
+                        {
+                            nearSeam = (coarseLabels(dx, dy) != label);
+                        };
+                    };
+                    coarseBand(cx, cy) = nearSeam ? 1 : 0;
+                };
+            };
+            // use the result of the reduced image outside the band, the seeds
+            // of the full resolution image are kept
+#pragma omp parallel for
+            for (int y = 0; y < labels.height(); ++y)
+            {
+                for (int x = 0; x < labels.width(); ++x)
+                {
+                    if (labels(x, y) == 0 && coarseBand(x / factor, y / factor) == 0)
+                    {
+                        labels(x, y) = coarseLabels(x / factor, y / factor);
+                    };
+                };
+            };
+            // and grow the band at full resolution
+            SeededRegionGrowingParallel(cost, labels);
+        };
+
         template <class ImageType>
         ImageType ResizeImage(const ImageType& image, const vigra::Size2D& newSize)
         {
@@ -115,8 +271,12 @@ namespace vigra_ext
         };
     }; // namespace detail
     
+    /** merge image2 into image1, the seam is found with the watershed algorithm,
+     *  if hardSeam is false the seam is blended by solving the Poisson equation,
+     *  the convergence of the solver is then reported in poissonReport (if not NULL) */
     template <class ImageType, class MaskType>
-    void MergeImages(ImageType& image1, MaskType& mask1, const ImageType& image2, const MaskType& mask2, const vigra::Diff2D offset, const bool wrap, const bool hardSeam)
+    void MergeImages(ImageType& image1, MaskType& mask1, const ImageType& image2, const MaskType& mask2, const vigra::Diff2D offset, const bool wrap, const bool hardSeam,
+        vigra_ext::poisson::MultigridReport* poissonReport = NULL)
     {
         const vigra::Point2D offsetPoint(offset);
         const vigra::Rect2D offsetRect(offsetPoint, mask2.size());
@@ -199,8 +359,7 @@ namespace vigra_ext
         vigra::BImage diffByte(diff.size());
         vigra::omp::transformImage(vigra::srcImageRange(diff), vigra::destImage(diffByte), vigra::functor::Param(255) - vigra::functor::Param(255.0f / diffMinMax.max)*vigra::functor::Arg1());
         diff.resize(0, 0);
-        // run watershed algorithm
-        vigra::ArrayOfRegionStatistics<vigra::SeedRgDirectValueFunctor<vigra::UInt8> > stats(3);
+        // run watershed algorithm, only in the overlapping area
         if (doWrap)
         {
             // handle wrapping
@@ -218,7 +377,10 @@ namespace vigra_ext
             {
                 vigra::gaussianSmoothing(vigra::srcImageRange(diffWrapped), vigra::destImage(diffWrapped), smoothRadius);
             };
-            vigra::fastSeededRegionGrowing(vigra::srcImageRange(diffWrapped), vigra::destImage(labelsWrapped, p1), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+            vigra::BImage overlapLabels(diffWrapped.size());
+            vigra::omp::copyImage(vigra::srcImageRange(labelsWrapped, vigra::Rect2D(p1, diffWrapped.size())), vigra::destImage(overlapLabels));
+            detail::SeamWatershed(diffWrapped, overlapLabels);
+            vigra::omp::copyImage(vigra::srcImageRange(overlapLabels), vigra::destImage(labelsWrapped, p1));
             vigra::omp::copyImage(labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth / 2, 0), labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth, oldHeight), labelsWrapped.accessor(),
                 labels.upperLeft() + vigra::Diff2D(oldWidth / 2, 0), labels.accessor());
             vigra::omp::copyImage(labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth, 0), labelsWrapped.upperLeft() + vigra::Diff2D(oldWidth + oldWidth / 2, oldHeight), labelsWrapped.accessor(),
@@ -232,7 +394,10 @@ namespace vigra_ext
             {
                 vigra::gaussianSmoothing(vigra::srcImageRange(diffByte), vigra::destImage(diffByte), smoothRadius);
             };
-            vigra::fastSeededRegionGrowing(vigra::srcImageRange(diffByte), vigra::destImage(labels, p1), stats, vigra::CompleteGrow, vigra::FourNeighborCode(), 255);
+            vigra::BImage overlapLabels(diffByte.size());
+            vigra::omp::copyImage(vigra::srcImageRange(labels, vigra::Rect2D(p1, diffByte.size())), vigra::destImage(overlapLabels));
+            detail::SeamWatershed(diffByte, overlapLabels);
+            vigra::omp::copyImage(vigra::srcImageRange(overlapLabels), vigra::destImage(labels, p1));
         };
         // now we can merge the images
         // merging the mask is straightforward
@@ -266,7 +431,11 @@ namespace vigra_ext
             // we start with the values of the image2 as begin
             vigra::omp::copyImageIf(vigra::srcImageRange(image2), vigra::srcImage(seams[0], vigra_ext::poisson::MaskGreaterAccessor<vigra::Int8>(2)), vigra::destImage(target));
             // solve poisson equation
-            vigra_ext::poisson::Multigrid(target, gradient, seams, minLength, 0.01f, 500, doWrap);
+            const vigra_ext::poisson::MultigridReport report = vigra_ext::poisson::SolveMultigrid(target, gradient, seams, minLength, 1e-5, 30, doWrap);
+            if (poissonReport != NULL)
+            {
+                *poissonReport = report;
+            };
             // copy result back into output
             vigra::omp::copyImageIf(vigra::srcImageRange(target), vigra::srcImage(seams[0], vigra_ext::poisson::MaskGreaterAccessor<vigra::Int8>(2)), vigra::destImage(image1, offsetPoint));
         };
@@ -32,9 +32,16 @@
 #include <vigra/functorexpression.hxx>
 
 #include <vigra_ext/FunctorAccessor.h>
+#include <vigra_ext/utils.h>
 #include <hugin_utils/utils.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
 #include <tiffio.h>
+#include <zlib.h>
 
 // add this to the vigra_ext namespace
 namespace vigra_ext {
@@ -553,6 +560,466 @@ createAlphaTiffImage(vigra::triple<ImageIterator, ImageIterator, ImageAccessor>
 
 
 
+//***************************************************************************
+//
+//  tiled tiff output, the image is written tile row by tile row, so the
+//  caller needs to keep only a band of tile height in memory
+//
+//***************************************************************************
+
+/** sample format of the tiff file and scale for the 8 bit alpha channel,
+ *  same values as used by createAlphaTiffImage */
+template <class T>
+struct TiffTileTraits;
+
+#define TIFF_TILE_TRAITS(T, format, scale) \
+template<> \
+struct TiffTileTraits<T> \
+{ \
+    static int sampleFormat() { return format; }; \
+    static double alphaScale() { return scale; }; \
+};
+
+TIFF_TILE_TRAITS(vigra::UInt8, SAMPLEFORMAT_UINT, 1.0)
+TIFF_TILE_TRAITS(vigra::Int16, SAMPLEFORMAT_INT, 128.0)
+TIFF_TILE_TRAITS(vigra::UInt16, SAMPLEFORMAT_UINT, 256.0)
+TIFF_TILE_TRAITS(vigra::Int32, SAMPLEFORMAT_INT, 8388608.0)
+TIFF_TILE_TRAITS(vigra::UInt32, SAMPLEFORMAT_UINT, 16777216.0)
+TIFF_TILE_TRAITS(float, SAMPLEFORMAT_IEEEFP, 1.0 / 255)
+TIFF_TILE_TRAITS(double, SAMPLEFORMAT_IEEEFP, 1.0 / 255)
+
+#undef TIFF_TILE_TRAITS
+
+/** return the component @p c of a pixel */
+template <class T>
+inline T getTiffTileComponent(const T& v, int c)
+{
+    return v;
+}
+
+template <class T>
+inline T getTiffTileComponent(const vigra::RGBValue<T>& v, int c)
+{
+    return v[c];
+}
+
+/** writes an image with alpha channel into a tiled tiff file.
+ *
+ *  The image is written in rows of tiles from top to bottom, each call of
+ *  writeTileRow() writes a band with the height of a tile. The alpha channel
+ *  is stored with the same type as the color channels (see createAlphaTiffImage).
+ *  Only gray and RGB images are supported.
+ *
+ *  With DEFLATE compression the tiles of each band are compressed in parallel
+ *  and written with TIFFWriteRawTile, all other compressions are done by libtiff.
+ *
+ *  Optionally reduced resolution overviews are written into additional
+ *  directories (as used by GDAL and cloud optimized GeoTIFF readers), each
+ *  level has half the size of the previous one, until the image fits into a
+ *  single tile. The overviews are calculated from the bands while writing,
+ *  the encoded tiles are spooled into a temporary file for each level
+ *  (compressed when using DEFLATE) and copied into the tiff file when it is
+ *  closed. Only when no temporary file can be created they are kept in memory.
+ */
+template <class PixelType>
+class TiledTiffWriter
+{
+public:
+    typedef typename ValueTypeTraits<PixelType>::value_type component_type;
+
+    TiledTiffWriter() : m_tiff(NULL), m_tileSize(0), m_channels(sizeof(PixelType) / sizeof(component_type)),
+        m_compression(COMPRESSION_NONE), m_rowsWritten(0)
+    {};
+
+    ~TiledTiffWriter()
+    {
+        close();
+    };
+
+    /** create the tiff file
+     *  @param filename name of the output file
+     *  @param size size of the image
+     *  @param tileSize width and height of the tiles, needs to be a multiple of 16
+     *  @param compression compression as used by createTiffDirectory
+     *  @param bigTIFF true, if a BigTIFF file should be written, a BigTIFF file is
+     *         also written if the uncompressed data exceeds the 4 GB limit of tiff
+     *  @param offset position of the image in the full canvas
+     *  @param canvasSize size of the full canvas
+     *  @param icc icc profile
+     *  @param overviews true, if reduced resolution overviews should be added
+     *  @return true, if the file could be created
+     */
+    bool open(const std::string& filename, const vigra::Size2D& size, int tileSize, const std::string& compression,
+              bool bigTIFF, const vigra::Diff2D& offset, const vigra::Size2D& canvasSize,
+              const vigra::ImageExportInfo::ICCProfile& icc, bool overviews = false)
+    {
+        close();
+        m_size = size;
+        m_tileSize = tileSize;
+        m_rowsWritten = 0;
+        const int samples = m_channels + 1;
+        double bytes = static_cast<double>(size.area());
+        if (overviews)
+        {
+            vigra::Size2D levelSize(size);
+            while (levelSize.x > tileSize || levelSize.y > tileSize)
+            {
+                levelSize = vigra::Size2D((levelSize.x + 1) / 2, (levelSize.y + 1) / 2);
+                m_overviews.push_back(OverviewLevel(levelSize, tileSize, samples));
+                m_overviews.back().spool = std::tmpfile();
+                bytes += levelSize.area();
+            };
+        };
+        // the final size of compressed files is not known in advance, so decide
+        // on the uncompressed size (with some margin for the directories)
+        bytes *= samples * sizeof(component_type);
+        m_tiff = TIFFOpen(filename.c_str(), (bigTIFF || bytes > 4.0e9) ? "w8" : "w");
+        if (m_tiff == NULL)
+        {
+            closeSpoolFiles();
+            return false;
+        };
+        createTiffDirectory(m_tiff, filename, filename, compression, 1, 1, offset, canvasSize, icc);
+        TIFFGetField(m_tiff, TIFFTAG_COMPRESSION, &m_compression);
+        setTileFields(size);
+        return true;
+    };
+
+    /** return true, if the file is open */
+    bool isOpen() const { return m_tiff != NULL; };
+
+    /** write the row of tiles starting at image row @p y (which needs to be a
+     *  multiple of the tile size). The iterators point to the first pixel of
+     *  the row, rows below the image are ignored.
+     *  @return false, if writing failed */
+    template <class ImageIterator, class ImageAccessor,
+              class AlphaIterator, class AlphaAccessor>
+    bool writeTileRow(int y, ImageIterator upperleft, ImageAccessor a,
+                      AlphaIterator alphaUpperleft, AlphaAccessor alphaA)
+    {
+        if (m_tiff == NULL)
+        {
+            return false;
+        };
+        const int samples = m_channels + 1;
+        const int width = m_size.x;
+        const int h = std::min(m_tileSize, m_size.y - y);
+        const double alphaScale = TiffTileTraits<component_type>::alphaScale();
+        // interleave the colors and the alpha channel of the whole band
+        m_band.resize(static_cast<size_t>(width) * m_tileSize * samples);
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int ty = 0; ty < h; ++ty)
+        {
+            component_type* p = &m_band[static_cast<size_t>(ty) * width * samples];
+            ImageIterator xs(upperleft + vigra::Diff2D(0, ty));
+            AlphaIterator xa(alphaUpperleft + vigra::Diff2D(0, ty));
+            for (int x = 0; x < width; ++x, ++xs.x, ++xa.x)
+            {
+                const PixelType v = a(xs);
+                for (int c = 0; c < m_channels; ++c)
+                {
+                    *p++ = getTiffTileComponent(v, c);
+                };
+                *p++ = vigra::NumericTraits<component_type>::fromRealPromote(alphaA(xa) * alphaScale);
+            };
+        };
+        TileVector tiles;
+        if (!encodeBand(m_band, width, h, tiles))
+        {
+            return false;
+        };
+        const ttile_t firstTile = TIFFComputeTile(m_tiff, 0, y, 0, 0);
+        for (size_t i = 0; i < tiles.size(); ++i)
+        {
+            if (!writeTile(firstTile + i, tiles[i]))
+            {
+                return false;
+            };
+        };
+        m_rowsWritten = y + h;
+        return addToOverview(0, m_band, width, h, m_rowsWritten >= m_size.y);
+    };
+
+    /** write the overviews and close the file
+     *  @return false, if the overviews could not be written */
+    bool close()
+    {
+        bool success = true;
+        if (m_tiff != NULL)
+        {
+            if (!m_overviews.empty() && m_rowsWritten >= m_size.y)
+            {
+                success = writeOverviews();
+            };
+            TIFFClose(m_tiff);
+            m_tiff = NULL;
+        };
+        closeSpoolFiles();
+        return success;
+    };
+
+private:
+    // not copyable
+    TiledTiffWriter(const TiledTiffWriter&);
+    TiledTiffWriter& operator=(const TiledTiffWriter&);
+
+    /** encoded data of the tiles */
+    typedef std::vector<std::vector<unsigned char> > TileVector;
+
+    /** a single overview level */
+    struct OverviewLevel
+    {
+        OverviewLevel(const vigra::Size2D& levelSize, int tileSize, int samples) :
+            size(levelSize), band(static_cast<size_t>(levelSize.x) * tileSize * samples), bandRows(0), spool(NULL)
+        {};
+        vigra::Size2D size;
+        /** current band, which is filled from the finer level */
+        std::vector<component_type> band;
+        int bandRows;
+        /** temporary file with the encoded tiles of this level, written and
+         *  read sequentially, owned by TiledTiffWriter */
+        FILE* spool;
+        /** size of each encoded tile in the spool file */
+        std::vector<size_t> tileSizes;
+        /** encoded tiles of this level, only used when the spool file could not be created */
+        TileVector tiles;
+    };
+
+    /** close and remove the spool files of all overview levels */
+    void closeSpoolFiles()
+    {
+        for (size_t level = 0; level < m_overviews.size(); ++level)
+        {
+            if (m_overviews[level].spool != NULL)
+            {
+                fclose(m_overviews[level].spool);
+            };
+        };
+        m_overviews.clear();
+    };
+
+    /** set the tags for the image structure of the current directory */
+    void setTileFields(const vigra::Size2D& size)
+    {
+        TIFFSetField(m_tiff, TIFFTAG_IMAGEWIDTH, size.x);
+        TIFFSetField(m_tiff, TIFFTAG_IMAGELENGTH, size.y);
+        TIFFSetField(m_tiff, TIFFTAG_TILEWIDTH, m_tileSize);
+        TIFFSetField(m_tiff, TIFFTAG_TILELENGTH, m_tileSize);
+        TIFFSetField(m_tiff, TIFFTAG_BITSPERSAMPLE, sizeof(component_type) * 8);
+        TIFFSetField(m_tiff, TIFFTAG_SAMPLESPERPIXEL, m_channels + 1);
+        TIFFSetField(m_tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(m_tiff, TIFFTAG_SAMPLEFORMAT, TiffTileTraits<component_type>::sampleFormat());
+        TIFFSetField(m_tiff, TIFFTAG_PHOTOMETRIC, m_channels == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+        // for alpha stuff, do not uses premultilied data
+        uint16 nextra_samples = 1;
+        uint16 extra_samples = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(m_tiff, TIFFTAG_EXTRASAMPLES, nextra_samples, &extra_samples);
+    };
+
+    /** split the interleaved band into tiles, tiles at the border are padded with
+     *  transparent pixels. With DEFLATE compression the tiles are compressed,
+     *  otherwise the tiles contain the raw data. */
+    bool encodeBand(const std::vector<component_type>& band, int width, int height, TileVector& tiles) const
+    {
+        const int samples = m_channels + 1;
+        const int nrTiles = (width + m_tileSize - 1) / m_tileSize;
+        const size_t tileBytes = static_cast<size_t>(m_tileSize) * m_tileSize * samples * sizeof(component_type);
+        const bool deflate = (m_compression == COMPRESSION_DEFLATE || m_compression == COMPRESSION_ADOBE_DEFLATE);
+        tiles.resize(nrTiles);
+        bool success = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < nrTiles; ++i)
+        {
+            const int x0 = i * m_tileSize;
+            const int w = std::min(m_tileSize, width - x0);
+            std::vector<component_type> tile(static_cast<size_t>(m_tileSize) * m_tileSize * samples, component_type());
+            for (int ty = 0; ty < height; ++ty)
+            {
+                const component_type* src = &band[(static_cast<size_t>(ty) * width + x0) * samples];
+                std::copy(src, src + w * samples, &tile[static_cast<size_t>(ty) * m_tileSize * samples]);
+            };
+            const Bytef* data = reinterpret_cast<const Bytef*>(&tile[0]);
+            if (deflate)
+            {
+                uLongf compressedBytes = compressBound(tileBytes);
+                tiles[i].resize(compressedBytes);
+                if (compress2(&tiles[i][0], &compressedBytes, data, tileBytes, Z_DEFAULT_COMPRESSION) == Z_OK)
+                {
+                    tiles[i].resize(compressedBytes);
+                }
+                else
+                {
+                    success = false;
+                };
+            }
+            else
+            {
+                tiles[i].assign(data, data + tileBytes);
+            };
+        };
+        return success;
+    };
+
+    /** write tile @p tile of the current directory */
+    bool writeTile(ttile_t tile, std::vector<unsigned char>& data)
+    {
+        if (m_compression == COMPRESSION_DEFLATE || m_compression == COMPRESSION_ADOBE_DEFLATE)
+        {
+            return TIFFWriteRawTile(m_tiff, tile, &data[0], data.size()) >= 0;
+        };
+        return TIFFWriteEncodedTile(m_tiff, tile, &data[0], data.size()) >= 0;
+    };
+
+    /** downsample the band of the finer level by 2 and add the rows to the overview
+     *  level, each full band of the level is encoded and passed on to the next level
+     *  @param last true, if this is the last band of the finer level */
+    bool addToOverview(size_t level, const std::vector<component_type>& src, int srcWidth, int srcHeight, bool last)
+    {
+        if (level >= m_overviews.size())
+        {
+            return true;
+        };
+        OverviewLevel& overview = m_overviews[level];
+        const int samples = m_channels + 1;
+        const int width = overview.size.x;
+        for (int sy = 0; sy < srcHeight; sy += 2)
+        {
+            const component_type* row1 = &src[static_cast<size_t>(sy) * srcWidth * samples];
+            const component_type* row2 = (sy + 1 < srcHeight) ? row1 + static_cast<size_t>(srcWidth) * samples : row1;
+            component_type* dest = &overview.band[static_cast<size_t>(overview.bandRows) * width * samples];
+            for (int x = 0; x < width; ++x, dest += samples)
+            {
+                const int x2 = std::min(2 * x + 1, srcWidth - 1);
+                const component_type* pixels[4] = { row1 + 2 * x * samples, row1 + x2 * samples,
+                                                    row2 + 2 * x * samples, row2 + x2 * samples };
+                // average all pixels with an alpha value
+                double sum[3] = { 0, 0, 0 };
+                int count = 0;
+                component_type alpha = component_type();
+                for (int j = 0; j < 4; ++j)
+                {
+                    if (pixels[j][m_channels] > 0)
+                    {
+                        for (int c = 0; c < m_channels; ++c)
+                        {
+                            sum[c] += pixels[j][c];
+                        };
+                        alpha = std::max(alpha, pixels[j][m_channels]);
+                        ++count;
+                    };
+                };
+                for (int c = 0; c < m_channels; ++c)
+                {
+                    dest[c] = count > 0 ? vigra::NumericTraits<component_type>::fromRealPromote(sum[c] / count) : component_type();
+                };
+                dest[m_channels] = alpha;
+            };
+            ++overview.bandRows;
+            if (overview.bandRows == m_tileSize && !flushOverview(level, false))
+            {
+                return false;
+            };
+        };
+        if (last)
+        {
+            return flushOverview(level, true);
+        };
+        return true;
+    };
+
+    /** encode the current band of the overview level and pass it on to the next level */
+    bool flushOverview(size_t level, bool last)
+    {
+        OverviewLevel& overview = m_overviews[level];
+        const int rows = overview.bandRows;
+        if (rows > 0)
+        {
+            TileVector tiles;
+            if (!encodeBand(overview.band, overview.size.x, rows, tiles))
+            {
+                return false;
+            };
+            for (size_t i = 0; i < tiles.size(); ++i)
+            {
+                if (overview.spool != NULL)
+                {
+                    if (fwrite(&tiles[i][0], 1, tiles[i].size(), overview.spool) != tiles[i].size())
+                    {
+                        return false;
+                    };
+                    overview.tileSizes.push_back(tiles[i].size());
+                }
+                else
+                {
+                    overview.tiles.push_back(std::vector<unsigned char>());
+                    overview.tiles.back().swap(tiles[i]);
+                };
+            };
+            overview.bandRows = 0;
+        };
+        if (rows > 0 || last)
+        {
+            return addToOverview(level + 1, overview.band, overview.size.x, rows, last);
+        };
+        return true;
+    };
+
+    /** write all overview levels as reduced resolution images into new directories */
+    bool writeOverviews()
+    {
+        for (size_t level = 0; level < m_overviews.size(); ++level)
+        {
+            if (!TIFFWriteDirectory(m_tiff))
+            {
+                return false;
+            };
+            TIFFSetField(m_tiff, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+            TIFFSetField(m_tiff, TIFFTAG_COMPRESSION, m_compression);
+            setTileFields(m_overviews[level].size);
+            OverviewLevel& overview = m_overviews[level];
+            if (overview.spool != NULL)
+            {
+                // the tiles were spooled in order, so read them back sequentially
+                rewind(overview.spool);
+                std::vector<unsigned char> tile;
+                for (size_t i = 0; i < overview.tileSizes.size(); ++i)
+                {
+                    tile.resize(overview.tileSizes[i]);
+                    if (fread(&tile[0], 1, tile.size(), overview.spool) != tile.size() || !writeTile(i, tile))
+                    {
+                        return false;
+                    };
+                };
+                fclose(overview.spool);
+                overview.spool = NULL;
+            }
+            else
+            {
+                TileVector& tiles = overview.tiles;
+                for (size_t i = 0; i < tiles.size(); ++i)
+                {
+                    if (!writeTile(i, tiles[i]))
+                    {
+                        return false;
+                    };
+                    std::vector<unsigned char>().swap(tiles[i]);
+                };
+            };
+        };
+        return true;
+    };
+
+    vigra::TiffImage* m_tiff;
+    vigra::Size2D m_size;
+    int m_tileSize;
+    const int m_channels;
+    uint16 m_compression;
+    int m_rowsWritten;
+    std::vector<component_type> m_band;
+    std::vector<OverviewLevel> m_overviews;
+};
+
+
 //***************************************************************************
 //
 //  functions to read tiff files with a single alpha channel,
@@ -405,6 +405,9 @@ public:
         lfeat::KeyPointVect_t	_kp;
         int					_descLength;
         bool          	   _loadFail;
+        /** true, if the downscaled image was decoded directly at half size,
+         *  the pixels are then the centers of 2x2 blocks */
+        bool _reducedDecode;
 
         // kdtree
         flann::Matrix<double> _flann_descriptors;
@@ -413,6 +416,7 @@ public:
         ImgData()
         {
             _loadFail = false;
+            _reducedDecode = false;
             _number = 0;
             _detectWidth = 0;
             _detectHeight = 0;
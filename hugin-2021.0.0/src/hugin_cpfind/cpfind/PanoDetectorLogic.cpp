@@ -27,6 +27,7 @@
 #include <vigra/distancetransform.hxx>
 #include "vigra_ext/impexalpha.hxx"
 #include "vigra_ext/cms.h"
+#include "vigra_ext/ReducedImport.h"
 
 #include <localfeatures/Sieve.h>
 #include <localfeatures/PointMatch.h>
@@ -210,6 +211,41 @@ void RemapImage(const HuginBase::SrcPanoImage& srcImage, const HuginBase::Panora
     image = NULL;
 }
 
+/** decode an 8 bit image directly at half size for the downscaled detection,
+ *  this is only possible when no masks and crops have to be applied at full size
+ *  @return true, if image and mask contain the image in the detection size */
+bool ReducedDecodeImage(const HuginBase::SrcPanoImage& srcImage, const vigra::ImageImportInfo& info,
+    int detectWidth, int detectHeight, vigra::BRGBImage*& image, vigra::BImage*& mask)
+{
+    if (srcImage.hasActiveMasks() || (srcImage.getCropMode() != HuginBase::SrcPanoImage::NO_CROP && !srcImage.getCropRect().isEmpty()))
+    {
+        return false;
+    };
+    vigra::BRGBImage reducedImage;
+    vigra::BImage reducedMask;
+    if (!vigra_ext::importReducedImage(info, 2, reducedImage, reducedMask))
+    {
+        return false;
+    };
+    // the reduced image is rounded up, the detection size down
+    if (reducedImage.width() < detectWidth || reducedImage.width() > detectWidth + 1 ||
+        reducedImage.height() < detectHeight || reducedImage.height() > detectHeight + 1)
+    {
+        return false;
+    };
+    const vigra::Diff2D detectSize(detectWidth, detectHeight);
+    image = new vigra::BRGBImage(detectSize);
+    vigra::copyImage(reducedImage.upperLeft(), reducedImage.upperLeft() + detectSize, reducedImage.accessor(),
+        image->upperLeft(), image->accessor());
+    if (reducedMask.width() > 0)
+    {
+        mask = new vigra::BImage(detectSize);
+        vigra::copyImage(reducedMask.upperLeft(), reducedMask.upperLeft() + detectSize, reducedMask.accessor(),
+            mask->upperLeft(), mask->accessor());
+    };
+    return true;
+}
+
 /** downscale image if requested, optimized code for non-downscale version to prevent unnecessary copying 
  *  the image data */
 template <class ImageType>
@@ -394,17 +430,30 @@ bool PanoDetector::AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDet
                     case vigra::ImageImportInfo::UINT8:
                         // special variant for unsigned 8 bit images
                         {
-                            vigra::BRGBImage* rgbImage=new vigra::BRGBImage(aImageInfo.size());
+                            vigra::BRGBImage* rgbImage = NULL;
                             vigra::BImage* mask = NULL;
-                            // load image
-                            if (aImageInfo.numExtraBands() == 1)
+                            bool downscale = ioImgInfo.IsDownscale();
+                            if (downscale && ReducedDecodeImage(iPanoDetector._panoramaInfoCopy.getImage(ioImgInfo._number),
+                                aImageInfo, ioImgInfo._detectWidth, ioImgInfo._detectHeight, rgbImage, mask))
                             {
-                                mask=new vigra::BImage(aImageInfo.size());
-                                vigra::importImageAlpha(aImageInfo, vigra::destImage(*rgbImage), vigra::destImage(*mask));
+                                // the image has already the final size
+                                TRACE_IMG("Decoded image at half size...");
+                                ioImgInfo._reducedDecode = true;
+                                downscale = false;
                             }
                             else
                             {
-                                vigra::importImage(aImageInfo, vigra::destImage(*rgbImage));
+                                // load image
+                                rgbImage = new vigra::BRGBImage(aImageInfo.size());
+                                if (aImageInfo.numExtraBands() == 1)
+                                {
+                                    mask=new vigra::BImage(aImageInfo.size());
+                                    vigra::importImageAlpha(aImageInfo, vigra::destImage(*rgbImage), vigra::destImage(*mask));
+                                }
+                                else
+                                {
+                                    vigra::importImage(aImageInfo, vigra::destImage(*rgbImage));
+                                };
                             };
                             // apply icc profile
                             if (!aImageInfo.getICCProfile().empty())
@@ -424,12 +473,12 @@ bool PanoDetector::AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDet
                             }
                             else
                             {
-                                if (ioImgInfo.IsDownscale())
+                                if (downscale)
                                 {
                                     TRACE_IMG("Downscale image...");
                                 };
                                 HandleDownscaleImage(iPanoDetector._panoramaInfoCopy.getImage(ioImgInfo._number), rgbImage, mask,
-                                    ioImgInfo._detectWidth, ioImgInfo._detectHeight, ioImgInfo.IsDownscale(),
+                                    ioImgInfo._detectWidth, ioImgInfo._detectHeight, downscale,
                                     scaled, final_mask);
                             };
                             if (iPanoDetector.getCeleste())
@@ -811,8 +860,16 @@ bool PanoDetector::RemapBackKeypoints(ImgData& ioImgInfo, const PanoDetector& iP
         for (size_t i = 0; i < ioImgInfo._kp.size(); ++i)
         {
             lfeat::KeyPointPtr& aK = ioImgInfo._kp[i];
-            aK->_x *= 2.0;
-            aK->_y *= 2.0;
+            if (ioImgInfo._reducedDecode)
+            {
+                aK->_x = vigra_ext::ReducedToFullCoordinate(aK->_x, 2);
+                aK->_y = vigra_ext::ReducedToFullCoordinate(aK->_y, 2);
+            }
+            else
+            {
+                aK->_x *= 2.0;
+                aK->_y *= 2.0;
+            };
             aK->_scale *= 2.0;
         };
     }
@@ -30,6 +30,7 @@
 #include <algorithm>
 #include <cctype>
 #include <string>
+#include <thread>
 
 #include <vigra/error.hxx>
 
@@ -108,6 +109,32 @@ static void usage(const char* name)
          << "                   lower and upper cutoff (specify in range 0...1," << std::endl
          << "                   relative the full range)" << std::endl
          << "      --seam=hard|blend   select the blend mode for the seam" << std::endl
+         << "      --remap-plan-dir=DIR  store the remapping coordinates in DIR" << std::endl
+         << "                   and reuse them in the next run, when the" << std::endl
+         << "                   geometry has not changed" << std::endl
+         << "      --transform-grid[=size:tolerance]  calculate the transformation" << std::endl
+         << "                   only on a sparse grid and interpolate in between" << std::endl
+         << "                   optionally the initial grid size in pixels (default 16)" << std::endl
+         << "                   and the tolerance in pixels (default 0.05) can be given" << std::endl
+         << "      --exact-transform  always use the libpano transformation, also" << std::endl
+         << "                   for projections which have a faster fused version" << std::endl
+         << "      --tiled-output[=tilesize]  write TIFF output as tiled TIFF, the" << std::endl
+         << "                   panorama is processed in bands and is never kept" << std::endl
+         << "                   completely in memory (default tile size 512)" << std::endl
+         << "      --overviews  add reduced resolution overviews to the tiled" << std::endl
+         << "                   output (only with --tiled-output)" << std::endl
+         << "      --parallel-images[=n]  load and remap up to n images at the same" << std::endl
+         << "                   time (default: number of cores), each image is" << std::endl
+         << "                   remapped by a single thread" << std::endl
+         << "      --photometric-lut=on|off|verify  use lookup tables for the" << std::endl
+         << "                   photometric correction of 8 and 16 bit images" << std::endl
+         << "                   (default off), verify compares them with the" << std::endl
+         << "                   exact calculation and falls back to it, if they" << std::endl
+         << "                   deviate more than half a step of 16 bit output" << std::endl
+         << "      --write-queue[=threads:memory]  write the images of the multiple" << std::endl
+         << "                   images output in background threads, while the" << std::endl
+         << "                   next images are remapped (default 2 threads and" << std::endl
+         << "                   at most 1024 MB of queued images)" << std::endl
          << std::endl;
 }
 
@@ -143,7 +170,15 @@ int main(int argc, char* argv[])
         MASKCLIPEXPOSURE,
         SEAMMODE,
         USE_BIGTIFF,
-        RANGECOMPRESSION
+        RANGECOMPRESSION,
+        REMAPPLANDIR,
+        TRANSFORMGRID,
+        EXACTTRANSFORM,
+        TILEDOUTPUT,
+        OVERVIEWS,
+        PARALLELIMAGES,
+        PHOTOMETRICLUT,
+        WRITEQUEUE
     };
     static struct option longOptions[] =
     {
@@ -157,6 +192,14 @@ int main(int argc, char* argv[])
         { "gpu", no_argument, NULL, 'g'},
         { "bigtiff", no_argument, NULL, USE_BIGTIFF },
         { "output-range-compression", required_argument, NULL, RANGECOMPRESSION },
+        { "remap-plan-dir", required_argument, NULL, REMAPPLANDIR },
+        { "transform-grid", optional_argument, NULL, TRANSFORMGRID },
+        { "exact-transform", no_argument, NULL, EXACTTRANSFORM },
+        { "tiled-output", optional_argument, NULL, TILEDOUTPUT },
+        { "overviews", no_argument, NULL, OVERVIEWS },
+        { "parallel-images", optional_argument, NULL, PARALLELIMAGES },
+        { "photometric-lut", required_argument, NULL, PHOTOMETRICLUT },
+        { "write-queue", optional_argument, NULL, WRITEQUEUE },
         { "help", no_argument, NULL, 'h'},
         { "debug", no_argument, NULL, 'd'},
         { "output", required_argument, NULL, 'o'},
@@ -306,6 +349,109 @@ int main(int argc, char* argv[])
             case USE_BIGTIFF:
                 HuginBase::Nona::SetAdvancedOption(advOptions, "useBigTIFF", true);
                 break;
+            case REMAPPLANDIR:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "remapPlanDir", std::string(optarg));
+                break;
+            case EXACTTRANSFORM:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "useFusedTransform", false);
+                break;
+            case TRANSFORMGRID:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "useTransformGrid", true);
+                if (optarg != NULL && *optarg != 0)
+                {
+                    std::vector<std::string> tokens = hugin_utils::SplitString(std::string(optarg), ":");
+                    double gridSize;
+                    double tolerance;
+                    if (tokens.size() == 2 && hugin_utils::stringToDouble(tokens[0], gridSize) && hugin_utils::stringToDouble(tokens[1], tolerance)
+                        && gridSize >= 4 && tolerance > 0)
+                    {
+                        HuginBase::Nona::SetAdvancedOption(advOptions, "transformGridSize", static_cast<float>(gridSize));
+                        HuginBase::Nona::SetAdvancedOption(advOptions, "transformGridTolerance", static_cast<float>(tolerance));
+                    }
+                    else
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not valid for --transform-grid" << std::endl
+                            << "      Expected --transform-grid=size:tolerance" << std::endl
+                            << "      The size should be at least 4, the tolerance a positive number." << std::endl;
+                        return 1;
+                    };
+                };
+                break;
+            case TILEDOUTPUT:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "tiledOutput", true);
+                if (optarg != NULL && *optarg != 0)
+                {
+                    int tileSize;
+                    if (!hugin_utils::stringToInt(std::string(optarg), tileSize) || tileSize < 16 || tileSize % 16 != 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not valid for --tiled-output" << std::endl
+                            << "      The tile size should be a multiple of 16." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "tileSize", static_cast<float>(tileSize));
+                };
+                break;
+            case OVERVIEWS:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "tiledOverviews", true);
+                break;
+            case PARALLELIMAGES:
+                {
+                    int nrImages = std::max<int>(std::thread::hardware_concurrency(), 2);
+                    if (optarg != NULL && *optarg != 0)
+                    {
+                        if (!hugin_utils::stringToInt(std::string(optarg), nrImages) || nrImages < 1)
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not valid for --parallel-images" << std::endl
+                                << "      The number of images should be a positive number." << std::endl;
+                            return 1;
+                        };
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "parallelImages", static_cast<float>(nrImages));
+                };
+                break;
+            case PHOTOMETRICLUT:
+                {
+                    const std::string mode = hugin_utils::tolower(std::string(optarg));
+                    if (mode == "on" || mode == "verify")
+                    {
+                        HuginBase::Nona::SetAdvancedOption(advOptions, "usePhotometricLUT", true);
+                        HuginBase::Nona::SetAdvancedOption(advOptions, "verifyPhotometricLUT", mode == "verify");
+                    }
+                    else
+                    {
+                        if (mode == "off")
+                        {
+                            HuginBase::Nona::SetAdvancedOption(advOptions, "usePhotometricLUT", false);
+                        }
+                        else
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not valid for --photometric-lut" << std::endl
+                                << "      Valid values are on, off and verify." << std::endl;
+                            return 1;
+                        };
+                    };
+                };
+                break;
+            case WRITEQUEUE:
+                {
+                    double nrThreads = 2;
+                    double memory = 1024;
+                    if (optarg != NULL && *optarg != 0)
+                    {
+                        std::vector<std::string> tokens = hugin_utils::SplitString(std::string(optarg), ":");
+                        if (tokens.empty() || tokens.size() > 2 || !hugin_utils::stringToDouble(tokens[0], nrThreads) || nrThreads < 1
+                            || (tokens.size() == 2 && (!hugin_utils::stringToDouble(tokens[1], memory) || memory <= 0)))
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not valid for --write-queue" << std::endl
+                                << "      Expected --write-queue=threads:memory" << std::endl
+                                << "      The number of threads should be at least 1, the memory in MB a positive number." << std::endl;
+                            return 1;
+                        };
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "writeQueueThreads", static_cast<float>(nrThreads));
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "writeQueueMemory", static_cast<float>(memory));
+                };
+                break;
             case RANGECOMPRESSION:
                 if (!hugin_utils::stringToDouble(std::string(optarg), rangeCompression))
                 {
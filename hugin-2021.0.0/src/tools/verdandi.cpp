@@ -164,7 +164,13 @@ bool LoadAndMergeImages(std::vector<vigra::ImageImportInfo> imageInfos, const st
         std::cout << "Loaded " << imageInfos[i].getFileName() << std::endl;
         roi |= vigra::Rect2D(vigra::Point2D(imageInfos[i].getPosition()), imageInfos[i].size());
 
-        vigra_ext::MergeImages(image, mask, image2, mask2, imageInfos[i].getPosition(), wrap, hardSeam);
+        vigra_ext::poisson::MultigridReport report;
+        vigra_ext::MergeImages(image, mask, image2, mask2, imageInfos[i].getPosition(), wrap, hardSeam, &report);
+        if (report.cycles > 0)
+        {
+            std::cout << "Blended seam in " << report.cycles << " multigrid cycles, residual " << report.initialResidual
+                << " -> " << report.finalResidual << (report.converged ? "" : " (not converged)") << std::endl;
+        };
     };
     // save output
     {